@@ -50,6 +50,7 @@ check_include_file(malloc.h HAVE_MALLOC_H)
 check_include_file(malloc/malloc.h HAVE_MALLOC_MALLOC_H)
 check_include_file(memory.h HAVE_MEMORY_H)
 check_include_file(ndir.h HAVE_NDIR_H)
+check_include_file(poll.h HAVE_POLL_H)
 if( NOT LLVM_ON_WIN32 )
   check_include_file(pthread.h HAVE_PTHREAD_H)
 endif()
@@ -99,6 +100,7 @@ endif( LLVM_USING_GLIBC )
 
 check_symbol_exists(abort stdlib.h HAVE_ABORT)
 check_function_exists(getcwd HAVE_GETCWD)
+check_function_exists(fork HAVE_FORK)
 check_symbol_exists(alloca alloca.h HAVE_ALLOCA)
 check_symbol_exists(getpagesize unistd.h HAVE_GETPAGESIZE)
 check_symbol_exists(getrusage sys/resource.h HAVE_GETRUSAGE)
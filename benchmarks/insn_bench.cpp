@@ -0,0 +1,198 @@
+//
+// Instruction matching benchmark
+//
+//  Copyright (C) 2011  PathScale Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND OTHER CONTRIBUTORS ``AS IS''
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR OTHER CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Assembles a 64-bit instruction mix (general purpose, SSE, AVX, FPU) with
+// the GAS parser and times parsing, which is where instruction operands are
+// matched against the x86 instruction tables.  Each run parses its own copy
+// of the source, and the best of several runs is reported.
+//
+// Usage: insn_bench [repetitions]
+//
+#include <cstddef>
+#include <cstdlib>
+#include <string>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/System/Process.h"
+#include "llvm/System/TimeValue.h"
+#include "yasmx/Basic/Diagnostic.h"
+#include "yasmx/Basic/FileManager.h"
+#include "yasmx/Basic/SourceManager.h"
+#include "yasmx/Parse/Directive.h"
+#include "yasmx/Parse/HeaderSearch.h"
+#include "yasmx/Parse/Parser.h"
+#include "yasmx/System/plugin.h"
+#include "yasmx/Arch.h"
+#include "yasmx/Assembler.h"
+#include "yasmx/Object.h"
+
+
+namespace {
+class CountingDiagnosticClient : public yasm::DiagnosticClient
+{
+public:
+    CountingDiagnosticClient() : m_errors(0) {}
+    void HandleDiagnostic(yasm::Diagnostic::Level level,
+                          const yasm::DiagnosticInfo& info)
+    {
+        if (level >= yasm::Diagnostic::Error)
+            ++m_errors;
+    }
+    unsigned int m_errors;
+};
+} // anonymous namespace
+
+static const char* insn_mix[] =
+{
+    "movq 16(%rbx,%rcx,8), %rax",
+    "movl %edx, 8(%rsp)",
+    "addl $5, %eax",
+    "subq $0x28, %rsp",
+    "cmpl $7, (%rdi)",
+    "leaq (%rsi,%rax,4), %rdx",
+    "pushq %rbp",
+    "popq %r12",
+    "call l0",
+    "jz l0",
+    "xorl %ecx, %ecx",
+    "shll $3, %r9d",
+    "imulq $12, %r11, %r10",
+    "testb $0x80, 1(%rax)",
+    "movzbl (%rsi), %eax",
+    "cmovne %rdx, %rax",
+    "movaps (%rax), %xmm0",
+    "addps %xmm2, %xmm1",
+    "pxor %xmm4, %xmm3",
+    "movdqu %xmm5, 32(%rdi)",
+    "pshufd $27, %xmm7, %xmm6",
+    "cvtsi2sdq %rax, %xmm0",
+    "vaddps %ymm2, %ymm1, %ymm0",
+    "vmovups (%rsi), %ymm3",
+    "vpermilps $27, %xmm2, %xmm1",
+    "vfmadd231ps 64(%rdx), %ymm5, %ymm4",
+    "vpshufb %xmm8, %xmm7, %xmm6",
+    "vcvtsi2sdq %rax, %xmm1, %xmm0",
+    "vblendvps %ymm4, %ymm3, %ymm2, %ymm1",
+    "fldl (%rbx)",
+    "fmul %st(1), %st",
+    "fstps (%rcx)",
+};
+static const std::size_t insn_mix_size = sizeof(insn_mix)/sizeof(insn_mix[0]);
+
+static void
+GenerateSource(llvm::raw_ostream& os, unsigned int reps)
+{
+    os << ".code64\nl0:\n";
+    for (unsigned int i=0; i<reps; ++i)
+    {
+        for (std::size_t j=0; j<insn_mix_size; ++j)
+            os << insn_mix[j] << '\n';
+    }
+}
+
+// Return the seconds spent parsing source.
+static double
+TimeParse(llvm::StringRef source)
+{
+    CountingDiagnosticClient client;
+    yasm::Diagnostic diags(&client);
+    yasm::SourceManager smgr(diags);
+    diags.setSourceManager(&smgr);
+    yasm::FileManager fmgr;
+    yasm::HeaderSearch headers(fmgr);
+
+    yasm::Assembler assembler("x86", "elf64", diags);
+    if (!assembler.setParser("gas", diags))
+        return -1.0;
+
+    smgr.createMainFileIDForMemBuffer(
+        llvm::MemoryBuffer::getMemBufferCopy(source, "<bench>"));
+    if (!assembler.InitObject(smgr, diags))
+        return -1.0;
+    yasm::Object& object = *assembler.getObject();
+
+    yasm::Parser& parser = assembler.InitParser(smgr, diags, headers);
+    yasm::Directives dirs;
+    assembler.getArch()->AddDirectives(dirs, "gas");
+    parser.AddDirectives(dirs, "gas");
+
+    llvm::sys::TimeValue start(0.0), end(0.0), user(0.0), sys(0.0);
+    llvm::sys::Process::GetTimeUsage(start, user, sys);
+    parser.Parse(object, dirs, diags);
+    llvm::sys::Process::GetTimeUsage(end, user, sys);
+    if (client.m_errors != 0)
+        return -1.0;
+    llvm::sys::TimeValue elapsed = end - start;
+    return elapsed.seconds() + elapsed.nanoseconds() / 1e9;
+}
+
+int
+main(int argc, char* argv[])
+{
+    llvm::llvm_shutdown_obj llvm_manager(false);
+
+    unsigned int reps = 20000;
+    if (argc > 1)
+        reps = static_cast<unsigned int>(std::atoi(argv[1]));
+
+    if (!yasm::LoadStandardPlugins())
+    {
+        llvm::errs() << "insn_bench: could not load standard modules\n";
+        return EXIT_FAILURE;
+    }
+
+    llvm::SmallString<128> source;
+    {
+        llvm::raw_svector_ostream os(source);
+        GenerateSource(os, reps);
+    }
+
+    static const int num_runs = 5;
+    double best = 0.0;
+    for (int run=0; run<num_runs; ++run)
+    {
+        double t = TimeParse(source.str());
+        if (t < 0.0)
+        {
+            llvm::errs() << "insn_bench: assembly failed\n";
+            return EXIT_FAILURE;
+        }
+        if (run == 0 || t < best)
+            best = t;
+    }
+
+    double num_insns = static_cast<double>(reps) * insn_mix_size;
+    llvm::outs() << "instructions: " << llvm::format("%.0f", num_insns)
+                 << '\n';
+    llvm::outs() << llvm::format("parse time (s): %.4f\n", best);
+    llvm::outs() << llvm::format("instructions/s: %.0f\n",
+                                 best > 0.0 ? num_insns/best : 0.0);
+    return EXIT_SUCCESS;
+}
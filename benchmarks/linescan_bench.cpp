@@ -0,0 +1,199 @@
+//
+// Line number scanning benchmark
+//
+//  Copyright (C) 2011  PathScale Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND OTHER CONTRIBUTORS ``AS IS''
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR OTHER CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Builds a large in-memory source file and times the first line number
+// query on it, which is when SourceManager scans the whole buffer for line
+// breaks.  A plain byte-at-a-time scan of the same buffer is timed for
+// comparison.  The best of several runs is reported for each.
+//
+// Usage: linescan_bench [megabytes]
+//
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "llvm/Support/Format.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/System/Process.h"
+#include "llvm/System/TimeValue.h"
+#include "yasmx/Basic/Diagnostic.h"
+#include "yasmx/Basic/SourceManager.h"
+
+
+namespace {
+class NullDiagnosticClient : public yasm::DiagnosticClient
+{
+public:
+    void HandleDiagnostic(yasm::Diagnostic::Level level,
+                          const yasm::DiagnosticInfo& info)
+    {
+    }
+};
+} // anonymous namespace
+
+// Fill buf with assembly-like lines of varying length; every eighth line
+// ends with \r\n.
+static void
+GenerateSource(char* buf, std::size_t size)
+{
+    static const char* const lines[] =
+    {
+        "        mov rax, [rbx+rcx*8+16]",
+        "        add eax, 5",
+        "label:",
+        "        vpaddd ymm0, ymm1, [rsi+rdi*4+0x1000]   ; long comment",
+        "",
+        "        dq sym+8, sym+16, sym+24, sym+32",
+        "        ret",
+    };
+    static const std::size_t num_lines = sizeof(lines)/sizeof(lines[0]);
+
+    std::size_t pos = 0;
+    for (std::size_t n=0; pos < size; ++n)
+    {
+        const char* line = lines[n % num_lines];
+        std::size_t len = std::strlen(line);
+        for (std::size_t i=0; i<len && pos < size; ++i)
+            buf[pos++] = line[i];
+        if ((n & 7) == 7 && pos < size)
+            buf[pos++] = '\r';
+        if (pos < size)
+            buf[pos++] = '\n';
+    }
+}
+
+static double
+Now()
+{
+    llvm::sys::TimeValue now(0.0), user(0.0), sys(0.0);
+    llvm::sys::Process::GetTimeUsage(now, user, sys);
+    return now.seconds() + now.nanoseconds() / 1e9;
+}
+
+// Time the first line number query on a fresh SourceManager, which builds
+// the line table for the whole buffer.
+static double
+TimeSourceManager(const llvm::MemoryBuffer& data, unsigned int* lines)
+{
+    NullDiagnosticClient client;
+    yasm::Diagnostic diags(&client);
+    yasm::SourceManager smgr(diags);
+    diags.setSourceManager(&smgr);
+    yasm::FileID fid = smgr.createMainFileIDForMemBuffer(
+        llvm::MemoryBuffer::getMemBuffer(data.getBuffer(), "<bench>"));
+
+    double start = Now();
+    *lines = smgr.getLineNumber(fid, data.getBufferSize());
+    return Now() - start;
+}
+
+// Byte-at-a-time scan into a vector, then copied out; this is how the line
+// table used to be built.
+static double
+TimeReference(const llvm::MemoryBuffer& data, unsigned int* lines)
+{
+    double start = Now();
+    std::vector<unsigned> offsets;
+    offsets.push_back(0);
+    const unsigned char* buf =
+        reinterpret_cast<const unsigned char*>(data.getBufferStart());
+    const unsigned char* end =
+        reinterpret_cast<const unsigned char*>(data.getBufferEnd());
+    unsigned offs = 0;
+    for (;;)
+    {
+        const unsigned char* next = buf;
+        while (*next != '\n' && *next != '\r' && *next != '\0')
+            ++next;
+        offs += next-buf;
+        buf = next;
+        if (buf[0] == '\n' || buf[0] == '\r')
+        {
+            if ((buf[1] == '\n' || buf[1] == '\r') && buf[0] != buf[1])
+                ++offs, ++buf;
+            ++offs, ++buf;
+            offsets.push_back(offs);
+        }
+        else
+        {
+            if (buf == end)
+                break;
+            ++offs, ++buf;
+        }
+    }
+    std::vector<unsigned> table(offsets.begin(), offsets.end());
+    double elapsed = Now() - start;
+    *lines = table.size();
+    return elapsed;
+}
+
+int
+main(int argc, char* argv[])
+{
+    llvm::llvm_shutdown_obj llvm_manager(false);
+
+    unsigned long megabytes = 256;
+    if (argc > 1)
+        megabytes = std::strtoul(argv[1], 0, 10);
+    std::size_t size = megabytes * 1024 * 1024;
+
+    std::auto_ptr<llvm::MemoryBuffer> data(
+        llvm::MemoryBuffer::getNewUninitMemBuffer(size, "<bench>"));
+    GenerateSource(const_cast<char*>(data->getBufferStart()), size);
+
+    static const int num_runs = 5;
+    double smgr_time = 0.0, ref_time = 0.0;
+    unsigned int smgr_lines = 0, ref_lines = 0;
+    for (int run=0; run<num_runs; ++run)
+    {
+        double smgr_run = TimeSourceManager(*data, &smgr_lines);
+        double ref_run = TimeReference(*data, &ref_lines);
+        if (run == 0 || smgr_run < smgr_time)
+            smgr_time = smgr_run;
+        if (run == 0 || ref_run < ref_time)
+            ref_time = ref_run;
+    }
+
+    if (smgr_lines != ref_lines)
+    {
+        llvm::errs() << "linescan_bench: line count mismatch ("
+                     << smgr_lines << " vs " << ref_lines << ")\n";
+        return EXIT_FAILURE;
+    }
+
+    double mb = static_cast<double>(size) / (1024.0 * 1024.0);
+    llvm::outs() << "buffer: " << megabytes << " MB, " << ref_lines
+                 << " lines\n";
+    llvm::outs() << llvm::format("SourceManager:  %8.4f s  %8.1f MB/s\n",
+                                 smgr_time, mb / smgr_time);
+    llvm::outs() << llvm::format("byte scan:      %8.4f s  %8.1f MB/s\n",
+                                 ref_time, mb / ref_time);
+    llvm::outs() << llvm::format("speedup: %.2f\n", ref_time / smgr_time);
+    return EXIT_SUCCESS;
+}
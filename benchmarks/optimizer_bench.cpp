@@ -0,0 +1,245 @@
+//
+// Optimizer benchmark: sequential versus batched span expansion
+//
+//  Copyright (C) 2011  PathScale Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND OTHER CONTRIBUTORS ``AS IS''
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR OTHER CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Generates JIT-style code (long runs of conditional branches) with
+// increasing branch reach and times Object::Optimize() with the sequential
+// and batched expansion loops.  Only optimization is timed; each run parses
+// and finalizes its own copy of the source, and the best of several runs is
+// reported.
+//
+// Usage: optimizer_bench [instructions]
+//
+#include <cstddef>
+#include <cstdlib>
+#include <string>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/System/Process.h"
+#include "llvm/System/TimeValue.h"
+#include "yasmx/Basic/Diagnostic.h"
+#include "yasmx/Basic/FileManager.h"
+#include "yasmx/Basic/SourceManager.h"
+#include "yasmx/Parse/Directive.h"
+#include "yasmx/Parse/HeaderSearch.h"
+#include "yasmx/Parse/Parser.h"
+#include "yasmx/System/plugin.h"
+#include "yasmx/Arch.h"
+#include "yasmx/Assembler.h"
+#include "yasmx/Object.h"
+
+
+namespace {
+class CountingDiagnosticClient : public yasm::DiagnosticClient
+{
+public:
+    CountingDiagnosticClient() : m_errors(0) {}
+    void HandleDiagnostic(yasm::Diagnostic::Level level,
+                          const yasm::DiagnosticInfo& info)
+    {
+        if (level >= yasm::Diagnostic::Error)
+            ++m_errors;
+    }
+    unsigned int m_errors;
+};
+} // anonymous namespace
+
+// Generate num_insns conditional branches, each to a label up to reach
+// branches away (randomly forward or back).  Branches start out short; with
+// reach near the short branch range, each expansion pushes neighboring
+// branches out of range, so most expansions happen in step 2.
+static void
+GenerateSource(llvm::raw_ostream& os, unsigned int num_insns,
+               unsigned int reach)
+{
+    unsigned long seed = 12345;
+    for (unsigned int i=0; i<num_insns; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        unsigned int dist =
+            1 + static_cast<unsigned int>((seed >> 16) % reach);
+        unsigned int target;
+        if ((seed >> 8) & 1)
+            target = (i + dist < num_insns) ? i + dist : num_insns-1;
+        else
+            target = (i > dist) ? i - dist : 0;
+        os << 'l' << i << ": jz l" << target << '\n';
+    }
+}
+
+// Generate a chain of num_insns backward branches, each spanning the one
+// before it with no room to spare, so every expansion pushes exactly one
+// more branch out of range.
+static void
+GenerateChain(llvm::raw_ostream& os, unsigned int num_insns)
+{
+    os << "l0: .fill 200, 1, 0\n jz l0\n";
+    for (unsigned int i=1; i<num_insns; ++i)
+        os << 'l' << i << ": .fill 62, 1, 0\n jz l" << (i-1) << '\n';
+}
+
+// Parse and finalize source, then return the seconds spent optimizing.
+static double
+TimeOptimize(llvm::StringRef source, bool batch)
+{
+    CountingDiagnosticClient client;
+    yasm::Diagnostic diags(&client);
+    yasm::SourceManager smgr(diags);
+    diags.setSourceManager(&smgr);
+    yasm::FileManager fmgr;
+    yasm::HeaderSearch headers(fmgr);
+
+    yasm::Assembler assembler("x86", "elf32", diags);
+    if (!assembler.setParser("gas", diags))
+        return -1.0;
+
+    smgr.createMainFileIDForMemBuffer(
+        llvm::MemoryBuffer::getMemBufferCopy(source, "<bench>"));
+    if (!assembler.InitObject(smgr, diags))
+        return -1.0;
+    yasm::Object& object = *assembler.getObject();
+    object.getConfig().BatchOptimize = batch;
+
+    yasm::Parser& parser = assembler.InitParser(smgr, diags, headers);
+    yasm::Directives dirs;
+    assembler.getArch()->AddDirectives(dirs, "gas");
+    parser.AddDirectives(dirs, "gas");
+    parser.Parse(object, dirs, diags);
+    object.Finalize(diags);
+    if (client.m_errors != 0)
+        return -1.0;
+
+    llvm::sys::TimeValue start(0.0), end(0.0), user(0.0), sys(0.0);
+    llvm::sys::Process::GetTimeUsage(start, user, sys);
+    object.Optimize(diags);
+    llvm::sys::Process::GetTimeUsage(end, user, sys);
+    if (client.m_errors != 0)
+        return -1.0;
+    llvm::sys::TimeValue elapsed = end - start;
+    return elapsed.seconds() + elapsed.nanoseconds() / 1e9;
+}
+
+int
+main(int argc, char* argv[])
+{
+    llvm::llvm_shutdown_obj llvm_manager(false);
+
+    unsigned int num_insns = 200000;
+    if (argc > 1)
+        num_insns = static_cast<unsigned int>(std::atoi(argv[1]));
+
+    if (!yasm::LoadStandardPlugins())
+    {
+        llvm::errs() << "optimizer_bench: could not load standard modules\n";
+        return EXIT_FAILURE;
+    }
+
+    llvm::outs() << "instructions: " << num_insns << '\n';
+    llvm::outs() << "   reach  sequential(s)  batched(s)  speedup\n";
+
+    static const unsigned int reaches[] =
+        {8, 16, 32, 48, 56, 60, 62, 64, 72, 96, 128, 192, 256, 512};
+    static const int num_runs = 5;
+
+    unsigned int crossover = 0;
+    for (std::size_t r=0; r<sizeof(reaches)/sizeof(reaches[0]); ++r)
+    {
+        unsigned int reach = reaches[r];
+        llvm::SmallString<128> source;
+        {
+            llvm::raw_svector_ostream os(source);
+            GenerateSource(os, num_insns, reach);
+        }
+
+        double seq = 0.0, batch = 0.0;
+        for (int run=0; run<num_runs; ++run)
+        {
+            double seq_run = TimeOptimize(source.str(), false);
+            double batch_run = TimeOptimize(source.str(), true);
+            if (seq_run < 0.0 || batch_run < 0.0)
+            {
+                llvm::errs() << "optimizer_bench: assembly failed\n";
+                return EXIT_FAILURE;
+            }
+            if (run == 0 || seq_run < seq)
+                seq = seq_run;
+            if (run == 0 || batch_run < batch)
+                batch = batch_run;
+        }
+
+        llvm::outs() << llvm::format("%8u", reach)
+                     << llvm::format("  %13.4f  %10.4f", seq, batch)
+                     << llvm::format("  %7.2f\n",
+                                     batch > 0.0 ? seq/batch : 0.0);
+        // The crossover is the reach from which batched stays faster.
+        if (batch >= seq)
+            crossover = 0;
+        else if (crossover == 0)
+            crossover = reach;
+    }
+
+    if (crossover != 0)
+        llvm::outs() << "batched expansion is faster from reach "
+                     << crossover << '\n';
+    else
+        llvm::outs() << "batched expansion was never faster\n";
+
+    llvm::outs() << "\ndependent chain\n";
+    llvm::outs() << "  length  sequential(s)  batched(s)  speedup\n";
+    for (unsigned int length=num_insns/40; length<=num_insns/5; length*=2)
+    {
+        llvm::SmallString<128> source;
+        {
+            llvm::raw_svector_ostream os(source);
+            GenerateChain(os, length);
+        }
+
+        double seq = 0.0, batch = 0.0;
+        for (int run=0; run<num_runs; ++run)
+        {
+            double seq_run = TimeOptimize(source.str(), false);
+            double batch_run = TimeOptimize(source.str(), true);
+            if (seq_run < 0.0 || batch_run < 0.0)
+            {
+                llvm::errs() << "optimizer_bench: assembly failed\n";
+                return EXIT_FAILURE;
+            }
+            if (run == 0 || seq_run < seq)
+                seq = seq_run;
+            if (run == 0 || batch_run < batch)
+                batch = batch_run;
+        }
+
+        llvm::outs() << llvm::format("%8u", length)
+                     << llvm::format("  %13.4f  %10.4f", seq, batch)
+                     << llvm::format("  %7.2f\n",
+                                     batch > 0.0 ? seq/batch : 0.0);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,210 @@
+//
+// Object file output benchmark
+//
+//  Copyright (C) 2011  PathScale Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND OTHER CONTRIBUTORS ``AS IS''
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR OTHER CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Times Assembler::Output() writing bin, ELF and COFF files for two
+// sources: many small instructions and data values (lots of tiny
+// bytecodes), and a data section with a large uninitialized gap.  Each run
+// assembles its own object; only output is timed, and the best of several
+// runs is reported.
+//
+// Usage: output_bench [lines [gap megabytes]]
+//
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/System/Process.h"
+#include "llvm/System/TimeValue.h"
+#include "yasmx/Basic/Diagnostic.h"
+#include "yasmx/Basic/FileManager.h"
+#include "yasmx/Basic/SourceManager.h"
+#include "yasmx/Parse/HeaderSearch.h"
+#include "yasmx/System/plugin.h"
+#include "yasmx/Assembler.h"
+
+
+namespace {
+class CountingDiagnosticClient : public yasm::DiagnosticClient
+{
+public:
+    CountingDiagnosticClient() : m_errors(0) {}
+    void HandleDiagnostic(yasm::Diagnostic::Level level,
+                          const yasm::DiagnosticInfo& info)
+    {
+        if (level >= yasm::Diagnostic::Error)
+            ++m_errors;
+    }
+    unsigned int m_errors;
+};
+} // anonymous namespace
+
+static const char* const output_filename = "output_bench.tmp";
+
+// Alternate small instructions and data values, a few bytes each.
+static void
+GenerateSmall(llvm::raw_ostream& os, unsigned int num_lines)
+{
+    for (unsigned int i=0; i<num_lines; ++i)
+    {
+        if ((i & 1023) == 0)
+            os << ((i & 1024) ? ".data\n" : ".text\n");
+        if (i & 1024)
+            os << ".long " << i << '\n';
+        else
+            os << "movl $" << i << ", %eax\n";
+    }
+}
+
+// A data section that is almost entirely uninitialized.
+static void
+GenerateGap(llvm::raw_ostream& os, unsigned long megabytes)
+{
+    os << ".text\nret\n.data\n.byte 1\n";
+    os << ".skip " << megabytes*1024*1024 << '\n';
+    os << ".byte 2\n";
+}
+
+// Assemble source, then return the seconds spent writing the object file.
+static double
+TimeOutput(llvm::StringRef source, const char* objfmt, unsigned long* size)
+{
+    CountingDiagnosticClient client;
+    yasm::Diagnostic diags(&client);
+    yasm::SourceManager smgr(diags);
+    diags.setSourceManager(&smgr);
+    yasm::FileManager fmgr;
+    yasm::HeaderSearch headers(fmgr);
+
+    yasm::Assembler assembler("x86", objfmt, diags);
+    if (!assembler.setParser("gas", diags))
+        return -1.0;
+
+    smgr.createMainFileIDForMemBuffer(
+        llvm::MemoryBuffer::getMemBufferCopy(source, "<bench>"));
+    assembler.setObjectFilename(output_filename);
+    if (!assembler.InitObject(smgr, diags))
+        return -1.0;
+    assembler.InitParser(smgr, diags, headers);
+    if (!assembler.Assemble(smgr, diags))
+        return -1.0;
+
+    std::string err;
+    llvm::sys::TimeValue start(0.0), end(0.0), user(0.0), sys(0.0);
+    llvm::sys::Process::GetTimeUsage(start, user, sys);
+    {
+        llvm::raw_fd_ostream out(output_filename, err,
+                                 llvm::raw_fd_ostream::F_Binary);
+        if (!err.empty() || !assembler.Output(out, diags))
+            return -1.0;
+    }
+    llvm::sys::Process::GetTimeUsage(end, user, sys);
+    if (client.m_errors != 0)
+        return -1.0;
+
+    // COFF seeks back to write its headers, so ask the file for its size.
+    std::FILE* f = std::fopen(output_filename, "rb");
+    if (!f)
+        return -1.0;
+    std::fseek(f, 0, SEEK_END);
+    *size = static_cast<unsigned long>(std::ftell(f));
+    std::fclose(f);
+
+    llvm::sys::TimeValue elapsed = end - start;
+    return elapsed.seconds() + elapsed.nanoseconds() / 1e9;
+}
+
+int
+main(int argc, char* argv[])
+{
+    llvm::llvm_shutdown_obj llvm_manager(false);
+
+    unsigned int num_lines = 1000000;
+    unsigned long gap_megabytes = 256;
+    if (argc > 1)
+        num_lines = static_cast<unsigned int>(std::atoi(argv[1]));
+    if (argc > 2)
+        gap_megabytes = std::strtoul(argv[2], 0, 10);
+
+    if (!yasm::LoadStandardPlugins())
+    {
+        llvm::errs() << "output_bench: could not load standard modules\n";
+        return EXIT_FAILURE;
+    }
+
+    llvm::SmallString<128> small, gap;
+    {
+        llvm::raw_svector_ostream os(small);
+        GenerateSmall(os, num_lines);
+    }
+    {
+        llvm::raw_svector_ostream os(gap);
+        GenerateGap(os, gap_megabytes);
+    }
+
+    static const char* const objfmts[] = {"bin", "elf64", "win64"};
+    static const int num_runs = 5;
+
+    llvm::outs() << "source   format        size(MB)  output(s)      MB/s\n";
+    for (int src=0; src<2; ++src)
+    {
+        llvm::StringRef source = src == 0 ? small.str() : gap.str();
+        for (std::size_t f=0; f<sizeof(objfmts)/sizeof(objfmts[0]); ++f)
+        {
+            double best = 0.0;
+            unsigned long size = 0;
+            for (int run=0; run<num_runs; ++run)
+            {
+                double t = TimeOutput(source, objfmts[f], &size);
+                if (t < 0.0)
+                {
+                    llvm::errs() << "output_bench: " << objfmts[f]
+                                 << " output failed\n";
+                    std::remove(output_filename);
+                    return EXIT_FAILURE;
+                }
+                if (run == 0 || t < best)
+                    best = t;
+            }
+
+            double mb = static_cast<double>(size) / (1024.0 * 1024.0);
+            llvm::outs() << llvm::format("%-8s %-8s", src == 0 ? "small"
+                                                               : "gap",
+                                         objfmts[f])
+                         << llvm::format("  %10.1f  %9.4f  %8.1f\n",
+                                         mb, best,
+                                         best > 0.0 ? mb/best : 0.0);
+        }
+    }
+
+    std::remove(output_filename);
+    return EXIT_SUCCESS;
+}
@@ -36,9 +36,18 @@
 /* Define to 1 if you have the <sys/types.h> header file. */
 #cmakedefine HAVE_SYS_TYPES_H 1
 
+/* Define to 1 if you have the <sys/wait.h> header file. */
+#cmakedefine HAVE_SYS_WAIT_H 1
+
+/* Define to 1 if you have the <poll.h> header file. */
+#cmakedefine HAVE_POLL_H 1
+
 /* Define to 1 if you have the `getcwd' function. */
 #cmakedefine HAVE_GETCWD 1
 
+/* Define to 1 if you have the `fork' function. */
+#cmakedefine HAVE_FORK 1
+
 /* Name of package */
 #define PACKAGE "yasm"
 
@@ -26,6 +26,8 @@
 //
 #include "config.h"
 
+#include <cerrno>
+#include <cstring>
 #include <memory>
 
 #include "llvm/ADT/StringExtras.h"
@@ -51,11 +53,23 @@
 #include "yasmx/Module.h"
 #include "yasmx/Object.h"
 #include "yasmx/ObjectFormat.h"
+#include "yasmx/OptimizerCache.h"
 
 #ifdef HAVE_LIBGEN_H
 #include <libgen.h>
 #endif
 
+// Multiple input files are assembled in forked worker processes; the
+// parsers keep global state, so assembling more than one file per process
+// is not safe.
+#if defined(HAVE_FORK) && defined(HAVE_SYS_WAIT_H) && defined(HAVE_POLL_H)
+#define YASM_ENABLE_JOBS 1
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
 #include "frontends/license.cpp"
 #include "frontends/DiagnosticOptions.h"
 #include "frontends/TextDiagnosticPrinter.h"
@@ -87,13 +101,14 @@ static cl::extrahelp help_tail(
     "\n"
     "Files are asm sources to be assembled.\n"
     "\n"
-    "Sample invocation:\n"
+    "Sample invocations:\n"
     "   pathas -f elf -o object.o source.asm\n"
+    "   pathas -f elf -j 4 a.asm b.asm c.asm\n"
     "\n"
     "Report bugs to support@pathscale.com\n");
 
-static cl::opt<std::string> in_filename(cl::Positional,
-    cl::desc("file"));
+static cl::list<std::string> in_filenames(cl::Positional,
+    cl::desc("file..."));
 
 // -a, --arch
 static cl::opt<std::string> arch_keyword("a",
@@ -106,6 +121,13 @@ static cl::alias arch_keyword_long("arch",
     cl::value_desc("arch"),
     cl::aliasopt(arch_keyword));
 
+// --align-branch-boundary
+static cl::opt<unsigned int> align_branch_boundary("align-branch-boundary",
+    cl::desc("Pad so jumps and fused compare/jumps don't cross or end on "
+             "a <n>-byte boundary"),
+    cl::value_desc("n"),
+    cl::init(0));
+
 // -D, -d
 static cl::list<std::string> predefine_macros("D",
     cl::desc("Pre-define a macro, optionally to value"),
@@ -197,6 +219,16 @@ static cl::alias include_paths_alias("i",
     cl::aliasopt(include_paths),
     cl::Prefix);
 
+// -j, --jobs
+static cl::opt<unsigned int> num_jobs("j",
+    cl::desc("Assemble up to <jobs> input files at once"),
+    cl::value_desc("jobs"),
+    cl::init(1));
+static cl::alias num_jobs_long("jobs",
+    cl::desc("Alias for -j"),
+    cl::value_desc("jobs"),
+    cl::aliasopt(num_jobs));
+
 // -L, --lformat
 static cl::opt<std::string> listfmt_keyword("L",
     cl::desc("Select list format (list with -L help)"),
@@ -246,6 +278,19 @@ static cl::opt<int> optimize_level("O",
     cl::Prefix,
     cl::Hidden);
 
+// --batch-optimize
+static cl::opt<bool> batch_optimize("batch-optimize",
+    cl::desc("Expand jumps in batches (faster on large inputs)"));
+
+// --optimizer-cache
+static cl::opt<std::string> optimizer_cache_filename("optimizer-cache",
+    cl::desc("Reuse and update optimizer decisions saved in file"),
+    cl::value_desc("file"));
+
+// --merge-strings
+static cl::opt<bool> merge_strings("merge-strings",
+    cl::desc("Share duplicate and tail strings in object string tables"));
+
 // -N, --plugin
 #ifndef BUILD_STATIC
 static cl::list<std::string> plugin_names("N",
@@ -503,6 +548,9 @@ ConfigureObject(yasm::Object& object)
         else
             break; // we're done with the list
     }
+
+    config.BatchOptimize = batch_optimize;
+    config.MergeStrings = merge_strings;
 }
 
 static void
@@ -676,12 +724,14 @@ do_preproc_only(void)
 }
 #endif
 static int
-do_assemble(yasm::SourceManager& source_mgr, yasm::Diagnostic& diags)
+do_assemble(const std::string& in_filename,
+            yasm::FileManager& file_mgr,
+            yasm::SourceManager& source_mgr,
+            yasm::Diagnostic& diags)
 {
     // Apply warning settings
     ApplyWarningSettings(diags);
 
-    yasm::FileManager file_mgr;
     yasm::Assembler assembler(arch_keyword, objfmt_keyword, diags, dump_object);
     yasm::HeaderSearch headers(file_mgr);
 
@@ -720,6 +770,34 @@ do_assemble(yasm::SourceManager& source_mgr, yasm::Diagnostic& diags)
 
     assembler.getArch()->setVar("force_strict", force_strict);
 
+    if (align_branch_boundary != 0)
+    {
+        if ((align_branch_boundary & (align_branch_boundary-1)) != 0)
+        {
+            diags.Report(yasm::SourceLocation(),
+                         yasm::diag::fatal_bad_branch_align)
+                << static_cast<unsigned int>(align_branch_boundary);
+            return EXIT_FAILURE;
+        }
+        if (!assembler.getArch()->setVar("align_branch_boundary",
+                                         align_branch_boundary))
+            diags.Report(yasm::SourceLocation(),
+                         yasm::diag::warn_branch_align_unsupported)
+                << arch_keyword;
+    }
+
+    // Load optimizer cache if specified.  A missing or unreadable cache
+    // simply starts out empty.
+    yasm::OptimizerCache opt_cache;
+    if (!optimizer_cache_filename.empty())
+    {
+        std::auto_ptr<llvm::MemoryBuffer> cache_buf(
+            llvm::MemoryBuffer::getFile(optimizer_cache_filename));
+        if (cache_buf.get())
+            opt_cache.Read(*cache_buf);
+        assembler.setOptimizerCache(&opt_cache);
+    }
+
     // open the input file or STDIN (for filename of "-")
     if (in_filename == "-")
     {
@@ -781,6 +859,21 @@ do_assemble(yasm::SourceManager& source_mgr, yasm::Diagnostic& diags)
 
     // close object file
     out.close();
+
+    // Save optimizer cache for the next assembly.
+    if (!optimizer_cache_filename.empty())
+    {
+        llvm::raw_fd_ostream cache_out(optimizer_cache_filename.c_str(), err,
+                                       llvm::raw_fd_ostream::F_Binary);
+        if (!err.empty())
+        {
+            diags.Report(yasm::SourceLocation(),
+                         yasm::diag::err_cannot_open_file)
+                << optimizer_cache_filename << err;
+            return EXIT_FAILURE;
+        }
+        opt_cache.Write(cache_out);
+    }
 #if 0
     // Open and write the list file
     if (list_filename)
@@ -801,6 +894,186 @@ do_assemble(yasm::SourceManager& source_mgr, yasm::Diagnostic& diags)
     return EXIT_SUCCESS;
 }
 
+#ifdef YASM_ENABLE_JOBS
+namespace {
+// An assembly job.  Diagnostics are collected from the worker through a
+// pipe so they can be printed in input file order.
+struct Job
+{
+    Job() : pid(-1), fd(-1), done(false), status(EXIT_FAILURE) {}
+
+    pid_t pid;
+    int fd;
+    std::string diag_text;
+    bool done;
+    int status;
+};
+} // anonymous namespace
+
+// Fork a worker process that assembles in_filename.  Returns false and
+// sets err if the worker could not be started.
+static bool
+StartJob(Job& job,
+         const std::string& in_filename,
+         yasm::FileManager& file_mgr,
+         const yasm::DiagnosticOptions& diag_opts,
+         std::string& err)
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        err = strerror(errno);
+        return false;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        err = strerror(errno);
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+
+    if (pid == 0)
+    {
+        // Worker: assemble with fresh diagnostics and source manager,
+        // sharing the modules and file cache set up by the parent.
+        close(fds[0]);
+        int status;
+        {
+            llvm::raw_fd_ostream diag_os(fds[1], true);
+            yasm::TextDiagnosticPrinter diag_printer(diag_os, diag_opts);
+            yasm::Diagnostic diags(&diag_printer);
+            yasm::SourceManager source_mgr(diags);
+            diags.setSourceManager(&source_mgr);
+            diag_printer.setPrefix("pathas");
+            status = do_assemble(in_filename, file_mgr, source_mgr, diags);
+        }
+        _exit(status);
+    }
+
+    close(fds[1]);
+    job.pid = pid;
+    job.fd = fds[0];
+    return true;
+}
+
+// Read available diagnostics from a running job.  At end of file, reap the
+// worker and mark the job done.
+static void
+ReadJob(Job& job)
+{
+    char buf[4096];
+    ssize_t got = read(job.fd, buf, sizeof(buf));
+    if (got < 0 && (errno == EINTR || errno == EAGAIN))
+        return;
+    if (got > 0)
+    {
+        job.diag_text.append(buf, got);
+        return;
+    }
+
+    close(job.fd);
+    job.fd = -1;
+
+    int wstatus;
+    while (waitpid(job.pid, &wstatus, 0) < 0)
+    {
+        if (errno != EINTR)
+        {
+            wstatus = -1;
+            break;
+        }
+    }
+    job.done = true;
+    if (wstatus != -1 && WIFEXITED(wstatus))
+        job.status = WEXITSTATUS(wstatus);
+    else
+        job.status = EXIT_FAILURE;
+}
+
+// Assemble all input files, running up to num_jobs workers at once.
+// Workers are started in input order as earlier ones finish; each job's
+// diagnostics are printed as a block, in input order.
+static int
+do_assemble_jobs(yasm::FileManager& file_mgr,
+                 const yasm::DiagnosticOptions& diag_opts,
+                 yasm::Diagnostic& diags)
+{
+    std::size_t num_files = in_filenames.size();
+    std::vector<Job> jobs(num_files);
+    std::size_t next_start = 0, next_report = 0, running = 0;
+    unsigned int max_jobs = num_jobs == 0 ? 1 : num_jobs;
+    int result = EXIT_SUCCESS;
+
+    // Don't let workers inherit (and duplicate) buffered output.
+    llvm::outs().flush();
+    errfile->flush();
+
+    std::vector<struct pollfd> pollfds;
+    std::vector<std::size_t> pollfd_jobs;
+    while (next_report < next_start || next_start < num_files)
+    {
+        while (running < max_jobs && next_start < num_files)
+        {
+            std::string err;
+            if (!StartJob(jobs[next_start], in_filenames[next_start],
+                          file_mgr, diag_opts, err))
+            {
+                diags.Report(yasm::diag::fatal_job_start)
+                    << in_filenames[next_start] << err;
+                num_files = next_start;
+                result = EXIT_FAILURE;
+                break;
+            }
+            ++next_start;
+            ++running;
+        }
+
+        pollfds.clear();
+        pollfd_jobs.clear();
+        for (std::size_t i=next_report; i<next_start; ++i)
+        {
+            if (jobs[i].fd < 0)
+                continue;
+            struct pollfd pfd;
+            pfd.fd = jobs[i].fd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            pollfds.push_back(pfd);
+            pollfd_jobs.push_back(i);
+        }
+
+        if (!pollfds.empty() &&
+            poll(&pollfds[0], pollfds.size(), -1) > 0)
+        {
+            for (std::size_t i=0, n=pollfds.size(); i<n; ++i)
+            {
+                if (pollfds[i].revents == 0)
+                    continue;
+                Job& job = jobs[pollfd_jobs[i]];
+                ReadJob(job);
+                if (job.done)
+                    --running;
+            }
+        }
+
+        // Print diagnostics of finished jobs in input order.
+        for (; next_report < next_start && jobs[next_report].done;
+             ++next_report)
+        {
+            Job& job = jobs[next_report];
+            *errfile << job.diag_text;
+            errfile->flush();
+            if (job.status != EXIT_SUCCESS)
+                result = EXIT_FAILURE;
+        }
+    }
+    return result;
+}
+#endif
+
 // main function
 int
 main(int argc, char* argv[])
@@ -918,12 +1191,34 @@ main(int argc, char* argv[])
 
     // Require an input filename.  We don't use llvm::cl facilities for this
     // as we want to allow e.g. "yasm --license".
-    if (in_filename.empty())
+    if (in_filenames.empty())
     {
         diags.Report(yasm::diag::fatal_no_input_files);
         return EXIT_FAILURE;
     }
 
+    // Options naming a single output can't be shared by several inputs.
+    if (in_filenames.size() > 1)
+    {
+        const char* single_opt = 0;
+        if (!obj_filename.empty())
+            single_opt = "-o";
+        else if (!list_filename.empty())
+            single_opt = "-l";
+        else if (!optimizer_cache_filename.empty())
+            single_opt = "--optimizer-cache";
+        if (single_opt)
+        {
+            diags.Report(yasm::diag::fatal_multiple_inputs_option)
+                << single_opt;
+            return EXIT_FAILURE;
+        }
+#ifndef YASM_ENABLE_JOBS
+        diags.Report(yasm::diag::fatal_multiple_inputs_unsupported);
+        return EXIT_FAILURE;
+#endif
+    }
+
     // If not already specified, default to bin as the object format.
     if (objfmt_keyword.empty())
         objfmt_keyword = "bin";
@@ -945,6 +1240,17 @@ main(int argc, char* argv[])
             listfmt_keyword = "nasm";
     }
 
-    return do_assemble(source_mgr, diags);
+    // The file manager caches directory and file lookups; workers inherit
+    // whatever the parent has already looked up, including include paths.
+    yasm::FileManager file_mgr;
+    for (std::vector<std::string>::iterator i = include_paths.begin(),
+         end = include_paths.end(); i != end; ++i)
+        file_mgr.getDirectory(*i);
+
+#ifdef YASM_ENABLE_JOBS
+    if (in_filenames.size() > 1)
+        return do_assemble_jobs(file_mgr, diag_opts, diags);
+#endif
+    return do_assemble(in_filenames.front(), file_mgr, source_mgr, diags);
 }
 
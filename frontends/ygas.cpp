@@ -139,6 +139,11 @@ static cl::list<bool> noexecstack("noexecstack",
 static cl::list<bool> no_signed_overflow("J",
     cl::desc("don't warn about signed overflow"));
 
+// -mbranches-within-32B-boundaries
+static cl::opt<bool> branches_within_32b("mbranches-within-32B-boundaries",
+    cl::desc("pad so jumps and fused compare/jumps don't cross or end on "
+             "a 32-byte boundary"));
+
 // -I
 static cl::list<std::string> include_paths("I",
     cl::desc("Add include path"),
@@ -387,6 +392,9 @@ do_assemble(yasm::SourceManager& source_mgr, yasm::Diagnostic& diags)
     if (diags.hasFatalErrorOccurred())
         return EXIT_FAILURE;
 
+    if (branches_within_32b)
+        assembler.getArch()->setVar("align_branch_boundary", 32);
+
     // Set debug format to dwarf2pass if it's legal for this object format.
     if (assembler.isOkDebugFormat("dwarf2pass"))
     {
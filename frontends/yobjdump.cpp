@@ -44,6 +44,7 @@
 #include "yasmx/Support/registry.h"
 #include "yasmx/System/plugin.h"
 #include "yasmx/Arch.h"
+#include "yasmx/BytecodeOutput.h"
 #include "yasmx/Bytecode.h"
 #include "yasmx/Location.h"
 #include "yasmx/Object.h"
@@ -322,12 +323,124 @@ DumpContentsLine(const yasm::IntNum& addr,
     os << '\n';
 }
 
+namespace {
+/// Collects bytecode output into hex dump lines.
+class DumpContentsOutput : public yasm::BytecodeOutput
+{
+public:
+    DumpContentsOutput(yasm::Diagnostic& diags,
+                       const yasm::IntNum& addr,
+                       unsigned int addr_bits)
+        : BytecodeOutput(diags)
+        , m_addr(addr)
+        , m_addr_bits(addr_bits)
+        , m_line_pos(0)
+    {}
+    ~DumpContentsOutput();
+
+    /// Output any remaining partial line.
+    void Flush();
+
+    bool ConvertValueToBytes(yasm::Value& value,
+                             yasm::Location loc,
+                             yasm::NumericOutput& num_out);
+
+protected:
+    void DoOutputGap(unsigned long size, yasm::SourceLocation source);
+    void DoOutputBytes(const yasm::Bytes& bytes, yasm::SourceLocation source);
+    void DoOutputBorrowed(const unsigned char* data,
+                          unsigned long size,
+                          yasm::SourceLocation source);
+
+private:
+    void Append(const unsigned char* data, unsigned long size);
+
+    yasm::IntNum m_addr;
+    unsigned int m_addr_bits;
+    unsigned char m_line[16];
+    int m_line_pos;
+};
+} // anonymous namespace
+
+DumpContentsOutput::~DumpContentsOutput()
+{
+}
+
+void
+DumpContentsOutput::Flush()
+{
+    if (m_line_pos != 0)
+        DumpContentsLine(m_addr, m_line, m_line_pos, m_addr_bits);
+    m_line_pos = 0;
+}
+
+bool
+DumpContentsOutput::ConvertValueToBytes(yasm::Value& value,
+                                        yasm::Location loc,
+                                        yasm::NumericOutput& num_out)
+{
+    // Values read from an object file are already in the bytes.
+    return true;
+}
+
+void
+DumpContentsOutput::DoOutputGap(unsigned long size,
+                                yasm::SourceLocation source)
+{
+    static const unsigned char zeros[16] = {0};
+    while (size > 0)
+    {
+        unsigned long tocopy = size < 16 ? size : 16;
+        Append(zeros, tocopy);
+        size -= tocopy;
+    }
+}
+
+void
+DumpContentsOutput::DoOutputBytes(const yasm::Bytes& bytes,
+                                  yasm::SourceLocation source)
+{
+    if (!bytes.empty())
+        Append(&bytes[0], bytes.size());
+}
+
+void
+DumpContentsOutput::DoOutputBorrowed(const unsigned char* data,
+                                     unsigned long size,
+                                     yasm::SourceLocation source)
+{
+    Append(data, size);
+}
+
+void
+DumpContentsOutput::Append(const unsigned char* data, unsigned long size)
+{
+    while (size > 0)
+    {
+        unsigned long tocopy = 16-m_line_pos;
+        if (tocopy > size)
+            tocopy = size;
+        std::memcpy(&m_line[m_line_pos], data, tocopy);
+        m_line_pos += tocopy;
+        data += tocopy;
+        size -= tocopy;
+
+        // when we've filled up a line, output it.
+        if (m_line_pos == 16)
+        {
+            DumpContentsLine(m_addr, m_line, 16, m_addr_bits);
+            m_addr += 16;
+            m_line_pos = 0;
+        }
+    }
+}
+
 static void
-DumpContents(const yasm::Object& object)
+DumpContents(yasm::Object& object, yasm::Diagnostic& diags)
 {
     llvm::raw_ostream& os = llvm::outs();
 
-    for (yasm::Object::const_section_iterator sect=object.sections_begin(),
+    for (yasm::Object::section_iterator sect=object.sections_begin(),
          end=object.sections_end(); sect != end; ++sect)
     {
         if (sect->isBSS())
@@ -350,39 +463,14 @@ DumpContents(const yasm::Object& object)
 
         os << "Contents of section " << sect->getName() << ":\n";
 
-        unsigned char line[16];
-        int line_pos = 0;
-        yasm::IntNum addr = sect->getVMA();
-
-        for (yasm::Section::const_bc_iterator bc=sect->bytecodes_begin(),
+        DumpContentsOutput out(diags, sect->getVMA(), addr_bits);
+        for (yasm::Section::bc_iterator bc=sect->bytecodes_begin(),
              endbc=sect->bytecodes_end(); bc != endbc; ++bc)
         {
-            // XXX: only outputs fixed portions
-            const yasm::Bytes& fixed = bc->getFixed();
-            long fixed_pos = 0;
-            long fixed_size = fixed.size();
-            while (fixed_pos < fixed_size)
-            {
-                long tocopy = 16-line_pos;
-                if (tocopy > (fixed_size-fixed_pos))
-                    tocopy = fixed_size-fixed_pos;
-                std::memcpy(&line[line_pos], &fixed[fixed_pos], tocopy);
-                line_pos += tocopy;
-                fixed_pos += tocopy;
-
-                // when we've filled up a line, output it.
-                if (line_pos == 16)
-                {
-                    DumpContentsLine(addr, line, 16, addr_bits);
-                    addr += 16;
-                    line_pos = 0;
-                }
-            }
+            if (!bc->Output(out))
+                break;
         }
-
-        // output any remaining
-        if (line_pos != 0)
-            DumpContentsLine(addr, line, line_pos, addr_bits);
+        out.Flush();
     }
 }
 
@@ -506,7 +594,7 @@ DoDump(const std::string& in_filename,
     if (show_relocs)
         DumpRelocs(object);
     if (show_contents)
-        DumpContents(object);
+        DumpContents(object, diags);
     return EXIT_SUCCESS;
 }
 
@@ -221,6 +221,10 @@ public:
   raw_ostream &write(unsigned char C);
   raw_ostream &write(const char *Ptr, size_t Size);
 
+  /// write_zeros - Output \arg NumZeros zero bytes.  Streams that can leave
+  /// a hole instead (e.g. a regular file being extended) do so.
+  raw_ostream &write_zeros(uint64_t NumZeros);
+
   // Formatted output, see the format() function in Support/Format.h.
   raw_ostream &operator<<(const format_object_base &Fmt);
 
@@ -266,6 +270,21 @@ private:
   /// \invariant { Size > 0 }
   virtual void write_impl(const char *Ptr, size_t Size) = 0;
 
+  /// writev_impl - Write the buffered bytes \arg Ptr1 followed by
+  /// \arg Ptr2, which is at least as large as the buffer.  The default
+  /// calls write_impl() for each; subclasses may gather them into a
+  /// single write.
+  ///
+  /// \invariant { Size2 > 0 }
+  virtual void writev_impl(const char *Ptr1, size_t Size1,
+                           const char *Ptr2, size_t Size2);
+
+  /// skip_impl - Try to advance the stream by \arg Size zero bytes without
+  /// writing them.  The buffer may still hold unflushed data, so subclasses
+  /// that reposition the underlying stream must flush() first.  The default
+  /// returns false, and the zeros are written instead.
+  virtual bool skip_impl(uint64_t Size);
+
   // An out of line virtual method to provide a home for the class vtable.
   virtual void handle();
 
@@ -322,9 +341,24 @@ class YASM_LIB_EXPORT raw_fd_ostream : public raw_ostream {
   bool ShouldClose;
   uint64_t pos;
 
+  /// hole_end - The end of the last hole left by skip_impl, or 0.  The
+  /// file is extended to it when closed in case nothing was written after.
+  uint64_t hole_end;
+
   /// write_impl - See raw_ostream::write_impl.
   virtual void write_impl(const char *Ptr, size_t Size);
 
+  /// writev_impl - See raw_ostream::writev_impl.
+  virtual void writev_impl(const char *Ptr1, size_t Size1,
+                           const char *Ptr2, size_t Size2);
+
+  /// skip_impl - Flush, then leave a hole when extending a regular file by
+  /// a large run of zeros.  See raw_ostream::skip_impl.
+  virtual bool skip_impl(uint64_t Size);
+
+  /// finish - Flush and extend the file over any trailing hole.
+  void finish();
+
   /// current_pos - Return the current position within the stream, not
   /// counting the bytes currently in the buffer.
   virtual uint64_t current_pos() const { return pos; }
@@ -366,7 +400,8 @@ public:
   /// ShouldClose is true, this closes the file when the stream is destroyed.
   raw_fd_ostream(int fd, bool shouldClose,
                  bool unbuffered=false) : raw_ostream(unbuffered), FD(fd),
-                                          ShouldClose(shouldClose) {}
+                                          ShouldClose(shouldClose), pos(0),
+                                          hole_end(0) {}
 
   ~raw_fd_ostream();
 
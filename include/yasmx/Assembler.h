@@ -53,6 +53,7 @@ class ListFormatModule;
 class Object;
 class ObjectFormat;
 class ObjectFormatModule;
+class OptimizerCache;
 class Parser;
 class ParserModule;
 class SourceManager;
@@ -122,6 +123,11 @@ public:
     /// @return False on error.
     bool setListFormat(llvm::StringRef list_keyword, Diagnostic& diags);
 
+    /// Set the optimizer cache; if set, optimization replays unchanged
+    /// sections from the cache and records the others into it.
+    /// @param cache            optimizer cache (not owned; may be NULL)
+    void setOptimizerCache(OptimizerCache* cache) { m_opt_cache = cache; }
+
     /// Initialize the object for assembly.  Does not read from input file.
     /// @param source_mgr       source manager
     /// @param diags            diagnostic reporting
@@ -184,6 +190,7 @@ private:
     std::string m_obj_filename;
     std::string m_machine;
     Assembler::ObjectDumpTime m_dump_time;
+    OptimizerCache* m_opt_cache;
 };
 
 } // namespace yasm
@@ -196,6 +196,15 @@ add_warning("warn_unknown_command_line_option",
             "unknown command line argument '%0'; try '-help'")
 add_fatal("fatal_bad_defsym",
           "bad defsym '%0'; format is --defsym name=value")
+add_fatal("fatal_multiple_inputs_option",
+          "option '%0' cannot be used with multiple input files")
+add_fatal("fatal_multiple_inputs_unsupported",
+          "multiple input files are not supported on this platform")
+add_fatal("fatal_job_start", "could not start assembly of '%0': %1")
+add_fatal("fatal_bad_branch_align",
+          "branch alignment boundary '%0' is not a power of 2")
+add_warning("warn_branch_align_unsupported",
+            "branch alignment not supported by architecture '%0'")
 
 # Source manager
 add_fatal("err_cannot_open_file", "cannot open file '%0': %1")
@@ -269,6 +278,18 @@ add_error("err_missing_or_invalid_immediate",
           "missing or invalid immediate expression")
 add_error("err_rept_without_endr", ".rept without matching .endr")
 add_error("err_endr_without_rept", ".endr without matching .rept")
+add_error("err_macro_without_endm", ".macro without matching .endm")
+add_error("err_endm_without_macro", ".endm without matching .macro")
+add_error("err_irp_without_endr", "%0 without matching .endr")
+add_error("err_macro_redefined", "macro '%0' already defined")
+add_error("err_macro_undefined", "macro '%0' not defined")
+add_error("err_macro_bad_qualifier",
+          "'%0' is not a valid qualifier for macro parameter '%1'")
+add_error("err_macro_missing_arg",
+          "missing value for required parameter '%0' of macro '%1'")
+add_error("err_macro_unknown_param", "macro '%0' has no parameter named '%1'")
+add_error("err_macro_too_many_args", "too many arguments to macro '%0'")
+add_error("err_macro_nested_too_deep", "macros nested too deeply")
 add_error("err_bad_argument_to_syntax_dir", "bad argument to syntax directive")
 add_warning("warn_popsection_without_pushsection",
             ".popsection without corresponding .pushsection; ignored")
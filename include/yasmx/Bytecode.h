@@ -170,6 +170,13 @@ public:
 
         virtual SpecialType getSpecial() const;
 
+        /// Get the period of a #SPECIAL_OFFSET bytecode's length: its
+        /// length only depends on its offset modulo the period.  The
+        /// default returns 0, for a length that may depend on the absolute
+        /// offset (e.g. an org).
+        /// @return Period, or 0 if none.
+        virtual unsigned long getOffsetPeriod() const;
+
         /// Get the type name of the bytecode contents.
         /// Implementations should return a known unique identifying name.
         virtual llvm::StringRef getType() const = 0;
@@ -30,8 +30,11 @@
 /// @endlicense
 ///
 #include <memory>
+#include <vector>
 
 #include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Allocator.h"
+#include "yasmx/Basic/SourceLocation.h"
 #include "yasmx/Config/export.h"
 #include "yasmx/Support/EndianState.h"
 #include "yasmx/Support/ptr_vector.h"
@@ -48,7 +51,6 @@ class Diagnostic;
 class Expr;
 class IntNum;
 class Section;
-class SourceLocation;
 
 /// A bytecode container.
 class YASM_LIB_EXPORT BytecodeContainer : public DebugDumper<BytecodeContainer>
@@ -75,6 +77,11 @@ public:
     /// @return Reference to gap bytecode.
     Bytecode& AppendGap(unsigned long size, SourceLocation source);
 
+    /// Copy the bytecodes of the container into a new container with no
+    /// section.  Used to clone nested (e.g. TIMES) contents.
+    /// @return Newly allocated container.
+    std::auto_ptr<BytecodeContainer> CloneBytecodes() const;
+
     /// Start a new bytecode at the end of the container.  Factory function.
     /// @return Reference to new bytecode.
     Bytecode& StartBytecode();
@@ -85,6 +92,24 @@ public:
     /// @return Reference to last bytecode.
     Bytecode& FreshBytecode();
 
+    /// Source location of an instruction in the container.
+    struct InsnSource
+    {
+        Location loc;               ///< Start of the instruction
+        SourceLocation source;      ///< Where it was defined
+    };
+    typedef std::vector<InsnSource> InsnSources;
+
+    /// Record that an instruction defined at source starts at the current
+    /// end of the container.  Called by Insn::Append() when
+    /// Object::Config::InsnSources is set.  Instructions inside nested
+    /// containers (e.g. TIMES) are not recorded.
+    /// @param source   source location
+    void AddInsnSource(SourceLocation source);
+
+    /// Get the instruction source locations, in container order.
+    const InsnSources& getInsnSources() const { return m_insn_sources; }
+
     typedef stdx::ptr_vector<Bytecode>::iterator bc_iterator;
     typedef stdx::ptr_vector<Bytecode>::const_iterator const_bc_iterator;
 
@@ -140,11 +165,17 @@ private:
 
     Section* m_sect;        ///< Pointer to parent section
 
-    /// The bytecodes for the section's contents.
+    /// Storage for the bytecodes.  Bytecodes are allocated in slabs and
+    /// all destroyed (and their memory freed) together with the container.
+    llvm::SpecificBumpPtrAllocator<Bytecode> m_bcs_pool;
+
+    /// The bytecodes for the section's contents (owned by m_bcs_pool).
     stdx::ptr_vector<Bytecode> m_bcs;
-    stdx::ptr_vector_owner<Bytecode> m_bcs_owner;
 
     bool m_last_gap;        ///< Last bytecode is a gap bytecode
+
+    /// Instruction source locations (see AddInsnSource()).
+    InsnSources m_insn_sources;
 };
 
 /// The factory functions append to the end of a section.
@@ -263,6 +294,21 @@ void AppendIncbin(BytecodeContainer& container,
                   /*@null@*/ std::auto_ptr<Expr> maxlen,
                   SourceLocation source);
 
+/// Append data that is borrowed rather than copied to the end of a section.
+/// The data is only read when the bytecode is output, so it must outlive
+/// the container (e.g. a memory buffer held by the source manager).
+/// The bytecode length is set on return.
+/// @param container        bytecode container
+/// @param data             data
+/// @param size             size of data, in bytes
+/// @param source           source location
+/// @return Reference to data bytecode.
+YASM_LIB_EXPORT
+Bytecode& AppendDataRef(BytecodeContainer& container,
+                        const unsigned char* data,
+                        unsigned long size,
+                        SourceLocation source);
+
 /// Append an alignment constraint that aligns the following data to a boundary.
 /// @param sect         section
 /// @param boundary     byte alignment (must be a power of two)
@@ -118,6 +118,16 @@ public:
     /// @param source       source location
     inline void OutputBytes(const Bytes& bytes, SourceLocation source);
 
+    /// Output a sequence of bytes borrowed from the caller (e.g. a mapped
+    /// file).  The data is not copied into a Bytes first, so this should
+    /// be used for large ranges.
+    /// @param data         data
+    /// @param size         size of data, in bytes
+    /// @param source       source location
+    inline void OutputBorrowed(const unsigned char* data,
+                               unsigned long size,
+                               SourceLocation source);
+
     /// Convert a value to bytes.  Called by OutputValue() so that
     /// implementations can keep track of relocations and verify legal
     /// expressions.
@@ -163,6 +173,16 @@ protected:
     virtual void DoOutputBytes(const Bytes& bytes,
                                SourceLocation source) = 0;
 
+    /// Overrideable implementation of OutputBorrowed().
+    /// The base implementation passes the data to DoOutputBytes() in
+    /// bounded chunks.
+    /// @param data         data
+    /// @param size         size of data, in bytes
+    /// @param source       source location
+    virtual void DoOutputBorrowed(const unsigned char* data,
+                                  unsigned long size,
+                                  SourceLocation source);
+
 private:
     friend class Bytecode;
 
@@ -172,6 +192,7 @@ private:
     Diagnostic& m_diags;        ///< Diagnostic reporting
     Bytes m_scratch;            ///< Reusable scratch area
     Bytes m_bc_scratch;         ///< Reusable scratch area for Bytecode class
+    Bytes m_chunk_scratch;      ///< Reusable scratch area for DoOutputBorrowed
     unsigned long m_num_output; ///< Total number of bytes+gap output
 };
 
@@ -220,6 +241,15 @@ BytecodeOutput::OutputBytes(const Bytes& bytes, SourceLocation source)
     m_num_output += static_cast<unsigned long>(bytes.size());
 }
 
+inline void
+BytecodeOutput::OutputBorrowed(const unsigned char* data,
+                               unsigned long size,
+                               SourceLocation source)
+{
+    DoOutputBorrowed(data, size, source);
+    m_num_output += size;
+}
+
 /// No-output specialization of BytecodeOutput.
 /// Warns on all attempts to output non-gaps.
 class YASM_LIB_EXPORT BytecodeNoOutput : public BytecodeOutput
@@ -237,10 +267,14 @@ protected:
                              NumericOutput& num_out);
     void DoOutputGap(unsigned long size, SourceLocation source);
     void DoOutputBytes(const Bytes& bytes, SourceLocation source);
+    void DoOutputBorrowed(const unsigned char* data,
+                          unsigned long size,
+                          SourceLocation source);
 };
 
 /// Stream output specialization of BytecodeOutput.
-/// Handles gaps by converting to 0 and generating a warning.
+/// Handles gaps by converting to 0 and generating a warning; large gaps
+/// become holes when the stream is a regular file.
 /// This does not implement ConvertValueToBytes(), so it's still a virtual
 /// base class.
 class YASM_LIB_EXPORT BytecodeStreamOutput : public BytecodeOutput
@@ -254,6 +288,9 @@ public:
 protected:
     void DoOutputGap(unsigned long size, SourceLocation source);
     void DoOutputBytes(const Bytes& bytes, SourceLocation source);
+    void DoOutputBorrowed(const unsigned char* data,
+                          unsigned long size,
+                          SourceLocation source);
 
     llvm::raw_ostream& m_os;
 };
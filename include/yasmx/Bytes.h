@@ -29,8 +29,7 @@
 /// POSSIBILITY OF SUCH DAMAGE.
 /// @endlicense
 ///
-#include <vector>
-
+#include "llvm/ADT/SmallVector.h"
 #include "yasmx/Config/export.h"
 #include "yasmx/Support/EndianState.h"
 #include "yasmx/DebugDumper.h"
@@ -41,13 +40,14 @@ namespace llvm { class raw_ostream; }
 namespace yasm
 {
 
-/// A vector of bytes.
+/// A vector of bytes.  Short contents (such as the fixed portion of most
+/// bytecodes) are stored inline without a separate heap allocation.
 class YASM_LIB_EXPORT Bytes
-    : private std::vector<unsigned char>
+    : private llvm::SmallVector<unsigned char, 16>
     , public EndianState
     , public DebugDumper<Bytes>
 {
-    typedef std::vector<unsigned char> base_vector;
+    typedef llvm::SmallVector<unsigned char, 16> base_vector;
 
 public:
     Bytes() {}
@@ -76,7 +76,6 @@ public:
     using base_vector::empty;
     using base_vector::reserve;
     using base_vector::operator[];
-    using base_vector::at;
     using base_vector::front;
     using base_vector::back;
     using base_vector::assign;
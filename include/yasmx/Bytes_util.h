@@ -29,6 +29,7 @@
 /// POSSIBILITY OF SUCH DAMAGE.
 /// @endlicense
 ///
+#include "llvm/System/DataTypes.h"
 #include "yasmx/Config/export.h"
 
 #include "yasmx/Bytes.h"
@@ -123,6 +124,26 @@ Write32(Bytes& bytes, unsigned long val)
     }
 }
 
+/// Write a 64-bit value to a bytes buffer.
+/// @param bytes    output bytes buffer
+/// @param val      64-bit value
+inline void
+Write64(Bytes& bytes, uint64_t val)
+{
+    unsigned long low = static_cast<unsigned long>(val & 0xFFFFFFFFUL);
+    unsigned long high = static_cast<unsigned long>(val >> 32);
+    if (bytes.isBigEndian())
+    {
+        Write32(bytes, high);
+        Write32(bytes, low);
+    }
+    else
+    {
+        Write32(bytes, low);
+        Write32(bytes, high);
+    }
+}
+
 /// Write a N-bit value to a bytes buffer.
 /// @param bytes    output bytes buffer
 /// @param val      integer value
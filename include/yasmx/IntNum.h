@@ -417,6 +417,17 @@ private:
                   SourceLocation source,
                   Diagnostic* diags);
 
+    /// Get the value as a sign-extended BITVECT_NATIVE_SIZE-bit bitvector.
+    /// Never allocates.
+    /// @param words    BITVECT_NATIVE_SIZE/64 words of storage (output)
+    void getWords(uint64_t* words) const;
+
+    /// Set the value from a BITVECT_NATIVE_SIZE-bit bitvector.  Only
+    /// allocates if the value does not fit into a SmallValue and the
+    /// intnum does not already hold a bitvector.
+    /// @param words    BITVECT_NATIVE_SIZE/64 words
+    void setWords(const uint64_t* words);
+
     /// Set an intnum to an unsigned integer.
     /// @param val      integer value
     void set(USmallValue val);
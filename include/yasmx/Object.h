@@ -48,6 +48,7 @@ namespace yasm
 
 class Arch;
 class Diagnostic;
+class OptimizerCache;
 class Section;
 class Symbol;
 
@@ -76,6 +77,20 @@ public:
         /// Advise linker that stack should be non-executable.
         /// Defaults to false.
         bool NoExecStack;
+
+        /// Expand spans in batches during optimization (see
+        /// Optimizer::Step2Batched()).  Defaults to false.
+        bool BatchOptimize;
+
+        /// Store duplicate strings once and share common string tails in
+        /// object format string tables.  Defaults to false.
+        bool MergeStrings;
+
+        /// Record the source location of each instruction in its section
+        /// (see BytecodeContainer::AddInsnSource()), for debug formats that
+        /// generate line information from the assembly source.
+        /// Defaults to false.
+        bool InsnSources;
     };
 
     /// Constructor.  A default section is created as the first
@@ -117,7 +132,9 @@ public:
     /// Optimize an object.  Takes the unoptimized object and optimizes it.
     /// If successful, the object is ready for output to an object file.
     /// @param diags    diagnostic reporting
-    void Optimize(Diagnostic& diags);
+    /// @param cache    optimizer cache to replay from and record into
+    ///                 (may be NULL)
+    void Optimize(Diagnostic& diags, OptimizerCache* cache = 0);
 
     /// Updates all bytecode offsets in object.
     /// @param diags    diagnostic reporting
@@ -271,9 +288,8 @@ private:
     Sections m_sections;
     stdx::ptr_vector_owner<Section> m_sections_owner;
 
-    /// Symbols in the symbol table
+    /// Symbols in the symbol table (owned by m_impl's symbol pool)
     Symbols m_symbols;
-    stdx::ptr_vector_owner<Symbol> m_symbols_owner;
 
     /// Pimpl for symbol table hash trie.
     class Impl;
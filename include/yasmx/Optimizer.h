@@ -39,13 +39,19 @@ namespace yasm
 
 class Bytecode;
 class Diagnostic;
+class OptimizerCache;
 class Value;
 
 /// Optimizer.  Determines jump sizes, offset setters, all offsets.
 class YASM_LIB_EXPORT Optimizer : public DebugDumper<Optimizer>
 {
 public:
-    Optimizer(Diagnostic& diags);
+    /// Constructor.
+    /// @param diags        diagnostic reporting
+    /// @param cache        optimizer cache; if non-NULL, runs of spans with
+    ///                     matching entries are replayed from the cache, and
+    ///                     all other runs are recorded into it
+    explicit Optimizer(Diagnostic& diags, OptimizerCache* cache = 0);
     ~Optimizer();
     void AddSpan(Bytecode& bc,
                  int id,
@@ -67,6 +73,14 @@ public:
     void Step1e();
     void Step2();
 
+    /// Alternative to Step2() that expands each queue as a batch and
+    /// propagates the length changes with a prefix-sum sweep over all span
+    /// terms.  Faster when many spans expand at once.  Sections with TIMES
+    /// or multi-term spans, or with a span across an align or org, are
+    /// left to Step2(), so the result is the same as Step2().
+    /// @return Number of span expansions done in batches.
+    unsigned long Step2Batched();
+
     // Step 3: update offsets
 
 #ifdef WITH_XML
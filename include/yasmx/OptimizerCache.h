@@ -0,0 +1,120 @@
+#ifndef YASM_OPTIMIZERCACHE_H
+#define YASM_OPTIMIZERCACHE_H
+///
+/// @file
+/// @brief Optimizer cache interface.
+///
+/// @license
+///  Copyright (C) 2011  PathScale Inc.
+///
+/// Redistribution and use in source and binary forms, with or without
+/// modification, are permitted provided that the following conditions
+/// are met:
+///  - Redistributions of source code must retain the above copyright
+///    notice, this list of conditions and the following disclaimer.
+///  - Redistributions in binary form must reproduce the above copyright
+///    notice, this list of conditions and the following disclaimer in the
+///    documentation and/or other materials provided with the distribution.
+///
+/// THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND OTHER CONTRIBUTORS ``AS IS''
+/// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+/// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+/// ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR OTHER CONTRIBUTORS BE
+/// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+/// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+/// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+/// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+/// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+/// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+/// POSSIBILITY OF SUCH DAMAGE.
+/// @endlicense
+#include <map>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/StringRef.h"
+#include "yasmx/Config/export.h"
+
+
+namespace llvm { class MemoryBuffer; class raw_ostream; }
+
+namespace yasm
+{
+
+/// Optimizer decisions persisted between assemblies.
+///
+/// The optimizer splits each section into runs of bytecodes whose spans
+/// only depend on each other.  For each run, it records the last
+/// Bytecode::Expand() call it makes on each span, keyed by a hash of the
+/// run's layout before optimization (bytecode lengths and types, span values
+/// and thresholds).  When a later assembly produces a run with the same key,
+/// the recorded expansions are replayed instead of running the span
+/// optimizer over that run, so an edit only re-optimizes the runs it touches.
+/// Replayed expansions are checked against the recorded outcome before
+/// anything is applied, so a stale entry only costs the check.
+class YASM_LIB_EXPORT OptimizerCache
+{
+public:
+    /// Size of a run key, in bytes.
+    enum { KEY_SIZE = 16 };
+
+    /// A recorded Bytecode::Expand() call and its outcome.
+    struct Expansion
+    {
+        unsigned long bc;       ///< bytecode index relative to run
+        int id;                 ///< span id
+        long old_val;           ///< previous span value
+        long new_val;           ///< new span value
+        unsigned long len;      ///< resulting tail length
+        long neg_thres;         ///< resulting negative threshold
+        long pos_thres;         ///< resulting positive threshold
+        bool keep;              ///< resulting keep (still dependent) flag
+    };
+    typedef std::vector<Expansion> Expansions;
+
+    OptimizerCache();
+    ~OptimizerCache();
+
+    /// Look up the expansions recorded for a run.
+    /// Marks the entry as used so it is kept by Write().
+    /// @param key      run key
+    /// @return Recorded expansions, or NULL if none.
+    const Expansions* Lookup(llvm::StringRef key);
+
+    /// Start recording a run.  Any existing entry for the key is
+    /// discarded.  The entry is marked as used.
+    /// @param key      run key
+    /// @return Empty expansion list to record into.
+    Expansions& Record(llvm::StringRef key);
+
+    /// Get the number of entries.
+    /// @return Number of entries.
+    size_t size() const { return m_entries.size(); }
+
+    /// Load entries from a buffer previously produced by Write().
+    /// Existing entries are kept unless replaced.
+    /// @param in       input buffer
+    /// @return False if the buffer is not a valid cache (nothing loaded).
+    bool Read(const llvm::MemoryBuffer& in);
+
+    /// Write the entries used since construction or Read().
+    /// @param os       output stream
+    void Write(llvm::raw_ostream& os) const;
+
+private:
+    OptimizerCache(const OptimizerCache&);                  // not implemented
+    const OptimizerCache& operator=(const OptimizerCache&); // not implemented
+
+    struct Entry
+    {
+        Entry() : used(false) {}
+        Expansions expansions;
+        bool used;
+    };
+    typedef std::map<std::string, Entry> Entries;
+    Entries m_entries;
+};
+
+} // namespace yasm
+
+#endif
@@ -131,10 +131,14 @@ public:
     /// tokens has a permanent owner somewhere, so they do not need to be copied.
     /// If it is true, it assumes the array of tokens is allocated with new[] and
     /// must be freed.
+    ///
+    /// The tokens are returned repeat_count times in succession (e.g. for
+    /// a repeat block) without copying them.
     void EnterTokenStream(const Token* toks,
                           unsigned int num_toks,
                           bool disable_macro_expansion,
-                          bool owns_tokens);
+                          bool owns_tokens,
+                          unsigned long repeat_count = 1);
 
     /// Pop the current lexer/macro exp off the top of the
     /// lexer stack.  This should only be used in situations where the current
@@ -77,6 +77,12 @@ class YASM_LIB_EXPORT TokenLexer
     /// This is the next token that Lex will return.
     unsigned m_cur_token;
 
+    /// The number of times the token stream is returned in total, and the
+    /// current (0-based) pass.  Repeated streams replay the single copy in
+    /// Tokens rather than storing each repetition.
+    unsigned long m_repeat_count;
+    unsigned long m_iteration;
+
     /// The source location range where this macro was instantiated.
     SourceLocation m_instantiate_loc_start, m_instantiate_loc_end;
 
@@ -118,21 +124,29 @@ public:
 #endif
     /// Create a TokenLexer for the specified token stream.  If 'OwnsTokens' is
     /// specified, this takes ownership of the tokens and delete[]'s them when
-    /// the token lexer is empty.
+    /// the token lexer is empty.  The stream is returned 'RepeatCount' times
+    /// in succession.
     TokenLexer(const Token* tok_array, unsigned num_toks,
-               bool disable_expansion, bool owns_tokens, Preprocessor& pp)
+               bool disable_expansion, bool owns_tokens, Preprocessor& pp,
+               unsigned long repeat_count = 1)
         : /*m_macro(0), m_actual_args(0),*/ m_pp(pp), m_owns_tokens(false)
     {
-        Init(tok_array, num_toks, disable_expansion, owns_tokens);
+        Init(tok_array, num_toks, disable_expansion, owns_tokens,
+             repeat_count);
     }
 
     /// Initialize this TokenLexer with the specified token stream.
     /// This does not take ownership of the specified token vector.
     ///
     /// DisableExpansion is true when macro expansion of tokens lexed from this
-    /// stream should be disabled.
+    /// stream should be disabled.  RepeatCount is the number of times the
+    /// stream is returned.
     void Init(const Token* tok_array, unsigned num_toks,
-              bool disable_macro_expansion, bool owns_tokens);
+              bool disable_macro_expansion, bool owns_tokens,
+              unsigned long repeat_count = 1);
+
+    /// Get the current (0-based) pass through a repeated token stream.
+    unsigned long getIteration() const { return m_iteration; }
 
     ~TokenLexer() { destroy(); }
 
@@ -151,7 +165,8 @@ private:
     /// include stack.
     bool isAtEnd() const
     {
-        return m_cur_token == m_num_tokens;
+        return m_cur_token == m_num_tokens &&
+            (m_num_tokens == 0 || m_iteration+1 >= m_repeat_count);
     }
 
 #if 0
@@ -32,6 +32,7 @@
 #include <memory>
 #include <string>
 
+#include "llvm/System/DataTypes.h"
 #include "yasmx/Config/export.h"
 #include "yasmx/DebugDumper.h"
 #include "yasmx/Expr.h"
@@ -47,13 +48,13 @@ namespace yasm
 class YASM_LIB_EXPORT Reloc : public DebugDumper<Reloc>
 {
 public:
-    Reloc(const IntNum& addr, SymbolRef sym);
+    Reloc(uint64_t addr, SymbolRef sym);
     virtual ~Reloc();
 
     SymbolRef getSymbol() { return m_sym; }
     const SymbolRef getSymbol() const { return m_sym; }
 
-    const IntNum& getAddress() const { return m_addr; }
+    uint64_t getAddress() const { return m_addr; }
 
     /// Get the relocated value as an expression.
     /// Should be overloaded by derived classes that have addends.
@@ -73,7 +74,7 @@ public:
 #endif // WITH_XML
 
 protected:
-    IntNum m_addr;      ///< Offset (address) within section
+    uint64_t m_addr;    ///< Offset (address) within section
     SymbolRef m_sym;    ///< Relocated symbol
 
 #ifdef WITH_XML
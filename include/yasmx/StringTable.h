@@ -29,8 +29,10 @@
 /// POSSIBILITY OF SUCH DAMAGE.
 /// @endlicense
 ///
+#include <utility>
 #include <vector>
 
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
 #include "yasmx/Config/export.h"
 
@@ -58,6 +60,7 @@ public:
                 unsigned long first_index=0)
         : m_storage(first, last)
         , m_first_index(first_index)
+        , m_intern(false)
     {}
 
     /// Destructor.
@@ -77,6 +80,24 @@ public:
     /// Throws out_of_range exception if index is out of range.
     llvm::StringRef getString(unsigned long index) const;
 
+    /// Enable or disable string interning.  While enabled, getIndex()
+    /// returns the index of an identical string already added (while
+    /// interning was enabled) instead of appending a duplicate.
+    /// @param intern   true to intern strings
+    void setInterning(bool intern=true) { m_intern = intern; }
+
+    /// Rebuild the table so that each distinct string is stored once and
+    /// strings that are tails of other strings (e.g. ".text" and
+    /// ".rela.text") share storage.  Indexes returned by getIndex() before
+    /// the merge must be translated with getMergedIndex().
+    void MergeTails();
+
+    /// Translate an index returned by getIndex() before MergeTails() to
+    /// an index into the merged table.
+    /// @param index    String index from before the merge
+    /// @return Merged string index.
+    unsigned long getMergedIndex(unsigned long index) const;
+
     /// Get the size of the string table.
     /// @return Size in bytes.
     unsigned long getSize() const { return m_storage.size(); }
@@ -94,6 +115,19 @@ public:
 private:
     std::vector<char> m_storage;
     unsigned long m_first_index;
+
+    /// Interning enabled?
+    bool m_intern;
+
+    /// Index of each interned string.
+    llvm::StringMap<unsigned long> m_interned;
+
+    /// Storage offset of each string added with getIndex().
+    std::vector<unsigned long> m_offsets;
+
+    /// (old offset, new offset) pairs from the last MergeTails(),
+    /// sorted by old offset.
+    std::vector<std::pair<unsigned long, unsigned long> > m_merged;
 };
 
 } // namespace yasm
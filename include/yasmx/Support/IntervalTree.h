@@ -17,10 +17,10 @@
 #include <cassert>
 #include <climits>
 #include <cstdlib>
-#include <vector>
+#include <deque>
 
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/Support/raw_ostream.h"
-#include "yasmx/Config/functional.h"
 
 
 namespace yasm
@@ -69,8 +69,8 @@ public:
     IntervalTreeNode<T>* Insert(long low, long high, T data);
     IntervalTreeNode<T>* getPredecessor(IntervalTreeNode<T>*) const;
     IntervalTreeNode<T>* getSuccessor(IntervalTreeNode<T>*) const;
-    void Enumerate(long low, long high,
-                   TR1::function<void (IntervalTreeNode<T>*)> callback);
+    template <typename Func>
+    void Enumerate(long low, long high, Func callback);
     void Put(llvm::raw_ostream& os) const;
 #ifdef YASM_INTERVAL_TREE_CHECK_ASSUMPTIONS
     void CheckAssumptions() const;
@@ -102,6 +102,11 @@ protected:
     IntervalTreeNode<T>* m_root;
     IntervalTreeNode<T>* m_nil;
 
+    // Storage for all nodes, so that nodes are not allocated one at a time
+    // and are laid out roughly in insertion order.  Deleted nodes are not
+    // reused; their storage is released with the tree.
+    std::deque<IntervalTreeNode<T> > m_nodes;
+
     void LeftRotate(IntervalTreeNode<T>*);
     void RightRotate(IntervalTreeNode<T>*);
     void TreeInsertHelp(IntervalTreeNode<T>*);
@@ -439,7 +444,8 @@ IntervalTree<T>::Insert(long low, long high, T data)
 {
     IntervalTreeNode<T> *x, *y, *newNode;
 
-    x = new IntervalTreeNode<T>(low, high, data);
+    m_nodes.push_back(IntervalTreeNode<T>(low, high, data));
+    x = &m_nodes.back();
     TreeInsertHelp(x);
     FixUpMaxHigh(x->parent);
     newNode = x;
@@ -645,29 +651,6 @@ IntervalTree<T>::Put(llvm::raw_ostream& os) const
 template <typename T>
 IntervalTree<T>::~IntervalTree()
 {
-    IntervalTreeNode<T>* x = m_root->left;
-    std::vector<IntervalTreeNode<T>*> stuffToFree;
-
-    if (x != m_nil)
-    {
-        if (x->left != m_nil)
-            stuffToFree.push_back(x->left);
-        if (x->right != m_nil)
-            stuffToFree.push_back(x->right);
-        delete x;
-        while (!stuffToFree.empty())
-        {
-            x = stuffToFree.back();
-            stuffToFree.pop_back();
-
-            if (x->left != m_nil)
-                stuffToFree.push_back(x->left);
-            if (x->right != m_nil)
-                stuffToFree.push_back(x->right);
-            delete x;
-        }
-    }
-
     delete m_nil;
     delete m_root;
 }
@@ -831,7 +814,7 @@ IntervalTree<T>::DeleteNode(IntervalTreeNode<T>* z, long& low, long& high)
         }
         else
             y->red = z->red;
-        delete z;
+        // z's storage is owned by m_nodes
 #ifdef YASM_INTERVAL_TREE_CHECK_ASSUMPTIONS
         CheckAssumptions();
 #else
@@ -844,7 +827,7 @@ IntervalTree<T>::DeleteNode(IntervalTreeNode<T>* z, long& low, long& high)
         FixUpMaxHigh(x->parent);
         if (!(y->red))
             DeleteFixUp(x);
-        delete y;
+        // y's storage is owned by m_nodes
 #ifdef YASM_INTERVAL_TREE_CHECK_ASSUMPTIONS
         CheckAssumptions();
 #else
@@ -895,11 +878,11 @@ IntervalTree<T>::DeleteNode(IntervalTreeNode<T>* z, long& low, long& high)
  * of the left child of root as well as the right child of root.
  */
 template <typename T>
+template <typename Func>
 void
-IntervalTree<T>::Enumerate(long low, long high,
-    TR1::function<void (IntervalTreeNode<T>*)> callback)
+IntervalTree<T>::Enumerate(long low, long high, Func callback)
 {
-    std::vector<RecursionNode> recursionNodeStack(1);
+    llvm::SmallVector<RecursionNode, 32> recursionNodeStack(1);
 
     IntervalTreeNode<T>* x=m_root->left;
     bool stuffToDo = (x != m_nil);
@@ -21,6 +21,7 @@ namespace yasm
 
 class YASM_LIB_EXPORT MD5
 {
+public:
     MD5();
 
     void Init();
@@ -53,6 +53,8 @@ class YASM_LIB_EXPORT Symbol : public AssocDataContainer
 
 public:
     /// Constructor.
+    /// @param name     symbol name; not copied, so the storage must outlive
+    ///                 the symbol (Object keeps symbol names in an arena)
     explicit Symbol(llvm::StringRef name);
 
     /// Destructor.
@@ -230,7 +232,7 @@ private:
 
     bool DefineCheck(SourceLocation source, Diagnostic& diags) const;
 
-    std::string m_name;
+    llvm::StringRef m_name;         ///< name (storage owned by Object)
     Type m_type;
     int m_status;
     int m_visibility;
@@ -32,6 +32,9 @@
 #if defined(HAVE_FCNTL_H)
 # include <fcntl.h>
 #endif
+#if !defined(_MSC_VER) && !defined(__MINGW32__)
+# include <sys/uio.h>
+#endif
 
 #if defined(_MSC_VER)
 #include <io.h>
@@ -69,6 +72,17 @@ raw_ostream::~raw_ostream() {
 // An out of line virtual method to provide a home for the class vtable.
 void raw_ostream::handle() {}
 
+void raw_ostream::writev_impl(const char *Ptr1, size_t Size1,
+                              const char *Ptr2, size_t Size2) {
+  if (Size1 != 0)
+    write_impl(Ptr1, Size1);
+  write_impl(Ptr2, Size2);
+}
+
+bool raw_ostream::skip_impl(uint64_t Size) {
+  return false;
+}
+
 size_t raw_ostream::preferred_buffer_size() const {
   // BUFSIZ is intended to be a reasonable default.
   return BUFSIZ;
@@ -257,15 +271,21 @@ raw_ostream &raw_ostream::write(const char *Ptr, size_t Size) {
       return write(Ptr, Size);
     }
 
-    // Write out the data in buffer-sized blocks until the remainder
-    // fits within the buffer.
-    do {
-      size_t NumBytes = OutBufEnd - OutBufCur;
-      copy_to_buffer(Ptr, NumBytes);
-      flush_nonempty();
-      Ptr += NumBytes;
-      Size -= NumBytes;
-    } while (OutBufCur+Size > OutBufEnd);
+    // Data at least as large as the buffer is handed over together with
+    // whatever is buffered, rather than copied through the buffer.
+    if (Size >= size_t(OutBufEnd - OutBufStart)) {
+      size_t Length = OutBufCur - OutBufStart;
+      OutBufCur = OutBufStart;
+      writev_impl(OutBufStart, Length, Ptr, Size);
+      return *this;
+    }
+
+    // Otherwise fill up and flush the buffer; the remainder then fits.
+    size_t NumBytes = OutBufEnd - OutBufCur;
+    copy_to_buffer(Ptr, NumBytes);
+    flush_nonempty();
+    Ptr += NumBytes;
+    Size -= NumBytes;
   }
 
   copy_to_buffer(Ptr, Size);
@@ -333,6 +353,22 @@ raw_ostream &raw_ostream::operator<<(const format_object_base &Fmt) {
   }
 }
 
+/// write_zeros - Output zero bytes, leaving a hole if the stream can.
+raw_ostream &raw_ostream::write_zeros(uint64_t NumZeros) {
+  static const char Zeros[4096] = {0};
+
+  if (skip_impl(NumZeros))
+    return *this;
+
+  while (NumZeros) {
+    size_t NumToWrite = NumZeros < sizeof(Zeros) ? size_t(NumZeros)
+                                                 : sizeof(Zeros);
+    write(Zeros, NumToWrite);
+    NumZeros -= NumToWrite;
+  }
+  return *this;
+}
+
 /// indent - Insert 'NumSpaces' spaces.
 raw_ostream &raw_ostream::indent(unsigned NumSpaces) {
   static const char Spaces[] = "                                "
@@ -370,7 +406,7 @@ void format_object_base::home() {
 /// stream should be immediately destroyed; the string will be empty
 /// if no error occurred.
 raw_fd_ostream::raw_fd_ostream(const char *Filename, std::string &ErrorInfo,
-                               unsigned Flags) : pos(0) {
+                               unsigned Flags) : pos(0), hole_end(0) {
   assert(Filename != 0 && "Filename is null");
   // Verify that we don't have both "append" and "excl".
   assert((!(Flags & F_Excl) || !(Flags & F_Append)) &&
@@ -419,7 +455,7 @@ raw_fd_ostream::raw_fd_ostream(const char *Filename, std::string &ErrorInfo,
 
 raw_fd_ostream::~raw_fd_ostream() {
   if (FD < 0) return;
-  flush();
+  finish();
   if (ShouldClose)
     while (::close(FD) != 0)
       if (errno != EINTR) {
@@ -468,7 +504,7 @@ void raw_fd_ostream::write_impl(const char *Ptr, size_t Size) {
 void raw_fd_ostream::close() {
   assert(ShouldClose);
   ShouldClose = false;
-  flush();
+  finish();
   while (::close(FD) != 0)
     if (errno != EINTR) {
       error_detected();
@@ -477,6 +513,96 @@ void raw_fd_ostream::close() {
   FD = -1;
 }
 
+void raw_fd_ostream::writev_impl(const char *Ptr1, size_t Size1,
+                                 const char *Ptr2, size_t Size2) {
+#if !defined(_MSC_VER) && !defined(__MINGW32__)
+  assert(FD >= 0 && "File already closed.");
+  pos += Size1 + Size2;
+
+  struct iovec iov[2];
+  iov[0].iov_base = const_cast<char *>(Ptr1);
+  iov[0].iov_len = Size1;
+  iov[1].iov_base = const_cast<char *>(Ptr2);
+  iov[1].iov_len = Size2;
+  struct iovec *Vec = Size1 != 0 ? iov : iov+1;
+  int Count = Size1 != 0 ? 2 : 1;
+
+  do {
+    ssize_t ret = ::writev(FD, Vec, Count);
+
+    if (ret < 0) {
+      // Retry recoverable errors as write_impl does.
+      if (errno == EINTR || errno == EAGAIN
+#ifdef EWOULDBLOCK
+          || errno == EWOULDBLOCK
+#endif
+          )
+        continue;
+
+      error_detected();
+      break;
+    }
+
+    // Step past whatever was written.
+    size_t Written = ret;
+    while (Count > 0 && Written >= Vec->iov_len) {
+      Written -= Vec->iov_len;
+      ++Vec;
+      --Count;
+    }
+    if (Count > 0) {
+      Vec->iov_base = static_cast<char *>(Vec->iov_base) + Written;
+      Vec->iov_len -= Written;
+    }
+  } while (Count > 0);
+#else
+  raw_ostream::writev_impl(Ptr1, Size1, Ptr2, Size2);
+#endif
+}
+
+bool raw_fd_ostream::skip_impl(uint64_t Size) {
+#if !defined(_MSC_VER) && !defined(__MINGW32__)
+  // Smaller runs are cheaper to write than to seek over.
+  static const uint64_t MinHoleSize = 64*1024;
+  if (Size < MinHoleSize)
+    return false;
+
+  // Only leave a hole when extending a regular file at the current
+  // position; anything else must really be overwritten with zeros.
+  int Flags = ::fcntl(FD, F_GETFL);
+  if (Flags == -1 || (Flags & O_APPEND))
+    return false;
+  flush();
+  struct stat statbuf;
+  if (fstat(FD, &statbuf) != 0 || !S_ISREG(statbuf.st_mode) ||
+      uint64_t(statbuf.st_size) > pos ||
+      ::lseek(FD, 0, SEEK_CUR) != off_t(pos))
+    return false;
+
+  uint64_t end = pos + Size;
+  if (::lseek(FD, end, SEEK_SET) != off_t(end))
+    return false;
+  pos = hole_end = end;
+  return true;
+#else
+  return false;
+#endif
+}
+
+void raw_fd_ostream::finish() {
+  flush();
+#if !defined(_MSC_VER) && !defined(__MINGW32__)
+  if (hole_end != 0) {
+    // Nothing may have been written after the last hole.
+    struct stat statbuf;
+    if (fstat(FD, &statbuf) == 0 && uint64_t(statbuf.st_size) < hole_end &&
+        ::ftruncate(FD, hole_end) != 0)
+      error_detected();
+    hole_end = 0;
+  }
+#endif
+}
+
 uint64_t raw_fd_ostream::seek(uint64_t off) {
   flush();
   pos = ::lseek(FD, off, SEEK_SET);
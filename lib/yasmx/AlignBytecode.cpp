@@ -76,6 +76,8 @@ public:
 
     SpecialType getSpecial() const;
 
+    unsigned long getOffsetPeriod() const;
+
     AlignBytecode* clone() const;
 
 #ifdef WITH_XML
@@ -304,6 +306,19 @@ AlignBytecode::getSpecial() const
     return SPECIAL_OFFSET;
 }
 
+unsigned long
+AlignBytecode::getOffsetPeriod() const
+{
+    // Expand() pads (with or without maxskip) based on the offset bits
+    // below the boundary, so the length repeats every power of two that
+    // covers the boundary (0 if none fits).
+    unsigned long boundary = m_boundary.getIntNum().getUInt();
+    unsigned long period = 1;
+    while (period != 0 && period < boundary)
+        period <<= 1;
+    return period;
+}
+
 AlignBytecode*
 AlignBytecode::clone() const
 {
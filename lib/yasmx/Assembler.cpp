@@ -27,6 +27,7 @@
 #include "yasmx/Assembler.h"
 
 #include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
 #include "llvm/System/Path.h"
 #include "yasmx/Basic/Diagnostic.h"
 #include "yasmx/Basic/SourceManager.h"
@@ -71,7 +72,8 @@ Assembler::Assembler(llvm::StringRef arch_keyword,
       m_dbgfmt(0),
       m_listfmt(0),
       m_object(0),
-      m_dump_time(dump_time)
+      m_dump_time(dump_time),
+      m_opt_cache(0)
 {
     if (m_arch_module.get() == 0)
     {
@@ -327,7 +329,7 @@ Assembler::Assemble(SourceManager& source_mgr, Diagnostic& diags)
         return false;
 
     // Optimize
-    m_object->Optimize(diags);
+    m_object->Optimize(diags, m_opt_cache);
 
     if (m_dump_time == Assembler::DUMP_AFTER_OPTIMIZE)
         m_object->Dump();
@@ -344,6 +346,12 @@ Assembler::Assemble(SourceManager& source_mgr, Diagnostic& diags)
 bool
 Assembler::Output(llvm::raw_fd_ostream& os, Diagnostic& diags)
 {
+    // Object formats write many small pieces; stage them in a large buffer
+    // so they reach the file in few system calls.
+    static const size_t OUTPUT_BUFFER_SIZE = 256*1024;
+    if (os.GetBufferSize() < OUTPUT_BUFFER_SIZE)
+        os.SetBufferSize(OUTPUT_BUFFER_SIZE);
+
     // Write the object file
     m_objfmt->Output(os,
                      !m_dbgfmt_module->getKeyword().equals_lower("null"),
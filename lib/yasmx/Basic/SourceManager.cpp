@@ -810,6 +810,207 @@ unsigned SourceManager::getInstantiationColumnNumber(SourceLocation Loc,
   return getColumnNumber(LocInfo.first, LocInfo.second, Invalid);
 }
 
+//===----------------------------------------------------------------------===//
+// Line Offset Scanning
+//===----------------------------------------------------------------------===//
+
+// Line offsets are found a block of 32 bytes at a time: each block is turned
+// into a bitmask of its '\n', '\r' and '\0' bytes, and only the set bits are
+// looked at individually.  SSE2 is part of the x86-64 baseline; AVX2 is used
+// when the running CPU supports it.
+#if defined(__GNUC__) && defined(__SSE2__) && \
+    (defined(__x86_64__) || defined(__i386__))
+#define YASM_LINESCAN_SSE2 1
+#include <emmintrin.h>
+#if defined(__clang__) || __GNUC__ > 4 || \
+    (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#define YASM_LINESCAN_AVX2 1
+#include <immintrin.h>
+#endif
+#endif
+
+/// isLineBreak - Return true if C is '\n' or '\r'.
+static inline bool isLineBreak(unsigned char C) {
+  return C == '\n' || C == '\r';
+}
+
+/// CountLineBreaksScalar - Count the '\n' and '\r' bytes in [Buf, End).
+static unsigned CountLineBreaksScalar(const unsigned char *Buf,
+                                      const unsigned char *End) {
+  unsigned Count = 0;
+  for (; Buf != End; ++Buf)
+    if (isLineBreak(*Buf))
+      ++Count;
+  return Count;
+}
+
+/// FindLineOffsetsScalar - Append the offset (relative to Start) of each line
+/// beginning in [Buf, End) to Out.  End must point to a null.  Returns the
+/// new end of Out.
+static unsigned *FindLineOffsetsScalar(const unsigned char *Start,
+                                       const unsigned char *Buf,
+                                       const unsigned char *End,
+                                       unsigned *Out) {
+  while (1) {
+    // Skip over the contents of the line.
+    while (*Buf != '\n' && *Buf != '\r' && *Buf != '\0')
+      ++Buf;
+
+    if (isLineBreak(Buf[0])) {
+      // If this is \n\r or \r\n, skip both characters.
+      if (isLineBreak(Buf[1]) && Buf[0] != Buf[1])
+        ++Buf;
+      ++Buf;
+      *Out++ = Buf - Start;
+    } else {
+      // Otherwise, this is a null.  If end of file, exit.
+      if (Buf == End) break;
+      // Otherwise, skip the null.
+      ++Buf;
+    }
+  }
+  return Out;
+}
+
+#ifdef YASM_LINESCAN_SSE2
+/// AddBlockLineOffsets - Append the line offsets for a 32-byte block given
+/// the mask of its '\n', '\r' and '\0' bytes.  The block must not contain the
+/// terminating null.  Next is the position to continue scanning from; it is
+/// moved past the block when a \r\n pair straddles the block boundary.
+static inline unsigned *AddBlockLineOffsets(const unsigned char *Start,
+                                            const unsigned char *Block,
+                                            uint32_t Mask, unsigned *Out,
+                                            const unsigned char *&Next) {
+  while (Mask) {
+    unsigned Bit = __builtin_ctz(Mask);
+    Mask &= Mask - 1;
+    const unsigned char *C = Block + Bit;
+    if (*C == '\0')
+      continue;         // Embedded nulls are skipped.
+    // If this is \n\r or \r\n, the line starts after both characters.
+    if (isLineBreak(C[1]) && C[0] != C[1]) {
+      ++C;
+      if (Bit == 31)
+        Next = C + 1;
+      else
+        Mask &= ~(1U << (Bit+1));
+    }
+    *Out++ = C + 1 - Start;
+  }
+  return Out;
+}
+
+/// MaskSSE2 - Return the 32-bit mask of '\n' and '\r' (and '\0' if WithNull)
+/// bytes at Buf.
+static inline uint32_t MaskSSE2(const unsigned char *Buf, bool WithNull) {
+  const __m128i NL = _mm_set1_epi8('\n');
+  const __m128i CR = _mm_set1_epi8('\r');
+  const __m128i Lo = _mm_loadu_si128((const __m128i *)Buf);
+  const __m128i Hi = _mm_loadu_si128((const __m128i *)(Buf + 16));
+  __m128i MLo = _mm_or_si128(_mm_cmpeq_epi8(Lo, NL), _mm_cmpeq_epi8(Lo, CR));
+  __m128i MHi = _mm_or_si128(_mm_cmpeq_epi8(Hi, NL), _mm_cmpeq_epi8(Hi, CR));
+  if (WithNull) {
+    const __m128i Zero = _mm_setzero_si128();
+    MLo = _mm_or_si128(MLo, _mm_cmpeq_epi8(Lo, Zero));
+    MHi = _mm_or_si128(MHi, _mm_cmpeq_epi8(Hi, Zero));
+  }
+  return (uint32_t)_mm_movemask_epi8(MLo) |
+         ((uint32_t)_mm_movemask_epi8(MHi) << 16);
+}
+
+static unsigned CountLineBreaksSSE2(const unsigned char *Buf,
+                                    const unsigned char *End) {
+  unsigned Count = 0;
+  for (; End - Buf >= 32; Buf += 32)
+    Count += __builtin_popcount(MaskSSE2(Buf, false));
+  return Count + CountLineBreaksScalar(Buf, End);
+}
+
+static unsigned *FindLineOffsetsSSE2(const unsigned char *Start,
+                                     const unsigned char *End,
+                                     unsigned *Out) {
+  const unsigned char *Buf = Start;
+  while (End - Buf >= 32) {
+    const unsigned char *Next = Buf + 32;
+    Out = AddBlockLineOffsets(Start, Buf, MaskSSE2(Buf, true), Out, Next);
+    Buf = Next;
+  }
+  return FindLineOffsetsScalar(Start, Buf, End, Out);
+}
+#endif // YASM_LINESCAN_SSE2
+
+#ifdef YASM_LINESCAN_AVX2
+/// MaskAVX2 - Return the 32-bit mask of '\n' and '\r' (and '\0' if WithNull)
+/// bytes at Buf.
+__attribute__((target("avx2")))
+static inline uint32_t MaskAVX2(const unsigned char *Buf, bool WithNull) {
+  const __m256i V = _mm256_loadu_si256((const __m256i *)Buf);
+  __m256i M = _mm256_or_si256(_mm256_cmpeq_epi8(V, _mm256_set1_epi8('\n')),
+                              _mm256_cmpeq_epi8(V, _mm256_set1_epi8('\r')));
+  if (WithNull)
+    M = _mm256_or_si256(M, _mm256_cmpeq_epi8(V, _mm256_setzero_si256()));
+  return (uint32_t)_mm256_movemask_epi8(M);
+}
+
+__attribute__((target("avx2")))
+static unsigned CountLineBreaksAVX2(const unsigned char *Buf,
+                                    const unsigned char *End) {
+  unsigned Count = 0;
+  for (; End - Buf >= 32; Buf += 32)
+    Count += __builtin_popcount(MaskAVX2(Buf, false));
+  return Count + CountLineBreaksScalar(Buf, End);
+}
+
+__attribute__((target("avx2")))
+static unsigned *FindLineOffsetsAVX2(const unsigned char *Start,
+                                     const unsigned char *End,
+                                     unsigned *Out) {
+  const unsigned char *Buf = Start;
+  while (End - Buf >= 32) {
+    const unsigned char *Next = Buf + 32;
+    Out = AddBlockLineOffsets(Start, Buf, MaskAVX2(Buf, true), Out, Next);
+    Buf = Next;
+  }
+  return FindLineOffsetsScalar(Start, Buf, End, Out);
+}
+
+static bool hasAVX2() {
+  static const bool HasAVX2 = __builtin_cpu_supports("avx2");
+  return HasAVX2;
+}
+#endif // YASM_LINESCAN_AVX2
+
+/// CountLineBreaks - Return the number of '\n' and '\r' bytes in [Buf, End).
+/// This is an upper bound on the number of lines after the first.
+static unsigned CountLineBreaks(const unsigned char *Buf,
+                                const unsigned char *End) {
+#ifdef YASM_LINESCAN_AVX2
+  if (hasAVX2())
+    return CountLineBreaksAVX2(Buf, End);
+#endif
+#ifdef YASM_LINESCAN_SSE2
+  return CountLineBreaksSSE2(Buf, End);
+#else
+  return CountLineBreaksScalar(Buf, End);
+#endif
+}
+
+/// FindLineOffsets - Write the file offsets of all of the *physical* source
+/// lines after the first in the null-terminated buffer [Start, End) to Out.
+/// Returns the new end of Out.
+static unsigned *FindLineOffsets(const unsigned char *Start,
+                                 const unsigned char *End, unsigned *Out) {
+#ifdef YASM_LINESCAN_AVX2
+  if (hasAVX2())
+    return FindLineOffsetsAVX2(Start, End, Out);
+#endif
+#ifdef YASM_LINESCAN_SSE2
+  return FindLineOffsetsSSE2(Start, End, Out);
+#else
+  return FindLineOffsetsScalar(Start, Start, End, Out);
+#endif
+}
+
 static DISABLE_INLINE void
 ComputeLineNumbers(Diagnostic &Diag, ContentCache *FI,
                    llvm::BumpPtrAllocator &Alloc,
@@ -825,42 +1026,18 @@ static void ComputeLineNumbers(Diagnostic &Diag, ContentCache *FI,
 
   // Find the file offsets of all of the *physical* source lines.  This does
   // not look at trigraphs, escaped newlines, or anything else tricky.
-  std::vector<unsigned> LineOffsets;
-
-  // Line #1 starts at char 0.
-  LineOffsets.push_back(0);
-
+  // Every line after the first starts after a '\n' or '\r', so counting
+  // those gives an upper bound on the table size and the offsets can be
+  // written directly into the allocator.
   const unsigned char *Buf = (const unsigned char *)Buffer->getBufferStart();
   const unsigned char *End = (const unsigned char *)Buffer->getBufferEnd();
-  unsigned Offs = 0;
-  while (1) {
-    // Skip over the contents of the line.
-    // TODO: Vectorize this?  This is very performance sensitive for programs
-    // with lots of diagnostics and in -E mode.
-    const unsigned char *NextBuf = (const unsigned char *)Buf;
-    while (*NextBuf != '\n' && *NextBuf != '\r' && *NextBuf != '\0')
-      ++NextBuf;
-    Offs += NextBuf-Buf;
-    Buf = NextBuf;
-
-    if (Buf[0] == '\n' || Buf[0] == '\r') {
-      // If this is \n\r or \r\n, skip both characters.
-      if ((Buf[1] == '\n' || Buf[1] == '\r') && Buf[0] != Buf[1])
-        ++Offs, ++Buf;
-      ++Offs, ++Buf;
-      LineOffsets.push_back(Offs);
-    } else {
-      // Otherwise, this is a null.  If end of file, exit.
-      if (Buf == End) break;
-      // Otherwise, skip the null.
-      ++Offs, ++Buf;
-    }
-  }
+  unsigned *LineOffsets =
+    Alloc.Allocate<unsigned>(CountLineBreaks(Buf, End) + 1);
 
-  // Copy the offsets into the FileInfo structure.
-  FI->NumLines = LineOffsets.size();
-  FI->SourceLineCache = Alloc.Allocate<unsigned>(LineOffsets.size());
-  std::copy(LineOffsets.begin(), LineOffsets.end(), FI->SourceLineCache);
+  // Line #1 starts at char 0.
+  LineOffsets[0] = 0;
+  FI->NumLines = FindLineOffsets(Buf, End, LineOffsets + 1) - LineOffsets;
+  FI->SourceLineCache = LineOffsets;
 }
 
 /// getLineNumber - Given a SourceLocation, return the spelling line number
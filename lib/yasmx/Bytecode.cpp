@@ -80,6 +80,12 @@ Bytecode::Contents::getSpecial() const
     return SPECIAL_NONE;
 }
 
+unsigned long
+Bytecode::Contents::getOffsetPeriod() const
+{
+    return 0;
+}
+
 Bytecode::Contents::Contents(const Contents& rhs)
 {
 }
@@ -110,7 +116,9 @@ Bytecode::Bytecode()
 }
 
 Bytecode::Bytecode(const Bytecode& oth)
-    : m_contents(oth.m_contents->clone()),
+    : m_fixed(oth.m_fixed),
+      m_fixed_fixups(oth.m_fixed_fixups),
+      m_contents(oth.m_contents.get() ? oth.m_contents->clone() : 0),
       m_container(oth.m_container),
       m_len(oth.m_len),
       m_source(oth.m_source),
@@ -281,22 +289,45 @@ Bytecode::UpdateOffset(unsigned long offset, Diagnostic& diags)
     return getNextOffset();
 }
 
+// Append a fixup by swapping it into place.  Copying a fixup deep copies
+// its expressions, so this also avoids the copies std::vector would make
+// when growing.
+static Bytecode::Fixup&
+PushFixup(std::vector<Bytecode::Fixup>& fixups, Bytecode::Fixup& fixup)
+{
+    Bytecode::Fixup empty(0, Value(0));
+    if (fixups.size() == fixups.capacity())
+    {
+        std::vector<Bytecode::Fixup> grown;
+        grown.reserve(fixups.empty() ? 1 : 2*fixups.size());
+        grown.resize(fixups.size(), empty);
+        for (std::vector<Bytecode::Fixup>::size_type i=0, n=fixups.size();
+             i<n; ++i)
+            grown[i].swap(fixups[i]);
+        fixups.swap(grown);
+    }
+    fixups.push_back(empty);
+    fixups.back().swap(fixup);
+    ++num_fixed_value;
+    return fixups.back();
+}
+
 void
 Bytecode::AppendFixed(const Value& val)
 {
     unsigned int valsize = val.getSize()/8;
-    m_fixed_fixups.push_back(Fixup(m_fixed.size(), val));
+    Fixup fixup(m_fixed.size(), val);
+    PushFixup(m_fixed_fixups, fixup);
     m_fixed.Write(valsize, 0);
-    ++num_fixed_value;
 }
 
 void
 Bytecode::AppendFixed(std::auto_ptr<Value> val)
 {
     unsigned int valsize = val->getSize()/8;
-    m_fixed_fixups.push_back(Fixup(m_fixed.size(), val));
+    Fixup fixup(m_fixed.size(), val);
+    PushFixup(m_fixed_fixups, fixup);
     m_fixed.Write(valsize, 0);
-    ++num_fixed_value;
 }
 
 Value&
@@ -304,10 +335,10 @@ Bytecode::AppendFixed(unsigned int size,
                       std::auto_ptr<Expr> e,
                       SourceLocation source)
 {
-    m_fixed_fixups.push_back(Fixup(m_fixed.size(), size*8, e, source));
+    Fixup fixup(m_fixed.size(), size*8, e, source);
+    Value& val = PushFixup(m_fixed_fixups, fixup);
     m_fixed.Write(size, 0);
-    ++num_fixed_value;
-    return m_fixed_fixups.back();
+    return val;
 }
 
 #ifdef WITH_XML
@@ -26,11 +26,14 @@
 //
 #include "yasmx/BytecodeContainer.h"
 
+#include <new>
+
 #include "yasmx/Basic/Diagnostic.h"
 #include "yasmx/BytecodeOutput.h"
 #include "yasmx/Bytecode.h"
 #include "yasmx/Expr.h"
 #include "yasmx/Optimizer.h"
+#include "yasmx/Section.h"
 
 
 using namespace yasm;
@@ -134,7 +137,10 @@ GapBytecode::Write(pugi::xml_node out) const
 
 BytecodeContainer::BytecodeContainer(Section* sect)
     : m_sect(sect),
-      m_bcs_owner(m_bcs),
+      // Only a section's own container grows large; nested containers
+      // (TIMES contents) usually hold one or two bytecodes.
+      m_bcs_pool(sect && static_cast<BytecodeContainer*>(sect) == this ?
+                 4096 : sizeof(llvm::MemSlab) + 2*sizeof(Bytecode)),
       m_last_gap(false)
 {
     // A container always has at least one bytecode.
@@ -150,8 +156,11 @@ BytecodeContainer::AppendBytecode(std::auto_ptr<Bytecode> bc)
 {
     if (bc.get() != 0)
     {
-        bc->m_container = this; // record parent
-        m_bcs.push_back(bc.release());
+        // Move into pool storage; the original is freed on return.
+        Bytecode* pbc = new (m_bcs_pool.Allocate()) Bytecode;
+        pbc->swap(*bc);
+        pbc->m_container = this; // record parent
+        m_bcs.push_back(pbc);
     }
     m_last_gap = false;
 }
@@ -171,10 +180,27 @@ BytecodeContainer::AppendGap(unsigned long size, SourceLocation source)
     return bc;
 }
 
+std::auto_ptr<BytecodeContainer>
+BytecodeContainer::CloneBytecodes() const
+{
+    std::auto_ptr<BytecodeContainer> copy(new BytecodeContainer(0));
+
+    // Drop the initial bytecode; the pool destroys it with the container.
+    copy->m_bcs.pop_back();
+    for (const_bc_iterator bc=m_bcs.begin(), end=m_bcs.end(); bc != end; ++bc)
+    {
+        Bytecode* pbc = new (copy->m_bcs_pool.Allocate()) Bytecode(*bc);
+        pbc->m_container = copy.get(); // record parent
+        copy->m_bcs.push_back(pbc);
+    }
+    copy->m_last_gap = m_last_gap;
+    return copy;
+}
+
 Bytecode&
 BytecodeContainer::StartBytecode()
 {
-    Bytecode* bc = new Bytecode;
+    Bytecode* bc = new (m_bcs_pool.Allocate()) Bytecode;
     bc->m_container = this; // record parent
     m_bcs.push_back(bc);
     m_last_gap = false;
@@ -190,6 +216,13 @@ BytecodeContainer::FreshBytecode()
     return bc;
 }
 
+void
+BytecodeContainer::AddInsnSource(SourceLocation source)
+{
+    InsnSource insn = { getEndLoc(), source };
+    m_insn_sources.push_back(insn);
+}
+
 Location
 BytecodeContainer::getEndLoc()
 {
@@ -55,6 +55,26 @@ BytecodeOutput::ConvertSymbolToBytes(SymbolRef sym,
     return true;
 }
 
+void
+BytecodeOutput::DoOutputBorrowed(const unsigned char* data,
+                                 unsigned long size,
+                                 SourceLocation source)
+{
+    // Copy through a bounded buffer so memory use does not grow with size.
+    static const unsigned long CHUNK_SIZE = 64*1024;
+
+    Bytes& bytes = m_chunk_scratch;
+    while (size > 0)
+    {
+        unsigned long tocopy = size < CHUNK_SIZE ? size : CHUNK_SIZE;
+        bytes.resize(0);
+        bytes.Write(data, tocopy);
+        DoOutputBytes(bytes, source);
+        data += tocopy;
+        size -= tocopy;
+    }
+}
+
 BytecodeNoOutput::~BytecodeNoOutput()
 {
 }
@@ -88,6 +108,16 @@ BytecodeNoOutput::DoOutputBytes(const Bytes& bytes, SourceLocation source)
     Diag(source, diag::warn_nobits_data);
 }
 
+void
+BytecodeNoOutput::DoOutputBorrowed(const unsigned char* data,
+                                   unsigned long size,
+                                   SourceLocation source)
+{
+    if (size == 0)
+        return;
+    Diag(source, diag::warn_nobits_data);
+}
+
 BytecodeStreamOutput::~BytecodeStreamOutput()
 {
 }
@@ -96,23 +126,13 @@ void
 BytecodeStreamOutput::DoOutputGap(unsigned long size, SourceLocation source)
 {
     // Warn that gaps are converted to 0 and write out the 0's.
-    static const unsigned long BLOCK_SIZE = 4096;
-
     if (size == 0)
         return;
 
     Diag(source, diag::warn_uninit_zero);
 
-    // Write out in chunks
-    Bytes& bytes = getScratch();
-    bytes.resize(BLOCK_SIZE);
-    while (size > BLOCK_SIZE)
-    {
-        m_os << bytes;
-        size -= BLOCK_SIZE;
-    }
-    bytes.resize(size);
-    m_os << bytes;
+    // Large gaps in a file being extended become holes.
+    m_os.write_zeros(size);
 }
 
 void
@@ -121,3 +141,13 @@ BytecodeStreamOutput::DoOutputBytes(const Bytes& bytes, SourceLocation source)
     // Output bytes to file
     m_os << bytes;
 }
+
+void
+BytecodeStreamOutput::DoOutputBorrowed(const unsigned char* data,
+                                       unsigned long size,
+                                       SourceLocation source)
+{
+    // Writes larger than the stream buffer go straight to the file,
+    // gathered with whatever was already buffered.
+    m_os.write(reinterpret_cast<const char*>(data), size);
+}
@@ -34,8 +34,6 @@
 
 using namespace yasm;
 
-static llvm::APInt staticbv(IntNum::BITVECT_NATIVE_SIZE, 0);
-
 static inline uint64_t
 Extract(const llvm::APInt& bv, unsigned int width, unsigned int lsb)
 {
@@ -44,6 +42,28 @@ Extract(const llvm::APInt& bv, unsigned int width, unsigned int lsb)
     return v;
 }
 
+/// Get the number of bits needed to store a long value in LEB128 form,
+/// or 0 if the value needs the bitvector path.
+static int
+SmallSizeLEB128(const IntNum& intn, bool sign)
+{
+    if (!intn.isInt())
+        return 0;
+    long v = intn.getInt();
+    if (!sign && v < 0)
+        return 0;   // zero-extended from full bitvector width
+
+    // count bits after which only sign bits remain
+    unsigned long u = static_cast<unsigned long>(v < 0 ? ~v : v);
+    int size = 0;
+    while (u != 0)
+    {
+        ++size;
+        u >>= 1;
+    }
+    return sign ? size+1 : size;
+}
+
 unsigned long
 yasm::WriteLEB128(Bytes& bytes, const IntNum& intn, bool sign)
 {
@@ -54,15 +74,28 @@ yasm::WriteLEB128(Bytes& bytes, const IntNum& intn, bool sign)
         return 1;
     }
 
-    const llvm::APInt* bv = intn.getBV(&staticbv);
+    Bytes::size_type orig_size = bytes.size();
+    int i = 0;
+
+    if (int size = SmallSizeLEB128(intn, sign))
+    {
+        long v = intn.getInt();
+        for (; i<size-7; i += 7)
+            bytes.push_back(static_cast<unsigned char>(((v >> i) & 0x7F)
+                                                       | 0x80));
+        // last byte does not have MSB set
+        bytes.push_back(static_cast<unsigned char>((v >> i) & 0x7F));
+        return static_cast<unsigned long>(bytes.size()-orig_size);
+    }
+
+    llvm::APInt bv_storage(IntNum::BITVECT_NATIVE_SIZE, 0);
+    const llvm::APInt* bv = intn.getBV(&bv_storage);
     int size;
     if (sign)
         size = bv->getMinSignedBits();
     else
         size = bv->getActiveBits();
 
-    Bytes::size_type orig_size = bytes.size();
-    int i = 0;
     for (; i<size-7; i += 7)
         bytes.push_back(static_cast<unsigned char>(Extract(*bv, 7, i)) | 0x80);
     // last byte does not have MSB set
@@ -77,7 +110,11 @@ yasm::SizeLEB128(const IntNum& intn, bool sign)
     if (intn.isZero())
         return 1;
 
-    const llvm::APInt* bv = intn.getBV(&staticbv);
+    if (int size = SmallSizeLEB128(intn, sign))
+        return (size+6)/7;
+
+    llvm::APInt bv_storage(IntNum::BITVECT_NATIVE_SIZE, 0);
+    const llvm::APInt* bv = intn.getBV(&bv_storage);
     if (sign)
         return (bv->getMinSignedBits()+6)/7;
     else
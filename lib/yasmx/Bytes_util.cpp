@@ -37,8 +37,6 @@
 
 using namespace yasm;
 
-static llvm::APInt staticbv(IntNum::BITVECT_NATIVE_SIZE, 0);
-
 void
 yasm::Write8(Bytes& bytes, const IntNum& intn)
 {
@@ -74,23 +72,6 @@ yasm::Write64(Bytes& bytes, const IntNum& intn)
     }
 }
 
-static inline void
-Write64I(Bytes& bytes, uint64_t val)
-{
-    unsigned long low = static_cast<unsigned long>(val);
-    unsigned long high = static_cast<unsigned long>(val >> 32);
-    if (bytes.isBigEndian())
-    {
-        Write32(bytes, high);
-        Write32(bytes, low);
-    }
-    else
-    {
-        Write32(bytes, low);
-        Write32(bytes, high);
-    }
-}
-
 void
 yasm::WriteN(Bytes& bytes, const IntNum& intn, int n)
 {
@@ -107,7 +88,8 @@ yasm::WriteN(Bytes& bytes, const IntNum& intn, int n)
     }
 
     // harder cases
-    const llvm::APInt* bv = intn.getBV(&staticbv);
+    llvm::APInt bv_storage(IntNum::BITVECT_NATIVE_SIZE, 0);
+    const llvm::APInt* bv = intn.getBV(&bv_storage);
     const uint64_t* words = bv->getRawData();
     unsigned int nwords = bv->getNumWords();
     llvm::APInt tmp;    // must be here so it stays in scope
@@ -135,7 +117,7 @@ yasm::WriteN(Bytes& bytes, const IntNum& intn, int n)
         // rest (if any) is whole words
         unsigned int w = nwords-2;
         for (; i>=64; i-=64, --w)
-            Write64I(bytes, words[w]);
+            Write64(bytes, words[w]);
     }
     else
     {
@@ -143,7 +125,7 @@ yasm::WriteN(Bytes& bytes, const IntNum& intn, int n)
         unsigned int w = 0;
         int i = 0;
         for (; i<=n-64; i+=64, ++w)
-            Write64I(bytes, words[w]);
+            Write64(bytes, words[w]);
         // finish with bytes
         if (i < n)
         {
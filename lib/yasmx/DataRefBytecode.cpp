@@ -0,0 +1,141 @@
+///
+/// Borrowed data bytecode implementation
+///
+///  Copyright (C) 2011  PathScale Inc.
+///
+/// Redistribution and use in source and binary forms, with or without
+/// modification, are permitted provided that the following conditions
+/// are met:
+/// 1. Redistributions of source code must retain the above copyright
+///    notice, this list of conditions and the following disclaimer.
+/// 2. Redistributions in binary form must reproduce the above copyright
+///    notice, this list of conditions and the following disclaimer in the
+///    documentation and/or other materials provided with the distribution.
+///
+/// THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND OTHER CONTRIBUTORS ``AS IS''
+/// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+/// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+/// ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR OTHER CONTRIBUTORS BE
+/// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+/// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+/// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+/// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+/// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+/// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+/// POSSIBILITY OF SUCH DAMAGE.
+///
+#include "yasmx/BytecodeContainer.h"
+
+#include "yasmx/Basic/Diagnostic.h"
+#include "yasmx/BytecodeOutput.h"
+#include "yasmx/Bytecode.h"
+
+
+using namespace yasm;
+
+namespace {
+class DataRefBytecode : public Bytecode::Contents
+{
+public:
+    DataRefBytecode(const unsigned char* data, unsigned long size);
+    ~DataRefBytecode();
+
+    /// Finalizes the bytecode after parsing.
+    bool Finalize(Bytecode& bc, Diagnostic& diags);
+
+    /// Calculates the minimum size of a bytecode.
+    bool CalcLen(Bytecode& bc,
+                 /*@out@*/ unsigned long* len,
+                 const Bytecode::AddSpanFunc& add_span,
+                 Diagnostic& diags);
+
+    /// Convert a bytecode into its byte representation.
+    bool Output(Bytecode& bc, BytecodeOutput& bc_out);
+
+    llvm::StringRef getType() const;
+
+    DataRefBytecode* clone() const;
+
+#ifdef WITH_XML
+    /// Write an XML representation.  For debugging purposes.
+    pugi::xml_node Write(pugi::xml_node out) const;
+#endif // WITH_XML
+
+private:
+    const unsigned char* m_data;    ///< borrowed data (not owned)
+    unsigned long m_size;           ///< size of data (in bytes)
+};
+} // anonymous namespace
+
+DataRefBytecode::DataRefBytecode(const unsigned char* data,
+                                 unsigned long size)
+    : m_data(data),
+      m_size(size)
+{
+}
+
+DataRefBytecode::~DataRefBytecode()
+{
+}
+
+bool
+DataRefBytecode::Finalize(Bytecode& bc, Diagnostic& diags)
+{
+    return true;
+}
+
+bool
+DataRefBytecode::CalcLen(Bytecode& bc,
+                         /*@out@*/ unsigned long* len,
+                         const Bytecode::AddSpanFunc& add_span,
+                         Diagnostic& diags)
+{
+    *len = m_size;
+    return true;
+}
+
+bool
+DataRefBytecode::Output(Bytecode& bc, BytecodeOutput& bc_out)
+{
+    bc_out.OutputBorrowed(m_data, m_size, bc.getSource());
+    return true;
+}
+
+llvm::StringRef
+DataRefBytecode::getType() const
+{
+    return "yasm::DataRefBytecode";
+}
+
+DataRefBytecode*
+DataRefBytecode::clone() const
+{
+    return new DataRefBytecode(m_data, m_size);
+}
+
+#ifdef WITH_XML
+pugi::xml_node
+DataRefBytecode::Write(pugi::xml_node out) const
+{
+    pugi::xml_node root = out.append_child("DataRef");
+    append_child(root, "Size", m_size);
+    return root;
+}
+#endif // WITH_XML
+
+Bytecode&
+yasm::AppendDataRef(BytecodeContainer& container,
+                    const unsigned char* data,
+                    unsigned long size,
+                    SourceLocation source)
+{
+    Bytecode& bc = container.FreshBytecode();
+    bc.Transform(Bytecode::Contents::Ptr(new DataRefBytecode(data, size)));
+    bc.setSource(source);
+
+    // The length is known up front; set it now so the bytecode is usable
+    // without going through the optimizer.
+    Diagnostic nodiags(0);
+    bc.CalcLen(0, nodiags);
+    return bc;
+}
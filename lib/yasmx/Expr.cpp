@@ -24,13 +24,17 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 //
+#define DEBUG_TYPE "Expr"
+
 #include "yasmx/Expr.h"
 
 #include <algorithm>
+#include <climits>
 #include <iterator>
 
 #include "llvm/ADT/APFloat.h"
 #include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/Support/raw_ostream.h"
 #include "yasmx/Basic/Diagnostic.h"
 #include "yasmx/Config/functional.h"
@@ -39,6 +43,10 @@
 #include "yasmx/Symbol.h"
 
 
+STATISTIC(num_simplify, "Number of expressions simplified");
+STATISTIC(num_simplify_fast,
+          "Number of expressions simplified without leveling");
+
 using namespace yasm;
 
 /// Look for simple identities that make the entire result constant:
@@ -350,7 +358,9 @@ Expr::~Expr()
 void
 Expr::swap(Expr& oth)
 {
-    std::swap(m_terms, oth.m_terms);
+    // Use the SmallVector swap; the generic std::swap would deep copy the
+    // terms three times.
+    m_terms.swap(oth.m_terms);
 }
 
 void
@@ -519,36 +529,50 @@ TransformNegImpl(Expr& e,
             }
             case Op::ADD:
             {
-                if (!negating)
-                    break;
-
-                // Negate all children
+                // Negate all children (if negating)
                 int new_depth = child->m_depth+1;
                 for (int x = 0, nchild = child->getNumChild(); x < nchild; ++x)
-                    n = TransformNegImpl(e, n-1, new_depth, depth_delta, true);
+                    n = TransformNegImpl(e, n-1, new_depth, depth_delta,
+                                         negating);
                 break;
             }
             case Op::MUL:
             {
-                if (!negating)
-                    break;
+                int new_depth = child->m_depth+1;
+                int nchild = child->getNumChild();
+                if (negating)
+                {
+                    // Insert -1 term.  Do this by inserting a new MUL op
+                    // and changing this term to -1, to avoid having to
+                    // deal with updating n.
+                    terms.insert(terms.begin()+n+1,
+                                 ExprTerm(child->getOp(), nchild+1,
+                                          child->getSource(),
+                                          child->m_depth));
+                    child = &terms[n];  // need to re-get as terms may move
+                    *child = ExprTerm(-1, child->getSource(), new_depth);
+                }
 
-                // Insert -1 term.  Do this by inserting a new MUL op
-                // and changing this term to -1, to avoid having to
-                // deal with updating n.
-                terms.insert(terms.begin()+n+1,
-                             ExprTerm(child->getOp(),
-                                      child->getNumChild()+1,
-                                      child->getSource(),
-                                      child->m_depth));
-                child = &terms[n];      // need to re-get as terms may move
-                *child = ExprTerm(-1, child->getSource(), child->m_depth+1);
+                // Transform children without negating them.
+                for (int x = 0; x < nchild; ++x)
+                    n = TransformNegImpl(e, n-1, new_depth, depth_delta,
+                                         false);
                 break;
             }
             default:
             {
                 if (!negating)
+                {
+                    // Transform children of other operators (e.g. a SUB
+                    // inside an XOR) on their own; they must not pick up
+                    // the negation state of a sibling.
+                    int new_depth = child->m_depth+1;
+                    for (int x = 0, nchild = child->getNumChild(); x < nchild;
+                         ++x)
+                        n = TransformNegImpl(e, n-1, new_depth, depth_delta,
+                                             false);
                     break;
+                }
 
                 // Directly negate if possible (integers or floats)
                 if (IntNum* intn = child->getIntNum())
@@ -814,9 +838,149 @@ again:
         root.Zero();    // If operator has no children, replace it with a zero.
 }
 
+/// Check if a+b overflows a long.
+static inline bool
+AddOverflows(long a, long b)
+{
+    return (b > 0 && a > LONG_MAX - b) || (b < 0 && a < LONG_MIN - b);
+}
+
+/// Check if a*b overflows a long.
+static inline bool
+MulOverflows(long a, long b)
+{
+    if (a == 0 || b == 0)
+        return false;
+    if (a > 0)
+        return (b > 0) ? (a > LONG_MAX / b) : (b < LONG_MIN / a);
+    return (b > 0) ? (a < LONG_MIN / b) : (a < LONG_MAX / b);
+}
+
+/// Evaluate an expression consisting only of small integers and simple
+/// arithmetic using native arithmetic.  This gives the same result as
+/// full simplification for these operators, without the leveling passes.
+/// @param terms    expression terms
+/// @param result   result value (output)
+/// @param source   source location of the last integer term (output)
+/// @return False if the expression contains anything else, is nested too
+///         deeply, or an intermediate result does not fit in a long.
+static bool
+FoldSmallInt(const ExprTerms& terms, long* result, SourceLocation* source)
+{
+    enum { MAX_STACK = 16 };
+    long vals[MAX_STACK];
+    int depths[MAX_STACK];
+    int sp = 0;
+
+    for (ExprTerms::const_iterator i=terms.begin(), end=terms.end();
+         i != end; ++i)
+    {
+        if (const IntNum* intn = i->getIntNum())
+        {
+            if (sp == MAX_STACK || !intn->isInt())
+                return false;
+            vals[sp] = intn->getInt();
+            depths[sp] = i->m_depth;
+            ++sp;
+            *source = i->getSource();
+            continue;
+        }
+        if (!i->isOp())
+            return false;
+
+        int nchild = i->getNumChild();
+        if (nchild < 1 || nchild > sp)
+            return false;
+        int first = sp - nchild;
+        for (int n=first; n<sp; ++n)
+        {
+            if (depths[n] != i->m_depth+1)
+                return false;
+        }
+
+        long val = vals[first];
+        switch (i->getOp())
+        {
+            case Op::IDENT:
+                if (nchild != 1)
+                    return false;
+                break;
+            case Op::NEG:
+                if (nchild != 1 || val == LONG_MIN)
+                    return false;
+                val = -val;
+                break;
+            case Op::ADD:
+                for (int n=first+1; n<sp; ++n)
+                {
+                    if (AddOverflows(val, vals[n]))
+                        return false;
+                    val += vals[n];
+                }
+                break;
+            case Op::SUB:
+                if (nchild != 2 || vals[sp-1] == LONG_MIN ||
+                    AddOverflows(val, -vals[sp-1]))
+                    return false;
+                val -= vals[sp-1];
+                break;
+            case Op::MUL:
+                for (int n=first+1; n<sp; ++n)
+                {
+                    if (MulOverflows(val, vals[n]))
+                        return false;
+                    val *= vals[n];
+                }
+                break;
+            case Op::OR:
+                for (int n=first+1; n<sp; ++n)
+                    val |= vals[n];
+                break;
+            case Op::AND:
+                for (int n=first+1; n<sp; ++n)
+                    val &= vals[n];
+                break;
+            case Op::XOR:
+                for (int n=first+1; n<sp; ++n)
+                    val ^= vals[n];
+                break;
+            default:
+                return false;
+        }
+        vals[first] = val;
+        depths[first] = i->m_depth;
+        sp = first+1;
+    }
+
+    if (sp != 1 || depths[0] != 0)
+        return false;
+    *result = vals[0];
+    return true;
+}
+
 void
 Expr::Simplify(Diagnostic& diags, bool simplify_reg_mul)
 {
+    ++num_simplify;
+
+    // Single terms and purely small integer expressions don't need the
+    // general transformation and leveling passes.
+    if (m_terms.size() == 1 && !m_terms.front().isEmpty() &&
+        !m_terms.front().isOp())
+    {
+        ++num_simplify_fast;
+        return;
+    }
+    long intval;
+    SourceLocation source;
+    if (FoldSmallInt(m_terms, &intval, &source))
+    {
+        m_terms.clear();
+        m_terms.push_back(ExprTerm(IntNum(intval), source));
+        ++num_simplify_fast;
+        return;
+    }
+
     TransformNeg();
 
     for (int pos=0, size=m_terms.size(); pos<size; ++pos)
@@ -200,11 +200,10 @@ IncbinBytecode::Output(Bytecode& bc, BytecodeOutput& bc_out)
         start = m_start->getIntNum().getUInt();
     }
 
-    // Copy len bytes
-    Bytes& bytes = bc_out.getScratch();
-    bytes.Write(reinterpret_cast<const unsigned char*>(m_buf->getBufferStart())
-                + start, bc.getTailLen());
-    bc_out.OutputBytes(bytes, bc.getSource());
+    // Output len bytes straight from the file buffer
+    bc_out.OutputBorrowed(
+        reinterpret_cast<const unsigned char*>(m_buf->getBufferStart()) + start,
+        bc.getTailLen(), bc.getSource());
     return true;
 }
 
@@ -31,9 +31,12 @@
 #include "yasmx/Basic/Diagnostic.h"
 #include "yasmx/Config/functional.h"
 #include "yasmx/Arch.h"
+#include "yasmx/BytecodeContainer.h"
 #include "yasmx/EffAddr.h"
 #include "yasmx/Expr.h"
 #include "yasmx/Expr_util.h"
+#include "yasmx/Object.h"
+#include "yasmx/Section.h"
 
 
 using namespace yasm;
@@ -304,6 +307,15 @@ Insn::Append(BytecodeContainer& container,
     }
     if (!ok)
         return false;
+
+    // Only instructions appended directly to a section are recorded;
+    // those inside a TIMES (or other nested) container have no section
+    // of their own and get no source line entries.
+    const Section* sect = container.getSection();
+    if (sect && sect->getObject() &&
+        sect->getObject()->getConfig().InsnSources)
+        container.AddInsnSource(source);
+
     return DoAppend(container, source, diags);
 }
 
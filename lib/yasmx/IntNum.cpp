@@ -40,18 +40,6 @@
 
 using namespace yasm;
 
-/// Static bitvect used for conversions.
-static llvm::APInt conv_bv(IntNum::BITVECT_NATIVE_SIZE, 0);
-
-/// Static bitvects used for computation.
-static llvm::APInt result(IntNum::BITVECT_NATIVE_SIZE, 0);
-static llvm::APInt spare(IntNum::BITVECT_NATIVE_SIZE, 0);
-static llvm::APInt op1static(IntNum::BITVECT_NATIVE_SIZE, 0);
-static llvm::APInt op2static(IntNum::BITVECT_NATIVE_SIZE, 0);
-
-/// Static bitvect used for sign extension.
-static llvm::APInt signext_bv(IntNum::BITVECT_NATIVE_SIZE, 0);
-
 enum
 {
     SV_BITS = std::numeric_limits<IntNumData::SmallValue>::digits,
@@ -59,6 +47,106 @@ enum
     ULONG_BITS = std::numeric_limits<unsigned long>::digits
 };
 
+namespace {
+typedef llvm::integerPart Word;
+
+enum
+{
+    WORD_BITS = std::numeric_limits<Word>::digits,
+    NATIVE_WORDS = IntNum::BITVECT_NATIVE_SIZE / WORD_BITS
+};
+
+/// Native-size bitvector.  All bitvector calculations are performed in
+/// these on the stack, so they are reentrant and never allocate.
+typedef Word NativeBV[NATIVE_WORDS];
+} // anonymous namespace
+
+static inline bool
+isNegative(const NativeBV bv)
+{
+    return (bv[NATIVE_WORDS-1] >> (WORD_BITS-1)) != 0;
+}
+
+static void
+SetSmallValue(NativeBV bv, IntNumData::SmallValue val)
+{
+    // conversion to unsigned sign-extends
+    bv[0] = static_cast<Word>(val);
+    Word ext = val < 0 ? ~static_cast<Word>(0) : 0;
+    for (int i=1; i<NATIVE_WORDS; ++i)
+        bv[i] = ext;
+}
+
+/// Check if bv fits into a SmallValue.
+static bool
+FitsSmallValue(const NativeBV bv)
+{
+    bool neg = isNegative(bv);
+    Word ext = neg ? ~static_cast<Word>(0) : 0;
+    for (int i=1; i<NATIVE_WORDS; ++i)
+    {
+        if (bv[i] != ext)
+            return false;
+    }
+    IntNumData::SmallValue sv = static_cast<IntNumData::SmallValue>(bv[0]);
+    return static_cast<Word>(sv) == bv[0] && (sv < 0) == neg;
+}
+
+static int
+SignedCompare(const NativeBV lhs, const NativeBV rhs)
+{
+    bool lhs_neg = isNegative(lhs), rhs_neg = isNegative(rhs);
+    if (lhs_neg != rhs_neg)
+        return lhs_neg ? -1 : 1;
+    return llvm::APInt::tcCompare(lhs, rhs, NATIVE_WORDS);
+}
+
+/// Arithmetic (sign-filling) shift right.
+static void
+ArithShiftRight(NativeBV bv, unsigned int count)
+{
+    bool neg = isNegative(bv);
+    if (neg)
+        llvm::APInt::tcComplement(bv, NATIVE_WORDS);
+    llvm::APInt::tcShiftRight(bv, NATIVE_WORDS, count);
+    if (neg)
+        llvm::APInt::tcComplement(bv, NATIVE_WORDS);
+}
+
+/// Clamp a shift count to the native bitvector size.
+static unsigned int
+ShiftCount(IntNumData::SmallValue count)
+{
+    if (count > IntNum::BITVECT_NATIVE_SIZE)
+        return IntNum::BITVECT_NATIVE_SIZE;
+    return static_cast<unsigned int>(count);
+}
+
+/// Signed or unsigned division.  Sets quot to lhs/rhs and rem to lhs%rhs,
+/// with the signs of C++ (truncating) division.  rhs must be nonzero.
+static void
+DivRem(NativeBV quot, NativeBV rem, const NativeBV lhs, const NativeBV rhs,
+       bool is_signed)
+{
+    NativeBV divisor, scratch;
+    llvm::APInt::tcAssign(quot, lhs, NATIVE_WORDS);
+    llvm::APInt::tcAssign(divisor, rhs, NATIVE_WORDS);
+
+    bool lhs_neg = is_signed && isNegative(lhs);
+    bool rhs_neg = is_signed && isNegative(rhs);
+    if (lhs_neg)
+        llvm::APInt::tcNegate(quot, NATIVE_WORDS);
+    if (rhs_neg)
+        llvm::APInt::tcNegate(divisor, NATIVE_WORDS);
+
+    llvm::APInt::tcDivide(quot, divisor, rem, scratch, NATIVE_WORDS);
+
+    if (lhs_neg != rhs_neg)
+        llvm::APInt::tcNegate(quot, NATIVE_WORDS);
+    if (lhs_neg)
+        llvm::APInt::tcNegate(rem, NATIVE_WORDS);
+}
+
 bool
 yasm::isOkSize(const llvm::APInt& intn,
                unsigned int size,
@@ -110,6 +198,34 @@ IntNum::setBV(const llvm::APInt& bv)
     m_val.bv->sextOrTrunc(BITVECT_NATIVE_SIZE);
 }
 
+void
+IntNum::getWords(uint64_t* words) const
+{
+    if (m_type == INTNUM_BV)
+        llvm::APInt::tcAssign(words, m_val.bv->getRawData(), NATIVE_WORDS);
+    else
+        SetSmallValue(words, m_val.sv);
+}
+
+void
+IntNum::setWords(const uint64_t* words)
+{
+    if (FitsSmallValue(words))
+        set(static_cast<SmallValue>(words[0]));
+    else if (m_type == INTNUM_BV)
+    {
+        // Bitvectors are always BITVECT_NATIVE_SIZE bits wide, so the
+        // existing storage can be overwritten in place.
+        llvm::APInt::tcAssign(const_cast<uint64_t*>(m_val.bv->getRawData()),
+                              words, NATIVE_WORDS);
+    }
+    else
+    {
+        m_val.bv = new llvm::APInt(BITVECT_NATIVE_SIZE, NATIVE_WORDS, words);
+        m_type = INTNUM_BV;
+    }
+}
+
 const llvm::APInt*
 IntNum::getBV(llvm::APInt* bv) const
 {
@@ -203,18 +319,8 @@ IntNum::setStr(llvm::StringRef str, unsigned int radix)
     }
 
     // long case
-    conv_bv = 0;
-
-    // Figure out if we can shift instead of multiply
-    unsigned int shift =
-        (radix == 16 ? 4 : radix == 8 ? 3 : radix == 2 ? 1 : 0);
-
-    llvm::APInt& radixval = op1static;
-    llvm::APInt& charval = op2static;
-    llvm::APInt& oldval = spare;
-
-    radixval = radix;
-    oldval = 0;
+    NativeBV val;
+    llvm::APInt::tcSet(val, 0, NATIVE_WORDS);
 
     bool overflowed = false;
     for (llvm::StringRef::iterator i=begin, end=str.end(); i != end; ++i)
@@ -224,33 +330,18 @@ IntNum::setStr(llvm::StringRef str, unsigned int radix)
         // If this letter is out of bound for this radix, reject it.
         assert(c < radix && "invalid digit for given radix");
 
-        charval = c;
-
-        // Add the digit to the value in the appropriate radix.  If adding in
-        // digits made the value smaller, then this overflowed.
-        oldval = conv_bv;
-
-        // Shift or multiply by radix, did overflow occur on the multiply?
-        if (shift)
-            conv_bv <<= shift;
-        else
-            conv_bv *= radixval;
-        overflowed |= conv_bv.udiv(radixval) != oldval;
-
-        // Add value, did overflow occur on the value?
-        //   (a + b) ult b  <=> overflow
-        conv_bv += charval;
-        overflowed |= conv_bv.ult(charval);
+        // val = val*radix + c; overflow is reported if any higher words
+        // would have been nonzero.
+        overflowed |= llvm::APInt::tcMultiplyPart(val, val, radix, c,
+                                                  NATIVE_WORDS, NATIVE_WORDS,
+                                                  false) != 0;
     }
 
     // If it's negative, put it in two's complement form
     if (is_neg)
-    {
-        --conv_bv;
-        conv_bv.flip();
-    }
+        llvm::APInt::tcNegate(val, NATIVE_WORDS);
 
-    setBV(conv_bv);
+    setWords(val);
     return overflowed;
 }
 
@@ -425,154 +516,138 @@ IntNum::CalcImpl(Op::Op op,
 
     // Always do computations with in full bit vector.
     // Bit vector results must be calculated through intermediate storage.
-    const llvm::APInt* op1 = getBV(&op1static);
-    const llvm::APInt* op2 = 0;
+    NativeBV op1, op2, result, spare;
+    getWords(op1);
     if (operand)
-        op2 = operand->getBV(&op2static);
+        operand->getWords(op2);
 
     // A operation does a bitvector computation if result is allocated.
     switch (op)
     {
         case Op::ADD:
-        {
-            result = *op1;
-            result += *op2;
+            llvm::APInt::tcAssign(result, op1, NATIVE_WORDS);
+            llvm::APInt::tcAdd(result, op2, 0, NATIVE_WORDS);
             break;
-        }
         case Op::SUB:
-        {
-            result = *op1;
-            result -= *op2;
+            llvm::APInt::tcAssign(result, op1, NATIVE_WORDS);
+            llvm::APInt::tcSubtract(result, op2, 0, NATIVE_WORDS);
             break;
-        }
         case Op::MUL:
-            result = *op1;
-            result *= *op2;
+            llvm::APInt::tcMultiply(result, op1, op2, NATIVE_WORDS);
             break;
         case Op::DIV:
-            // TODO: make sure op1 and op2 are unsigned
-            if (!*op2)
-            {
-                assert(diags && "divide by zero");
-                diags->Report(source, diag::err_divide_by_zero);
-                return false;
-            }
-            result = op1->udiv(*op2);
-            break;
         case Op::SIGNDIV:
-            if (!*op2)
-            {
-                assert(diags && "divide by zero");
-                diags->Report(source, diag::err_divide_by_zero);
-                return false;
-            }
-            result = op1->sdiv(*op2);
-            break;
         case Op::MOD:
-            // TODO: make sure op1 and op2 are unsigned
-            if (!*op2)
-            {
-                assert(diags && "divide by zero");
-                diags->Report(source, diag::err_divide_by_zero);
-                return false;
-            }
-            result = op1->urem(*op2);
-            break;
         case Op::SIGNMOD:
-            if (!*op2)
+            // TODO: make sure op1 and op2 are unsigned for DIV and MOD
+            if (llvm::APInt::tcIsZero(op2, NATIVE_WORDS))
             {
                 assert(diags && "divide by zero");
                 diags->Report(source, diag::err_divide_by_zero);
                 return false;
             }
-            result = op1->srem(*op2);
+            if (op == Op::DIV || op == Op::SIGNDIV)
+                DivRem(result, spare, op1, op2, op == Op::SIGNDIV);
+            else
+                DivRem(spare, result, op1, op2, op == Op::SIGNMOD);
             break;
         case Op::NEG:
-            result = -*op1;
+            llvm::APInt::tcAssign(result, op1, NATIVE_WORDS);
+            llvm::APInt::tcNegate(result, NATIVE_WORDS);
             break;
         case Op::NOT:
-            result = *op1;
-            result.flip();
+            llvm::APInt::tcAssign(result, op1, NATIVE_WORDS);
+            llvm::APInt::tcComplement(result, NATIVE_WORDS);
             break;
         case Op::OR:
-            result = *op1;
-            result |= *op2;
+            llvm::APInt::tcAssign(result, op1, NATIVE_WORDS);
+            llvm::APInt::tcOr(result, op2, NATIVE_WORDS);
             break;
         case Op::AND:
-            result = *op1;
-            result &= *op2;
+            llvm::APInt::tcAssign(result, op1, NATIVE_WORDS);
+            llvm::APInt::tcAnd(result, op2, NATIVE_WORDS);
             break;
         case Op::XOR:
-            result = *op1;
-            result ^= *op2;
+            llvm::APInt::tcAssign(result, op1, NATIVE_WORDS);
+            llvm::APInt::tcXor(result, op2, NATIVE_WORDS);
             break;
         case Op::XNOR:
-            result = *op1;
-            result ^= *op2;
-            result.flip();
+            llvm::APInt::tcAssign(result, op1, NATIVE_WORDS);
+            llvm::APInt::tcXor(result, op2, NATIVE_WORDS);
+            llvm::APInt::tcComplement(result, NATIVE_WORDS);
             break;
         case Op::NOR:
-            result = *op1;
-            result |= *op2;
-            result.flip();
+            llvm::APInt::tcAssign(result, op1, NATIVE_WORDS);
+            llvm::APInt::tcOr(result, op2, NATIVE_WORDS);
+            llvm::APInt::tcComplement(result, NATIVE_WORDS);
             break;
         case Op::SHL:
-            if (operand->m_type == INTNUM_SV)
-            {
-                if (operand->m_val.sv >= 0)
-                    result = op1->shl(operand->m_val.sv);
-                else
-                    result = op1->ashr(-operand->m_val.sv);
-            }
-            else    // don't even bother, just zero result
-                result.clear();
-            break;
         case Op::SHR:
             if (operand->m_type == INTNUM_SV)
             {
-                if (operand->m_val.sv >= 0)
-                    result = op1->ashr(operand->m_val.sv);
+                SmallValue count = operand->m_val.sv;
+                bool left = (op == Op::SHL);
+                if (count < 0)
+                {
+                    count = -count;
+                    left = !left;
+                }
+                llvm::APInt::tcAssign(result, op1, NATIVE_WORDS);
+                if (left)
+                    llvm::APInt::tcShiftLeft(result, NATIVE_WORDS,
+                                             ShiftCount(count));
                 else
-                    result = op1->shl(-operand->m_val.sv);
+                    ArithShiftRight(result, ShiftCount(count));
             }
             else    // don't even bother, just zero result
-                result.clear();
+                llvm::APInt::tcSet(result, 0, NATIVE_WORDS);
             break;
         case Op::LOR:
-            set(static_cast<SmallValue>((!!*op1) || (!!*op2)));
+            set(static_cast<SmallValue>(
+                !llvm::APInt::tcIsZero(op1, NATIVE_WORDS) ||
+                !llvm::APInt::tcIsZero(op2, NATIVE_WORDS)));
             return true;
         case Op::LAND:
-            set(static_cast<SmallValue>((!!*op1) && (!!*op2)));
+            set(static_cast<SmallValue>(
+                !llvm::APInt::tcIsZero(op1, NATIVE_WORDS) &&
+                !llvm::APInt::tcIsZero(op2, NATIVE_WORDS)));
             return true;
         case Op::LNOT:
-            set(static_cast<SmallValue>(!*op1));
+            set(static_cast<SmallValue>(
+                llvm::APInt::tcIsZero(op1, NATIVE_WORDS)));
             return true;
         case Op::LXOR:
-            set(static_cast<SmallValue>((!!*op1) ^ (!!*op2)));
+            set(static_cast<SmallValue>(
+                llvm::APInt::tcIsZero(op1, NATIVE_WORDS) !=
+                llvm::APInt::tcIsZero(op2, NATIVE_WORDS)));
             return true;
         case Op::LXNOR:
-            set(static_cast<SmallValue>(!((!!*op1) ^ (!!*op2))));
+            set(static_cast<SmallValue>(
+                llvm::APInt::tcIsZero(op1, NATIVE_WORDS) ==
+                llvm::APInt::tcIsZero(op2, NATIVE_WORDS)));
             return true;
         case Op::LNOR:
-            set(static_cast<SmallValue>(!((!!*op1) || (!!*op2))));
+            set(static_cast<SmallValue>(
+                llvm::APInt::tcIsZero(op1, NATIVE_WORDS) &&
+                llvm::APInt::tcIsZero(op2, NATIVE_WORDS)));
             return true;
         case Op::EQ:
-            set(static_cast<SmallValue>(op1->eq(*op2)));
+            set(static_cast<SmallValue>(SignedCompare(op1, op2) == 0));
             return true;
         case Op::LT:
-            set(static_cast<SmallValue>(op1->slt(*op2)));
+            set(static_cast<SmallValue>(SignedCompare(op1, op2) < 0));
             return true;
         case Op::GT:
-            set(static_cast<SmallValue>(op1->sgt(*op2)));
+            set(static_cast<SmallValue>(SignedCompare(op1, op2) > 0));
             return true;
         case Op::LE:
-            set(static_cast<SmallValue>(op1->sle(*op2)));
+            set(static_cast<SmallValue>(SignedCompare(op1, op2) <= 0));
             return true;
         case Op::GE:
-            set(static_cast<SmallValue>(op1->sge(*op2)));
+            set(static_cast<SmallValue>(SignedCompare(op1, op2) >= 0));
             return true;
         case Op::NE:
-            set(static_cast<SmallValue>(op1->ne(*op2)));
+            set(static_cast<SmallValue>(SignedCompare(op1, op2) != 0));
             return true;
         case Op::SEG:
             assert(diags && "invalid use of operator 'SEG'");
@@ -587,7 +662,7 @@ IntNum::CalcImpl(Op::Op op,
             diags->Report(source, diag::err_invalid_op_use) << ":";
             return false;
         case Op::IDENT:
-            result = *op1;
+            llvm::APInt::tcAssign(result, op1, NATIVE_WORDS);
             break;
         default:
             assert(diags && "invalid integer operation");
@@ -596,7 +671,7 @@ IntNum::CalcImpl(Op::Op op,
     }
 
     // Try to fit the result into long if possible
-    setBV(result);
+    setWords(result);
     return true;
 }
 /*@=nullderef =nullpass =branchstate@*/
@@ -604,11 +679,26 @@ IntNum::CalcImpl(Op::Op op,
 void
 IntNum::SignExtend(unsigned int size)
 {
+    assert(size > 0 && "sign extend from zero bits");
+    if (size >= BITVECT_NATIVE_SIZE)
+        return;
+
     // For now, always implement with full bit vector.
-    llvm::APInt* bv = getBV(&signext_bv);
-    bv->trunc(size);
-    bv->sext(BITVECT_NATIVE_SIZE);
-    setBV(*bv);
+    NativeBV bv;
+    getWords(bv);
+    unsigned int word = size / WORD_BITS;
+    unsigned int bit = size % WORD_BITS;
+    Word ext = llvm::APInt::tcExtractBit(bv, size-1) ? ~static_cast<Word>(0)
+                                                     : 0;
+    if (bit != 0)
+    {
+        Word mask = ~static_cast<Word>(0) << bit;
+        bv[word] = (bv[word] & ~mask) | (ext & mask);
+        ++word;
+    }
+    for (; word < NATIVE_WORDS; ++word)
+        bv[word] = ext;
+    setWords(bv);
 }
 
 void
@@ -749,7 +839,7 @@ IntNum::isOkSize(unsigned int size, unsigned int rshift, int rangetype) const
                 return false;
         }
     }
-    return yasm::isOkSize(*getBV(&conv_bv), size, rshift, rangetype);
+    return yasm::isOkSize(*m_val.bv, size, rshift, rangetype);
 }
 
 bool
@@ -809,13 +899,10 @@ yasm::Compare(const IntNum& lhs, const IntNum& rhs)
         return 0;
     }
 
-    const llvm::APInt* op1 = lhs.getBV(&op1static);
-    const llvm::APInt* op2 = rhs.getBV(&op2static);
-    if (op1->slt(*op2))
-        return -1;
-    if (op1->sgt(*op2))
-        return 1;
-    return 0;
+    NativeBV op1, op2;
+    lhs.getWords(op1);
+    rhs.getWords(op2);
+    return SignedCompare(op1, op2);
 }
 
 bool
@@ -824,9 +911,10 @@ yasm::operator==(const IntNum& lhs, const IntNum& rhs)
     if (lhs.m_type == IntNum::INTNUM_SV && rhs.m_type == IntNum::INTNUM_SV)
         return lhs.m_val.sv == rhs.m_val.sv;
 
-    const llvm::APInt* op1 = lhs.getBV(&op1static);
-    const llvm::APInt* op2 = rhs.getBV(&op2static);
-    return op1->eq(*op2);
+    NativeBV op1, op2;
+    lhs.getWords(op1);
+    rhs.getWords(op2);
+    return SignedCompare(op1, op2) == 0;
 }
 
 bool
@@ -835,9 +923,10 @@ yasm::operator<(const IntNum& lhs, const IntNum& rhs)
     if (lhs.m_type == IntNum::INTNUM_SV && rhs.m_type == IntNum::INTNUM_SV)
         return lhs.m_val.sv < rhs.m_val.sv;
 
-    const llvm::APInt* op1 = lhs.getBV(&op1static);
-    const llvm::APInt* op2 = rhs.getBV(&op2static);
-    return op1->slt(*op2);
+    NativeBV op1, op2;
+    lhs.getWords(op1);
+    rhs.getWords(op2);
+    return SignedCompare(op1, op2) < 0;
 }
 
 bool
@@ -846,9 +935,10 @@ yasm::operator>(const IntNum& lhs, const IntNum& rhs)
     if (lhs.m_type == IntNum::INTNUM_SV && rhs.m_type == IntNum::INTNUM_SV)
         return lhs.m_val.sv > rhs.m_val.sv;
 
-    const llvm::APInt* op1 = lhs.getBV(&op1static);
-    const llvm::APInt* op2 = rhs.getBV(&op2static);
-    return op1->sgt(*op2);
+    NativeBV op1, op2;
+    lhs.getWords(op1);
+    rhs.getWords(op2);
+    return SignedCompare(op1, op2) > 0;
 }
 
 void
@@ -881,10 +971,13 @@ IntNum::getStr(llvm::SmallVectorImpl<char>& str,
                 fmt = "%lX";
             break;
         default:
+        {
             // fall back to bigval
-            getBV(&conv_bv)->toString(str, static_cast<unsigned>(base), true,
-                                      lowercase);
+            llvm::APInt bv(BITVECT_NATIVE_SIZE, 0);
+            getBV(&bv)->toString(str, static_cast<unsigned>(base), true,
+                                 lowercase);
             return;
+        }
     }
 
     char s[40];
@@ -938,21 +1031,43 @@ IntNum::Print(llvm::raw_ostream& os,
               bool showbase,
               int bits) const
 {
-    const llvm::APInt* bv = getBV(&conv_bv);
+    llvm::SmallString<40> s;
+    if (m_type == INTNUM_SV)
+    {
+        // Format small values directly to avoid a bitvector.
+        static const char digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+        static const char udigits[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+        const char* d = lowercase ? digits : udigits;
+
+        USmallValue v = static_cast<USmallValue>(m_val.sv);
+        if (m_val.sv < 0)
+        {
+            v = 0-v;
+            os << '-';
+        }
 
-    if (bv->isNegative())
+        char buf[SV_BITS+1];
+        char* end = buf+sizeof(buf);
+        char* p = end;
+        do
+        {
+            *--p = d[v % base];
+            v /= base;
+        } while (v != 0);
+        s.append(p, end);
+    }
+    else
     {
-        // negate in place
-        conv_bv = *bv;
-        conv_bv.flip();
-        ++conv_bv;
-        bv = &conv_bv;
-        os << '-';
+        llvm::APInt bv(*m_val.bv);
+        if (bv.isNegative())
+        {
+            bv.flip();
+            ++bv;
+            os << '-';
+        }
+        bv.toString(s, base, true, lowercase);
     }
 
-    llvm::SmallString<40> s;
-    bv->toString(s, base, true, lowercase);
-
     // prefix and 0 padding, if required
     int padding = 0;
     if (base == 2)
@@ -120,6 +120,8 @@ public:
     BytecodeContainer& getContents() { return *m_contents; }
 
 private:
+    MultipleBytecode(const MultipleBytecode& rhs);
+
     /// Number of times contents is repeated.
     Multiple m_multiple;
 
@@ -290,6 +292,13 @@ MultipleBytecode::MultipleBytecode(std::auto_ptr<BytecodeContainer> contents,
 {
 }
 
+MultipleBytecode::MultipleBytecode(const MultipleBytecode& rhs)
+    : Bytecode::Contents(rhs)
+    , m_multiple(rhs.m_multiple)
+    , m_contents(rhs.m_contents->CloneBytecodes().release())
+{
+}
+
 MultipleBytecode::~MultipleBytecode()
 {
 }
@@ -449,9 +458,7 @@ MultipleBytecode::getType() const
 MultipleBytecode*
 MultipleBytecode::clone() const
 {
-    // TODO: cloning
-    assert(false);
-    return 0;
+    return new MultipleBytecode(*this);
 }
 
 #ifdef WITH_XML
@@ -29,13 +29,13 @@
 #include "yasmx/Object.h"
 
 #include <algorithm>
+#include <cstring>
 #include <memory>
 
-#include <boost/pool/pool.hpp>
-
 #include "llvm/ADT/Statistic.h"
 #include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/Twine.h"
+#include "llvm/Support/Allocator.h"
 #include "yasmx/Basic/Diagnostic.h"
 #include "yasmx/Config/functional.h"
 #include "yasmx/Arch.h"
@@ -69,24 +69,31 @@ public:
     Impl(bool nocase)
         : sym_map(nocase)
         , special_sym_map(true)
-        , m_sym_pool(sizeof(Symbol))
     {}
     ~Impl() {}
 
-    Symbol* NewSymbol(llvm::StringRef name)
+    /// Copy a symbol table name into the name arena.  Names in the symbol
+    /// table are unique, so there's no need to look for an existing copy.
+    llvm::StringRef CopyName(llvm::StringRef name)
     {
-        Symbol* sym = static_cast<Symbol*>(m_sym_pool.malloc());
-        new (sym) Symbol(name);
-        return sym;
+        char* str = static_cast<char*>(m_name_pool.Allocate(name.size()+1, 1));
+        std::memcpy(str, name.data(), name.size());
+        str[name.size()] = '\0';
+        return llvm::StringRef(str, name.size());
     }
 
-    void DeleteSymbol(Symbol* sym)
+    /// Create a symbol with a name that is unique in the symbol table.
+    Symbol* NewTableSymbol(llvm::StringRef name)
     {
-        if (sym)
-        {
-            sym->~Symbol();
-            m_sym_pool.free(sym);
-        }
+        return new (m_sym_pool.Allocate()) Symbol(CopyName(name));
+    }
+
+    /// Create a symbol outside the symbol table.  These commonly share
+    /// names (e.g. "$"), so the name is interned.
+    Symbol* NewSymbol(llvm::StringRef name)
+    {
+        return new (m_sym_pool.Allocate())
+            Symbol(m_names.GetOrCreateValue(name).getKey());
     }
 
     typedef hamt<llvm::StringRef, Symbol, SymGetName> SymbolTable;
@@ -101,8 +108,14 @@ public:
     llvm::StringMap<Section*> section_map;
 
 private:
-    /// Pool for symbols not in the symbol table.
-    boost::pool<> m_sym_pool;
+    /// Storage for all symbols.  Destroys them when the object is deleted.
+    llvm::SpecificBumpPtrAllocator<Symbol> m_sym_pool;
+
+    /// Storage for symbol table symbol names.
+    llvm::BumpPtrAllocator m_name_pool;
+
+    /// Interned names of symbols not in the symbol table.
+    llvm::StringMap<char, llvm::BumpPtrAllocator> m_names;
 };
 } // namespace yasm
 
@@ -113,12 +126,14 @@ Object::Object(llvm::StringRef src_filename,
       m_arch(arch),
       m_cur_section(0),
       m_sections_owner(m_sections),
-      m_symbols_owner(m_symbols),
       m_impl(new Impl(false))
 {
     m_options.DisableGlobalSubRelative = false;
     m_config.ExecStack = false;
     m_config.NoExecStack = false;
+    m_config.BatchOptimize = false;
+    m_config.MergeStrings = false;
+    m_config.InsnSources = false;
 }
 
 void
@@ -182,23 +197,17 @@ Object::FindSymbol(llvm::StringRef name)
 SymbolRef
 Object::getSymbol(llvm::StringRef name)
 {
-    // Don't use pool allocator for symbols in the symbol table.
-    // We have to maintain an ordered link list of all symbols in the symbol
-    // table, so it's easy enough to reuse that for deleting the symbols.
-    // The memory impact of keeping a second linked list (internal to the pool)
-    // seems to outweigh the moderate time savings of pool deletion.
-    std::auto_ptr<Symbol> sym(new Symbol(name));
-    Symbol* sym2 = m_impl->sym_map.Insert(sym.get());
-    if (sym2)
+    if (Symbol* sym = m_impl->sym_map.Find(name))
     {
         ++num_exist_symbol;
-        return SymbolRef(sym2);
+        return SymbolRef(sym);
     }
 
     ++num_new_symbol;
-    sym2 = sym.get();
-    m_symbols.push_back(sym.release());
-    return SymbolRef(sym2);
+    Symbol* sym = m_impl->NewTableSymbol(name);
+    m_impl->sym_map.Insert(sym);
+    m_symbols.push_back(sym);
+    return SymbolRef(sym);
 }
 
 SymbolRef
@@ -213,7 +222,7 @@ Object::getSymbol(Location loc)
 SymbolRef
 Object::AppendSymbol(llvm::StringRef name)
 {
-    Symbol* sym = new Symbol(name);
+    Symbol* sym = m_impl->NewSymbol(name);
     m_symbols.push_back(sym);
     return SymbolRef(sym);
 }
@@ -229,7 +238,7 @@ void
 Object::RenameSymbol(SymbolRef sym, llvm::StringRef name)
 {
     m_impl->sym_map.Remove(sym->getName());
-    sym->m_name = name;
+    sym->m_name = m_impl->CopyName(name);
     m_impl->sym_map.Insert(sym);
 }
 
@@ -317,9 +326,9 @@ Object::UpdateBytecodeOffsets(Diagnostic& diags)
 }
 
 void
-Object::Optimize(Diagnostic& diags)
+Object::Optimize(Diagnostic& diags, OptimizerCache* cache)
 {
-    Optimizer opt(diags);
+    Optimizer opt(diags, cache);
     unsigned long bc_index = 0;
 
     // Step 1a
@@ -374,7 +383,10 @@ Object::Optimize(Diagnostic& diags)
         return;
 
     // Step 2
-    opt.Step2();
+    if (m_config.BatchOptimize)
+        opt.Step2Batched();
+    else
+        opt.Step2();
     if (diags.hasErrorOccurred())
         return;
 
@@ -29,12 +29,16 @@
 #include "yasmx/Optimizer.h"
 
 #include <algorithm>
+#include <climits>
+#include <cstddef>
 #include <deque>
-#include <list>
+#include <iterator>
+#include <map>
 #include <memory>
+#include <set>
+#include <string>
 #include <vector>
 
-#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/ADT/Twine.h"
@@ -43,12 +47,16 @@
 #include "yasmx/Basic/Diagnostic.h"
 #include "yasmx/Config/functional.h"
 #include "yasmx/Support/IntervalTree.h"
+#include "yasmx/Support/MD5.h"
+#include "yasmx/BytecodeContainer.h"
 #include "yasmx/Bytecode.h"
 #include "yasmx/DebugDumper.h"
 #include "yasmx/Expr.h"
 #include "yasmx/IntNum.h"
 #include "yasmx/Location_util.h"
+#include "yasmx/OptimizerCache.h"
 #include "yasmx/Section.h"
+#include "yasmx/Symbol.h"
 #include "yasmx/Value.h"
 
 
@@ -57,9 +65,13 @@ STATISTIC(num_spans, "Number of spans created");
 STATISTIC(num_step1d, "Number of spans after step 1b");
 STATISTIC(num_itree, "Number of span terms added to interval tree");
 STATISTIC(num_offset_setters, "Number of offset setters");
+STATISTIC(num_backtrace, "Number of TIMES backtrace entries");
 STATISTIC(num_recalc, "Number of span recalculations performed");
 STATISTIC(num_expansions, "Number of expansions performed");
 STATISTIC(num_initial_qb, "Number of spans on initial QB");
+STATISTIC(num_batches, "Number of batched expansion rounds");
+STATISTIC(num_cache_replayed, "Number of span runs replayed from cache");
+STATISTIC(num_cache_recorded, "Number of span runs recorded to cache");
 
 using namespace yasm;
 
@@ -86,7 +98,9 @@ using namespace yasm;
 //  - handling of multiples
 //
 // Data structures:
-//  - Interval tree to store spans and associated data
+//  - Span table, with all span terms in a single flat array; spans and
+//    queues refer to each other by index rather than by pointer
+//  - Interval tree over the bytecode ranges covered by span terms
 //  - Queues QA and QB
 //
 // Each span keeps track of:
@@ -115,6 +129,13 @@ using namespace yasm;
 // forward.  In either case, the ongoing offset is updated as well as the
 // lengths of any spans dependent on the offset-setter.
 //
+// An offset-setter may also depend on the lengths of the (up to two)
+// bytecodes right after it, e.g. padding that keeps a compare and jump pair
+// from crossing a boundary.  When one of them is expanded, the
+// offset-setter before it is re-evaluated at its unchanged offset, and any
+// change in its length is added to the expansion before the following
+// offset-setters are examined.
+//
 // Alignment/ORG value is critical value.
 // Cannot be combined with TIMES.
 //
@@ -161,6 +182,56 @@ using namespace yasm;
 //       change), add it to tail of Q.
 // 3. Final pass over bytecodes to generate final offsets.
 //
+// Batched expansion (alternative to step 2):
+//
+// Each interval tree enumeration in step 2 costs O(log N + K) for the K
+// spans crossing the expanded bytecode, which adds up when a single pass
+// expands many bytecodes (e.g. long runs of short jumps that all need to
+// become near jumps).  In batched mode, the whole queue is expanded at
+// once, collecting the length change of each expanded bytecode.  If the
+// batch is large, the length changes are summed into a prefix-sum array
+// indexed by bytecode index, and every active term is updated with a
+// single subtraction of two prefix sums; otherwise the crossing terms are
+// updated through the interval tree as in step 2.  Spans that exceed their
+// thresholds form the next batch.
+//
+// Expanding a batch before any of its length changes propagate is only
+// safe where growth can't shrink a span.  A section is handed to step 2
+// instead if any of its active spans is an id<=0 span, has a value other
+// than a single term, or crosses an offset setter (an align or org that
+// absorbs growth before it).  Offset setters that no span crosses (e.g.
+// aligns between functions) are moved once after each batch.  In the
+// remaining sections both modes reach the same (smallest) result.
+//
+// Optimizer cache:
+//
+// A span only depends on the bytecodes between its own bytecode and the
+// locations in its value, and never crosses sections (a distance between
+// bytecodes in different sections is not a span term).  Step 1b splits each
+// section into runs of bytecodes: spans whose extents overlap are in the same
+// run, so each run reaches its fixed point independently of the others.  A
+// run containing an offset setter depends on where it starts.  If the offset
+// setter before it is an align that always ends at a multiple of the period
+// of every offset setter in the run, only the fixed distance from that align
+// matters (e.g. a function aligned at its entry with aligned loops inside).
+// Runs between that align and the run change its distance, so they are merged
+// into it until the align before it qualifies; if none does, the run is
+// merged with everything before it in the section.  When a cache is provided,
+// a key is computed for each run from everything the optimizer observes
+// before expansion: bytecode types and minimum lengths, span values and
+// thresholds, and the response of each offset setter to a few probe offsets.
+// If the cache has an entry for the key, the recorded Expand() calls are
+// first run against copies of the affected bytecodes; if every copy responds
+// exactly as recorded, the optimizer would have taken the same path, so the
+// calls are applied to the real bytecodes and the run's spans are dropped.
+// Otherwise, the last Expand() the optimizer performs on each span in that
+// run is recorded under the key for the next assembly; expansions only grow a
+// bytecode, so the last one is enough to reach the final form, and a hit
+// costs one Expand() per expanded span instead of a full optimization.
+// Offset setters are not recorded; step 1c recomputes them from the final
+// offsets anyway.  Editing one function thus only re-optimizes the runs it
+// touches.
+//
 namespace {
 class OffsetSetter : public DebugDumper<OffsetSetter>
 {
@@ -201,11 +272,12 @@ OffsetSetter::Write(pugi::xml_node out) const
 #endif // WITH_XML
 
 namespace {
-class Span : public DebugDumper<Span>
+class Span
 {
-    friend class Optimizer;
-    friend class Optimizer::Impl;
 public:
+    // Span terms are stored contiguously in Optimizer::Impl::m_terms; the
+    // terms of a single span are adjacent and indexed by substitution
+    // index.
     class Term : public DebugDumper<Span::Term>
     {
     public:
@@ -213,7 +285,7 @@ public:
         Term(unsigned int subst,
              Location loc,
              Location loc2,
-             Span* span,
+             std::size_t span,
              long new_val);
         ~Term() {}
 #ifdef WITH_XML
@@ -222,43 +294,37 @@ public:
 
         Location m_loc;
         Location m_loc2;
-        Span* m_span;       // span this term is a member of
+        std::size_t m_span; // index of span this term is a member of
         long m_cur_val;
         long m_new_val;
         unsigned int m_subst;
     };
+    typedef std::vector<Term> Terms;
 
     Span(Bytecode& bc,
          int id,
-         const Value& value,
          long neg_thres,
          long pos_thres,
-         size_t os_index);
+         std::size_t os_index);
+    Span(const Span& oth);
+    Span& operator= (const Span& rhs);
     ~Span();
 
-    bool CreateTerms(Optimizer::Impl* optimize, Diagnostic& diags);
-    bool RecalcNormal(Diagnostic& diags);
+    void swap(Span& oth);
 
     std::string getName() const;
 #ifdef WITH_XML
-    pugi::xml_node Write(pugi::xml_node out) const;
+    pugi::xml_node Write(pugi::xml_node out, const Terms& terms) const;
     pugi::xml_node WriteRef(pugi::xml_node out) const;
 #endif // WITH_XML
 
-private:
-    Span(const Span&);                  // not implemented
-    const Span& operator=(const Span&); // not implemented
-
-    void AddTerm(unsigned int subst, Location loc, Location loc2);
-
-    Bytecode& m_bc;
+    Bytecode* m_bc;
 
     Value m_depval;
 
     // span terms in absolute portion of value
-    typedef std::vector<Term> Terms;
-    Terms m_span_terms;
-    ExprTerms m_expr_terms;
+    std::size_t m_terms_begin;
+    std::size_t m_terms_size;
 
     long m_cur_val;
     long m_new_val;
@@ -268,15 +334,35 @@ private:
 
     int m_id;
 
-    enum { INACTIVE = 0, ACTIVE, ON_Q } m_active;
+    // REMOVED spans are dropped from the span table after step 1b.
+    enum { INACTIVE = 0, ACTIVE, ON_Q, REMOVED } m_active;
+
+    // Index of first offset setter following this span's bytecode
+    std::size_t m_os_index;
 
-    // Spans that led to this span.  Used only for
+    // Index of this span's backtrace (id<=0 spans only).  Used only for
     // checking for circular references (cycles) with id=0 spans.
-    typedef llvm::SmallPtrSet<Span*, 4> BacktraceSpans;
-    BacktraceSpans m_backtrace;
+    std::size_t m_cycle_index;
+};
 
-    // Index of first offset setter following this span's bytecode
-    size_t m_os_index;
+// Length change of a bytecode during a batched expansion round.
+struct BcDelta
+{
+    BcDelta(Bytecode* bc_, long diff_) : bc(bc_), diff(diff_) {}
+    Bytecode* bc;
+    long diff;
+};
+typedef std::vector<BcDelta> BcDeltas;
+
+// Bytecode index range of a span term (see ITreeAdd()).  Empty if the term
+// is between locations in the same bytecode.
+struct TermRange
+{
+    unsigned long low;
+    unsigned long high;
+    bool forward;   // true if the term grows as the range grows
+
+    bool empty() const { return low > high; }
 };
 } // anonymous namespace
 
@@ -284,33 +370,90 @@ namespace yasm {
 class Optimizer::Impl : public DebugDumper<Optimizer::Impl>
 {
 public:
-    Impl(Diagnostic& diags);
+    Impl(Diagnostic& diags, OptimizerCache* cache);
     ~Impl();
 
     void Step1b();
     bool Step1d();
     void Step1e();
     void Step2();
+    unsigned long Step2Batched();
 
 #ifdef WITH_XML
     pugi::xml_node Write(pugi::xml_node out) const;
 #endif // WITH_XML
 
-    void ITreeAdd(Span& span, Span::Term& term);
-    void CheckCycle(IntervalTreeNode<Span::Term*> * node,
-                    Span& span);
-    void ExpandTerm(IntervalTreeNode<Span::Term*> * node, long len_diff);
+    bool Expand(Bytecode& bc,
+                int id,
+                long old_val,
+                long new_val,
+                bool* keep,
+                long* neg_thres,
+                long* pos_thres);
+    void ReplayCached();
+    bool Replay(const std::vector<Bytecode*>& bcs,
+                const OptimizerCache::Expansions& exps);
+    bool getSpanExtent(const Span& span,
+                       unsigned long* low,
+                       unsigned long* high) const;
+
+    void AddTerm(std::size_t span_index,
+                 unsigned int subst,
+                 Location loc,
+                 Location loc2);
+    bool CreateTerms(std::size_t span_index);
+    bool RecalcNormal(Span& span);
+    void RemoveSpans();
+
+    TermRange getTermRange(const Span& span, std::size_t term_index) const;
+    void ITreeAdd(const Span& span, std::size_t term_index);
+    void CheckCycle(IntervalTreeNode<std::size_t>* node, const Span& span);
+    void ExpandTerm(IntervalTreeNode<std::size_t>* node, long len_diff);
+    long UpdatePrecedingSetter(OffsetSetter& os);
 
     Diagnostic& m_diags;
 
-    typedef std::list<Span*> Spans;
-    Spans m_spans;      // ownership list
+    // Spans in bytecode order.  A deque is used so that growing it never
+    // copies the spans' values.
+    typedef std::deque<Span> Spans;
+    Spans m_spans;
+
+    Span::Terms m_terms;
 
-    typedef std::deque<Span*> SpanQueue;
+    // Scratch expression terms for RecalcNormal().
+    ExprTerms m_expr_terms;
+
+    // Queues of span indexes.
+    typedef std::deque<std::size_t> SpanQueue;
     SpanQueue m_QA, m_QB;
 
-    IntervalTree<Span::Term*> m_itree;
+    // Bytecode index ranges of span terms, with data the term index.
+    IntervalTree<std::size_t> m_itree;
     std::vector<OffsetSetter> m_offset_setters;
+
+    // Backtraces of id<=0 spans: sorted cycle indexes of the spans each
+    // one depends on, so memory follows the dependencies that exist.
+    typedef std::vector<std::size_t> Backtrace;
+    std::vector<Backtrace> m_backtrace;
+
+    OptimizerCache* m_cache;
+
+    // Runs being recorded into the cache, by index of their last bytecode.
+    struct Recorder
+    {
+        OptimizerCache::Expansions* exps;
+        const BytecodeContainer* container;
+        unsigned long base;     // index of first bytecode in run
+
+        // Per bytecode (relative to base), 1 + index in exps of its most
+        // recent expansion, or 0 if none.
+        std::vector<std::size_t> last;
+        // Per expansion, 1 + index of the previous expansion of the same
+        // bytecode, or 0 if none.
+        std::vector<std::size_t> prev;
+    };
+    typedef std::map<unsigned long, Recorder> Recorders;
+    Recorders m_recorders;
 };
 } // namespace yasm
 
@@ -325,7 +468,7 @@ Span::Term::Term()
 Span::Term::Term(unsigned int subst,
                  Location loc,
                  Location loc2,
-                 Span* span,
+                 std::size_t span,
                  long new_val)
     : m_loc(loc),
       m_loc2(loc2),
@@ -353,23 +496,70 @@ Span::Term::Write(pugi::xml_node out) const
 
 Span::Span(Bytecode& bc,
            int id,
-           /*@null@*/ const Value& value,
            long neg_thres,
            long pos_thres,
-           size_t os_index)
-    : m_bc(bc),
-      m_depval(value),
+           std::size_t os_index)
+    : m_bc(&bc),
+      m_depval(0),
+      m_terms_begin(0),
+      m_terms_size(0),
       m_cur_val(0),
       m_new_val(0),
       m_neg_thres(neg_thres),
       m_pos_thres(pos_thres),
       m_id(id),
       m_active(ACTIVE),
-      m_os_index(os_index)
+      m_os_index(os_index),
+      m_cycle_index(0)
 {
     ++num_spans;
 }
 
+Span::Span(const Span& oth)
+    : m_bc(oth.m_bc),
+      m_depval(oth.m_depval),
+      m_terms_begin(oth.m_terms_begin),
+      m_terms_size(oth.m_terms_size),
+      m_cur_val(oth.m_cur_val),
+      m_new_val(oth.m_new_val),
+      m_neg_thres(oth.m_neg_thres),
+      m_pos_thres(oth.m_pos_thres),
+      m_id(oth.m_id),
+      m_active(oth.m_active),
+      m_os_index(oth.m_os_index),
+      m_cycle_index(oth.m_cycle_index)
+{
+}
+
+Span&
+Span::operator= (const Span& rhs)
+{
+    if (this != &rhs)
+        Span(rhs).swap(*this);
+    return *this;
+}
+
+Span::~Span()
+{
+}
+
+void
+Span::swap(Span& oth)
+{
+    std::swap(m_bc, oth.m_bc);
+    m_depval.swap(oth.m_depval);
+    std::swap(m_terms_begin, oth.m_terms_begin);
+    std::swap(m_terms_size, oth.m_terms_size);
+    std::swap(m_cur_val, oth.m_cur_val);
+    std::swap(m_new_val, oth.m_new_val);
+    std::swap(m_neg_thres, oth.m_neg_thres);
+    std::swap(m_pos_thres, oth.m_pos_thres);
+    std::swap(m_id, oth.m_id);
+    std::swap(m_active, oth.m_active);
+    std::swap(m_os_index, oth.m_os_index);
+    std::swap(m_cycle_index, oth.m_cycle_index);
+}
+
 void
 Optimizer::AddSpan(Bytecode& bc,
                    int id,
@@ -377,50 +567,60 @@ Optimizer::AddSpan(Bytecode& bc,
                    long neg_thres,
                    long pos_thres)
 {
-    m_impl->m_spans.push_back(new Span(bc, id, value, neg_thres, pos_thres,
-                                       m_impl->m_offset_setters.size()-1));
+    m_impl->m_spans.push_back(Span(bc, id, neg_thres, pos_thres,
+                                   m_impl->m_offset_setters.size()-1));
+    m_impl->m_spans.back().m_depval = value;
 }
 
 void
-Span::AddTerm(unsigned int subst, Location loc, Location loc2)
+Optimizer::Impl::AddTerm(std::size_t span_index,
+                         unsigned int subst,
+                         Location loc,
+                         Location loc2)
 {
     IntNum intn;
     bool ok = CalcDist(loc, loc2, &intn);
     ok = ok;    // avoid warning due to assert usage
     assert(ok && "could not calculate bc distance");
 
-    if (subst >= m_span_terms.size())
-        m_span_terms.resize(subst+1);
-    m_span_terms[subst] = Term(subst, loc, loc2, this, intn.getInt());
+    Span& span = m_spans[span_index];
+    if (subst >= span.m_terms_size)
+    {
+        span.m_terms_size = subst+1;
+        m_terms.resize(span.m_terms_begin + span.m_terms_size);
+    }
+    m_terms[span.m_terms_begin + subst] =
+        Span::Term(subst, loc, loc2, span_index, intn.getInt());
 }
 
 bool
-Span::CreateTerms(Optimizer::Impl* optimize, Diagnostic& diags)
+Optimizer::Impl::CreateTerms(std::size_t span_index)
 {
+    Span& span = m_spans[span_index];
+    span.m_terms_begin = m_terms.size();
+    span.m_terms_size = 0;
+
     // Split out sym-sym terms in absolute portion of dependent value
-    if (m_depval.hasAbs())
+    if (span.m_depval.hasAbs())
     {
-        SubstDist(*m_depval.getAbs(), diags,
-                  TR1::bind(&Span::AddTerm, this, _1, _2, _3));
-        if (m_span_terms.size() > 0)
+        SubstDist(*span.m_depval.getAbs(), m_diags,
+                  TR1::bind(&Optimizer::Impl::AddTerm, this, span_index,
+                            _1, _2, _3));
+        unsigned long index = span.m_bc->getIndex();
+        for (Span::Terms::const_iterator
+             i=m_terms.begin()+span.m_terms_begin, end=m_terms.end();
+             i != end; ++i)
         {
-            for (Terms::iterator i=m_span_terms.begin(),
-                 end=m_span_terms.end(); i != end; ++i)
+            // Check for circular references
+            if (span.m_id <= 0 &&
+                ((index > i->m_loc.bc->getIndex()-1 &&
+                  index <= i->m_loc2.bc->getIndex()-1) ||
+                 (index > i->m_loc2.bc->getIndex()-1 &&
+                  index <= i->m_loc.bc->getIndex()-1)))
             {
-                // Create expression terms with dummy value
-                m_expr_terms.push_back(ExprTerm(0));
-
-                // Check for circular references
-                if (m_id <= 0 &&
-                    ((m_bc.getIndex() > i->m_loc.bc->getIndex()-1 &&
-                      m_bc.getIndex() <= i->m_loc2.bc->getIndex()-1) ||
-                     (m_bc.getIndex() > i->m_loc2.bc->getIndex()-1 &&
-                      m_bc.getIndex() <= i->m_loc.bc->getIndex()-1)))
-                {
-                    diags.Report(m_bc.getSource(),
-                                 diag::err_optimizer_circular_reference);
-                    return false;
-                }
+                m_diags.Report(span.m_bc->getSource(),
+                               diag::err_optimizer_circular_reference);
+                return false;
             }
         }
     }
@@ -430,44 +630,74 @@ Span::CreateTerms(Optimizer::Impl* optimize, Diagnostic& diags)
 // Recalculate span value based on current span replacement values.
 // Returns True if span needs expansion (e.g. exceeded thresholds).
 bool
-Span::RecalcNormal(Diagnostic& diags)
+Optimizer::Impl::RecalcNormal(Span& span)
 {
     ++num_recalc;
-    m_new_val = 0;
+    span.m_new_val = 0;
 
-    if (m_depval.isRelative())
-        m_new_val = LONG_MAX;       // too complex; force to longest form
-    else if (m_depval.hasAbs())
+    if (span.m_depval.isRelative())
+        span.m_new_val = LONG_MAX;  // too complex; force to longest form
+    else if (span.m_depval.hasAbs())
     {
         ExprTerm result;
 
         // Update sym-sym terms and substitute back into expr
-        for (Terms::iterator i=m_span_terms.begin(), end=m_span_terms.end();
-             i != end; ++i)
+        if (m_expr_terms.size() < span.m_terms_size)
+            m_expr_terms.resize(span.m_terms_size, ExprTerm(0));
+        for (Span::Terms::const_iterator
+             i=m_terms.begin()+span.m_terms_begin,
+             end=i+span.m_terms_size; i != end; ++i)
             *m_expr_terms[i->m_subst].getIntNum() = i->m_new_val;
-        if (!Evaluate(*m_depval.getAbs(), diags, &result, &m_expr_terms[0],
-                      m_expr_terms.size(), false, false)
+        if (!Evaluate(*span.m_depval.getAbs(), m_diags, &result,
+                      m_expr_terms.empty() ? 0 : &m_expr_terms[0],
+                      span.m_terms_size, false, false)
             || !result.isType(ExprTerm::INT))
-            m_new_val = LONG_MAX;   // too complex; force to longest form
+            span.m_new_val = LONG_MAX;  // too complex; force to longest form
         else
-            m_new_val = result.getIntNum()->getInt();
+            span.m_new_val = result.getIntNum()->getInt();
     }
 
-    if (m_new_val == LONG_MAX)
-        m_active = INACTIVE;
+    if (span.m_new_val == LONG_MAX)
+        span.m_active = Span::INACTIVE;
 
-    DEBUG(llvm::errs() << "updated " << getName() << " newval to "
-          << m_new_val << '\n');
+    DEBUG(llvm::errs() << "updated " << span.getName() << " newval to "
+          << span.m_new_val << '\n');
 
     // If id<=0, flag update on any change
-    if (m_id <= 0)
-        return (m_new_val != m_cur_val);
+    if (span.m_id <= 0)
+        return (span.m_new_val != span.m_cur_val);
 
-    return (m_new_val < m_neg_thres || m_new_val > m_pos_thres);
+    return (span.m_new_val < span.m_neg_thres ||
+            span.m_new_val > span.m_pos_thres);
 }
 
-Span::~Span()
+// Drop spans marked REMOVED, keeping the remaining spans and their terms
+// contiguous and in order.
+void
+Optimizer::Impl::RemoveSpans()
 {
+    std::size_t sw = 0, tw = 0;
+    for (std::size_t sr=0, send=m_spans.size(); sr != send; ++sr)
+    {
+        Span& span = m_spans[sr];
+        if (span.m_active == Span::REMOVED)
+            continue;
+
+        std::size_t tr = span.m_terms_begin;
+        span.m_terms_begin = tw;
+        for (std::size_t n=0; n != span.m_terms_size; ++n, ++tr, ++tw)
+        {
+            if (tw != tr)
+                m_terms[tw] = m_terms[tr];
+            m_terms[tw].m_span = sw;
+        }
+
+        if (sw != sr)
+            m_spans[sw].swap(span);
+        ++sw;
+    }
+    m_spans.erase(m_spans.begin()+sw, m_spans.end());
+    m_terms.erase(m_terms.begin()+tw, m_terms.end());
 }
 
 std::string
@@ -475,17 +705,17 @@ Span::getName() const
 {
     llvm::SmallString<32> ss;
     llvm::raw_svector_ostream oss(ss);
-    oss << "SPAN{" << m_bc.getIndex() << ',' << m_id << '}';
+    oss << "SPAN{" << m_bc->getIndex() << ',' << m_id << '}';
     return oss.str();
 }
 
 #ifdef WITH_XML
 pugi::xml_node
-Span::Write(pugi::xml_node out) const
+Span::Write(pugi::xml_node out, const Terms& terms) const
 {
     pugi::xml_node root = out.append_child("Span");
     root.append_attribute("bc") =
-        llvm::Twine::utohexstr((uint64_t)(&m_bc)).str().c_str();
+        llvm::Twine::utohexstr((uint64_t)m_bc).str().c_str();
     root.append_attribute("id") = m_id;
 
     if (!m_depval.hasAbs() || m_depval.isRelative())
@@ -498,8 +728,8 @@ Span::Write(pugi::xml_node out) const
         append_child(root, "DepVal", oss.str().data());
     }
 
-    for (Terms::const_iterator i=m_span_terms.begin(), end=m_span_terms.end();
-         i != end; ++i)
+    for (Terms::const_iterator i=terms.begin()+m_terms_begin,
+         end=i+m_terms_size; i != end; ++i)
         append_data(root, *i);
 
     root.append_attribute("curval") = m_cur_val;
@@ -512,13 +742,9 @@ Span::Write(pugi::xml_node out) const
         case INACTIVE:  root.append_attribute("active") = "inactive"; break;
         case ACTIVE:    root.append_attribute("active") = "active"; break;
         case ON_Q:      root.append_attribute("active") = "queued"; break;
+        case REMOVED:   root.append_attribute("active") = "removed"; break;
     }
 
-    pugi::xml_node backtrace = root.append_child("Backtrace");
-    for (BacktraceSpans::const_iterator i=m_backtrace.begin(),
-         end=m_backtrace.end(); i != end; ++i)
-        (*i)->WriteRef(backtrace);
-
     root.append_attribute("os_index") = static_cast<unsigned long>(m_os_index);
     return root;
 }
@@ -527,14 +753,15 @@ pugi::xml_node
 Span::WriteRef(pugi::xml_node out) const
 {
     pugi::xml_node root = out.append_child("Span");
-    root.append_attribute("bc") = m_bc.getIndex();
+    root.append_attribute("bc") = m_bc->getIndex();
     root.append_attribute("id") = m_id;
     return root;
 }
 #endif // WITH_XML
 
-Optimizer::Impl::Impl(Diagnostic& diags)
-    : m_diags(diags)
+Optimizer::Impl::Impl(Diagnostic& diags, OptimizerCache* cache)
+    : m_diags(diags),
+      m_cache(cache)
 {
     // Create an placeholder offset setter for spans to point to; this will
     // get updated if/when we actually run into one.
@@ -543,11 +770,6 @@ Optimizer::Impl::Impl(Diagnostic& diags)
 
 Optimizer::Impl::~Impl()
 {
-    while (!m_spans.empty())
-    {
-        delete m_spans.back();
-        m_spans.pop_back();
-    }
 }
 
 #ifdef WITH_XML
@@ -560,19 +782,32 @@ Optimizer::Impl::Write(pugi::xml_node out) const
     pugi::xml_node spans = root.append_child("Spans");
     for (Spans::const_iterator i=m_spans.begin(), end=m_spans.end();
          i != end; ++i)
-        append_data(spans, **i);
+    {
+        pugi::xml_node span = i->Write(spans, m_terms);
+        if (i->m_id > 0 || m_backtrace.empty())
+            continue;
+
+        pugi::xml_node backtrace = span.append_child("Backtrace");
+        const Backtrace& bt = m_backtrace[i->m_cycle_index];
+        for (Spans::const_iterator j=m_spans.begin(); j != end; ++j)
+        {
+            if (j->m_id <= 0 &&
+                std::binary_search(bt.begin(), bt.end(), j->m_cycle_index))
+                j->WriteRef(backtrace);
+        }
+    }
 
     // queue A
     pugi::xml_node qa = root.append_child("QueueA");
     for (SpanQueue::const_iterator j=m_QA.begin(), end=m_QA.end();
          j != end; ++j)
-        (*j)->WriteRef(qa);
+        m_spans[*j].WriteRef(qa);
 
     // queue B
     pugi::xml_node qb = root.append_child("QueueB");
     for (SpanQueue::const_iterator k=m_QB.begin(), end=m_QB.end();
          k != end; ++k)
-        (*k)->WriteRef(qa);
+        m_spans[*k].WriteRef(qa);
 
     // offset setters
     pugi::xml_node osetters = root.append_child("OffsetSetters");
@@ -596,173 +831,781 @@ Optimizer::AddOffsetSetter(Bytecode& bc)
     m_impl->m_offset_setters.push_back(OffsetSetter());
 }
 
-void
-Optimizer::Impl::ITreeAdd(Span& span, Span::Term& term)
+TermRange
+Optimizer::Impl::getTermRange(const Span& span,
+                              std::size_t term_index) const
 {
+    const Span::Term& term = m_terms[term_index];
     long precbc_index, precbc2_index;
-    unsigned long low, high;
+    TermRange range;
 
-    // Update term length
     if (term.m_loc.bc)
         precbc_index = term.m_loc.bc->getIndex();
     else
-        precbc_index = span.m_bc.getIndex()-1;
+        precbc_index = span.m_bc->getIndex()-1;
 
     if (term.m_loc2.bc)
         precbc2_index = term.m_loc2.bc->getIndex();
     else
-        precbc2_index = span.m_bc.getIndex()-1;
+        precbc2_index = span.m_bc->getIndex()-1;
 
     if (precbc_index < precbc2_index)
     {
-        low = precbc_index;
-        high = precbc2_index-1;
+        range.low = precbc_index;
+        range.high = precbc2_index-1;
+        range.forward = true;
     }
     else if (precbc_index > precbc2_index)
     {
-        low = precbc2_index;
-        high = precbc_index-1;
+        range.low = precbc2_index;
+        range.high = precbc_index-1;
+        range.forward = false;
     }
     else
-        return;     // difference is same bc - always 0!
+    {
+        // difference is same bc - always 0!
+        range.low = 1;
+        range.high = 0;
+        range.forward = true;
+    }
+    return range;
+}
+
+void
+Optimizer::Impl::ITreeAdd(const Span& span, std::size_t term_index)
+{
+    TermRange range = getTermRange(span, term_index);
+    if (range.empty())
+        return;
 
-    m_itree.Insert(static_cast<long>(low), static_cast<long>(high), &term);
+    m_itree.Insert(static_cast<long>(range.low),
+                   static_cast<long>(range.high),
+                   term_index);
     ++num_itree;
 }
 
 void
-Optimizer::Impl::CheckCycle(IntervalTreeNode<Span::Term*> * node, Span& span)
+Optimizer::Impl::CheckCycle(IntervalTreeNode<std::size_t>* node,
+                            const Span& span)
 {
-    Span::Term* term = node->getData();
-    Span* depspan = term->m_span;
+    const Span& depspan = m_spans[m_terms[node->getData()].m_span];
 
     // Only check for cycles in id=0 spans
-    if (depspan->m_id > 0)
+    if (depspan.m_id > 0)
         return;
 
+    const Backtrace& bt = m_backtrace[span.m_cycle_index];
+    Backtrace& depbt = m_backtrace[depspan.m_cycle_index];
+
     // Check for a circular reference by looking to see if this dependent
     // span is in our backtrace.
-    if (span.m_backtrace.count(depspan))
+    if (std::binary_search(bt.begin(), bt.end(), depspan.m_cycle_index))
     {
-        m_diags.Report(span.m_bc.getSource(),
+        m_diags.Report(span.m_bc->getSource(),
                        diag::err_optimizer_circular_reference);
         return;
     }
 
     // Add our complete backtrace and ourselves to backtrace of dependent
     // span.
-    depspan->m_backtrace.insert(span.m_backtrace.begin(),
-                                span.m_backtrace.end());
-    depspan->m_backtrace.insert(&span);
+    Backtrace merged;
+    merged.reserve(depbt.size() + bt.size() + 1);
+    std::set_union(depbt.begin(), depbt.end(), bt.begin(), bt.end(),
+                   std::back_inserter(merged));
+    Backtrace::iterator pos =
+        std::lower_bound(merged.begin(), merged.end(), span.m_cycle_index);
+    if (pos == merged.end() || *pos != span.m_cycle_index)
+        merged.insert(pos, span.m_cycle_index);
+    num_backtrace += merged.size() - depbt.size();
+    depbt.swap(merged);
 }
 
 void
-Optimizer::Impl::ExpandTerm(IntervalTreeNode<Span::Term*> * node, long len_diff)
+Optimizer::Impl::ExpandTerm(IntervalTreeNode<std::size_t>* node,
+                            long len_diff)
 {
-    Span::Term* term = node->getData();
-    Span* span = term->m_span;
+    std::size_t term_index = node->getData();
+    Span::Term& term = m_terms[term_index];
+    std::size_t span_index = term.m_span;
+    Span& span = m_spans[span_index];
     long precbc_index, precbc2_index;
 
     // Don't expand inactive spans
-    if (span->m_active == Span::INACTIVE)
+    if (span.m_active == Span::INACTIVE)
         return;
 
-    DEBUG(llvm::errs() << "expand " << span->getName() << " by " << len_diff
+    DEBUG(llvm::errs() << "expand " << span.getName() << " by " << len_diff
           << '\n');
 
     // Update term length
-    if (term->m_loc.bc)
-        precbc_index = term->m_loc.bc->getIndex();
+    if (term.m_loc.bc)
+        precbc_index = term.m_loc.bc->getIndex();
     else
-        precbc_index = span->m_bc.getIndex()-1;
+        precbc_index = span.m_bc->getIndex()-1;
 
-    if (term->m_loc2.bc)
-        precbc2_index = term->m_loc2.bc->getIndex();
+    if (term.m_loc2.bc)
+        precbc2_index = term.m_loc2.bc->getIndex();
     else
-        precbc2_index = span->m_bc.getIndex()-1;
+        precbc2_index = span.m_bc->getIndex()-1;
 
     if (precbc_index < precbc2_index)
-        term->m_new_val += len_diff;
+        term.m_new_val += len_diff;
     else
-        term->m_new_val -= len_diff;
-    DEBUG(llvm::errs() << "updated " << span->getName() << " term "
-          << (term-&span->m_span_terms.front())
-          << " newval to " << term->m_new_val << '\n');
+        term.m_new_val -= len_diff;
+    DEBUG(llvm::errs() << "updated " << span.getName() << " term "
+          << (term_index - span.m_terms_begin)
+          << " newval to " << term.m_new_val << '\n');
 
     // If already on Q, don't re-add
-    if (span->m_active == Span::ON_Q)
+    if (span.m_active == Span::ON_Q)
     {
-        DEBUG(llvm::errs() << span->getName() << " already on queue\n");
+        DEBUG(llvm::errs() << span.getName() << " already on queue\n");
         return;
     }
 
     // Update term and check against thresholds
-    if (!span->RecalcNormal(m_diags))
+    if (!RecalcNormal(span))
     {
-        DEBUG(llvm::errs() << span->getName()
+        DEBUG(llvm::errs() << span.getName()
               << " didn't change, not readded\n");
         return; // didn't exceed thresholds, we're done
     }
 
     // Exceeded thresholds, need to add to Q for expansion
-    DEBUG(llvm::errs() << span->getName() << " added back on queue\n");
-    if (span->m_id <= 0)
-        m_QA.push_back(span);
+    DEBUG(llvm::errs() << span.getName() << " added back on queue\n");
+    if (span.m_id <= 0)
+        m_QA.push_back(span_index);
     else
-        m_QB.push_back(span);
-    span->m_active = Span::ON_Q;    // Mark as being in Q
+        m_QB.push_back(span_index);
+    span.m_active = Span::ON_Q;     // Mark as being in Q
+}
+
+namespace {
+// Swallows diagnostics from probe expansions; the caller only checks
+// whether an error occurred.
+class ProbeDiagnosticClient : public DiagnosticClient
+{
+public:
+    void HandleDiagnostic(Diagnostic::Level level, const DiagnosticInfo& info)
+    {}
+};
+
+// Computes the cache key of a run of bytecodes.
+class RunKey
+{
+public:
+    RunKey(const BytecodeContainer& container,
+           unsigned long base,
+           unsigned long origin,
+           Diagnostic& probe_diags);
+
+    void AddBytecode(const Bytecode& bc);
+    void AddSpan(const Bytecode& bc,
+                 int id,
+                 const Value& value,
+                 long neg_thres,
+                 long pos_thres);
+    void AddInt(long val);
+    std::string getKey();
+
+    /// False if the run holds contents the key cannot describe.
+    bool isCacheable() const { return m_cacheable; }
+
+private:
+    void AddString(llvm::StringRef str);
+    void AddLocation(Location loc);
+    void AddExpr(const Expr& e);
+
+    MD5 m_md5;
+    const BytecodeContainer& m_container;
+    unsigned long m_base;
+    unsigned long m_origin;     // offset the probe offsets are relative to
+    Diagnostic& m_probe_diags;
+    bool m_cacheable;
+};
+} // anonymous namespace
+
+RunKey::RunKey(const BytecodeContainer& container,
+               unsigned long base,
+               unsigned long origin,
+               Diagnostic& probe_diags)
+    : m_container(container),
+      m_base(base),
+      m_origin(origin),
+      m_probe_diags(probe_diags),
+      m_cacheable(true)
+{
+}
+
+void
+RunKey::AddInt(long val)
+{
+    unsigned char buf[8];
+    unsigned long long uval = static_cast<unsigned long long>(val);
+    for (int i=0; i<8; ++i, uval >>= 8)
+        buf[i] = static_cast<unsigned char>(uval & 0xFF);
+    m_md5.Update(buf, 8);
+}
+
+void
+RunKey::AddString(llvm::StringRef str)
+{
+    AddInt(static_cast<long>(str.size()));
+    m_md5.Update(reinterpret_cast<const unsigned char*>(str.data()),
+                 static_cast<unsigned long>(str.size()));
+}
+
+void
+RunKey::AddLocation(Location loc)
+{
+    if (loc.bc->getContainer() == &m_container)
+    {
+        AddInt(static_cast<long>(loc.bc->getIndex() - m_base));
+        AddInt(static_cast<long>(loc.off));
+    }
+    else if (const Section* sect = loc.bc->getContainer()->getSection())
+    {
+        // Distances to other sections are never span terms, so only the
+        // identity of the section matters.
+        AddInt(-1);
+        AddString(sect->getName());
+    }
+    else
+    {
+        // A location inside nested (e.g. TIMES) contents; the key has no
+        // way to say where it is.
+        m_cacheable = false;
+    }
+}
+
+void
+RunKey::AddExpr(const Expr& e)
+{
+    const ExprTerms& terms = e.getTerms();
+    AddInt(static_cast<long>(terms.size()));
+    for (ExprTerms::const_iterator i=terms.begin(), end=terms.end();
+         i != end; ++i)
+    {
+        AddInt(i->getType());
+        AddInt(i->m_depth);
+        switch (i->getType())
+        {
+            case ExprTerm::INT:
+            {
+                const IntNum* intn = i->getIntNum();
+                AddInt(intn->isInt());
+                if (intn->isInt())
+                    AddInt(intn->getInt());
+                else
+                    AddString(intn->getStr());
+                break;
+            }
+            case ExprTerm::SUBST:
+                AddInt(*i->getSubst());
+                break;
+            case ExprTerm::SYM:
+            {
+                SymbolRef sym = i->getSymbol();
+                Location loc;
+                if (sym->getLabel(&loc))
+                    AddLocation(loc);
+                else
+                    AddString(sym->getName());
+                break;
+            }
+            case ExprTerm::LOC:
+                AddLocation(*i->getLocation());
+                break;
+            case ExprTerm::OP:
+                AddInt(i->getOp());
+                AddInt(i->getNumChild());
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+void
+RunKey::AddBytecode(const Bytecode& bc)
+{
+    AddInt(static_cast<long>(bc.getFixedLen()));
+    AddInt(static_cast<long>(bc.getTailLen()));
+    if (!bc.hasContents())
+    {
+        AddInt(-1);
+        return;
+    }
+    AddString(bc.getContents().getType());
+
+    if (bc.getSpecial() != Bytecode::Contents::SPECIAL_OFFSET)
+        return;
+
+    // Offset setter lengths are recomputed from offsets between passes, so
+    // capture how this one responds to a few offsets; together with the
+    // minimum length this pins down alignment boundary and org target.
+    Bytecode probe(bc);
+    long probe_offsets[3] =
+        { 0, 1, static_cast<long>(bc.getTailOffset() - m_origin) };
+    for (int i=0; i<3; ++i)
+    {
+        bool keep = false;
+        long neg_thres = 0, pos_thres = 0;
+        m_probe_diags.Reset();
+        bool ok = probe.Expand(1, 0, probe_offsets[i], &keep, &neg_thres,
+                               &pos_thres, m_probe_diags);
+        AddInt(ok && !m_probe_diags.hasErrorOccurred());
+        AddInt(static_cast<long>(probe.getTailLen()));
+        AddInt(keep);
+        AddInt(pos_thres);
+    }
+}
+
+void
+RunKey::AddSpan(const Bytecode& bc,
+                    int id,
+                    const Value& value,
+                    long neg_thres,
+                    long pos_thres)
+{
+    AddInt(static_cast<long>(bc.getIndex() - m_base));
+    AddInt(id);
+    AddInt(neg_thres);
+    AddInt(pos_thres);
+    AddInt(value.isRelative());
+    AddInt(value.hasAbs());
+    if (value.hasAbs())
+        AddExpr(*value.getAbs());
+}
+
+std::string
+RunKey::getKey()
+{
+    unsigned char digest[OptimizerCache::KEY_SIZE];
+    m_md5.Final(digest);
+    return std::string(reinterpret_cast<const char*>(digest),
+                       OptimizerCache::KEY_SIZE);
+}
+
+bool
+Optimizer::Impl::Expand(Bytecode& bc,
+                        int id,
+                        long old_val,
+                        long new_val,
+                        bool* keep,
+                        long* neg_thres,
+                        long* pos_thres)
+{
+    if (!bc.Expand(id, old_val, new_val, keep, neg_thres, pos_thres, m_diags))
+        return false;
+
+    if (m_recorders.empty()
+        || bc.getSpecial() == Bytecode::Contents::SPECIAL_OFFSET)
+        return true;
+    Recorders::iterator rec = m_recorders.lower_bound(bc.getIndex());
+    if (rec == m_recorders.end() || rec->second.base > bc.getIndex()
+        || rec->second.container != bc.getContainer())
+        return true;
+
+    // Only the last expansion of each span is kept: expansions only grow a
+    // bytecode, so the last one alone brings it to its final form.
+    Recorder& r = rec->second;
+    unsigned long bci = bc.getIndex() - r.base;
+    std::size_t slot = r.last[bci];
+    while (slot != 0 && (*r.exps)[slot-1].id != id)
+        slot = r.prev[slot-1];
+    if (slot == 0)
+    {
+        r.exps->push_back(OptimizerCache::Expansion());
+        r.prev.push_back(r.last[bci]);
+        slot = r.last[bci] = r.exps->size();
+    }
+
+    OptimizerCache::Expansion& exp = (*r.exps)[slot-1];
+    exp.bc = bci;
+    exp.id = id;
+    exp.old_val = old_val;
+    exp.new_val = new_val;
+    exp.len = bc.getTailLen();
+    exp.neg_thres = *neg_thres;
+    exp.pos_thres = *pos_thres;
+    exp.keep = *keep;
+    return true;
+}
+
+bool
+Optimizer::Impl::Replay(const std::vector<Bytecode*>& bcs,
+                        const OptimizerCache::Expansions& exps)
+{
+    // Dry run on copies first; nothing can be undone once applied.
+    ProbeDiagnosticClient probe_client;
+    Diagnostic probe_diags(&probe_client);
+    stdx::ptr_vector<Bytecode> probes;
+    stdx::ptr_vector_owner<Bytecode> probes_owner(probes);
+    std::map<unsigned long, Bytecode*> probe_of;
+    bool ok = true;
+    for (OptimizerCache::Expansions::const_iterator exp=exps.begin(),
+         end=exps.end(); ok && exp != end; ++exp)
+    {
+        if (exp->bc >= bcs.size() || !bcs[exp->bc]->hasContents())
+        {
+            ok = false;
+            break;
+        }
+        Bytecode*& probe = probe_of[exp->bc];
+        if (!probe)
+        {
+            probes.push_back(new Bytecode(*bcs[exp->bc]));
+            probe = &probes.back();
+        }
+
+        bool keep = false;
+        long neg_thres = exp->neg_thres, pos_thres = exp->pos_thres;
+        ok = probe->Expand(exp->id, exp->old_val, exp->new_val, &keep,
+                           &neg_thres, &pos_thres, probe_diags)
+            && !probe_diags.hasErrorOccurred()
+            && probe->getTailLen() == exp->len
+            && keep == exp->keep
+            && (!keep || (neg_thres == exp->neg_thres &&
+                          pos_thres == exp->pos_thres));
+    }
+    if (!ok)
+    {
+        DEBUG(llvm::errs() << "cache entry for run at bc "
+              << bcs.front()->getIndex() << " does not match, optimizing\n");
+        return false;
+    }
+
+    for (OptimizerCache::Expansions::const_iterator exp=exps.begin(),
+         end=exps.end(); exp != end; ++exp)
+    {
+        bool keep = false;
+        long neg_thres = exp->neg_thres, pos_thres = exp->pos_thres;
+        bcs[exp->bc]->Expand(exp->id, exp->old_val, exp->new_val, &keep,
+                             &neg_thres, &pos_thres, m_diags);
+    }
+    return true;
+}
+
+bool
+Optimizer::Impl::getSpanExtent(const Span& span,
+                               unsigned long* low,
+                               unsigned long* high) const
+{
+    const BytecodeContainer* container = span.m_bc->getContainer();
+    *low = *high = span.m_bc->getIndex();
+    if (!span.m_depval.hasAbs())
+        return true;
+
+    const ExprTerms& terms = span.m_depval.getAbs()->getTerms();
+    for (ExprTerms::const_iterator i=terms.begin(), end=terms.end();
+         i != end; ++i)
+    {
+        Location loc;
+        if (const Location* locp = i->getLocation())
+            loc = *locp;
+        else if (!i->isType(ExprTerm::SYM) || !i->getSymbol()->getLabel(&loc))
+            continue;
+
+        if (loc.bc->getContainer() == container)
+        {
+            // As in getTermRange(), a distance covers the bytecode of its
+            // lower location but not that of its upper one.
+            unsigned long index = loc.bc->getIndex();
+            if (index < *low)
+                *low = index;
+            if (index > *high+1)
+                *high = index-1;
+        }
+        else if (!loc.bc->getContainer()->getSection())
+            return false;   // inside nested (e.g. TIMES) contents
+    }
+    return true;
+}
+
+namespace {
+// Bytecodes and spans of a section that can be optimized on their own.
+struct SpanRun
+{
+    unsigned long low, high;    // bytecode index range
+    std::size_t spans_begin, spans_end;
+
+    // If nonzero, the run's offset setters repeat every period bytes, and
+    // the run starts gap bytes (modulo period) after an aligned offset.
+    unsigned long period;
+    unsigned long gap;
+};
+} // anonymous namespace
+
+// True if the offset setter always ends at a multiple of period, wherever
+// it starts.  Its length repeats every getOffsetPeriod() bytes, so each
+// offset in one repetition is tried.
+static bool
+AlwaysAligns(const Bytecode& bc, unsigned long period, Diagnostic& probe_diags)
+{
+    unsigned long own = bc.getContents().getOffsetPeriod();
+    if (own == 0 || own > 4096)
+        return false;
+
+    Bytecode probe(bc);
+    for (unsigned long offset=0; offset<own; ++offset)
+    {
+        bool keep = false;
+        long neg_thres = 0, pos_thres = 0;
+        probe_diags.Reset();
+        if (!probe.Expand(1, 0, static_cast<long>(offset), &keep, &neg_thres,
+                          &pos_thres, probe_diags)
+            || probe_diags.hasErrorOccurred()
+            || (offset + probe.getTailLen()) % period != 0)
+            return false;
+    }
+    return true;
+}
+
+void
+Optimizer::Impl::ReplayCached()
+{
+    ProbeDiagnosticClient probe_client;
+    Diagnostic probe_diags(&probe_client);
+
+    std::vector<SpanRun> runs, anchored;
+    std::vector<unsigned long> setters;
+    std::vector<Bytecode*> bcs;
+    std::set<std::string> recording;
+
+    // Spans were added in bytecode order, so each section's spans form a
+    // contiguous run.
+    std::size_t spani = 0, spanend = m_spans.size();
+    while (spani != spanend)
+    {
+        BytecodeContainer* container = m_spans[spani].m_bc->getContainer();
+        std::size_t first = spani;
+        while (spani != spanend
+               && m_spans[spani].m_bc->getContainer() == container)
+            ++spani;
+        if (container->getSection() == 0 ||
+            static_cast<BytecodeContainer*>(container->getSection())
+            != container)
+            continue;   // nested contents have no bytecode indexes
+        unsigned long base = container->bytecodes_front().getIndex();
+
+        // Merge spans with overlapping extents into runs.  Spans are in
+        // bytecode order and each span's own bytecode is in its extent, so
+        // a span can only overlap the last run or the ones it reaches back
+        // into.
+        runs.clear();
+        bool cacheable = true;
+        for (std::size_t i=first; cacheable && i != spani; ++i)
+        {
+            SpanRun run;
+            cacheable = getSpanExtent(m_spans[i], &run.low, &run.high);
+            run.spans_begin = i;
+            run.spans_end = i+1;
+            run.period = 0;
+            run.gap = 0;
+            while (!runs.empty() && runs.back().high >= run.low)
+            {
+                run.low = std::min(run.low, runs.back().low);
+                run.high = std::max(run.high, runs.back().high);
+                run.spans_begin = runs.back().spans_begin;
+                runs.pop_back();
+            }
+            runs.push_back(run);
+        }
+        if (!cacheable)
+            continue;
+
+        bcs.clear();
+        for (BytecodeContainer::bc_iterator bc=container->bytecodes_begin(),
+             end=container->bytecodes_end(); bc != end; ++bc)
+            bcs.push_back(&(*bc));
+
+        // A run with an offset setter inside depends on its start offset.
+        // Only the start offset modulo the setters' period matters, which
+        // is fixed if the setter before the run always aligns to it and
+        // nothing in between changes length; runs in between are merged
+        // into the run until that holds.  Otherwise the start offset
+        // depends on everything before it; merge the run with the runs
+        // before it and start it at the start of the section.
+        setters.clear();
+        for (std::vector<OffsetSetter>::const_iterator
+             os=m_offset_setters.begin(), osend=m_offset_setters.end();
+             os != osend; ++os)
+        {
+            if (os->m_bc && os->m_bc->getContainer() == container)
+                setters.push_back(os->m_bc->getIndex());
+        }
+        anchored.clear();
+        std::size_t prefix_end = 0;     // runs merged into the prefix
+        for (std::vector<SpanRun>::const_iterator run=runs.begin(),
+             runend=runs.end(); run != runend; ++run)
+        {
+            SpanRun cur = *run;
+            for (;;)
+            {
+                std::vector<unsigned long>::const_iterator before =
+                    std::lower_bound(setters.begin(), setters.end(),
+                                     cur.low);
+                unsigned long period = 1;
+                std::vector<unsigned long>::const_iterator os = before;
+                for (; os != setters.end() && *os <= cur.high; ++os)
+                {
+                    unsigned long os_period =
+                        bcs[*os-base]->getContents().getOffsetPeriod();
+                    if (os_period == 0)
+                    {
+                        period = 0;
+                        break;
+                    }
+                    period = std::max(period, os_period);
+                }
+                if (os == before)
+                    break;      // no offset setter inside
+
+                if (period != 0 && before != setters.begin())
+                {
+                    unsigned long anchori = *(before-1);
+                    if (!anchored.empty() && anchored.back().high >= anchori)
+                    {
+                        if (anchored.size() <= prefix_end)
+                        {
+                            prefix_end = anchored.size()+1;
+                            break;
+                        }
+                        cur.low = anchored.back().low;
+                        cur.spans_begin = anchored.back().spans_begin;
+                        anchored.pop_back();
+                        continue;
+                    }
+                    const Bytecode& anchor = *bcs[anchori-base];
+                    if (AlwaysAligns(anchor, period, probe_diags))
+                    {
+                        cur.period = period;
+                        cur.gap = (bcs[cur.low-base]->getOffset()
+                                   - anchor.getNextOffset()) % period;
+                        break;
+                    }
+                }
+                prefix_end = anchored.size()+1;
+                break;
+            }
+            anchored.push_back(cur);
+        }
+        runs.clear();
+        if (prefix_end != 0)
+        {
+            SpanRun merged = anchored[prefix_end-1];
+            merged.low = base;
+            merged.spans_begin = first;
+            merged.period = 0;
+            merged.gap = 0;
+            runs.push_back(merged);
+        }
+        runs.insert(runs.end(), anchored.begin()+prefix_end, anchored.end());
+
+        for (std::vector<SpanRun>::const_iterator run=runs.begin(),
+             runend=runs.end(); run != runend; ++run)
+        {
+            unsigned long origin = 0;
+            if (run->period != 0)
+                origin = bcs[run->low-base]->getOffset();
+            RunKey key(*container, run->low, origin, probe_diags);
+            key.AddInt(static_cast<long>(run->period));
+            key.AddInt(static_cast<long>(run->gap));
+            for (unsigned long i=run->low; i <= run->high; ++i)
+                key.AddBytecode(*bcs[i-base]);
+            for (std::size_t i=run->spans_begin; i != run->spans_end; ++i)
+            {
+                const Span& span = m_spans[i];
+                key.AddSpan(*span.m_bc, span.m_id, span.m_depval,
+                            span.m_neg_thres, span.m_pos_thres);
+            }
+            if (!key.isCacheable())
+                continue;
+            std::string keystr = key.getKey();
+
+            // Identical runs (e.g. from a macro) share a key; the entry is
+            // only complete once the first of them has been optimized.
+            if (recording.count(keystr))
+                continue;
+
+            const OptimizerCache::Expansions* exps = m_cache->Lookup(keystr);
+            std::vector<Bytecode*> runbcs(bcs.begin()+(run->low-base),
+                                          bcs.begin()+(run->high-base+1));
+            if (exps && Replay(runbcs, *exps))
+            {
+                ++num_cache_replayed;
+                for (std::size_t i=run->spans_begin; i != run->spans_end; ++i)
+                    m_spans[i].m_active = Span::REMOVED;
+                continue;
+            }
+
+            ++num_cache_recorded;
+            recording.insert(keystr);
+            Recorder& rec = m_recorders[run->high];
+            rec.exps = &m_cache->Record(keystr);
+            rec.container = container;
+            rec.base = run->low;
+            rec.last.assign(run->high - run->low + 1, 0);
+        }
+    }
 }
 
 void
 Optimizer::Impl::Step1b()
 {
-    Spans::iterator spani = m_spans.begin();
-    while (spani != m_spans.end())
+    if (m_cache)
+        ReplayCached();
+
+    for (std::size_t spani=0, spanend=m_spans.size(); spani != spanend;
+         ++spani)
     {
-        Span* span = *spani;
-        if (span->CreateTerms(this, m_diags) && span->RecalcNormal(m_diags))
+        Span& span = m_spans[spani];
+        if (span.m_active == Span::REMOVED)
+            continue;   // replayed from cache
+        if (CreateTerms(spani) && RecalcNormal(span))
         {
             bool still_depend = false;
-            if (!span->m_bc.Expand(span->m_id, span->m_cur_val, span->m_new_val,
-                                   &still_depend, &span->m_neg_thres,
-                                   &span->m_pos_thres, m_diags))
+            if (!Expand(*span.m_bc, span.m_id, span.m_cur_val,
+                        span.m_new_val, &still_depend, &span.m_neg_thres,
+                        &span.m_pos_thres))
             {
                 continue; // error
             }
             else if (still_depend)
             {
-                if (span->m_active == Span::INACTIVE)
+                if (span.m_active == Span::INACTIVE)
                 {
-                    m_diags.Report(span->m_bc.getSource(),
+                    m_diags.Report(span.m_bc->getSource(),
                                    diag::err_optimizer_secondary_expansion);
                 }
             }
             else
             {
-                delete *spani;
-                spani = m_spans.erase(spani);
+                span.m_active = Span::REMOVED;
                 continue;
             }
         }
-        DEBUG(llvm::errs() << "updated " << span->getName() << " curval from "
-              << span->m_cur_val << " to " << span->m_new_val << '\n');
-        span->m_cur_val = span->m_new_val;
-        ++spani;
+        DEBUG(llvm::errs() << "updated " << span.getName() << " curval from "
+              << span.m_cur_val << " to " << span.m_new_val << '\n');
+        span.m_cur_val = span.m_new_val;
     }
+
+    RemoveSpans();
 }
 
 bool
 Optimizer::Impl::Step1d()
 {
-    for (Spans::iterator spani=m_spans.begin(), endspan=m_spans.end();
-         spani != endspan; ++spani)
+    for (std::size_t spani=0, spanend=m_spans.size(); spani != spanend;
+         ++spani)
     {
         ++num_step1d;
-        Span* span = *spani;
+        Span& span = m_spans[spani];
 
         // Update span terms based on new bc offsets
-        for (Span::Terms::iterator term=span->m_span_terms.begin(),
-             endterm=span->m_span_terms.end(); term != endterm; ++term)
+        for (Span::Terms::iterator term=m_terms.begin()+span.m_terms_begin,
+             endterm=term+span.m_terms_size; term != endterm; ++term)
         {
             IntNum intn;
             bool ok = CalcDist(term->m_loc, term->m_loc2, &intn);
@@ -770,16 +1613,16 @@ Optimizer::Impl::Step1d()
             assert(ok && "could not calculate bc distance");
             term->m_cur_val = term->m_new_val;
             term->m_new_val = intn.getInt();
-            DEBUG(llvm::errs() << "updated " << span->getName() << " term "
-                  << (term-span->m_span_terms.begin())
+            DEBUG(llvm::errs() << "updated " << span.getName() << " term "
+                  << (term-m_terms.begin()-span.m_terms_begin)
                   << " newval to " << term->m_new_val << '\n');
         }
 
-        if (span->RecalcNormal(m_diags))
+        if (RecalcNormal(span))
         {
             // Exceeded threshold, add span to QB
-            m_QB.push_back(&(*span));
-            span->m_active = Span::ON_Q;
+            m_QB.push_back(spani);
+            span.m_active = Span::ON_Q;
             ++num_initial_qb;
         }
     }
@@ -804,26 +1647,30 @@ Optimizer::Impl::Step1e()
     }
 
     // Build up interval tree
-    for (Spans::iterator spani=m_spans.begin(), endspan=m_spans.end();
-         spani != endspan; ++spani)
+    std::size_t num_cycle = 0;
+    for (Spans::iterator span=m_spans.begin(), endspan=m_spans.end();
+         span != endspan; ++span)
     {
-        Span* span = *spani;
-        for (Span::Terms::iterator term=span->m_span_terms.begin(),
-             endterm=span->m_span_terms.end(); term != endterm; ++term)
-            ITreeAdd(*span, *term);
+        for (std::size_t term=span->m_terms_begin,
+             endterm=term+span->m_terms_size; term != endterm; ++term)
+            ITreeAdd(*span, term);
+        if (span->m_id <= 0)
+            span->m_cycle_index = num_cycle++;
     }
 
     // Look for cycles in times expansion (span.id==0)
-    for (Spans::iterator spani=m_spans.begin(), endspan=m_spans.end();
-         spani != endspan; ++spani)
+    if (num_cycle == 0)
+        return;
+    m_backtrace.assign(num_cycle, Backtrace());
+    for (Spans::iterator span=m_spans.begin(), endspan=m_spans.end();
+         span != endspan; ++span)
     {
-        Span* span = *spani;
         if (span->m_id > 0)
             continue;
-        m_itree.Enumerate(static_cast<long>(span->m_bc.getIndex()),
-                          static_cast<long>(span->m_bc.getIndex()),
+        m_itree.Enumerate(static_cast<long>(span->m_bc->getIndex()),
+                          static_cast<long>(span->m_bc->getIndex()),
                           TR1::bind(&Optimizer::Impl::CheckCycle, this, _1,
-                                    TR1::ref(*span)));
+                                    TR1::cref(*span)));
     }
 }
 
@@ -834,40 +1681,41 @@ Optimizer::Impl::Step2()
 
     while (!m_QA.empty() || !m_QB.empty())
     {
-        Span* span;
+        std::size_t spani;
 
         // QA is for TIMES, update those first, then update non-TIMES.
         // This is so that TIMES can absorb increases before we look at
         // expanding non-TIMES BCs.
         if (!m_QA.empty())
         {
-            span = m_QA.front();
+            spani = m_QA.front();
             m_QA.pop_front();
         }
         else
         {
-            span = m_QB.front();
+            spani = m_QB.front();
             m_QB.pop_front();
         }
+        Span& span = m_spans[spani];
 
-        if (span->m_active == Span::INACTIVE)
+        if (span.m_active == Span::INACTIVE)
             continue;
-        span->m_active = Span::ACTIVE;  // no longer in Q
+        span.m_active = Span::ACTIVE;   // no longer in Q
 
         // Make sure we ended up ultimately exceeding thresholds; due to
         // offset BCs we may have been placed on Q and then reduced in size
         // again.
-        if (!span->RecalcNormal(m_diags))
+        if (!RecalcNormal(span))
             continue;
 
         ++num_expansions;
 
-        unsigned long orig_len = span->m_bc.getTotalLen();
+        unsigned long orig_len = span.m_bc->getTotalLen();
 
         bool still_depend = false;
-        if (!span->m_bc.Expand(span->m_id, span->m_cur_val, span->m_new_val,
-                               &still_depend, &span->m_neg_thres,
-                               &span->m_pos_thres, m_diags))
+        if (!Expand(*span.m_bc, span.m_id, span.m_cur_val,
+                    span.m_new_val, &still_depend, &span.m_neg_thres,
+                    &span.m_pos_thres))
         {
             // error
             continue;
@@ -875,40 +1723,62 @@ Optimizer::Impl::Step2()
         else if (still_depend)
         {
             // another threshold, keep active
-            for (Span::Terms::iterator term=span->m_span_terms.begin(),
-                 endterm=span->m_span_terms.end(); term != endterm; ++term)
+            for (Span::Terms::iterator term=m_terms.begin()+span.m_terms_begin,
+                 endterm=term+span.m_terms_size; term != endterm; ++term)
                 term->m_cur_val = term->m_new_val;
-            DEBUG(llvm::errs() << "updated " << span->getName()
-                  << " curval from " << span->m_cur_val << " to "
-                  << span->m_new_val << '\n');
-            span->m_cur_val = span->m_new_val;
+            DEBUG(llvm::errs() << "updated " << span.getName()
+                  << " curval from " << span.m_cur_val << " to "
+                  << span.m_new_val << '\n');
+            span.m_cur_val = span.m_new_val;
         }
         else
-            span->m_active = Span::INACTIVE;    // we're done with this span
+            span.m_active = Span::INACTIVE;     // we're done with this span
 
-        long len_diff = span->m_bc.getTotalLen() - orig_len;
+        long len_diff = span.m_bc->getTotalLen() - orig_len;
         if (len_diff == 0)
             continue;   // didn't increase in size
 
-        DEBUG(llvm::errs() << "BC@" << &span->m_bc << " ("
-              << span->m_bc.getIndex() << ") expansion by "
+        DEBUG(llvm::errs() << "BC@" << span.m_bc << " ("
+              << span.m_bc->getIndex() << ") expansion by "
               << len_diff << ":\n");
         // Iterate over all spans dependent across the bc just expanded
-        m_itree.Enumerate(static_cast<long>(span->m_bc.getIndex()),
-                          static_cast<long>(span->m_bc.getIndex()),
+        m_itree.Enumerate(static_cast<long>(span.m_bc->getIndex()),
+                          static_cast<long>(span.m_bc->getIndex()),
                           TR1::bind(&Optimizer::Impl::ExpandTerm, this, _1,
                                     len_diff));
 
+        // An offset-setter just before the bc just expanded may depend on
+        // its length; its own offset is unchanged, so re-evaluate it in
+        // place and include its change in the offset change that follows.
+        if (span.m_os_index > 0)
+        {
+            OffsetSetter& prev = m_offset_setters[span.m_os_index-1];
+            if (prev.m_bc && prev.m_bc->getIndex()+2 >= span.m_bc->getIndex()
+                && prev.m_bc->getContainer() == span.m_bc->getContainer())
+            {
+                long prev_diff = UpdatePrecedingSetter(prev);
+                if (prev_diff != 0)
+                {
+                    m_itree.Enumerate(
+                        static_cast<long>(prev.m_bc->getIndex()),
+                        static_cast<long>(prev.m_bc->getIndex()),
+                        TR1::bind(&Optimizer::Impl::ExpandTerm, this, _1,
+                                  prev_diff));
+                    len_diff += prev_diff;
+                }
+            }
+        }
+
         // Iterate over offset-setters that follow the bc just expanded.
         // Stop iteration if:
         //  - no more offset-setters in this section
         //  - offset-setter didn't move its following offset
         std::vector<OffsetSetter>::iterator os =
-            m_offset_setters.begin() + span->m_os_index;
+            m_offset_setters.begin() + span.m_os_index;
         long offset_diff = len_diff;
         while (os != m_offset_setters.end()
                && os->m_bc
-               && os->m_bc->getContainer() == span->m_bc.getContainer()
+               && os->m_bc->getContainer() == span.m_bc->getContainer()
                && offset_diff != 0)
         {
             unsigned long old_next_offset =
@@ -920,12 +1790,11 @@ Optimizer::Impl::Step2()
             os->m_new_val += offset_diff;
 
             orig_len = os->m_bc->getTailLen();
-            bool still_depend_temp;
-            long neg_thres_temp, pos_thres_temp;
-            os->m_bc->Expand(1, static_cast<long>(os->m_cur_val),
-                             static_cast<long>(os->m_new_val),
-                             &still_depend_temp, &neg_thres_temp,
-                             &pos_thres_temp, m_diags);
+            bool still_depend_temp = false;
+            long neg_thres_temp = 0, pos_thres_temp = 0;
+            Expand(*os->m_bc, 1, static_cast<long>(os->m_cur_val),
+                   static_cast<long>(os->m_new_val), &still_depend_temp,
+                   &neg_thres_temp, &pos_thres_temp);
             os->m_thres = static_cast<long>(pos_thres_temp);
 
             offset_diff =
@@ -948,8 +1817,327 @@ Optimizer::Impl::Step2()
     }
 }
 
-Optimizer::Optimizer(Diagnostic& diags)
-    : m_impl(new Impl(diags))
+long
+Optimizer::Impl::UpdatePrecedingSetter(OffsetSetter& os)
+{
+    unsigned long orig_len = os.m_bc->getTailLen();
+    bool still_depend_temp = false;
+    long neg_thres_temp = 0, pos_thres_temp = 0;
+    Expand(*os.m_bc, 1, static_cast<long>(os.m_cur_val),
+           static_cast<long>(os.m_new_val), &still_depend_temp,
+           &neg_thres_temp, &pos_thres_temp);
+    os.m_thres = static_cast<long>(pos_thres_temp);
+
+    long len_diff = os.m_bc->getTailLen() - orig_len;
+    if (len_diff != 0)
+        DEBUG(llvm::errs() << "BC@" << os.m_bc << " ("
+              << os.m_bc->getIndex() << ") offset setter change by "
+              << len_diff << " from following bc:\n");
+    return len_diff;
+}
+
+unsigned long
+Optimizer::Impl::Step2Batched()
+{
+    // Only sections where expansions can't make any span shorter are
+    // batched: no id<=0 spans (e.g. TIMES counts, which can go either way),
+    // only spans whose value is a single term, and no span across an
+    // offset setter (which absorbs growth).  There every span that exceeds
+    // its thresholds still does once more bytecodes have grown, so
+    // expanding a whole batch at once reaches the same result as step 2.
+    // Spans never cross sections, so the other sections are simply left to
+    // step 2.
+    std::vector<unsigned long> setters;     // bytecode indexes, in order
+    for (std::vector<OffsetSetter>::const_iterator os=m_offset_setters.begin(),
+         end=m_offset_setters.end(); os != end; ++os)
+    {
+        if (os->m_bc)
+            setters.push_back(os->m_bc->getIndex());
+    }
+    std::set<const BytecodeContainer*> sequential;
+    for (Spans::const_iterator span=m_spans.begin(), end=m_spans.end();
+         span != end; ++span)
+    {
+        if (span->m_active == Span::INACTIVE)
+            continue;
+        bool batchable = span->m_id > 0 && span->m_terms_size == 1
+            && span->m_depval.hasAbs() && !span->m_depval.isRelative();
+        if (batchable)
+        {
+            const ExprTerms& abs = span->m_depval.getAbs()->getTerms();
+            batchable = abs.size() == 1 && abs.front().isType(ExprTerm::SUBST);
+        }
+        if (batchable)
+        {
+            TermRange range = getTermRange(*span, span->m_terms_begin);
+            std::vector<unsigned long>::const_iterator os =
+                std::lower_bound(setters.begin(), setters.end(), range.low);
+            batchable = range.empty() || os == setters.end()
+                || *os > range.high;
+        }
+        if (!batchable)
+            sequential.insert(span->m_bc->getContainer());
+    }
+
+    SpanQueue batch;
+    if (!sequential.empty())
+    {
+        SpanQueue QA, QB;
+        QA.swap(m_QA);
+        QB.swap(m_QB);
+        for (SpanQueue::const_iterator i=QA.begin(), end=QA.end(); i != end;
+             ++i)
+            m_QA.push_back(*i);     // id<=0 spans are always sequential
+        for (SpanQueue::const_iterator i=QB.begin(), end=QB.end(); i != end;
+             ++i)
+        {
+            if (sequential.count(m_spans[*i].m_bc->getContainer()))
+                m_QB.push_back(*i);
+            else
+                batch.push_back(*i);
+        }
+        Step2();
+        m_QB.swap(batch);
+        batch.clear();
+    }
+
+    DEBUG(Dump());
+
+    // Bytecode index ranges of the terms that can be batched; the ranges
+    // never change.  The average number of terms crossing a bytecode
+    // estimates the cost of updating terms through the interval tree.
+    std::vector<std::size_t> batch_terms;
+    std::vector<TermRange> ranges;
+    unsigned long num_indexes = 0;
+    unsigned long total_cover = 0;
+    for (std::size_t i=0, end=m_terms.size(); i != end; ++i)
+    {
+        const Span& span = m_spans[m_terms[i].m_span];
+        if (span.m_active == Span::INACTIVE
+            || sequential.count(span.m_bc->getContainer()))
+            continue;
+        TermRange range = getTermRange(span, i);
+        if (range.empty())
+            continue;
+        batch_terms.push_back(i);
+        ranges.push_back(range);
+        if (range.high+1 > num_indexes)
+            num_indexes = range.high+1;
+        total_cover += range.high - range.low + 1;
+    }
+    unsigned long sweep_cost = num_indexes + batch_terms.size();
+    unsigned long delta_cost = 1;
+    for (std::size_t n=batch_terms.size(); n > 1; n >>= 1)
+        ++delta_cost;
+    if (num_indexes != 0)
+        delta_cost += total_cover / num_indexes;
+
+    // prefix[i] is the total length change of bytecodes with index < i.
+    std::vector<long> prefix;
+    BcDeltas deltas;
+    std::vector<std::size_t> touched;
+
+    // Offset change before each offset setter, and the offset setters to
+    // update after a batch.
+    std::vector<long> os_diff(m_offset_setters.size(), 0);
+    std::vector<std::size_t> os_marked;
+
+    unsigned long num_batched = 0;
+    while (!m_QB.empty())
+    {
+        batch.clear();
+        batch.swap(m_QB);
+        ++num_batches;
+
+        deltas.clear();
+        for (SpanQueue::const_iterator i=batch.begin(), end=batch.end();
+             i != end; ++i)
+        {
+            Span& span = m_spans[*i];
+
+            if (span.m_active == Span::INACTIVE)
+                continue;
+            span.m_active = Span::ACTIVE;   // no longer in Q
+
+            if (!RecalcNormal(span))
+                continue;
+
+            ++num_expansions;
+            ++num_batched;
+
+            unsigned long orig_len = span.m_bc->getTotalLen();
+
+            bool still_depend = false;
+            if (!Expand(*span.m_bc, span.m_id, span.m_cur_val,
+                        span.m_new_val, &still_depend, &span.m_neg_thres,
+                        &span.m_pos_thres))
+            {
+                // error
+                continue;
+            }
+            else if (still_depend)
+            {
+                // another threshold, keep active
+                for (Span::Terms::iterator
+                     term=m_terms.begin()+span.m_terms_begin,
+                     endterm=term+span.m_terms_size; term != endterm; ++term)
+                    term->m_cur_val = term->m_new_val;
+                span.m_cur_val = span.m_new_val;
+            }
+            else
+                span.m_active = Span::INACTIVE; // we're done with this span
+
+            long len_diff = span.m_bc->getTotalLen() - orig_len;
+            if (len_diff == 0)
+                continue;
+            deltas.push_back(BcDelta(span.m_bc, len_diff));
+
+            // Note the offset setter that follows the bytecode, and the one
+            // just before it if it may depend on the bytecode's length.
+            const BytecodeContainer* container = span.m_bc->getContainer();
+            if (m_offset_setters[span.m_os_index].m_bc
+                && m_offset_setters[span.m_os_index].m_bc->getContainer()
+                   == container)
+            {
+                os_diff[span.m_os_index] += len_diff;
+                os_marked.push_back(span.m_os_index);
+            }
+            if (span.m_os_index > 0)
+            {
+                const OffsetSetter& prev = m_offset_setters[span.m_os_index-1];
+                if (prev.m_bc
+                    && prev.m_bc->getIndex()+2 >= span.m_bc->getIndex()
+                    && prev.m_bc->getContainer() == container)
+                    os_marked.push_back(span.m_os_index-1);
+            }
+        }
+
+        if (deltas.empty())
+            continue;
+
+        // Move the noted offset setters by the growth before them, in
+        // section order, carrying any change in the offset following each
+        // on to the next, as step 2 does after each expansion.  No batched
+        // term crosses an offset setter, so their length changes don't
+        // need to be propagated.
+        std::sort(os_marked.begin(), os_marked.end());
+        os_marked.erase(std::unique(os_marked.begin(), os_marked.end()),
+                        os_marked.end());
+        std::vector<std::size_t>::const_iterator mark = os_marked.begin();
+        std::size_t osi = 0;
+        long offset_diff = 0;
+        const BytecodeContainer* container = 0;
+        for (;;)
+        {
+            bool marked;
+            if (offset_diff == 0)
+            {
+                if (mark == os_marked.end())
+                    break;
+                osi = *mark++;
+                marked = true;
+            }
+            else
+            {
+                marked = (mark != os_marked.end() && *mark == osi);
+                if (marked)
+                    ++mark;
+            }
+
+            OffsetSetter& os = m_offset_setters[osi];
+            long diff = os_diff[osi];
+            os_diff[osi++] = 0;
+            if (!os.m_bc || os.m_bc->getContainer() != container)
+                offset_diff = 0;    // end of section
+            if (!os.m_bc)
+                continue;
+            container = os.m_bc->getContainer();
+            offset_diff += diff;
+            if (offset_diff == 0 && !marked)
+                continue;
+
+            unsigned long old_next_offset =
+                os.m_cur_val + os.m_bc->getTotalLen();
+
+            assert((offset_diff >= 0 ||
+                    static_cast<unsigned long>(-offset_diff) <= os.m_new_val)
+                   && "org/align went to negative offset");
+            os.m_new_val += offset_diff;
+            UpdatePrecedingSetter(os);
+            offset_diff =
+                os.m_new_val + os.m_bc->getTotalLen() - old_next_offset;
+            os.m_cur_val = os.m_new_val;
+        }
+        os_marked.clear();
+
+        // Few expansions (e.g. a chain of jumps each pushing the next out
+        // of range): update just the crossing terms through the interval
+        // tree, as step 2 does.  This also queues spans that now exceed
+        // their thresholds.
+        if (deltas.size() * delta_cost < sweep_cost)
+        {
+            for (BcDeltas::const_iterator d=deltas.begin(), end=deltas.end();
+                 d != end; ++d)
+                m_itree.Enumerate(static_cast<long>(d->bc->getIndex()),
+                                  static_cast<long>(d->bc->getIndex()),
+                                  TR1::bind(&Optimizer::Impl::ExpandTerm,
+                                            this, _1, d->diff));
+            continue;
+        }
+
+        // Many expansions: sum the length changes into prefix sums and
+        // update every term with a single subtraction.
+        prefix.assign(num_indexes+1, 0);
+        for (BcDeltas::const_iterator d=deltas.begin(), end=deltas.end();
+             d != end; ++d)
+        {
+            unsigned long index = d->bc->getIndex();
+            if (index < num_indexes)
+                prefix[index+1] += d->diff;
+        }
+        for (unsigned long i=1; i <= num_indexes; ++i)
+            prefix[i] += prefix[i-1];
+
+        // Terms are in span order, so touched spans stay in span order.
+        touched.clear();
+        for (std::size_t i=0, end=batch_terms.size(); i != end; ++i)
+        {
+            const TermRange& range = ranges[i];
+            long diff = prefix[range.high+1] - prefix[range.low];
+            if (diff == 0)
+                continue;
+
+            Span::Term& term = m_terms[batch_terms[i]];
+            Span& span = m_spans[term.m_span];
+            if (span.m_active == Span::INACTIVE)
+                continue;
+
+            if (range.forward)
+                term.m_new_val += diff;
+            else
+                term.m_new_val -= diff;
+
+            if (span.m_active != Span::ON_Q
+                && (touched.empty() || touched.back() != term.m_span))
+                touched.push_back(term.m_span);
+        }
+
+        // Queue spans that now exceed their thresholds.
+        for (std::vector<std::size_t>::const_iterator i=touched.begin(),
+             end=touched.end(); i != end; ++i)
+        {
+            Span& span = m_spans[*i];
+            if (!RecalcNormal(span))
+                continue;
+            m_QB.push_back(*i);
+            span.m_active = Span::ON_Q;
+        }
+    }
+    return num_batched;
+}
+
+Optimizer::Optimizer(Diagnostic& diags, OptimizerCache* cache)
+    : m_impl(new Impl(diags, cache))
 {
 }
 
@@ -981,6 +2169,12 @@ Optimizer::Step2()
     m_impl->Step2();
 }
 
+unsigned long
+Optimizer::Step2Batched()
+{
+    return m_impl->Step2Batched();
+}
+
 #ifdef WITH_XML
 pugi::xml_node
 Optimizer::Write(pugi::xml_node out) const
@@ -0,0 +1,170 @@
+//
+// Optimizer cache implementation.
+//
+//  Copyright (C) 2011  PathScale Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND OTHER CONTRIBUTORS ``AS IS''
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR OTHER CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+#include "yasmx/OptimizerCache.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "yasmx/Bytes.h"
+#include "yasmx/Bytes_util.h"
+#include "yasmx/InputBuffer.h"
+#include "yasmx/IntNum.h"
+
+
+using namespace yasm;
+
+static const char cache_magic[4] = { 'Y', 'O', 'P', 'T' };
+static const unsigned long cache_version = 1;
+
+// Size of an expansion record in the file.
+static const size_t expansion_size = 4+4+8+8+8+8+8+1;
+
+OptimizerCache::OptimizerCache()
+{
+}
+
+OptimizerCache::~OptimizerCache()
+{
+}
+
+const OptimizerCache::Expansions*
+OptimizerCache::Lookup(llvm::StringRef key)
+{
+    Entries::iterator i = m_entries.find(key);
+    if (i == m_entries.end())
+        return 0;
+    i->second.used = true;
+    return &i->second.expansions;
+}
+
+OptimizerCache::Expansions&
+OptimizerCache::Record(llvm::StringRef key)
+{
+    Entry& entry = m_entries[key];
+    entry.expansions.clear();
+    entry.used = true;
+    return entry.expansions;
+}
+
+bool
+OptimizerCache::Read(const llvm::MemoryBuffer& in)
+{
+    InputBuffer inbuf(in);
+    inbuf.setLittleEndian();
+
+    Entries entries;
+    try
+    {
+        const unsigned char* magic = inbuf.Read(4);
+        if (!std::equal(magic, magic+4, cache_magic))
+            return false;
+        if (ReadU32(inbuf) != cache_version)
+            return false;
+
+        unsigned long nentries = ReadU32(inbuf);
+        for (unsigned long i=0; i<nentries; ++i)
+        {
+            const char* key =
+                reinterpret_cast<const char*>(inbuf.Read(KEY_SIZE));
+            Expansions& exps = entries[std::string(key, KEY_SIZE)].expansions;
+
+            // Don't trust the count further than the data that's left.
+            unsigned long nexps = ReadU32(inbuf);
+            if (nexps > inbuf.getReadableSize() / expansion_size)
+                return false;
+            exps.reserve(nexps);
+            for (unsigned long j=0; j<nexps; ++j)
+            {
+                Expansion exp;
+                exp.bc = ReadU32(inbuf);
+                exp.id = ReadS32(inbuf);
+                exp.old_val = ReadS64(inbuf).getInt();
+                exp.new_val = ReadS64(inbuf).getInt();
+                exp.len = ReadU64(inbuf).getUInt();
+                exp.neg_thres = ReadS64(inbuf).getInt();
+                exp.pos_thres = ReadS64(inbuf).getInt();
+                exp.keep = ReadU8(inbuf) != 0;
+                exps.push_back(exp);
+            }
+        }
+    }
+    catch (std::out_of_range&)
+    {
+        return false;
+    }
+
+    for (Entries::iterator i=entries.begin(), end=entries.end(); i != end; ++i)
+        m_entries[i->first].expansions.swap(i->second.expansions);
+    return true;
+}
+
+void
+OptimizerCache::Write(llvm::raw_ostream& os) const
+{
+    Bytes bytes;
+    bytes.setLittleEndian();
+
+    unsigned long nentries = 0;
+    for (Entries::const_iterator i=m_entries.begin(), end=m_entries.end();
+         i != end; ++i)
+    {
+        if (i->second.used)
+            ++nentries;
+    }
+
+    bytes.Write(reinterpret_cast<const unsigned char*>(cache_magic), 4);
+    Write32(bytes, cache_version);
+    Write32(bytes, nentries);
+    os << bytes;
+
+    for (Entries::const_iterator i=m_entries.begin(), end=m_entries.end();
+         i != end; ++i)
+    {
+        if (!i->second.used)
+            continue;
+        const Expansions& exps = i->second.expansions;
+
+        bytes.clear();
+        bytes.Write(reinterpret_cast<const unsigned char*>(i->first.data()),
+                    KEY_SIZE);
+        Write32(bytes, static_cast<unsigned long>(exps.size()));
+        for (Expansions::const_iterator exp=exps.begin(), expend=exps.end();
+             exp != expend; ++exp)
+        {
+            Write32(bytes, exp->bc);
+            Write32(bytes, static_cast<unsigned long>(exp->id));
+            Write64(bytes, IntNum(exp->old_val));
+            Write64(bytes, IntNum(exp->new_val));
+            Write64(bytes, IntNum(exp->len));
+            Write64(bytes, IntNum(exp->neg_thres));
+            Write64(bytes, IntNum(exp->pos_thres));
+            Write8(bytes, exp->keep ? 1 : 0);
+        }
+        os << bytes;
+    }
+}
@@ -101,7 +101,8 @@ void
 Preprocessor::EnterTokenStream(const Token* toks,
                                unsigned int num_toks,
                                bool disable_macro_expansion,
-                               bool owns_tokens)
+                               bool owns_tokens,
+                               unsigned long repeat_count)
 {
     // Save our current state.
     PushIncludeMacroStack();
@@ -112,13 +113,14 @@ Preprocessor::EnterTokenStream(const Token* toks,
     {
         m_cur_token_lexer.reset(new TokenLexer(toks, num_toks,
                                                disable_macro_expansion,
-                                               owns_tokens, *this));
+                                               owns_tokens, *this,
+                                               repeat_count));
     }
     else
     {
         m_cur_token_lexer.reset(m_token_lexer_cache[--m_num_cached_token_lexers]);
         m_cur_token_lexer->Init(toks, num_toks, disable_macro_expansion,
-                                owns_tokens);
+                                owns_tokens, repeat_count);
     }
 }
 
@@ -76,7 +76,8 @@ void TokenLexer::Init(Token &Tok, SourceLocation ILEnd, MacroArgs *Actuals) {
 /// take ownership of the specified token vector.
 void
 TokenLexer::Init(const Token *TokArray, unsigned NumToks,
-                 bool disableMacroExpansion, bool ownsTokens)
+                 bool disableMacroExpansion, bool ownsTokens,
+                 unsigned long RepeatCount)
 {
     // If the client is reusing a TokenLexer, make sure to free any memory
     // associated with it.
@@ -89,8 +90,10 @@ TokenLexer::Init(const Token *TokArray, unsigned NumToks,
     m_tokens = TokArray;
     m_owns_tokens = ownsTokens;
     m_disable_macro_expansion = disableMacroExpansion;
-    m_num_tokens = NumToks;
+    m_num_tokens = RepeatCount == 0 ? 0 : NumToks;
     m_cur_token = 0;
+    m_repeat_count = RepeatCount;
+    m_iteration = 0;
     m_instantiate_loc_start = m_instantiate_loc_end = SourceLocation();
     m_at_start_of_line = false;
     m_has_leading_space = false;
@@ -343,6 +346,12 @@ void TokenLexer::Lex(Token* Tok) {
     return PPCache.Lex(Tok);
   }
 
+  // Start the next pass through a repeated token stream.
+  if (m_cur_token == m_num_tokens) {
+    ++m_iteration;
+    m_cur_token = 0;
+  }
+
   // If this is the first token of the expanded result, we inherit spacing
   // properties later.
   bool isFirstToken = m_cur_token == 0;
@@ -519,6 +528,8 @@ unsigned TokenLexer::isNextTokenLParen() const {
   // Out of tokens?
   if (isAtEnd())
     return 2;
+  if (m_cur_token == m_num_tokens)
+    return m_tokens[0].is(Token::l_paren);
   return m_tokens[m_cur_token].is(Token::l_paren);
 }
 
@@ -29,7 +29,7 @@
 
 using namespace yasm;
 
-Reloc::Reloc(const IntNum& addr, SymbolRef sym)
+Reloc::Reloc(uint64_t addr, SymbolRef sym)
     : m_addr(addr),
       m_sym(sym)
 {
@@ -51,7 +51,7 @@ Reloc::Write(pugi::xml_node out) const
 {
     pugi::xml_node root = out.append_child("Reloc");
     root.append_attribute("type") = getTypeName().c_str();
-    append_child(root, "Addr", m_addr);
+    append_child(root, "Addr", IntNum(m_addr));
     append_child(root, "Sym", m_sym);
     DoWrite(out);
     return root;
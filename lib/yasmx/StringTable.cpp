@@ -26,13 +26,49 @@
 
 #include "yasmx/StringTable.h"
 
+#include <algorithm>
+#include <cassert>
+
 #include "llvm/Support/raw_ostream.h"
 
 
 using namespace yasm;
 
+namespace {
+typedef std::pair<llvm::StringRef, unsigned long> TailEntry;
+
+// Orders strings by their reversed contents, descending, so that a string
+// immediately follows the strings it is a tail of.
+struct TailOrder
+{
+    bool operator() (const TailEntry& lhs, const TailEntry& rhs) const
+    {
+        llvm::StringRef a = lhs.first, b = rhs.first;
+        size_t na = a.size(), nb = b.size();
+        while (na > 0 && nb > 0)
+        {
+            unsigned char ca = a[--na], cb = b[--nb];
+            if (ca != cb)
+                return ca > cb;
+        }
+        return na > nb;
+    }
+};
+
+typedef std::pair<unsigned long, unsigned long> MergedIndex;
+
+struct MergedIndexLess
+{
+    bool operator() (const MergedIndex& lhs, unsigned long rhs) const
+    {
+        return lhs.first < rhs;
+    }
+};
+} // anonymous namespace
+
 StringTable::StringTable(unsigned long first_index)
     : m_first_index(first_index)
+    , m_intern(false)
 {
     m_storage.push_back('\0');
 }
@@ -44,12 +80,88 @@ StringTable::~StringTable()
 unsigned long
 StringTable::getIndex(llvm::StringRef str)
 {
+    llvm::StringMapEntry<unsigned long>* interned = 0;
+    if (m_intern)
+    {
+        interned = &m_interned.GetOrCreateValue(str, ~0UL);
+        if (interned->getValue() != ~0UL)
+            return interned->getValue();
+    }
+
     unsigned long end = m_storage.size();
     m_storage.insert(m_storage.end(), str.begin(), str.end());
     m_storage.push_back('\0');
+    m_offsets.push_back(end);
+
+    if (interned)
+        interned->setValue(m_first_index+end);
     return m_first_index+end;
 }
 
+void
+StringTable::MergeTails()
+{
+    std::vector<TailEntry> strs;
+    strs.reserve(m_offsets.size());
+    for (std::vector<unsigned long>::const_iterator i=m_offsets.begin(),
+         end=m_offsets.end(); i != end; ++i)
+        strs.push_back(TailEntry(llvm::StringRef(&m_storage[*i]), *i));
+    std::sort(strs.begin(), strs.end(), TailOrder());
+
+    std::vector<char> storage;
+    std::vector<unsigned long> offsets;
+    storage.reserve(m_storage.size());
+    storage.push_back('\0');
+    m_merged.clear();
+    m_merged.reserve(strs.size()+1);
+    m_merged.push_back(MergedIndex(m_first_index, m_first_index));
+
+    llvm::StringRef prev;
+    unsigned long prev_offset = 0;
+    for (std::vector<TailEntry>::const_iterator i=strs.begin(),
+         end=strs.end(); i != end; ++i)
+    {
+        llvm::StringRef str = i->first;
+        unsigned long offset;
+        if (str.empty())
+            offset = 0;
+        else if (prev.endswith(str))
+            offset = prev_offset + prev.size() - str.size();
+        else
+        {
+            offset = storage.size();
+            storage.insert(storage.end(), str.begin(), str.end());
+            storage.push_back('\0');
+            offsets.push_back(offset);
+            prev = str;
+            prev_offset = offset;
+        }
+        m_merged.push_back(MergedIndex(m_first_index+i->second,
+                                       m_first_index+offset));
+    }
+    std::sort(m_merged.begin(), m_merged.end());
+
+    // Interned indexes refer to the old layout; the keys are owned by the
+    // map, so only the values need translating.
+    for (llvm::StringMap<unsigned long>::iterator i=m_interned.begin(),
+         end=m_interned.end(); i != end; ++i)
+        i->second = getMergedIndex(i->second);
+
+    m_storage.swap(storage);
+    m_offsets.swap(offsets);
+}
+
+unsigned long
+StringTable::getMergedIndex(unsigned long index) const
+{
+    std::vector<MergedIndex>::const_iterator i =
+        std::lower_bound(m_merged.begin(), m_merged.end(), index,
+                         MergedIndexLess());
+    assert(i != m_merged.end() && i->first == index &&
+           "index not returned by getIndex()");
+    return i->second;
+}
+
 llvm::StringRef
 StringTable::getString(unsigned long index) const
 {
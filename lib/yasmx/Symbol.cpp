@@ -190,7 +190,7 @@ pugi::xml_node
 Symbol::Write(pugi::xml_node out) const
 {
     pugi::xml_node root = out.append_child("Symbol");
-    root.append_attribute("id") = m_name.c_str();
+    root.append_attribute("id") = m_name.str().c_str();
     append_child(root, "Name", m_name);
     pugi::xml_attribute type = root.append_attribute("type");
     switch (m_type)
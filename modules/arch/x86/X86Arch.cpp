@@ -53,7 +53,8 @@ X86Arch::X86Arch(const ArchModule& module)
       m_mode_bits(0),
       m_force_strict(false),
       m_default_rel(false),
-      m_nop(NOP_BASIC)
+      m_nop(NOP_BASIC),
+      m_branch_align(0)
 {
     // default to all instructions/features enabled
     m_active_cpu.set();
@@ -136,6 +137,12 @@ X86Arch::setVar(llvm::StringRef var, unsigned long val)
                "default_rel requires bits=64");
         m_default_rel = (val != 0);
     }
+    else if (var.equals_lower("align_branch_boundary"))
+    {
+        assert((val & (val-1)) == 0 &&
+               "align_branch_boundary must be a power of 2");
+        m_branch_align = val;
+    }
     else
         return false;
     return true;
@@ -173,6 +180,39 @@ X86Arch::DirCpu(DirectiveInfo& info, Diagnostic& diags)
     }
 }
 
+void
+X86Arch::DirArch(DirectiveInfo& info, Diagnostic& diags)
+{
+    for (NameValues::const_iterator nv=info.getNameValues().begin(),
+         end=info.getNameValues().end(); nv != end; ++nv)
+    {
+        if (!nv->isString())
+        {
+            diags.Report(info.getSource(),
+                diags.getCustomDiagID(Diagnostic::Warning,
+                                      "ignored unrecognized CPU identifier"))
+                << nv->getValueRange();
+            continue;
+        }
+
+        // GAS names extensions with a leading '.' (e.g. ".sse4"),
+        // and allows [no]jumps, which has no meaning to us.
+        llvm::StringRef name = nv->getString();
+        if (name.startswith("."))
+            name = name.substr(1);
+        if (name.equals_lower("jumps") || name.equals_lower("nojumps"))
+            continue;
+
+        if (!ParseCpu(name))
+        {
+            diags.Report(info.getSource(),
+                diags.getCustomDiagID(Diagnostic::Warning,
+                                      "ignored unrecognized CPU identifier"))
+                << nv->getValueRange();
+        }
+    }
+}
+
 void
 X86Arch::DirBits(DirectiveInfo& info, Diagnostic& diags)
 {
@@ -494,6 +534,7 @@ X86Arch::AddDirectives(Directives& dirs, llvm::StringRef parser)
         {".code16", &X86Arch::DirCode16, Directives::ANY},
         {".code32", &X86Arch::DirCode32, Directives::ANY},
         {".code64", &X86Arch::DirCode64, Directives::ANY},
+        {".arch",   &X86Arch::DirArch, Directives::ARG_REQUIRED},
     };
 
     if (parser.equals_lower("nasm"))
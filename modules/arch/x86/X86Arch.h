@@ -148,11 +148,14 @@ public:
         PARSER_GAS_INTEL = 2,
         PARSER_UNKNOWN
     };
+    /// Code alignment fill format.  Selected by the CPU name (P6 and K8
+    /// and later use long NOPs) and overridable by the basicnop, intelnop,
+    /// and amdnop CPU keywords.
     enum NopFormat
     {
-        NOP_BASIC,
-        NOP_INTEL,
-        NOP_AMD
+        NOP_BASIC,      ///< 8086-compatible fill, jmp over longer gaps
+        NOP_INTEL,      ///< 0F 1F long NOPs, prefixed up to 15 bytes
+        NOP_AMD         ///< 0F 1F long NOPs, paired above 10 bytes
     };
 
     /// Constructor.
@@ -190,6 +193,10 @@ public:
 
     unsigned int getModeBits() const { return m_mode_bits; }
 
+    /// Get the branch alignment boundary.
+    /// @return Boundary that jumps should not cross or end on, 0 if none.
+    unsigned long getBranchAlign() const { return m_branch_align; }
+
     static const char* getName()
     { return "x86 (IA-32 and derivatives), AMD64"; }
     static const char* getKeyword() { return "x86"; }
@@ -203,6 +210,7 @@ private:
 
     // Directives
     void DirCpu(DirectiveInfo& info, Diagnostic& diags);
+    void DirArch(DirectiveInfo& info, Diagnostic& diags);
     void DirBits(DirectiveInfo& info, Diagnostic& diags);
     void DirCode16(DirectiveInfo& info, Diagnostic& diags);
     void DirCode32(DirectiveInfo& info, Diagnostic& diags);
@@ -218,6 +226,7 @@ private:
     bool m_force_strict;
     bool m_default_rel;
     NopFormat m_nop;
+    unsigned long m_branch_align;
 };
 
 }} // namespace yasm::arch
@@ -0,0 +1,425 @@
+//
+// x86 branch boundary alignment bytecode
+//
+//  Copyright (C) 2011  PathScale Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND OTHER CONTRIBUTORS ``AS IS''
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR OTHER CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#define DEBUG_TYPE "x86"
+
+#include "X86BranchAlign.h"
+
+#include "llvm/ADT/Statistic.h"
+#include "yasmx/Basic/Diagnostic.h"
+#include "yasmx/BytecodeContainer.h"
+#include "yasmx/BytecodeOutput.h"
+#include "yasmx/Bytecode.h"
+#include "yasmx/Bytes.h"
+#include "yasmx/Section.h"
+
+
+STATISTIC(num_branch_align, "Number of branch alignment pads created");
+STATISTIC(num_branch_fused, "Number of fused compare and jump pairs");
+
+using namespace yasm;
+using namespace yasm::arch;
+
+namespace {
+class X86BranchAlign : public Bytecode::Contents
+{
+public:
+    X86BranchAlign(unsigned long boundary,
+                   const unsigned char** fill,
+                   X86BranchFuse fuse);
+    ~X86BranchAlign();
+
+    bool Finalize(Bytecode& bc, Diagnostic& diags);
+    bool CalcLen(Bytecode& bc,
+                 /*@out@*/ unsigned long* len,
+                 const Bytecode::AddSpanFunc& add_span,
+                 Diagnostic& diags);
+    bool Expand(Bytecode& bc,
+                unsigned long* len,
+                int span,
+                long old_val,
+                long new_val,
+                bool* keep,
+                /*@out@*/ long* neg_thres,
+                /*@out@*/ long* pos_thres,
+                Diagnostic& diags);
+    bool Output(Bytecode& bc, BytecodeOutput& bc_out);
+
+    llvm::StringRef getType() const;
+
+    SpecialType getSpecial() const;
+
+    X86BranchAlign* clone() const;
+
+#ifdef WITH_XML
+    pugi::xml_node Write(pugi::xml_node out) const;
+#endif // WITH_XML
+
+    bool Fuses(unsigned int cc) const;
+
+    unsigned long m_boundary;
+    const unsigned char** m_fill;
+
+    // Fusion class of the padded instruction; X86_FUSE_NONE for a jump.
+    X86BranchFuse m_fuse;
+
+    // Whether padding is applied.  Pads before fusible instructions are
+    // only activated by a following fused jcc.
+    bool m_active;
+
+    // Set between a jcc fusing with the padded instruction and the end of
+    // its append.
+    bool m_fusing;
+
+    // The padded region is the fixed part of the following bytecode up to
+    // m_fixed_len, plus its tail if m_tail is set.  A fused jcc that
+    // follows a tail is in the next bytecode, and extends the region in
+    // the same way.
+    /*@null@*/ const Bytecode* m_insn;
+    unsigned long m_fixed_len;
+    bool m_tail;
+
+    /*@null@*/ const Bytecode* m_next;
+    unsigned long m_next_fixed_len;
+    bool m_next_tail;
+};
+} // anonymous namespace
+
+X86BranchAlign::X86BranchAlign(unsigned long boundary,
+                               const unsigned char** fill,
+                               X86BranchFuse fuse)
+    : Bytecode::Contents(),
+      m_boundary(boundary),
+      m_fill(fill),
+      m_fuse(fuse),
+      m_active(fuse == X86_FUSE_NONE),
+      m_fusing(false),
+      m_insn(0),
+      m_fixed_len(0),
+      m_tail(false),
+      m_next(0),
+      m_next_fixed_len(0),
+      m_next_tail(false)
+{
+}
+
+X86BranchAlign::~X86BranchAlign()
+{
+}
+
+bool
+X86BranchAlign::Fuses(unsigned int cc) const
+{
+    switch (cc & 0xF)
+    {
+        case 0x0: case 0x1:     // jo, jno
+        case 0x8: case 0x9:     // js, jns
+        case 0xA: case 0xB:     // jp, jnp
+            return m_fuse == X86_FUSE_TEST_AND;
+        case 0x2: case 0x3:     // jc, jnc
+        case 0x6: case 0x7:     // jna, ja
+            return m_fuse == X86_FUSE_TEST_AND || m_fuse == X86_FUSE_CMP_ALU;
+        default:                // je, jne, jl, jge, jle, jg
+            return m_fuse != X86_FUSE_NONE;
+    }
+}
+
+bool
+X86BranchAlign::Finalize(Bytecode& bc, Diagnostic& diags)
+{
+    return true;
+}
+
+bool
+X86BranchAlign::CalcLen(Bytecode& bc,
+                        /*@out@*/ unsigned long* len,
+                        const Bytecode::AddSpanFunc& add_span,
+                        Diagnostic& diags)
+{
+    bool keep = false;
+    long neg_thres = 0;
+    long pos_thres = 0;
+
+    *len = 0;
+    return Expand(bc, len, 0, 0, static_cast<long>(bc.getTailOffset()),
+                  &keep, &neg_thres, &pos_thres, diags);
+}
+
+bool
+X86BranchAlign::Expand(Bytecode& bc,
+                       unsigned long* len,
+                       int span,
+                       long old_val,
+                       long new_val,
+                       bool* keep,
+                       /*@out@*/ long* neg_thres,
+                       /*@out@*/ long* pos_thres,
+                       Diagnostic& diags)
+{
+    *len = 0;
+    *pos_thres = new_val;
+    *keep = true;
+
+    if (!m_active || !m_insn)
+        return true;
+
+    unsigned long insn_len = m_fixed_len;
+    if (m_tail)
+        insn_len += m_insn->getTailLen();
+    if (m_next)
+    {
+        insn_len += m_next_fixed_len;
+        if (m_next_tail)
+            insn_len += m_next->getTailLen();
+    }
+
+    // Regions as long as the boundary can't be helped.
+    if (insn_len == 0 || insn_len >= m_boundary)
+        return true;
+
+    unsigned long start = static_cast<unsigned long>(new_val)
+        & (m_boundary-1);
+    if (start + insn_len >= m_boundary)
+        *len = m_boundary - start;
+    return true;
+}
+
+bool
+X86BranchAlign::Output(Bytecode& bc, BytecodeOutput& bc_out)
+{
+    unsigned long len = bc.getTailLen();
+    if (len == 0)
+        return true;
+
+    if (!bc_out.isBits())
+    {
+        // Output as a gap.
+        bc_out.OutputGap(len, bc.getSource());
+        return true;
+    }
+
+    unsigned long maxlen = 15;
+    while (!m_fill[maxlen] && maxlen>0)
+        maxlen--;
+    if (maxlen == 0)
+    {
+        bc_out.Diag(bc.getSource(), diag::err_align_code_not_found);
+        return false;
+    }
+
+    Bytes& bytes = bc_out.getScratch();
+    while (len > maxlen)
+    {
+        bytes.insert(bytes.end(), &m_fill[maxlen][0], &m_fill[maxlen][maxlen]);
+        len -= maxlen;
+    }
+
+    if (!m_fill[len])
+    {
+        bc_out.Diag(bc.getSource(), diag::err_align_invalid_code_size)
+            << static_cast<unsigned int>(len);
+        return false;
+    }
+    bytes.insert(bytes.end(), &m_fill[len][0], &m_fill[len][len]);
+    bc_out.OutputBytes(bytes, bc.getSource());
+    return true;
+}
+
+llvm::StringRef
+X86BranchAlign::getType() const
+{
+    return "yasm::arch::X86BranchAlign";
+}
+
+X86BranchAlign::SpecialType
+X86BranchAlign::getSpecial() const
+{
+    return SPECIAL_OFFSET;
+}
+
+X86BranchAlign*
+X86BranchAlign::clone() const
+{
+    return new X86BranchAlign(*this);
+}
+
+#ifdef WITH_XML
+pugi::xml_node
+X86BranchAlign::Write(pugi::xml_node out) const
+{
+    pugi::xml_node root = out.append_child("X86BranchAlign");
+    root.append_attribute("boundary") = m_boundary;
+    pugi::xml_attribute fuse = root.append_attribute("fuse");
+    switch (m_fuse)
+    {
+        case X86_FUSE_NONE:     fuse = "none"; break;
+        case X86_FUSE_TEST_AND: fuse = "test"; break;
+        case X86_FUSE_CMP_ALU:  fuse = "cmp"; break;
+        case X86_FUSE_INC_DEC:  fuse = "incdec"; break;
+    }
+    if (m_active)
+        root.append_attribute("active") = true;
+    root.append_attribute("fixedlen") = m_fixed_len;
+    if (m_tail)
+        root.append_attribute("tail") = true;
+    if (m_next)
+    {
+        root.append_attribute("nextfixedlen") = m_next_fixed_len;
+        if (m_next_tail)
+            root.append_attribute("nexttail") = true;
+    }
+    return root;
+}
+#endif // WITH_XML
+
+// Padding is only done at section level; bytecodes inside a TIMES
+// container can't be offset setters.
+static inline bool
+isSectionLevel(BytecodeContainer& container)
+{
+    return static_cast<BytecodeContainer*>(container.getSection())
+        == &container;
+}
+
+// The pad n bytecodes before the last bytecode of the container, if any.
+static X86BranchAlign*
+getLastPad(BytecodeContainer& container, int n = 1)
+{
+    if (container.size() < static_cast<unsigned long>(n+1))
+        return 0;
+    Bytecode& bc = *(container.bytecodes_end() - (n+1));
+    if (!bc.hasContents()
+        || bc.getContents().getType() != "yasm::arch::X86BranchAlign")
+        return 0;
+    return static_cast<X86BranchAlign*>(&bc.getContents());
+}
+
+static void
+AppendPad(BytecodeContainer& container,
+          unsigned long boundary,
+          const unsigned char** fill,
+          X86BranchFuse fuse,
+          SourceLocation source)
+{
+    Bytecode& bc = container.FreshBytecode();
+    bc.Transform(Bytecode::Contents::Ptr(
+        new X86BranchAlign(boundary, fill, fuse)));
+    bc.setSource(source);
+    ++num_branch_align;
+}
+
+void
+arch::AppendBranchAlign(BytecodeContainer& container,
+                        unsigned long boundary,
+                        const unsigned char** fill,
+                        SourceLocation source)
+{
+    if (!isSectionLevel(container))
+        return;
+    AppendPad(container, boundary, fill, X86_FUSE_NONE, source);
+}
+
+void
+arch::AppendJccAlign(BytecodeContainer& container,
+                     unsigned long boundary,
+                     const unsigned char** fill,
+                     unsigned int cc,
+                     SourceLocation source)
+{
+    if (!isSectionLevel(container))
+        return;
+
+    // Fuse if the previous instruction was padded as fusible and nothing
+    // has been appended after it since.  If it ended in a tail, an empty
+    // bytecode may already have been started for the jcc.
+    Bytecode& last = container.bytecodes_back();
+    X86BranchAlign* pad = getLastPad(container);
+    bool fuse = false;
+    if (pad && pad->m_insn == &last)
+    {
+        if (pad->m_tail)
+            fuse = last.hasContents();
+        else
+            fuse = !last.hasContents()
+                && last.getFixedLen() == pad->m_fixed_len;
+    }
+    else if (!last.hasContents() && last.getFixedLen() == 0
+             && (pad = getLastPad(container, 2)) != 0)
+    {
+        fuse = pad->m_tail
+            && pad->m_insn == &*(container.bytecodes_end() - 2);
+    }
+    if (fuse && !pad->m_next && pad->Fuses(cc))
+    {
+        pad->m_active = true;
+        pad->m_fusing = true;
+        ++num_branch_fused;
+        return;
+    }
+    AppendPad(container, boundary, fill, X86_FUSE_NONE, source);
+}
+
+void
+arch::AppendFusibleAlign(BytecodeContainer& container,
+                         unsigned long boundary,
+                         const unsigned char** fill,
+                         X86BranchFuse fuse,
+                         SourceLocation source)
+{
+    if (!isSectionLevel(container))
+        return;
+    AppendPad(container, boundary, fill, fuse, source);
+}
+
+void
+arch::EndBranchAlign(BytecodeContainer& container)
+{
+    Bytecode& last = container.bytecodes_back();
+    if (last.getSpecial() == Bytecode::Contents::SPECIAL_OFFSET)
+        return;     // nothing was appended after the pad
+
+    X86BranchAlign* pad = getLastPad(container);
+    if (pad && (!pad->m_insn || (pad->m_fusing && pad->m_insn == &last)))
+    {
+        pad->m_insn = &last;
+        pad->m_fixed_len = last.getFixedLen();
+        pad->m_tail = last.hasContents();
+        pad->m_fusing = false;
+        return;
+    }
+
+    // A jcc fused with an instruction ending in a tail starts a bytecode
+    // of its own.
+    pad = getLastPad(container, 2);
+    if (pad && pad->m_fusing
+        && pad->m_insn == &*(container.bytecodes_end() - 2))
+    {
+        pad->m_next = &last;
+        pad->m_next_fixed_len = last.getFixedLen();
+        pad->m_next_tail = last.hasContents();
+        pad->m_fusing = false;
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef YASM_X86BRANCHALIGN_H
+#define YASM_X86BRANCHALIGN_H
+//
+// x86 branch boundary alignment bytecode header file
+//
+//  Copyright (C) 2011  PathScale Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND OTHER CONTRIBUTORS ``AS IS''
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR OTHER CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+// Branch alignment pads the space before a jump (or a compare that
+// macro-fuses with the following conditional jump) with NOPs so that the
+// padded instructions neither cross nor end on a boundary.  The pad is an
+// offset setter whose length also depends on the length of the bytecode
+// that follows it; the optimizer re-evaluates it when that bytecode grows.
+//
+#include "yasmx/Config/export.h"
+
+
+namespace yasm
+{
+
+class BytecodeContainer;
+class SourceLocation;
+
+namespace arch
+{
+
+/// Macro-fusion class of an instruction that may fuse with a following
+/// conditional jump.
+enum X86BranchFuse
+{
+    X86_FUSE_NONE,
+    X86_FUSE_TEST_AND,      ///< test, and: fuse with any jcc
+    X86_FUSE_CMP_ALU,       ///< cmp, add, sub: not with jo/js/jp and inverses
+    X86_FUSE_INC_DEC        ///< inc, dec: only with jz/jl/jle and inverses
+};
+
+/// Pad before an unconditional jump about to be appended.
+YASM_STD_EXPORT
+void AppendBranchAlign(BytecodeContainer& container,
+                       unsigned long boundary,
+                       const unsigned char** fill,
+                       SourceLocation source);
+
+/// Pad before a conditional jump with condition code cc about to be
+/// appended.  If it fuses with the instruction just before it, the pad
+/// in front of that instruction is activated instead.
+YASM_STD_EXPORT
+void AppendJccAlign(BytecodeContainer& container,
+                    unsigned long boundary,
+                    const unsigned char** fill,
+                    unsigned int cc,
+                    SourceLocation source);
+
+/// Pad before an instruction of the given fusion class about to be
+/// appended.  The pad stays empty unless a conditional jump fuses with it.
+YASM_STD_EXPORT
+void AppendFusibleAlign(BytecodeContainer& container,
+                        unsigned long boundary,
+                        const unsigned char** fill,
+                        X86BranchFuse fuse,
+                        SourceLocation source);
+
+/// Close the padded region after the instruction has been appended.
+YASM_STD_EXPORT
+void EndBranchAlign(BytecodeContainer& container);
+
+}} // namespace yasm::arch
+
+#endif
@@ -28,6 +28,8 @@
 
 #include "X86General.h"
 
+#include <algorithm>
+
 #include "llvm/ADT/Statistic.h"
 #include "llvm/ADT/Twine.h"
 #include "yasmx/Basic/Diagnostic.h"
@@ -51,6 +53,8 @@
 
 STATISTIC(num_generic, "Number of generic instructions appended");
 STATISTIC(num_generic_bc, "Number of generic bytecodes created");
+STATISTIC(num_generic_ea_direct,
+          "Number of generic instructions with EA output directly");
 
 using namespace yasm;
 using namespace yasm::arch;
@@ -621,6 +625,188 @@ X86General::Write(pugi::xml_node out) const
 }
 #endif // WITH_XML
 
+// Check that an (unfinalized) effective address expression can be fully
+// resolved at parse time: only integers, 32/64-bit general registers, and at
+// most one symbol that is an already-defined label or an extern, added (not
+// subtracted or multiplied) into the rest of the expression.  Anything else
+// (EQUs, forward references, WRT, SEG, etc) is left to X86General.
+static bool
+isDirectEAExpr(const Expr& e)
+{
+    const ExprTerms& terms = e.getTerms();
+    bool have_sym = false;
+    for (ExprTerms::const_iterator i=terms.begin(), end=terms.end(); i != end;
+         ++i)
+    {
+        switch (i->getType())
+        {
+            case ExprTerm::NONE:
+            case ExprTerm::INT:
+                break;
+            case ExprTerm::REG:
+            {
+                const X86Register* reg =
+                    static_cast<const X86Register*>(i->getRegister());
+                if (reg->getType() != X86Register::REG32 &&
+                    reg->getType() != X86Register::REG64)
+                    return false;
+                break;
+            }
+            case ExprTerm::SYM:
+            {
+                SymbolRef sym = i->getSymbol();
+                Location loc;
+                if (have_sym || sym->isSpecial() ||
+                    (!sym->getLabel(&loc) &&
+                     (sym->getVisibility() & Symbol::EXTERN) == 0))
+                    return false;
+                have_sym = true;
+
+                // All parent operators must be additions.
+                int depth = i->m_depth;
+                for (ExprTerms::const_iterator j=i+1; j != end; ++j)
+                {
+                    if (j->isEmpty() || j->m_depth >= depth)
+                        continue;
+                    if (!j->isOp(Op::ADD))
+                        return false;
+                    depth = j->m_depth;
+                }
+                break;
+            }
+            case ExprTerm::OP:
+                switch (i->getOp())
+                {
+                    case Op::IDENT:
+                    case Op::ADD:
+                    case Op::SUB:
+                    case Op::NEG:
+                    case Op::MUL:
+                        break;
+                    default:
+                        return false;
+                }
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+static bool
+AddRegUse(const ExprTerm& term,
+          const IntNum& mult,
+          const X86Register* regs[2],
+          int mults[2],
+          int* nregs)
+{
+    const X86Register* reg = static_cast<const X86Register*>(term.getRegister());
+    if (!reg || !mult.isInRange(1, 9) || *nregs == 2)
+        return false;
+    // Only allow each register once, and don't mix register sizes.
+    for (int i=0; i<*nregs; ++i)
+    {
+        if (regs[i]->getNum() == reg->getNum() ||
+            regs[i]->getType() != reg->getType())
+            return false;
+    }
+    regs[*nregs] = reg;
+    mults[*nregs] = static_cast<int>(mult.getInt());
+    ++(*nregs);
+    return true;
+}
+
+// Check that a finalized effective address is a simple combination of base,
+// index*scale, and displacement that X86EffAddr::Check() will accept without
+// issuing any diagnostics.
+static bool
+isDirectEA(const X86EffAddr& ea, unsigned char addrsize, unsigned int bits)
+{
+    const X86Register* regs[2];
+    int mults[2];
+    int nregs = 0;
+
+    if (const Expr* abs = ea.m_disp.getAbs())
+    {
+        // Expect (at most) a top-level ADD of INT, REG, and REG*INT terms.
+        const ExprTerms& terms = abs->getTerms();
+        const ExprTerm& root = terms.back();
+        int item_depth = root.m_depth;
+        if (root.isOp(Op::ADD))
+            ++item_depth;
+
+        const ExprTerm* mulreg = 0;
+        const IntNum* mulint = 0;
+        for (ExprTerms::const_iterator i=terms.begin(), end=terms.end();
+             i != end; ++i)
+        {
+            if (i->isEmpty() || (&*i == &root && root.isOp(Op::ADD)))
+                continue;
+            if (i->m_depth == item_depth+1)
+            {
+                // Operand of a multiply
+                if (i->isType(ExprTerm::REG) && !mulreg)
+                    mulreg = &*i;
+                else if (i->isType(ExprTerm::INT) && !mulint)
+                    mulint = i->getIntNum();
+                else
+                    return false;
+                continue;
+            }
+            if (i->m_depth != item_depth)
+                return false;
+            if (i->isType(ExprTerm::INT))
+                continue;
+            if (i->isType(ExprTerm::REG))
+            {
+                if (!AddRegUse(*i, 1, regs, mults, &nregs))
+                    return false;
+            }
+            else if (i->isOp(Op::MUL) && i->getNumChild() == 2 && mulreg &&
+                     mulint)
+            {
+                if (!AddRegUse(*mulreg, *mulint, regs, mults, &nregs))
+                    return false;
+                mulreg = 0;
+                mulint = 0;
+            }
+            else
+                return false;
+        }
+    }
+
+    // Address size must be 32 or 64 bit, and agree with any override.
+    unsigned int size = bits;
+    if (nregs > 0)
+        size = regs[0]->getType() == X86Register::REG64 ? 64 : 32;
+    if (addrsize != 0 && addrsize != size)
+        return false;
+    if (size == 16 || (size == 64 && bits != 64))
+        return false;
+
+    // ESP can only be a base register.
+    for (int i=0; i<nregs; ++i)
+    {
+        if (regs[i]->getNum() == 4 && mults[i] != 1)
+            return false;
+    }
+
+    switch (nregs)
+    {
+        case 1:
+            return mults[0] != 6 && mults[0] != 7;
+        case 2:
+            if (mults[1] == 1)
+                std::swap(mults[0], mults[1]);
+            return mults[0] == 1 &&
+                (mults[1] == 1 || mults[1] == 2 || mults[1] == 4 ||
+                 mults[1] == 8);
+        default:
+            return true;
+    }
+}
+
 void
 arch::AppendGeneral(BytecodeContainer& container,
                     const X86Common& common,
@@ -631,7 +817,8 @@ arch::AppendGeneral(BytecodeContainer& container,
                     unsigned char rex,
                     X86GeneralPostOp postop,
                     bool default_rel,
-                    SourceLocation source)
+                    SourceLocation source,
+                    Diagnostic& diags)
 {
     Bytecode& bc = container.FreshBytecode();
     ++num_generic;
@@ -650,9 +837,78 @@ arch::AppendGeneral(BytecodeContainer& container,
         return;
     }
 
-    // TODO: optimize EA case
+    // If the effective address is a register or can be fully resolved now
+    // (registers plus a constant or label/extern displacement), output the
+    // fixed contents, with a fixup for any relocated displacement.
+    // The short mov form is only possible for a 32-bit address override in
+    // 64-bit mode without registers (see X86General::Finalize()).
+    if (postop == X86_POSTOP_SHORT_MOV &&
+        (common.m_mode_bits != 64 || common.m_addrsize != 32 ||
+         default_rel ||
+         (ea->m_disp.hasAbs() &&
+          ea->m_disp.getAbs()->Contains(ExprTerm::REG))))
+        postop = X86_POSTOP_NONE;
+
+    X86Common direct_common(common);
+    if (postop == X86_POSTOP_NONE && ea->m_need_modrm &&
+        ea->m_disp.getSize() == 0 && !ea->m_pc_rel &&
+        (ea->m_valid_modrm ||
+         (rex != 0xff &&
+          (!ea->m_disp.hasAbs() || isDirectEAExpr(*ea->m_disp.getAbs())))))
+    {
+        // The expression checks above guarantee finalization succeeds.
+        // Finalize is idempotent, so falling back is safe after this.
+        if (ea->Finalize(diags) &&
+            (ea->m_valid_modrm ||
+             isDirectEA(*ea, common.m_addrsize, common.m_mode_bits)))
+        {
+            bool ip_rel = false;
+            if (!ea->Check(&direct_common.m_addrsize, common.m_mode_bits,
+                           false, &rex, &ip_rel, diags))
+                assert(false && "direct EA check failed");
+            assert(!ip_rel && "direct EA is IP-relative");
+
+            if (!ea->m_need_disp || ea->m_disp.getSize() != 0)
+            {
+                Bytes& bytes = bc.getFixed();
+                bytes.setLittleEndian();
+                unsigned long orig_size = bytes.size();
+                GeneralToBytes(bytes, direct_common, opcode, ea.get(),
+                               special_prefix, rex);
+                Write8(bytes, ea->m_modrm);
+                if (ea->m_need_sib)
+                    Write8(bytes, ea->m_sib);
+
+                if (ea->m_need_disp)
+                {
+                    Value& disp = ea->m_disp;
+                    unsigned int size = disp.getSize();
+                    IntNum num;
+                    if (!disp.isRelative() &&
+                        disp.getIntNum(&num, false, diags) &&
+                        num.isOkSize(size, 0, disp.isSigned() ? 1 : 2))
+                        WriteN(bytes, num, size);
+                    else
+                    {
+                        disp.setInsnStart(bytes.size()-orig_size);
+                        bc.AppendFixed(disp);
+                    }
+                }
+
+                if (imm.get() != 0)
+                {
+                    imm->setInsnStart(bytes.size()-orig_size);
+                    bc.AppendFixed(imm);
+                }
+                ++num_generic_ea_direct;
+                return;
+            }
+        }
+    }
+
     bc.Transform(Bytecode::Contents::Ptr(new X86General(
-        common, opcode, ea, imm, special_prefix, rex, postop, default_rel)));
+        direct_common, opcode, ea, imm, special_prefix, rex, postop,
+        default_rel)));
     bc.setSource(source);
     ++num_generic_bc;
 }
@@ -35,6 +35,7 @@ namespace yasm
 {
 
 class BytecodeContainer;
+class Diagnostic;
 class SourceLocation;
 class Value;
 
@@ -79,7 +80,8 @@ void AppendGeneral(BytecodeContainer& container,
                    unsigned char rex,
                    X86GeneralPostOp postop,
                    bool default_rel,
-                   SourceLocation source);
+                   SourceLocation source,
+                   Diagnostic& diags);
 
 }} // namespace yasm::arch
 
@@ -45,6 +45,7 @@
 #include "yasmx/IntNum.h"
 
 #include "X86Arch.h"
+#include "X86BranchAlign.h"
 #include "X86Common.h"
 #include "X86EffAddr.h"
 #include "X86General.h"
@@ -59,6 +60,7 @@
 #endif
 
 STATISTIC(num_groups_scanned, "Total number of instruction groups scanned");
+STATISTIC(num_shape_lookups, "Number of operand shape index lookups");
 STATISTIC(num_jmp_groups_scanned, "Total number of jump groups scanned");
 STATISTIC(num_empty_insn, "Number of empty instructions created");
 
@@ -221,6 +223,25 @@ enum X86OperandPostAction
     // large imm64 that can become a sign-extended imm32
     OPAP_SImm32Avail = 4
 };
+
+// Operand kinds for the operand shape dispatch index.
+// Must match operand_kinds in gen_x86_insn.py.
+enum X86OperandKind
+{
+    OPK_Imm = 0,
+    OPK_Mem = 1,
+    OPK_SegReg = 2,
+    OPK_Reg8 = 3,
+    OPK_Reg16 = 4,
+    OPK_Reg32 = 5,
+    OPK_Reg64 = 6,
+    OPK_FPUReg = 7,
+    OPK_MMXReg = 8,
+    OPK_XMMReg = 9,
+    OPK_YMMReg = 10,
+    OPK_CtlReg = 11,
+    OPK_Unknown = -1
+};
 } // anonymous namespace
 
 namespace yasm { namespace arch {
@@ -327,6 +348,27 @@ struct X86InsnInfo
     // operand, see above
     unsigned int operands_index:12;
 };
+
+// Operand shape dispatch index entry.  Each group has a table of these
+// (per parser), sorted by key, that lists the forms of the group that can
+// possibly match operands of that shape.
+struct X86InsnShape
+{
+    // Number of operands and operand kinds, see getShapeKey()
+    unsigned long key;
+
+    // The index into the insn_shape_forms array of the first candidate form
+    unsigned short first;
+
+    // The number of candidate forms, in group order
+    unsigned char count;
+};
+
+inline bool
+operator< (const X86InsnShape& shape, unsigned long key)
+{
+    return shape.key < key;
+}
 }} // namespace yasm::arch
 
 inline
@@ -566,8 +608,36 @@ X86Insn::DoAppendJmp(BytecodeContainer& container,
     common.ApplyPrefixes(jinfo.def_opersize_64, m_prefixes, diags);
     common.Finish();
 
+    // Pad jcc (70+cc, 0F 80+cc) and direct jmp (EB, E9) for branch
+    // alignment; loop/jcxz and call are left alone.
+    bool align = false;
+    if (unsigned long boundary = m_arch.getBranchAlign())
+    {
+        if (!shortop.isEmpty() && (shortop.get(0) & 0xF0) == 0x70)
+        {
+            AppendJccAlign(container, boundary, m_arch.getFill(),
+                           shortop.get(0) & 0x0F, source);
+            align = true;
+        }
+        else if (nearop.getLen() == 2 && nearop.get(0) == 0x0F
+                 && (nearop.get(1) & 0xF0) == 0x80)
+        {
+            AppendJccAlign(container, boundary, m_arch.getFill(),
+                           nearop.get(1) & 0x0F, source);
+            align = true;
+        }
+        else if ((!shortop.isEmpty() && shortop.get(0) == 0xEB)
+                 || (nearop.getLen() == 1 && nearop.get(0) == 0xE9))
+        {
+            AppendBranchAlign(container, boundary, m_arch.getFill(), source);
+            align = true;
+        }
+    }
+
     AppendJmp(container, common, shortop, nearop, imm, imm_source, source,
               op_sel);
+    if (align)
+        EndBranchAlign(container);
     return true;
 }
 
@@ -961,11 +1031,117 @@ X86Insn::MatchInfo(const X86InsnInfo& info, const unsigned int* size_lookup,
 #endif
 }
 
+static X86OperandKind
+getOperandKind(const Operand& op)
+{
+    switch (op.getType())
+    {
+        case Operand::IMM:
+            return OPK_Imm;
+        case Operand::MEMORY:
+            return OPK_Mem;
+        case Operand::SEGREG:
+            return OPK_SegReg;
+        case Operand::REG:
+            break;
+        default:
+            return OPK_Unknown;
+    }
+
+    // Registers with an explicit size override skip the register size
+    // check, so they can't be classified by size.
+    if (op.getSize() != 0)
+        return OPK_Unknown;
+
+    const X86Register* reg = static_cast<const X86Register*>(op.getReg());
+    switch (reg->getType())
+    {
+        case X86Register::REG8:
+        case X86Register::REG8X:
+            return OPK_Reg8;
+        case X86Register::REG16:
+            return OPK_Reg16;
+        case X86Register::REG32:
+            return OPK_Reg32;
+        case X86Register::REG64:
+            return OPK_Reg64;
+        case X86Register::FPUREG:
+            return OPK_FPUReg;
+        case X86Register::MMXREG:
+            return OPK_MMXReg;
+        case X86Register::XMMREG:
+            return OPK_XMMReg;
+        case X86Register::YMMREG:
+            return OPK_YMMReg;
+        case X86Register::CRREG:
+        case X86Register::DRREG:
+        case X86Register::TRREG:
+            return OPK_CtlReg;
+        default:
+            return OPK_Unknown;
+    }
+}
+
+bool
+X86Insn::getShapeKey(unsigned long* key) const
+{
+    // Operand count in the low 4 bits, followed by 4 bits per operand of
+    // operand kind + 1.  Operands are in NASM order (reversed in GAS mode;
+    // the GAS shape tables account for GAS_NO_REV forms).
+    unsigned long k = m_operands.size();
+    unsigned int shift = 4;
+    if (m_parser == X86Arch::PARSER_GAS)
+    {
+        for (Operands::const_reverse_iterator i = m_operands.rbegin(),
+             end = m_operands.rend(); i != end; ++i, shift += 4)
+        {
+            X86OperandKind kind = getOperandKind(*i);
+            if (kind == OPK_Unknown)
+                return false;
+            k |= static_cast<unsigned long>(kind+1) << shift;
+        }
+    }
+    else
+    {
+        for (Operands::const_iterator i = m_operands.begin(),
+             end = m_operands.end(); i != end; ++i, shift += 4)
+        {
+            X86OperandKind kind = getOperandKind(*i);
+            if (kind == OPK_Unknown)
+                return false;
+            k |= static_cast<unsigned long>(kind+1) << shift;
+        }
+    }
+    *key = k;
+    return true;
+}
+
 const X86InsnInfo*
 X86Insn::FindMatch(const unsigned int* size_lookup, int bypass) const
 {
-    // Just do a simple linear search through the info array for a match.
-    // First match wins.
+    // Use the operand shape index (if available) to check only the forms
+    // that can possibly match the kinds of operands present.  First match
+    // wins, as the candidates are kept in group order.
+    unsigned long key;
+    if (bypass == 0 && m_shapes != 0 && getShapeKey(&key))
+    {
+        ++num_shape_lookups;
+        const X86InsnShape* shapes_end = m_shapes+m_num_shapes;
+        const X86InsnShape* shape =
+            std::lower_bound(m_shapes, shapes_end, key);
+        if (shape == shapes_end || shape->key != key)
+            return 0;
+        for (const unsigned char* i = &insn_shape_forms[shape->first],
+             *end = i+shape->count; i != end; ++i)
+        {
+            if (MatchInfo(m_group[*i], size_lookup, bypass))
+                return &m_group[*i];
+        }
+        return 0;
+    }
+
+    // Otherwise just do a simple linear search through the info array for
+    // a match.  First match wins.
     const X86InsnInfo* info =
         std::find_if(&m_group[0], &m_group[m_num_info],
                      TR1::bind(&X86Insn::MatchInfo, this, _1, size_lookup,
@@ -1134,6 +1310,7 @@ public:
     bool Finish(BytecodeContainer& container,
                 const Insn::Prefixes& prefixes,
                 SourceLocation source);
+    X86BranchFuse getFusion() const;
 
 private:
     void ApplyOperand(const X86InfoOperand& info_op, Operand& op);
@@ -1731,10 +1908,50 @@ BuildGeneral::Finish(BytecodeContainer& container,
                   m_rex,
                   m_postop,
                   m_default_rel,
-                  source);
+                  source,
+                  m_diags);
     return true;
 }
 
+// Classify the instruction for macro-fusion with a following jcc.  Only
+// add/sub/cmp, and/test, and inc/dec fuse; not with both a memory operand
+// and an immediate, and inc/dec not with a memory operand at all.
+X86BranchFuse
+BuildGeneral::getFusion() const
+{
+    if (m_vexdata)
+        return X86_FUSE_NONE;
+
+    bool mem = m_x86_ea.get() != 0
+        && !(m_x86_ea->m_valid_modrm && (m_x86_ea->m_modrm & 0xC0) == 0xC0);
+    bool imm = m_imm.get() != 0;
+    unsigned char op = m_opcode.get(0);
+
+    X86BranchFuse fuse = X86_FUSE_NONE;
+    if (op <= 0x05 || (op >= 0x28 && op <= 0x2D) || (op >= 0x38 && op <= 0x3D))
+        fuse = X86_FUSE_CMP_ALU;
+    else if ((op >= 0x20 && op <= 0x25) || op == 0x84 || op == 0x85
+             || op == 0xA8 || op == 0xA9)
+        fuse = X86_FUSE_TEST_AND;
+    else if (op >= 0x80 && op <= 0x83)
+    {
+        if (m_spare == 0 || m_spare == 5 || m_spare == 7)
+            fuse = X86_FUSE_CMP_ALU;
+        else if (m_spare == 4)
+            fuse = X86_FUSE_TEST_AND;
+    }
+    else if ((op == 0xF6 || op == 0xF7) && m_spare == 0)
+        fuse = X86_FUSE_TEST_AND;
+    else if ((op == 0xFE || op == 0xFF) && m_spare <= 1)
+        return mem ? X86_FUSE_NONE : X86_FUSE_INC_DEC;
+    else if (op >= 0x40 && op <= 0x4F && m_mode_bits != 64)
+        return X86_FUSE_INC_DEC;
+
+    if (mem && imm)
+        return X86_FUSE_NONE;
+    return fuse;
+}
+
 bool
 X86Insn::DoAppendGeneral(BytecodeContainer& container,
                          const X86InsnInfo& info,
@@ -1750,7 +1967,20 @@ X86Insn::DoAppendGeneral(BytecodeContainer& container,
     buildgen.ApplyOperands(static_cast<X86Arch::ParserSelect>(m_parser),
                            m_operands);
     buildgen.ApplySegReg(m_segreg, m_segreg_source);
-    return buildgen.Finish(container, m_prefixes, source);
+
+    X86BranchFuse fuse = X86_FUSE_NONE;
+    if (unsigned long boundary = m_arch.getBranchAlign())
+    {
+        fuse = buildgen.getFusion();
+        if (fuse != X86_FUSE_NONE)
+            AppendFusibleAlign(container, boundary, m_arch.getFill(), fuse,
+                               source);
+    }
+    if (!buildgen.Finish(container, m_prefixes, source))
+        return false;
+    if (fuse != X86_FUSE_NONE)
+        EndBranchAlign(container);
+    return true;
 }
 
 namespace {
@@ -1782,6 +2012,11 @@ struct InsnPrefixParseData
     unsigned int cpu0:6;
     unsigned int cpu1:6;
     unsigned int cpu2:6;
+
+    // For instruction, operand shape dispatch index for the parser.
+    // 0 if prefix
+    const X86InsnShape* shapes;
+    unsigned int num_shapes;
 };
 
 // Pull in all parse data
@@ -1945,6 +2180,8 @@ X86Insn::X86Insn(const X86Arch& arch,
                  unsigned char mod_data1,
                  unsigned char mod_data2,
                  unsigned int num_info,
+                 const X86InsnShape* shapes,
+                 unsigned int num_shapes,
                  unsigned int mode_bits,
                  unsigned int suffix,
                  unsigned int misc_flags,
@@ -1953,6 +2190,8 @@ X86Insn::X86Insn(const X86Arch& arch,
                  bool default_rel)
     : m_arch(arch),
       m_group(group),
+      m_shapes(shapes),
+      m_num_shapes(num_shapes),
       m_active_cpu(active_cpu),
       m_num_info(num_info),
       m_mode_bits(mode_bits),
@@ -2018,6 +2257,8 @@ X86Arch::CreateEmptyInsn() const
         0,
         0,
         NELEMS(empty_insn),
+        0,
+        0,
         m_mode_bits,
         (m_parser == PARSER_GAS) ? SUF_Z : 0,
         0,
@@ -2040,6 +2281,8 @@ X86Arch::CreateInsn(const Arch::InsnInfo* info) const
         pdata->mod_data1,
         pdata->mod_data2,
         pdata->num_info,
+        pdata->shapes,
+        pdata->num_shapes,
         m_mode_bits,
         pdata->flags,
         pdata->misc_flags,
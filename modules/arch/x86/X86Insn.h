@@ -41,6 +41,7 @@ namespace arch
 
 struct X86InfoOperand;
 struct X86InsnInfo;
+struct X86InsnShape;
 class X86Opcode;
 
 class YASM_STD_EXPORT X86Insn : public Insn
@@ -53,6 +54,8 @@ public:
             unsigned char mod_data1,
             unsigned char mod_data2,
             unsigned int num_info,
+            const X86InsnShape* shapes,
+            unsigned int num_shapes,
             unsigned int mode_bits,
             unsigned int suffix,
             unsigned int misc_flags,
@@ -92,6 +95,7 @@ private:
                          SourceLocation source,
                          Diagnostic& diags);
 
+    bool getShapeKey(unsigned long* key) const;
     const X86InsnInfo* FindMatch(const unsigned int* size_lookup, int bypass)
         const;
     bool MatchInfo(const X86InsnInfo& info,
@@ -112,6 +116,10 @@ private:
     // instruction parse group - NULL if empty instruction (just prefixes)
     /*@null@*/ const X86InsnInfo* m_group;
 
+    // operand shape dispatch index for the group - NULL if none
+    /*@null@*/ const X86InsnShape* m_shapes;
+    unsigned int m_num_shapes;
+
     // CPU feature flags enabled at the time of parsing the instruction
     X86Arch::CpuMask m_active_cpu;
 
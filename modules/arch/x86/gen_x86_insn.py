@@ -28,6 +28,7 @@
 # NOTE: operands are arranged in NASM / Intel order (e.g. dest, src)
 
 import sys
+from itertools import product
 
 scriptname = "gen_x86_insn.py"
 
@@ -107,6 +108,15 @@ def cpu_lcd(cpu1, cpu2):
 
     return retval
 
+# Operand kinds used by the operand-shape dispatch index.  These must match
+# X86OperandKind in X86Insn.cpp.
+operand_kinds = ["Imm", "Mem", "SegReg", "Reg8", "Reg16", "Reg32", "Reg64",
+                 "FPUReg", "MMXReg", "XMMReg", "YMMReg", "CtlReg"]
+gpr_kinds = {8: ["Reg8"], 16: ["Reg16"], 32: ["Reg32"], 64: ["Reg64"],
+             "BITS": ["Reg16", "Reg32", "Reg64"]}
+simd_kinds = {64: ["MMXReg"], 128: ["XMMReg"], 256: ["YMMReg"]}
+max_shape_operands = 5
+
 class Operand(object):
     def __init__(self, **kwargs):
         self.type = kwargs.pop("type")
@@ -130,6 +140,41 @@ class Operand(object):
                                            and "EA" or self.dest),
                                "OPAP_%s" % self.opt]) + "}"
 
+    def shape_kinds(self):
+        """Operand kinds this operand can possibly match (a superset of what
+        X86Insn::MatchOperand() accepts)."""
+        if self.type in ["Imm", "Imm1", "ImmNotSegOff"]:
+            return ["Imm"]
+        if self.type in ["Mem", "MemOffs", "MemrAX", "MemEAX", "MemDX"]:
+            return ["Mem"]
+        if self.type in ["SegReg", "CS", "DS", "ES", "FS", "GS", "SS"]:
+            return ["SegReg"]
+        if self.type in ["CRReg", "CR4", "DRReg", "TRReg"]:
+            return ["CtlReg"]
+        if self.type == "ST0":
+            return ["FPUReg"]
+        if self.type == "XMM0":
+            return ["XMMReg"]
+        if self.type in ["Areg", "Creg", "Dreg"]:
+            return gpr_kinds.get(self.size, gpr_kinds[8] + gpr_kinds["BITS"])
+        if self.type in ["Reg", "RM"]:
+            if self.size == "Any":
+                kinds = gpr_kinds[8] + gpr_kinds["BITS"] + ["FPUReg"]
+            elif self.size == 80:
+                kinds = ["FPUReg"]
+            else:
+                kinds = list(gpr_kinds.get(self.size, []))
+            if self.type == "RM":
+                kinds.append("Mem")
+            return kinds
+        if self.type in ["SIMDReg", "SIMDRM"]:
+            kinds = list(simd_kinds.get(self.size,
+                                        ["MMXReg", "XMMReg", "YMMReg"]))
+            if self.type == "SIMDRM":
+                kinds.append("Mem")
+            return kinds
+        raise ValueError("unknown operand type %s" % self.type)
+
     def __eq__(self, other):
         return (self.type == other.type and
                 self.size == other.size and
@@ -497,6 +542,13 @@ class Insn(object):
                            cpus_str[1],
                            cpus_str[2]])
 
+    def shapes_str(self, parser):
+        num_shapes = group_shapes[self.groupname][parser]
+        if num_shapes == 0:
+            return "0,\t0"
+        return ",\t".join(["%s_%s_shapes" % (self.groupname, parser),
+                           "%d" % num_shapes])
+
 insns = {}
 def add_insn(name, groupname, **kwargs):
     opts = insns.setdefault(name, [])
@@ -525,6 +577,9 @@ class Prefix(object):
                            "0",
                            "0"])
 
+    def shapes_str(self, parser):
+        return "0,\t0"
+
 gas_insns = {}
 nasm_insns = {}
 prefixes = {}
@@ -602,7 +657,9 @@ def output_insns(f, parser, insns):
 struct InsnPrefixParseData;
 %%%%""" % parser, file=f)
     for keyword in sorted(insns):
-        lprint("%s,\t%s" % (keyword.lower(), insns[keyword]), file=f)
+        lprint("%s,\t%s,\t%s" % (keyword.lower(), insns[keyword],
+                                  insns[keyword].shapes_str(parser.lower())),
+               file=f)
 
 def output_gas_insns(f):
     output_insns(f, "Gas", gas_insns)
@@ -647,10 +704,83 @@ def output_groups(f):
         lprint(",\n    ".join(str(x) for x in groups[name]), file=f)
         lprint("};\n", file=f)
 
+    # Output operand-shape dispatch indexes
+    output_shapes(f)
+
     # Output prefixes
     for name in sorted(prefixes):
         lprint(prefixes[name].code_str(), file=f)
 
+# Number of shapes in the dispatch index of each group, by parser
+group_shapes = {}
+
+def shape_key(kinds):
+    """Encode an operand count and operand kinds the same way as
+    X86Insn::getShapeKey()."""
+    key = len(kinds)
+    for i, kind in enumerate(kinds):
+        key |= (operand_kinds.index(kind)+1) << (4*i+4)
+    return key
+
+def output_shapes(f):
+    """Output, for each group and parser, a sorted table mapping the shape
+    of the operands (count and kinds) to the forms that can possibly match
+    that shape, in group order.  The candidate form indexes of all groups
+    are merged into a single insn_shape_forms array."""
+    all_forms = []
+    form_lists = {}
+    tables = []
+    seen = set()
+    for name in groupnames_ordered:
+        if name in seen:
+            continue
+        seen.add(name)
+        group_shapes[name] = {}
+        if len(groups[name]) > 255:
+            raise ValueError("too many forms in group %s" % name)
+        for parser in ["nasm", "gas"]:
+            candidates = {}
+            for index, form in enumerate(groups[name]):
+                if parser not in form.parsers:
+                    continue
+                if len(form.operands) > max_shape_operands:
+                    continue
+                # In GAS mode, the operands are reversed before lookup, so
+                # GAS_NO_REV forms need to be reversed to match.
+                operands = form.operands
+                if parser == "gas" and form.gas_no_rev:
+                    operands = list(reversed(operands))
+                for kinds in product(*[op.shape_kinds() for op in operands]):
+                    candidates.setdefault(shape_key(kinds), []).append(index)
+
+            shapes = []
+            for key in sorted(candidates):
+                forms = tuple(candidates[key])
+                if forms not in form_lists:
+                    form_lists[forms] = len(all_forms)
+                    all_forms.extend(forms)
+                shapes.append("{ 0x%06X, %d, %d }" %
+                              (key, form_lists[forms], len(forms)))
+            group_shapes[name][parser] = len(shapes)
+            tables.append((name, parser, shapes))
+
+    if len(all_forms) > 65535:
+        raise ValueError("too many shape candidates")
+    lprint("static const unsigned char insn_shape_forms[] = {", file=f)
+    for i in range(0, len(all_forms), 16):
+        lprint("    " + ", ".join("%d" % x for x in all_forms[i:i+16]) + ",",
+               file=f)
+    lprint("};\n", file=f)
+
+    for name, parser, shapes in tables:
+        if not shapes:
+            continue
+        lprint("static const X86InsnShape %s_%s_shapes[] = {" %
+               (name, parser), file=f)
+        lprint("   ", end='', file=f)
+        lprint(",\n    ".join(shapes), file=f)
+        lprint("};\n", file=f)
+
 #####################################################################
 # General instruction groupings
 #####################################################################
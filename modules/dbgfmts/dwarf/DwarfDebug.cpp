@@ -56,6 +56,10 @@ DwarfDebug::DwarfDebug(const DebugFormatModule& module, Object& object)
         case FORMAT_64BIT: m_sizeof_offset = 8; break;
     }
     InitCfi(*object.getArch());
+
+    // Without .file directives, line information is generated from the
+    // source locations of the instructions.
+    object.getConfig().InsnSources = true;
 }
 
 DwarfDebug::~DwarfDebug()
@@ -104,6 +108,14 @@ DwarfDebug::Generate(ObjectFormat& objfmt,
     GenerateDebug(objfmt, smgr, diags);
 }
 
+DwarfPassDebug::DwarfPassDebug(const DebugFormatModule& module,
+                               Object& object)
+    : DwarfDebug(module, object)
+{
+    // Line information only comes from .loc directives.
+    object.getConfig().InsnSources = false;
+}
+
 DwarfPassDebug::~DwarfPassDebug()
 {
 }
@@ -204,6 +216,12 @@ DwarfDebug::AddDirectives(Directives& dirs, llvm::StringRef parser)
     AddCfiDirectives(dirs, parser);
 }
 
+ElfCfiDebug::ElfCfiDebug(const DebugFormatModule& module, Object& object)
+    : DwarfDebug(module, object)
+{
+    object.getConfig().InsnSources = false;
+}
+
 ElfCfiDebug::~ElfCfiDebug()
 {
 }
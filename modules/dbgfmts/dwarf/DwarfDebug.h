@@ -206,12 +206,7 @@ private:
                         DwarfLineState* state,
                         const DwarfLoc& loc,
                         const DwarfLoc* nextloc);
-    void GenerateLineBC(Section& debug_line,
-                        SourceManager& smgr,
-                        DwarfLineState* state,
-                        Bytecode& bc,
-                        DwarfLoc* loc,
-                        unsigned long* lastfile);
+    void CollectAsmLines(Section& sect, SourceManager& smgr);
     /// Append statement program prologue
     void AppendSPP(BytecodeContainer& container);
 
@@ -241,15 +236,14 @@ private:
 
     size_t AddFile(unsigned long filenum, llvm::StringRef pathname);
     size_t AddFile(const FileEntry* file);
+    unsigned long FindFile(llvm::StringRef pathname);
     unsigned long AddDir(llvm::StringRef dirname);
 };
 
 class YASM_STD_EXPORT DwarfPassDebug : public DwarfDebug
 {
 public:
-    DwarfPassDebug(const DebugFormatModule& module, Object& object)
-        : DwarfDebug(module, object)
-    {}
+    DwarfPassDebug(const DebugFormatModule& module, Object& object);
     ~DwarfPassDebug();
 
     static llvm::StringRef getName() { return "DWARF passthrough only"; }
@@ -262,9 +256,7 @@ public:
 class YASM_STD_EXPORT ElfCfiDebug : public DwarfDebug
 {
 public:
-    ElfCfiDebug(const DebugFormatModule& module, Object& object)
-        : DwarfDebug(module, object)
-    {}
+    ElfCfiDebug(const DebugFormatModule& module, Object& object);
     ~ElfCfiDebug();
 
     static llvm::StringRef getName() { return "ELF CFI information only"; }
@@ -190,6 +190,24 @@ DwarfDebug::AddFile(unsigned long filenum, llvm::StringRef pathname)
     return filenum;
 }
 
+// Find the filename table entry (1-based) for a presumed filename, adding
+// a new entry if it's not already there.
+unsigned long
+DwarfDebug::FindFile(llvm::StringRef pathname)
+{
+    for (Filenames::const_iterator i=m_filenames.begin(), end=m_filenames.end();
+         i != end; ++i)
+    {
+        if (i->pathname.empty() ? i->filename == pathname
+                                : i->pathname == pathname)
+            return (i-m_filenames.begin())+1;
+    }
+
+    unsigned long filenum = m_filenames.size()+1;
+    AddFile(filenum, pathname);
+    return filenum;
+}
+
 // Create and add a new line opcode to a section.
 void
 DwarfDebug::AppendLineOp(BytecodeContainer& container,
@@ -298,15 +316,8 @@ DwarfDebug::GenerateLineOp(Section& debug_line,
 #endif
 
     IntNum addr_delta;
-    if (!state->prevloc.bc)
-    {
-        addr_delta.Zero();
-    }
-    else
-    {
-        CalcDist(state->prevloc, loc.loc, &addr_delta);
-        assert(addr_delta.getSign() >= 0 && "dwarf2 address went backwards");
-    }
+    CalcDist(state->prevloc, loc.loc, &addr_delta);
+    assert(addr_delta.getSign() >= 0 && "dwarf2 address went backwards");
 
     // Generate appropriate opcode(s).  Address can only increment,
     // whereas line number can go backwards.
@@ -363,46 +374,61 @@ DwarfDebug::GenerateLineOp(Section& debug_line,
     }
     state->prevloc = loc.loc;
 }
-#if 0
+
+// Map the instructions in a code section to their source lines.  Only the
+// first instruction of each run on the same line becomes a row, so this is
+// a single linear pass over the instructions.
 void
-DwarfDebug::GenerateLineBC(Section& debug_line,
-                           SourceManager& smgr,
-                           DwarfLineState* state,
-                           Bytecode& bc,
-                           DwarfLoc* loc,
-                           unsigned long* lastfile)
+DwarfDebug::CollectAsmLines(Section& sect, SourceManager& smgr)
 {
-    unsigned long i;
-    const char *filename;
-    /*@null@*/ yasm_bytecode *nextbc = yasm_bc__next(bc);
+    if (!sect.isCode())
+        return;
 
-    if (nextbc && bc->offset == nextbc->offset)
-        return 0;
+    const BytecodeContainer::InsnSources& insns = sect.getInsnSources();
+    if (insns.empty())
+        return;
 
-    info->loc.vline = bc->line;
-    info->loc.bc = bc;
+    DwarfSection* dwarf2sect = sect.getAssocData<DwarfSection>();
+    if (!dwarf2sect)
+    {
+        dwarf2sect = new DwarfSection;
+        sect.AddAssocData(std::auto_ptr<DwarfSection>(dwarf2sect));
+    }
+    DwarfSection::AsmLines& lines = dwarf2sect->asm_lines;
 
-    yasm_linemap_lookup(info->linemap, bc->line, &filename, &info->loc.line);
-    // Find file index; just linear search it unless it was the last used
-    if (*lastfile > 0 && filename == m_filenames[*lastfile-1].pathname)
-        loc->file = *lastfile;
-    else
+    const char* lastname = 0;
+    unsigned long lastfile = 0;
+    for (BytecodeContainer::InsnSources::const_iterator i=insns.begin(),
+         end=insns.end(); i != end; ++i)
     {
-        for (i=0; i<dbgfmt_dwarf2->filenames_size; i++)
+        PresumedLoc ploc = smgr.getPresumedLoc(i->source);
+        if (ploc.isInvalid())
+            continue;
+
+        // Consecutive instructions are nearly always from the same file.
+        if (ploc.getFilename() != lastname)
+        {
+            lastname = ploc.getFilename();
+            lastfile = FindFile(lastname);
+        }
+
+        DwarfAsmLine line = { i->loc, lastfile, ploc.getLine() };
+        if (!lines.empty())
         {
-            if (strcmp(filename, dbgfmt_dwarf2->filenames[i].pathname) == 0)
-                break;
+            DwarfAsmLine& prev = lines.back();
+            if (prev.file == line.file && prev.line == line.line)
+                continue;
+            if (prev.loc.getOffset() == line.loc.getOffset())
+            {
+                // previous instruction was empty
+                prev = line;
+                continue;
+            }
         }
-        if (i >= dbgfmt_dwarf2->filenames_size)
-            yasm_internal_error(N_("could not find filename in table"));
-        info->loc.file = i+1;
-        info->lastfile = i+1;
-    }
-    if (GenerateLineOp(debug_line, state, loc, NULL))
-        return 1;
-    return 0;
+        lines.push_back(line);
+    }
 }
-#endif
+
 void
 DwarfDebug::GenerateLineSection(Section& sect,
                                 Section& debug_line,
@@ -432,7 +458,9 @@ DwarfDebug::GenerateLineSection(Section& sect,
     state.column = 0;
     state.isa = 0;
     state.is_stmt = DWARF_LINE_DEFAULT_IS_STMT;
-    state.prevloc.bc = NULL;
+    // set_address below points at the section start, so measure the first
+    // row from there (data may precede the first instruction).
+    state.prevloc = sect.getBeginLoc();
 
     // Set the starting address for the section
     AppendLineExtOp(debug_line, DW_LNE_set_address, m_sizeof_address,
@@ -440,16 +468,13 @@ DwarfDebug::GenerateLineSection(Section& sect,
 
     if (asm_source)
     {
-#if 0
-        unsigned long lastfile = 0;
-        DwarfLoc loc;
-
-        for (Section::bc_iterator i=sect.bytecodes_begin(),
-             end=sect.bytecodes_end(); i != end; ++i)
+        for (DwarfSection::AsmLines::const_iterator
+             i=dwarf2sect->asm_lines.begin(), end=dwarf2sect->asm_lines.end();
+             i != end; ++i)
         {
-            GenerateLineBC(debug_line, smgr, &state, *i, &loc, &lastfile);
+            DwarfLoc loc(i->loc, SourceLocation(), i->file, i->line);
+            GenerateLineOp(debug_line, &state, loc, 0);
         }
-#endif
     }
     else
     {
@@ -464,8 +489,6 @@ DwarfDebug::GenerateLineSection(Section& sect,
     // End sequence: bring address to end of section, then output end
     // sequence opcode.  Don't use a special opcode to do this as we don't
     // want an extra entry in the line matrix.
-    if (!state.prevloc.bc)
-        state.prevloc = sect.getBeginLoc();
     IntNum addr_delta;
     CalcDist(state.prevloc, sect.getEndLoc(), &addr_delta);
     if (addr_delta == DWARF_MAX_SPECIAL_ADDR_DELTA)
@@ -489,6 +512,15 @@ DwarfDebug::Generate_line(SourceManager& smgr,
         {
             AddFile(i->first);
         }
+
+        // Map instructions to source lines; this may add more filenames
+        // (e.g. from %line or line markers), so it must come before the
+        // statement program prologue.
+        for (Object::section_iterator i=m_object.sections_begin(),
+             end=m_object.sections_end(); i != end; ++i)
+        {
+            CollectAsmLines(*i, smgr);
+        }
     }
 
     Section* debug_line = m_object.FindSection(".debug_line");
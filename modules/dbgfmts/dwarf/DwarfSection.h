@@ -26,6 +26,8 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 //
+#include <vector>
+
 #include "yasmx/Basic/SourceLocation.h"
 #include "yasmx/Support/ptr_vector.h"
 #include "yasmx/AssocData.h"
@@ -70,6 +72,14 @@ struct YASM_STD_EXPORT DwarfLoc
     Location loc;           // location following
 };
 
+/// Line number row generated from the assembly source
+struct YASM_STD_EXPORT DwarfAsmLine
+{
+    Location loc;           // start of first instruction on the line
+    unsigned long file;     // index into table of filenames
+    unsigned long line;     // source line number
+};
+
 /// Per-section DWARF data
 class YASM_STD_EXPORT DwarfSection : public AssocData
 {
@@ -86,6 +96,11 @@ public:
     /// source order.
     typedef stdx::ptr_vector<DwarfLoc> Locs;
     Locs locs;
+
+    /// Line number rows generated from the assembly source, in address
+    /// order.  Only used when there are no .file directives.
+    typedef std::vector<DwarfAsmLine> AsmLines;
+    AsmLines asm_lines;
 };
 
 }} // namespace yasm::dbgfmt
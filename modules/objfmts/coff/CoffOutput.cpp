@@ -99,6 +99,9 @@ CoffOutput::CoffOutput(llvm::raw_ostream& os,
     , m_strtab(4)   // first 4 bytes in string table are length
     , m_no_output(diags)
 {
+    // Symbol records refer to the string table as they are written, so
+    // only exact duplicates can be shared.
+    m_strtab.setInterning(object.getConfig().MergeStrings);
 }
 
 CoffOutput::~CoffOutput()
@@ -233,8 +236,8 @@ CoffOutput::ConvertValueToBytes(Value& value,
         // Generate reloc
         CoffObject::Machine machine = m_objfmt.getMachine();
         CoffReloc::Type rtype = CoffReloc::ABSOLUTE;
-        IntNum addr = loc.getOffset();
-        addr += loc.bc->getContainer()->getSection()->getVMA();
+        uint64_t addr = loc.getOffset();
+        addr += loc.bc->getContainer()->getSection()->getVMA().Extract(32, 0);
 
         if (machine == CoffObject::MACHINE_I386)
         {
@@ -415,15 +418,13 @@ CoffOutput::OutputSection(Section& sect)
         }
     }
 
+    Bytes& scratch = getScratch();
+    scratch.reserve(10 * sect.getRelocs().size());
     for (Section::const_reloc_iterator i=sect.relocs_begin(),
          end=sect.relocs_end(); i != end; ++i)
-    {
-        const CoffReloc& reloc = static_cast<const CoffReloc&>(*i);
-        Bytes& scratch = getScratch();
-        reloc.Write(scratch);
-        assert(scratch.size() == 10);
-        m_os << scratch;
-    }
+        static_cast<const CoffReloc&>(*i).Write(scratch);
+    assert(scratch.size() == 10 * sect.getRelocs().size());
+    m_os << scratch;
     return true;
 }
 
@@ -35,7 +35,7 @@
 using namespace yasm;
 using namespace yasm::objfmt;
 
-CoffReloc::CoffReloc(const IntNum& addr, SymbolRef sym, Type type)
+CoffReloc::CoffReloc(uint64_t addr, SymbolRef sym, Type type)
     : Reloc(addr, sym)
     , m_type(type)
 {
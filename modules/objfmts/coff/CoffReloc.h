@@ -77,7 +77,7 @@ public:
         AMD64_TOKEN = 0xD       ///< CLR metadata token
     };
 
-    CoffReloc(const IntNum& addr, SymbolRef sym, Type type);
+    CoffReloc(uint64_t addr, SymbolRef sym, Type type);
     virtual ~CoffReloc();
 
     virtual Expr getValue() const;
@@ -92,7 +92,7 @@ protected:
 class Coff32Reloc : public CoffReloc
 {
 public:
-    Coff32Reloc(const IntNum& addr, SymbolRef sym, Type type)
+    Coff32Reloc(uint64_t addr, SymbolRef sym, Type type)
         : CoffReloc(addr, sym, type)
     {}
     virtual ~Coff32Reloc();
@@ -103,7 +103,7 @@ public:
 class Coff64Reloc : public CoffReloc
 {
 public:
-    Coff64Reloc(const IntNum& addr, SymbolRef sym, Type type)
+    Coff64Reloc(uint64_t addr, SymbolRef sym, Type type)
         : CoffReloc(addr, sym, type)
     {}
     virtual ~Coff64Reloc();
@@ -84,6 +84,21 @@ ElfConfig::AssignSymbolIndices(Object& object, ElfSymbolIndex* nlocal) const
     return num;
 }
 
+unsigned long
+ElfConfig::getSymbolTableSize(Object& object) const
+{
+    // undef symbol plus the symbols in the table
+    unsigned long count = 1;
+    for (Object::symbol_iterator sym=object.symbols_begin(),
+         end=object.symbols_end(); sym != end; ++sym)
+    {
+        ElfSymbol* elfsym = sym->getAssocData<ElfSymbol>();
+        if (elfsym && elfsym->isInTable())
+            ++count;
+    }
+    return count * (cls == ELFCLASS32 ? SYMTAB32_SIZE : SYMTAB64_SIZE);
+}
+
 unsigned long
 ElfConfig::WriteSymbolTable(llvm::raw_ostream& os,
                             Object& object,
@@ -84,6 +84,7 @@ struct YASM_STD_EXPORT ElfConfig : public DebugDumper<ElfConfig>
     ElfSymbolIndex AssignSymbolIndices(Object& object, ElfSymbolIndex* nlocal)
         const;
 
+    unsigned long getSymbolTableSize(Object& object) const;
     unsigned long WriteSymbolTable(llvm::raw_ostream& os,
                                    Object& object,
                                    Diagnostic& diags,
@@ -29,6 +29,7 @@
 #include <memory>
 #include <string>
 
+#include "llvm/System/DataTypes.h"
 #include "yasmx/Config/export.h"
 #include "yasmx/AssocData.h"
 #include "yasmx/Symbol.h"
@@ -111,7 +112,7 @@ public:
                   bool rela) const = 0;
 
     virtual std::auto_ptr<ElfReloc>
-        MakeReloc(SymbolRef sym, const IntNum& addr) const = 0;
+        MakeReloc(SymbolRef sym, uint64_t addr) const = 0;
 };
 
 YASM_STD_EXPORT
@@ -381,8 +381,10 @@ ElfObject::Read(SourceManager& sm, Diagnostic& diags)
             continue;
 
         // load relocations
-        elfsects[info]->ReadRelocs(in, *reloc_sect, *sections[info],
-                                   *m_machine, symtab, secttype == SHT_RELA);
+        if (!elfsects[info]->ReadRelocs(in, *reloc_sect, *sections[info],
+                                        *m_machine, symtab,
+                                        secttype == SHT_RELA, diags))
+            return false;
     }
     return true;
 }
@@ -736,7 +738,8 @@ namespace {
 class ElfOutput : public BytecodeStreamOutput
 {
 public:
-    ElfOutput(llvm::raw_fd_ostream& os,
+    ElfOutput(llvm::raw_ostream& os,
+              unsigned long base,
               ElfObject& objfmt,
               Object& object,
               Diagnostic& diags);
@@ -745,6 +748,15 @@ public:
     void OutputGroup(ElfGroup& group);
     void OutputSection(Section& sect, StringTable& shstrtab);
 
+    /// Total size of the contents, including borrowed ranges.
+    unsigned long getContentsSize() const
+    { return static_cast<unsigned long>(m_os.tell()) + m_borrowed_size; }
+
+    /// Write the contents to os, splicing the borrowed ranges and gaps
+    /// back into the in-memory contents.
+    void WriteContents(llvm::raw_ostream& os,
+                       const llvm::SmallVectorImpl<char>& contents) const;
+
     // OutputBytecode overrides
     bool ConvertValueToBytes(Value& value,
                              Location loc,
@@ -753,23 +765,44 @@ public:
                               Location loc,
                               NumericOutput& num_out);
 
+protected:
+    void DoOutputGap(unsigned long size, SourceLocation source);
+    void DoOutputBorrowed(const unsigned char* data,
+                          unsigned long size,
+                          SourceLocation source);
+
 private:
+    unsigned long PadToFileOffset(unsigned long offset);
+
     ElfObject& m_objfmt;
     Object& m_object;
-    llvm::raw_fd_ostream& m_fd_os;
+    unsigned long m_base;   // file offset of the start of m_os
+
+    // Borrowed ranges and gaps are not copied into m_os; instead each one
+    // records the position in m_os it belongs at.
+    struct Borrowed
+    {
+        unsigned long pos;
+        const unsigned char* data;  // NULL for a gap
+        unsigned long size;
+    };
+    std::vector<Borrowed> m_borrowed;
+    unsigned long m_borrowed_size;
     BytecodeNoOutput m_no_output;
     SymbolRef m_GOT_sym;
 };
 } // anonymous namespace
 
-ElfOutput::ElfOutput(llvm::raw_fd_ostream& os,
+ElfOutput::ElfOutput(llvm::raw_ostream& os,
+                     unsigned long base,
                      ElfObject& objfmt,
                      Object& object,
                      Diagnostic& diags)
     : BytecodeStreamOutput(os, diags)
     , m_objfmt(objfmt)
     , m_object(object)
-    , m_fd_os(os)
+    , m_base(base)
+    , m_borrowed_size(0)
     , m_no_output(diags)
     , m_GOT_sym(object.FindSymbol("_GLOBAL_OFFSET_TABLE_"))
 {
@@ -779,6 +812,55 @@ ElfOutput::~ElfOutput()
 {
 }
 
+// Pad the output with zeros up to the given file offset.
+unsigned long
+ElfOutput::PadToFileOffset(unsigned long offset)
+{
+    unsigned long pos = m_base + getContentsSize();
+    assert(pos <= offset && "padding backwards");
+    for (; pos < offset; ++pos)
+        m_os << '\0';
+    return offset;
+}
+
+void
+ElfOutput::DoOutputGap(unsigned long size, SourceLocation source)
+{
+    if (size == 0)
+        return;
+
+    Diag(source, diag::warn_uninit_zero);
+    DoOutputBorrowed(0, size, source);
+}
+
+void
+ElfOutput::DoOutputBorrowed(const unsigned char* data,
+                            unsigned long size,
+                            SourceLocation source)
+{
+    Borrowed b = {static_cast<unsigned long>(m_os.tell()), data, size};
+    m_borrowed.push_back(b);
+    m_borrowed_size += size;
+}
+
+void
+ElfOutput::WriteContents(llvm::raw_ostream& os,
+                         const llvm::SmallVectorImpl<char>& contents) const
+{
+    unsigned long pos = 0;
+    for (std::vector<Borrowed>::const_iterator i=m_borrowed.begin(),
+         end=m_borrowed.end(); i != end; ++i)
+    {
+        os.write(contents.data() + pos, i->pos - pos);
+        if (i->data)
+            os.write(reinterpret_cast<const char*>(i->data), i->size);
+        else
+            os.write_zeros(i->size);
+        pos = i->pos;
+    }
+    os.write(contents.data() + pos, contents.size() - pos);
+}
+
 bool
 ElfOutput::ConvertSymbolToBytes(SymbolRef sym,
                                 Location loc,
@@ -900,19 +982,8 @@ ElfOutput::ConvertValueToBytes(Value& value,
 void
 ElfOutput::OutputGroup(ElfGroup& group)
 {
-    uint64_t pos = m_os.tell();
-    if (m_os.has_error())
-    {
-        Diag(SourceLocation(), diag::err_file_output_position);
-        return;
-    }
-
-    m_fd_os.seek(group.elfsect->setFileOffset(pos));
-    if (m_os.has_error())
-    {
-        Diag(SourceLocation(), diag::err_file_output_seek);
-        return;
-    }
+    unsigned long pos = m_base + getContentsSize();
+    PadToFileOffset(group.elfsect->setFileOffset(pos));
 
     Bytes& scratch = getScratch();
     m_objfmt.m_config.setEndian(scratch);
@@ -949,28 +1020,15 @@ ElfOutput::OutputSection(Section& sect, StringTable& shstrtab)
 
     elfsect->setName(shstrtab.getIndex(sect.getName()));
 
-    uint64_t pos;
     if (sect.isBSS())
     {
         // Don't output BSS sections.
         outputter = &m_no_output;
-        pos = 0;    // position = 0 because it's not in the file
     }
     else
     {
-        pos = m_os.tell();
-        if (m_os.has_error())
-        {
-            Diag(SourceLocation(), diag::err_file_output_position);
-            return;
-        }
-
-        m_fd_os.seek(elfsect->setFileOffset(pos));
-        if (m_os.has_error())
-        {
-            Diag(SourceLocation(), diag::err_file_output_seek);
-            return;
-        }
+        unsigned long pos = m_base + getContentsSize();
+        PadToFileOffset(elfsect->setFileOffset(pos));
     }
 
     // Output bytecodes
@@ -1000,30 +1058,19 @@ ElfOutput::OutputSection(Section& sect, StringTable& shstrtab)
     elfsect->setRelName(shstrtab.getIndex(relname));
 }
 
-static unsigned long
-ElfAlignOutput(llvm::raw_fd_ostream& os, unsigned int align, Diagnostic& diags)
+static inline unsigned long
+ElfAlign(unsigned long pos, unsigned int align)
 {
     assert(isExp2(align) && "requested alignment not a power of two");
+    return (pos + align - 1) & ~static_cast<unsigned long>(align - 1);
+}
 
-    uint64_t pos = os.tell();
-    if (os.has_error())
-    {
-        diags.Report(SourceLocation(), diag::err_file_output_position);
-        return 0;
-    }
-
-    unsigned long delta = align - (pos & (align-1));
-    if (delta != align)
-    {
-        pos += delta;
-        os.seek(pos);
-        if (os.has_error())
-        {
-            diags.Report(SourceLocation(), diag::err_file_output_seek);
-            return 0;
-        }
-    }
-    return static_cast<unsigned long>(pos);
+static void
+ElfPadOutput(llvm::raw_ostream& os, unsigned long* pos, unsigned long offset)
+{
+    assert(*pos <= offset && "padding backwards");
+    for (; *pos < offset; ++*pos)
+        os << '\0';
 }
 
 void
@@ -1031,9 +1078,21 @@ ElfObject::Output(llvm::raw_fd_ostream& os,
                   bool all_syms,
                   DebugFormat& dbgfmt,
                   Diagnostic& diags)
+{
+    Output(static_cast<llvm::raw_ostream&>(os), all_syms, dbgfmt, diags);
+}
+
+void
+ElfObject::Output(llvm::raw_ostream& os,
+                  bool all_syms,
+                  DebugFormat& dbgfmt,
+                  Diagnostic& diags)
 {
     StringTable shstrtab, strtab;
     unsigned int align = (m_config.cls == ELFCLASS32) ? 4 : 8;
+    bool merge_strings = m_object.getConfig().MergeStrings;
+    shstrtab.setInterning(merge_strings);
+    strtab.setInterning(merge_strings);
 
     // XXX: ugly workaround to prevent all_syms from kicking in
     if (dbgfmt.getModule().getKeyword() == "elfcfi")
@@ -1069,14 +1128,6 @@ ElfObject::Output(llvm::raw_fd_ostream& os,
         }
     }
 
-    // Allocate space for Ehdr by seeking forward
-    os.seek(m_config.getProgramHeaderSize());
-    if (os.has_error())
-    {
-        diags.Report(SourceLocation(), diag::err_file_output_seek);
-        return;
-    }
-
     // Generate version symbols.
     for (SymVers::const_iterator i=m_symvers.begin(), end=m_symvers.end();
          i != end; ++i)
@@ -1140,7 +1191,13 @@ ElfObject::Output(llvm::raw_fd_ostream& os,
     ElfSection null_sect(m_config, SHT_NULL, 0);
     null_sect.setIndex(m_config.secthead_count++);
 
-    ElfOutput out(os, *this, m_object, diags);
+    // Section contents are generated first (generating them creates the
+    // relocations), into memory just past the Ehdr.  Everything else is laid
+    // out once they are known, so the file can be written sequentially.
+    unsigned long ehdr_size = m_config.getProgramHeaderSize();
+    llvm::SmallVector<char, 4096> contents;
+    llvm::raw_svector_ostream contents_os(contents);
+    ElfOutput out(contents_os, ehdr_size, *this, m_object, diags);
 
     // Group sections.
     ElfStringIndex groupname_index = 0;
@@ -1250,47 +1307,84 @@ ElfObject::Output(llvm::raw_fd_ostream& os,
     // Sort the symbols by symbol index.
     stdx::sort(m_object.symbols_begin(), m_object.symbols_end(), byIndex);
 
-    unsigned long offset, size;
     ElfStringIndex shstrtab_name = shstrtab.getIndex(".shstrtab");
     ElfStringIndex strtab_name = shstrtab.getIndex(".strtab");
     ElfStringIndex symtab_name = shstrtab.getIndex(".symtab");
 
-    // section header string table (.shstrtab)
-    offset = ElfAlignOutput(os, align, diags);
-    size = shstrtab.getSize();
-    shstrtab.Write(os);
+    // Share string tails (e.g. ".text" within ".rela.text") and renumber
+    // the names already assigned.
+    if (merge_strings)
+    {
+        shstrtab.MergeTails();
+        strtab.MergeTails();
 
+        for (Groups::iterator i=m_groups.begin(), end=m_groups.end();
+             i != end; ++i)
+        {
+            ElfSection& elfsect = *i->elfsect;
+            elfsect.setName(shstrtab.getMergedIndex(elfsect.getName()));
+        }
+
+        for (Object::section_iterator i=m_object.sections_begin(),
+             end=m_object.sections_end(); i != end; ++i)
+        {
+            ElfSection* elfsect = i->getAssocData<ElfSection>();
+            elfsect->setName(shstrtab.getMergedIndex(elfsect->getName()));
+            elfsect->setRelName(
+                shstrtab.getMergedIndex(elfsect->getRelName()));
+        }
+
+        for (Object::symbol_iterator i=m_object.symbols_begin(),
+             end=m_object.symbols_end(); i != end; ++i)
+        {
+            ElfSymbol* elfsym = i->getAssocData<ElfSymbol>();
+            if (elfsym && elfsym->hasName())
+                elfsym->setName(strtab.getMergedIndex(elfsym->getName()));
+        }
+
+        shstrtab_name = shstrtab.getMergedIndex(shstrtab_name);
+        strtab_name = shstrtab.getMergedIndex(strtab_name);
+        symtab_name = shstrtab.getMergedIndex(symtab_name);
+    }
+
+    //
+    // Layout.
+    //
+    contents_os.flush();
+    unsigned long pos = ehdr_size + out.getContentsSize();
+
+    // section header string table (.shstrtab)
+    pos = ElfAlign(pos, align);
     ElfSection shstrtab_sect(m_config, SHT_STRTAB, 0);
     m_config.shstrtab_index = m_config.secthead_count;
     shstrtab_sect.setName(shstrtab_name);
     shstrtab_sect.setIndex(m_config.secthead_count++);
-    shstrtab_sect.setFileOffset(offset);
-    shstrtab_sect.setSize(size);
+    shstrtab_sect.setFileOffset(pos);
+    shstrtab_sect.setSize(shstrtab.getSize());
+    pos += shstrtab.getSize();
 
     // string table (.strtab)
-    offset = ElfAlignOutput(os, align, diags);
-    size = strtab.getSize();
-    strtab.Write(os);
-
+    pos = ElfAlign(pos, align);
     ElfSection strtab_sect(m_config, SHT_STRTAB, 0);
     strtab_sect.setName(strtab_name);
     strtab_sect.setIndex(m_config.secthead_count++);
-    strtab_sect.setFileOffset(offset);
-    strtab_sect.setSize(size);
+    strtab_sect.setFileOffset(pos);
+    strtab_sect.setSize(strtab.getSize());
+    pos += strtab.getSize();
 
     // symbol table (.symtab)
-    offset = ElfAlignOutput(os, align, diags);
-    size = m_config.WriteSymbolTable(os, m_object, diags, out.getScratch());
-
+    pos = ElfAlign(pos, align);
+    unsigned long symtab_size = m_config.getSymbolTableSize(m_object);
     ElfSection symtab_sect(m_config, SHT_SYMTAB, 0, true);
     symtab_sect.setName(symtab_name);
     symtab_sect.setIndex(m_config.secthead_count++);
-    symtab_sect.setFileOffset(offset);
-    symtab_sect.setSize(size);
+    symtab_sect.setFileOffset(pos);
+    symtab_sect.setSize(symtab_size);
     symtab_sect.setInfo(symtab_nlocal);
     symtab_sect.setLink(strtab_sect.getIndex());    // link to .strtab
+    pos += symtab_size;
 
-    // output relocations
+    // relocation sections
     for (Object::section_iterator i=m_object.sections_begin(),
          end=m_object.sections_end(); i != end; ++i)
     {
@@ -1303,11 +1397,11 @@ ElfObject::Output(llvm::raw_fd_ostream& os,
 
         // need relocation section; set it up
         elfsect->setRelIndex(m_config.secthead_count++);
-        elfsect->WriteRelocs(os, *i, out.getScratch(), *m_machine, diags);
+        pos = elfsect->setRelFileOffset(pos, *i);
     }
 
-    // output section header table
-    m_config.secthead_pos = ElfAlignOutput(os, 16, diags);
+    // section header table
+    m_config.secthead_pos = ElfAlign(pos, 16);
 
 #if 0
     // stabs debugging support
@@ -1325,8 +1419,52 @@ ElfObject::Output(llvm::raw_fd_ostream& os,
     }
 #endif
 
+    //
+    // Output, strictly in file order.
+    //
+    Bytes& scratch = out.getScratch();
+
+    // Ehdr
+    m_config.WriteProgramHeader(os, scratch);
+    pos = ehdr_size;
+
+    // group and user section contents
+    out.WriteContents(os, contents);
+    pos += out.getContentsSize();
+
+    // section header string table (.shstrtab)
+    ElfPadOutput(os, &pos, shstrtab_sect.getFileOffset());
+    shstrtab.Write(os);
+    pos += shstrtab.getSize();
+
+    // string table (.strtab)
+    ElfPadOutput(os, &pos, strtab_sect.getFileOffset());
+    strtab.Write(os);
+    pos += strtab.getSize();
+
+    // symbol table (.symtab)
+    ElfPadOutput(os, &pos, symtab_sect.getFileOffset());
+    pos += m_config.WriteSymbolTable(os, m_object, diags, scratch);
+    assert(pos == symtab_sect.getFileOffset() + symtab_size);
+
+    // relocations
+    for (Object::section_iterator i=m_object.sections_begin(),
+         end=m_object.sections_end(); i != end; ++i)
+    {
+        if (i->getRelocs().size() == 0)
+            continue;
+
+        ElfSection* elfsect = i->getAssocData<ElfSection>();
+        assert(elfsect != 0);
+
+        ElfPadOutput(os, &pos, elfsect->getRelFileOffset());
+        pos += elfsect->WriteRelocs(os, *i, scratch);
+    }
+
+    ElfPadOutput(os, &pos, m_config.secthead_pos);
+
     // null section header
-    null_sect.Write(os, out.getScratch());
+    null_sect.Write(os, scratch);
 
     // group section headers
     for (Groups::iterator i=m_groups.begin(), end=m_groups.end(); i != end; ++i)
@@ -1337,7 +1475,7 @@ ElfObject::Output(llvm::raw_fd_ostream& os,
         ElfSymbol* elfsym = i->sym->getAssocData<ElfSymbol>();
         group.elfsect->setInfo(elfsym->getSymbolIndex());
 
-        group.elfsect->Write(os, out.getScratch());
+        group.elfsect->Write(os, scratch);
     }
 
     // user section headers
@@ -1347,13 +1485,13 @@ ElfObject::Output(llvm::raw_fd_ostream& os,
         ElfSection* elfsect = i->getAssocData<ElfSection>();
         assert(elfsect != 0);
 
-        elfsect->Write(os, out.getScratch());
+        elfsect->Write(os, scratch);
     }
 
     // standard section headers
-    shstrtab_sect.Write(os, out.getScratch());
-    strtab_sect.Write(os, out.getScratch());
-    symtab_sect.Write(os, out.getScratch());
+    shstrtab_sect.Write(os, scratch);
+    strtab_sect.Write(os, scratch);
+    symtab_sect.Write(os, scratch);
 
     // relocation section headers
     for (Object::section_iterator i=m_object.sections_begin(),
@@ -1363,18 +1501,8 @@ ElfObject::Output(llvm::raw_fd_ostream& os,
         assert(elfsect != 0);
 
         // relocation entries for .foo are stored in section .rel[a].foo
-        elfsect->WriteRel(os, symtab_sect.getIndex(), *i, out.getScratch());
-    }
-
-    // output Ehdr
-    os.seek(0);
-    if (os.has_error())
-    {
-        diags.Report(SourceLocation(), diag::err_file_output_seek);
-        return;
+        elfsect->WriteRel(os, symtab_sect.getIndex(), *i, scratch);
     }
-
-    m_config.WriteProgramHeader(os, out.getScratch());
 }
 
 Section*
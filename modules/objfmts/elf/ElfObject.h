@@ -50,6 +50,8 @@
 #include "ElfConfig.h"
 
 
+namespace llvm { class raw_ostream; }
+
 namespace yasm
 {
 class Diagnostic;
@@ -132,6 +134,12 @@ public:
                 DebugFormat& dbgfmt,
                 Diagnostic& diags);
 
+    /// Write the object to any stream; the output is fully sequential.
+    void Output(llvm::raw_ostream& os,
+                bool all_syms,
+                DebugFormat& dbgfmt,
+                Diagnostic& diags);
+
     Section* AddDefaultSection();
     Section* AppendSection(llvm::StringRef name,
                            SourceLocation source,
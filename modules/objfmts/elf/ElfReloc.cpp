@@ -37,7 +37,7 @@
 using namespace yasm;
 using namespace yasm::objfmt;
 
-ElfReloc::ElfReloc(SymbolRef sym, const IntNum& addr)
+ElfReloc::ElfReloc(SymbolRef sym, uint64_t addr)
     : Reloc(addr, sym)
     , m_type(0xff)      // default to invalid type
     , m_addend(0)
@@ -79,7 +79,9 @@ ElfReloc::ElfReloc(const ElfConfig& config,
         if (size > inbuf.getReadableSize())
             return;
 
-        m_addr = ReadU64(inbuf);
+        IntNum addr = ReadU64(inbuf);
+        m_addr = (static_cast<uint64_t>(addr.Extract(32, 32)) << 32) |
+            addr.Extract(32, 0);
 
         IntNum info = ReadU64(inbuf);
         m_sym = symtab.at(ELF64_R_SYM(info));
@@ -144,20 +146,17 @@ ElfReloc::HandleAddend(IntNum* intn,
 }
 
 void
-ElfReloc::Write(Bytes& bytes, const ElfConfig& config)
+ElfReloc::Write(Bytes& bytes, const ElfConfig& config) const
 {
     assert(isValid() && "invalid relocation");
     unsigned long r_sym = STN_UNDEF;
 
-    if (ElfSymbol* esym = getSymbol()->getAssocData<ElfSymbol>())
+    if (const ElfSymbol* esym = m_sym->getAssocData<ElfSymbol>())
         r_sym = esym->getSymbolIndex();
 
-    bytes.resize(0);
-    config.setEndian(bytes);
-
     if (config.cls == ELFCLASS32)
     {
-        Write32(bytes, m_addr);
+        Write32(bytes, static_cast<unsigned long>(m_addr & 0xFFFFFFFFUL));
         Write32(bytes,
                 ELF32_R_INFO(r_sym, static_cast<unsigned char>(m_type)));
 
@@ -167,8 +166,8 @@ ElfReloc::Write(Bytes& bytes, const ElfConfig& config)
     else if (config.cls == ELFCLASS64)
     {
         Write64(bytes, m_addr);
-        Write64(bytes,
-                ELF64_R_INFO(r_sym, static_cast<unsigned char>(m_type)));
+        Write64(bytes, (static_cast<uint64_t>(r_sym) << 32) |
+                static_cast<unsigned char>(m_type));
         if (config.rela)
             Write64(bytes, m_addend);
     }
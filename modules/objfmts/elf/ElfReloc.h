@@ -54,7 +54,7 @@ public:
              const llvm::MemoryBuffer& in,
              unsigned long* pos,
              bool rela);
-    ElfReloc(SymbolRef sym, const IntNum& addr);
+    ElfReloc(SymbolRef sym, uint64_t addr);
     virtual ~ElfReloc();
 
     /// Set relocation type for relative symbols (typical case).
@@ -81,7 +81,11 @@ public:
     virtual void HandleAddend(IntNum* intn,
                               const ElfConfig& config,
                               unsigned int insn_start);
-    void Write(Bytes& bytes, const ElfConfig& config);
+
+    /// Append the relocation entry to a bytes buffer.
+    /// @param bytes    output bytes buffer
+    /// @param config   ELF configuration (endianness already set in bytes)
+    void Write(Bytes& bytes, const ElfConfig& config) const;
 
 protected:
     SymbolRef           m_wrt;
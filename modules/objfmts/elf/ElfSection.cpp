@@ -26,6 +26,7 @@
 //
 #include "ElfSection.h"
 
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/raw_ostream.h"
 #include "yasmx/Basic/Diagnostic.h"
 #include "yasmx/Bytecode.h"
@@ -274,7 +275,7 @@ ElfSection::LoadSectionData(Section& sect,
     if (sect.isBSS())
         return true;
 
-    // Read section data
+    // Reference section data in place; it is only copied on output.
     InputBuffer inbuf(in, m_offset);
 
     unsigned long size = m_size.getUInt();
@@ -285,7 +286,7 @@ ElfSection::LoadSectionData(Section& sect,
         return false;
     }
 
-    sect.bytecodes_front().getFixed().Write(inbuf.Read(size), size);
+    AppendDataRef(sect, inbuf.Read(size), size, SourceLocation());
     return true;
 }
 
@@ -338,56 +339,76 @@ ElfSection::WriteRel(llvm::raw_ostream& os,
     return scratch.size();
 }
 
+unsigned long
+ElfSection::setRelFileOffset(unsigned long pos, const Section& sect)
+{
+    unsigned int size;
+    if (m_config.cls == ELFCLASS32)
+        size = m_config.rela ? RELOC32A_SIZE : RELOC32_SIZE;
+    else
+        size = m_config.rela ? RELOC64A_SIZE : RELOC64_SIZE;
+
+    // align to multiple of 4
+    m_rel_offset = (pos + 3) & ~3UL;
+    return m_rel_offset + size * sect.getRelocs().size();
+}
+
 unsigned long
 ElfSection::WriteRelocs(llvm::raw_ostream& os,
                         Section& sect,
-                        Bytes& scratch,
-                        const ElfMachine& machine,
-                        Diagnostic& diags)
+                        Bytes& scratch)
 {
-    if (sect.getRelocs().size() == 0)
-        return 0;
-
-    // first align section to multiple of 4
-    uint64_t pos = os.tell();
-    if (os.has_error())
-    {
-        diags.Report(SourceLocation(), diag::err_file_output_position);
-        pos = 0;
-    }
-    uint64_t apos = (pos + 3) & ~3;
-    for (; pos < apos; ++pos)
-        os << '\0';
-    m_rel_offset = static_cast<unsigned long>(pos);
+    unsigned int size;
+    if (m_config.cls == ELFCLASS32)
+        size = m_config.rela ? RELOC32A_SIZE : RELOC32_SIZE;
+    else
+        size = m_config.rela ? RELOC64A_SIZE : RELOC64_SIZE;
 
-    unsigned long size = 0;
+    // Serialize the whole table into scratch and write it out at once.
+    scratch.resize(0);
+    scratch.reserve(size * sect.getRelocs().size());
+    m_config.setEndian(scratch);
     for (Section::reloc_iterator i=sect.relocs_begin(), end=sect.relocs_end();
          i != end; ++i)
-    {
-        ElfReloc& reloc = static_cast<ElfReloc&>(*i);
-        scratch.resize(0);
-        reloc.Write(scratch, m_config);
-        os << scratch;
-        size += scratch.size();
-    }
-    return size;
+        static_cast<ElfReloc&>(*i).Write(scratch, m_config);
+    os << scratch;
+    return scratch.size();
 }
 
-void
+bool
 ElfSection::ReadRelocs(const llvm::MemoryBuffer&    in,
                        const ElfSection&            reloc_sect,
                        Section&                     sect,
                        const ElfMachine&            machine,
                        const ElfSymtab&             symtab,
-                       bool                         rela) const
+                       bool                         rela,
+                       Diagnostic&                  diags) const
 {
-    unsigned long start = reloc_sect.getFileOffset();
-    unsigned long end = start + reloc_sect.getSize().getUInt();
-    for (unsigned long pos = start; pos < end; )
+    unsigned int size;
+    if (m_config.cls == ELFCLASS32)
+        size = rela ? RELOC32A_SIZE : RELOC32_SIZE;
+    else
+        size = rela ? RELOC64A_SIZE : RELOC64_SIZE;
+
+    // Walk the table in place; it must lie entirely within the buffer.
+    unsigned long pos = reloc_sect.getFileOffset();
+    unsigned long table_size = reloc_sect.getSize().getUInt();
+    if (pos > in.getBufferSize() || table_size > in.getBufferSize() - pos)
+    {
+        diags.Report(SourceLocation(), diag::err_section_relocs_unreadable)
+            << sect.getName();
+        return false;
+    }
+    unsigned long count = table_size / size;
+
+    Section::Relocs& relocs = sect.getRelocs();
+    relocs.reserve(relocs.size() + count);
+    for (unsigned long i = 0; i < count; ++i)
     {
         sect.AddReloc(std::auto_ptr<Reloc>(
             machine.ReadReloc(m_config, symtab, in, &pos, rela).release()));
     }
+    return true;
 }
 
 unsigned long
@@ -109,6 +109,7 @@ public:
 
     void setRelIndex(ElfSectionIndex sectidx) { m_rel_index = sectidx; }
     void setRelName(ElfStringIndex nameidx) { m_rel_name_index = nameidx; }
+    ElfStringIndex getRelName() const { return m_rel_name_index; }
 
     void setEntSize(ElfSize size) { m_entsize = size; }
     ElfSize getEntSize() const { return m_entsize; }
@@ -121,17 +122,21 @@ public:
                            ElfSectionIndex symtab,
                            Section& sect,
                            Bytes& scratch);
+    /// Place the relocation entries for sect at the next suitably aligned
+    /// file offset at or after pos.
+    /// @return File offset just past the relocation entries.
+    unsigned long setRelFileOffset(unsigned long pos, const Section& sect);
+    unsigned long getRelFileOffset() const { return m_rel_offset; }
     unsigned long WriteRelocs(llvm::raw_ostream& os,
                               Section& sect,
-                              Bytes& scratch,
-                              const ElfMachine& machine,
-                              Diagnostic& diags);
-    void ReadRelocs(const llvm::MemoryBuffer& in,
+                              Bytes& scratch);
+    bool ReadRelocs(const llvm::MemoryBuffer& in,
                     const ElfSection& reloc_sect,
                     Section& sect,
                     const ElfMachine& machine,
                     const ElfSymtab& symtab,
-                    bool rela) const;
+                    bool rela,
+                    Diagnostic& diags) const;
 
     unsigned long setFileOffset(unsigned long pos);
     unsigned long getFileOffset() const { return m_offset; }
@@ -44,7 +44,7 @@ public:
                      bool rela)
         : ElfReloc(config, symtab, in, pos, rela)
     {}
-    ElfReloc_x86_x86(SymbolRef sym, const IntNum& addr)
+    ElfReloc_x86_x86(SymbolRef sym, uint64_t addr)
         : ElfReloc(sym, addr)
     {}
 
@@ -77,7 +77,7 @@ public:
     }
 
     std::auto_ptr<ElfReloc>
-    MakeReloc(SymbolRef sym, const IntNum& addr) const
+    MakeReloc(SymbolRef sym, uint64_t addr) const
     {
         return std::auto_ptr<ElfReloc>(new ElfReloc_x86_x86(sym, addr));
     }
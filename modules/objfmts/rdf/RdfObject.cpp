@@ -104,6 +104,9 @@ public:
                              NumericOutput& num_out);
     void DoOutputGap(unsigned long size, SourceLocation source);
     void DoOutputBytes(const Bytes& bytes, SourceLocation source);
+    void DoOutputBorrowed(const unsigned char* data,
+                          unsigned long size,
+                          SourceLocation source);
 
 private:
     llvm::raw_ostream& m_os;
@@ -160,7 +163,7 @@ RdfOutput::ConvertValueToBytes(Value& value,
         }
 
         Section* sect = loc.bc->getContainer()->getSection();
-        IntNum addr = loc.getOffset();
+        uint64_t addr = loc.getOffset();
         SymbolRef sym = value.getRelative();
         RdfReloc::Type type = RdfReloc::RDF_NORM;
 
@@ -228,6 +231,14 @@ RdfOutput::DoOutputBytes(const Bytes& bytes, SourceLocation source)
                                bytes.end());
 }
 
+void
+RdfOutput::DoOutputBorrowed(const unsigned char* data,
+                            unsigned long size,
+                            SourceLocation source)
+{
+    m_rdfsect->raw_data.insert(m_rdfsect->raw_data.end(), data, data+size);
+}
+
 void
 RdfOutput::OutputSectionToMemory(Section& sect)
 {
@@ -276,15 +287,13 @@ RdfOutput::OutputSectionRelocs(const Section& sect)
     if (sect.getRelocs().size() == 0)
         return;
 
+    Bytes& scratch = getScratch();
+    scratch.reserve(10 * sect.getRelocs().size());
     for (Section::const_reloc_iterator i=sect.relocs_begin(),
          end=sect.relocs_end(); i != end; ++i)
-    {
-        const RdfReloc& reloc = static_cast<const RdfReloc&>(*i);
-        Bytes& scratch = getScratch();
-        reloc.Write(scratch, rdfsect->scnum);
-        assert(scratch.size() == 10);
-        m_os << scratch;
-    }
+        static_cast<const RdfReloc&>(*i).Write(scratch, rdfsect->scnum);
+    assert(scratch.size() == 10 * sect.getRelocs().size());
+    m_os << scratch;
 }
 
 void
@@ -748,7 +757,7 @@ RdfObject::Read(SourceManager& sm, Diagnostic& diags)
                     << section->getName();
                 return false;
             }
-            section->bytecodes_front().getFixed().Write(inbuf.Read(size), size);
+            AppendDataRef(*section, inbuf.Read(size), size, SourceLocation());
         }
 
         // Create symbol for section start (used for relocations)
@@ -36,7 +36,7 @@
 using namespace yasm;
 using namespace yasm::objfmt;
 
-RdfReloc::RdfReloc(const IntNum& addr,
+RdfReloc::RdfReloc(uint64_t addr,
                    SymbolRef sym,
                    Type type,
                    unsigned int size,
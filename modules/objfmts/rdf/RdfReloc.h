@@ -48,7 +48,7 @@ public:
         RDF_SEG             ///< segment containing symbol
     };
 
-    RdfReloc(const IntNum& addr,
+    RdfReloc(uint64_t addr,
              SymbolRef sym,
              Type type,
              unsigned int size,
@@ -223,15 +223,13 @@ XdfOutput::OutputSection(Section& sect)
     }
     xsect->relptr = static_cast<unsigned long>(pos);
 
+    Bytes& scratch = getScratch();
+    scratch.reserve(RELOC_SIZE * sect.getRelocs().size());
     for (Section::const_reloc_iterator i=sect.relocs_begin(),
          end=sect.relocs_end(); i != end; ++i)
-    {
-        const XdfReloc& reloc = static_cast<const XdfReloc&>(*i);
-        Bytes& scratch = getScratch();
-        reloc.Write(scratch);
-        assert(scratch.size() == RELOC_SIZE);
-        m_os << scratch;
-    }
+        static_cast<const XdfReloc&>(*i).Write(scratch);
+    assert(scratch.size() == RELOC_SIZE * sect.getRelocs().size());
+    m_os << scratch;
 }
 
 void
@@ -549,8 +547,8 @@ XdfObject::Read(SourceManager& sm, Diagnostic& diags)
                 return false;
             }
 
-            section->bytecodes_front().getFixed().Write(inbuf.Read(xsect->size),
-                                                        xsect->size);
+            AppendDataRef(*section, inbuf.Read(xsect->size), xsect->size,
+                          SourceLocation());
         }
 
         // Associate section data with section
@@ -37,7 +37,7 @@
 using namespace yasm;
 using namespace yasm::objfmt;
 
-XdfReloc::XdfReloc(const IntNum& addr,
+XdfReloc::XdfReloc(uint64_t addr,
                    SymbolRef sym,
                    SymbolRef base,
                    Type type,
@@ -51,7 +51,7 @@ XdfReloc::XdfReloc(const IntNum& addr,
 {
 }
 
-XdfReloc::XdfReloc(const IntNum& addr, const Value& value, bool ip_rel)
+XdfReloc::XdfReloc(uint64_t addr, const Value& value, bool ip_rel)
     : Reloc(addr, value.getRelative())
     , m_base(0)
     , m_size(static_cast<Size>(value.getSize()/8))
@@ -61,13 +61,13 @@ public:
         XDF_64 = 8
     };
 
-    XdfReloc(const IntNum& addr,
+    XdfReloc(uint64_t addr,
              SymbolRef sym,
              SymbolRef base,
              Type type,
              Size size,
              unsigned int shift);
-    XdfReloc(const IntNum& addr, const Value& value, bool ip_rel);
+    XdfReloc(uint64_t addr, const Value& value, bool ip_rel);
     ~XdfReloc();
 
     Expr getValue() const;
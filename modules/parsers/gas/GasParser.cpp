@@ -107,11 +107,12 @@ GasParser::GasParser(const ParserModule& module,
         {".previous",   &GasParser::ParseDirPrevious,       0},
         // macro directives
         {".include",    &GasParser::ParseDirInclude,    0},
-#if 0
         {".macro",      &GasParser::ParseDirMacro,      0},
         {".endm",       &GasParser::ParseDirEndm,       0},
-#endif
+        {".purgem",     &GasParser::ParseDirPurgem,     0},
         {".rept",       &GasParser::ParseDirRept,       0},
+        {".irp",        &GasParser::ParseDirIrp,        0},
+        {".irpc",       &GasParser::ParseDirIrp,        1},
         {".endr",       &GasParser::ParseDirEndr,       0},
         // empty space/fill directives
         {".skip",       &GasParser::ParseDirSkip,   1},
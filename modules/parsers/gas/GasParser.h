@@ -120,8 +120,25 @@ private:
     bool ParseDirInclude(unsigned int, SourceLocation source);
     bool ParseDirMacro(unsigned int, SourceLocation source);
     bool ParseDirEndm(unsigned int, SourceLocation source);
+    bool ParseDirPurgem(unsigned int, SourceLocation source);
     bool ParseDirRept(unsigned int, SourceLocation source);
+    bool ParseDirIrp(unsigned int is_irpc, SourceLocation source);
     bool ParseDirEndr(unsigned int, SourceLocation source);
+
+    /// Lex and save the tokens of a .macro or .rept/.irp/.irpc body, up to
+    /// the matching .endm or .endr (which is left as the current token).
+    /// @param tokens   body tokens (output)
+    /// @param macro    true for a .macro body, false for a .endr block
+    /// @return False if end of file was reached first.
+    bool CollectBlock(std::vector<Token>* tokens, bool macro);
+
+    /// Lex a macro argument or parameter default value.
+    /// @param arg      argument tokens (output)
+    /// @param rest     take everything to the end of the statement
+    void ParseMacroArg(std::vector<Token>* arg, bool rest);
+
+    /// Parse the arguments of a macro invocation and expand it.
+    bool ParseMacroCall(const GasMacro& macro, SourceLocation source);
     bool ParseDirAlign(unsigned int power2, SourceLocation source);
     bool ParseDirOrg(unsigned int, SourceLocation source);
     bool ParseDirLocal(unsigned int, SourceLocation source);
@@ -153,6 +153,12 @@ next:
                                                          id_source);
                 }
 
+                if (m_gas_preproc.hasMacros())
+                {
+                    if (const GasMacro* macro = m_gas_preproc.getMacro(name))
+                        return ParseMacroCall(*macro, id_source);
+                }
+
                 DirectiveInfo dirinfo(*m_object, m_container->getEndLoc(),
                                       id_source);
                 ParseDirective(&dirinfo.getNameValues());
@@ -168,6 +174,15 @@ next:
                 break;
             }
 
+            if (m_gas_preproc.hasMacros())
+            {
+                if (const GasMacro* macro = m_gas_preproc.getMacro(name))
+                {
+                    ConsumeToken();
+                    return ParseMacroCall(*macro, exp_source);
+                }
+            }
+
             if (m_arch->hasParseInsn())
                 return m_arch->ParseInsn(*m_container, *this);
 
@@ -507,43 +522,327 @@ GasParser::ParseDirRept(unsigned int param, SourceLocation source)
     unsigned long count = intn.getUInt();
 
     // Lex and save tokens until we get an .endr
-    llvm::SmallVector<Token, 8> tokens;
+    std::vector<Token> tokens;
+    if (!CollectBlock(&tokens, false))
+    {
+        Diag(source, diag::err_rept_without_endr);
+        return false;
+    }
+    // Replay a single copy of the body count times.
+    Token* alloc_tokens = new Token[tokens.size()];
+    std::copy(tokens.begin(), tokens.end(), alloc_tokens);
+    m_preproc.EnterTokenStream(alloc_tokens, tokens.size(), false, true, count);
+    ConsumeToken(); // consume the .endr and get the first repeated token
+    return true;
+}
+
+bool
+GasParser::ParseDirIrp(unsigned int is_irpc, SourceLocation source)
+{
+    const char* dirname = is_irpc ? ".irpc" : ".irp";
+    if (m_token.isNot(GasToken::identifier) && m_token.isNot(GasToken::label))
+    {
+        Diag(m_token, diag::err_expected_ident);
+        return false;
+    }
+
+    // The body is expanded like a macro with a single parameter.
+    GasMacro macro;
+    macro.name = dirname;
+    macro.source = source;
+    macro.params.resize(1);
+    macro.params[0].name = m_token.getIdentifierInfo();
+    macro.params[0].required = false;
+    macro.params[0].vararg = false;
+    ConsumeToken();
+    if (m_token.is(GasToken::comma))
+        ConsumeToken();
+
+    GasMacroArgs values;
+    if (is_irpc)
+    {
+        std::vector<Token> chars;
+        ParseMacroArg(&chars, true);
+        m_gas_preproc.SplitChars(chars, &values);
+    }
+    else
+    {
+        while (!m_token.isEndOfStatement() && m_token.isNot(GasToken::eof))
+        {
+            values.push_back(std::vector<Token>());
+            ParseMacroArg(&values.back(), false);
+            if (m_token.is(GasToken::comma))
+                ConsumeToken();
+        }
+    }
+    // With no values, the body is expanded once with an empty value.
+    if (values.empty())
+        values.push_back(std::vector<Token>());
+
+    if (!CollectBlock(&macro.body, false))
+    {
+        Diag(source, diag::err_irp_without_endr) << dirname;
+        return false;
+    }
+    m_gas_preproc.CompileMacro(&macro);
+
+    std::vector<Token> tokens;
+    GasMacroArgs args(1);
+    for (GasMacroArgs::iterator i=values.begin(), end=values.end(); i != end;
+         ++i)
+    {
+        args[0].swap(*i);
+        m_gas_preproc.ExpandMacro(macro, args, &tokens);
+    }
+    m_gas_preproc.EnterMacroTokens(tokens, source);
+    ConsumeToken(); // consume the .endr and get the first expanded token
+    return true;
+}
+
+bool
+GasParser::ParseDirMacro(unsigned int param, SourceLocation source)
+{
+    if (m_token.isNot(GasToken::identifier) && m_token.isNot(GasToken::label))
+    {
+        Diag(m_token, diag::err_expected_ident);
+        return false;
+    }
+
+    std::auto_ptr<GasMacro> macro(new GasMacro);
+    macro->name = m_token.getIdentifierInfo()->getName();
+    macro->source = ConsumeToken();
+
+    // Parameters: name[:req|:vararg][=default], separated by commas or
+    // whitespace.
+    while (!m_token.isEndOfStatement() && m_token.isNot(GasToken::eof))
+    {
+        if (m_token.is(GasToken::comma))
+        {
+            ConsumeToken();
+            continue;
+        }
+        if (m_token.isNot(GasToken::identifier) &&
+            m_token.isNot(GasToken::label))
+        {
+            Diag(m_token, diag::err_expected_ident);
+            return false;
+        }
+        macro->params.push_back(GasMacro::Param());
+        GasMacro::Param& mparam = macro->params.back();
+        mparam.name = m_token.getIdentifierInfo();
+        mparam.required = false;
+        mparam.vararg = false;
+        ConsumeToken();
+
+        if (m_token.is(GasToken::colon))
+        {
+            ConsumeToken();
+            IdentifierInfo* qual = 0;
+            if (m_token.is(GasToken::identifier))
+                qual = m_token.getIdentifierInfo();
+            if (qual && qual->isStr("req"))
+                mparam.required = true;
+            else if (qual && qual->isStr("vararg"))
+                mparam.vararg = true;
+            else
+            {
+                Diag(m_token, diag::err_macro_bad_qualifier)
+                    << m_preproc.getSpelling(m_token)
+                    << mparam.name->getName();
+                return false;
+            }
+            ConsumeToken();
+        }
+
+        if (m_token.is(GasToken::equal))
+        {
+            ConsumeToken();
+            ParseMacroArg(&mparam.def, false);
+        }
+    }
+
+    if (!CollectBlock(&macro->body, true))
+    {
+        Diag(source, diag::err_macro_without_endm);
+        return false;
+    }
+    ConsumeToken(); // consume the .endm
+
+    m_gas_preproc.CompileMacro(macro.get());
+    return m_gas_preproc.DefineMacro(macro.release());
+}
+
+bool
+GasParser::ParseDirEndm(unsigned int param, SourceLocation source)
+{
+    // Shouldn't ever get here unless we didn't get a .macro first
+    Diag(source, diag::err_endm_without_macro);
+    return false;
+}
+
+bool
+GasParser::ParseDirPurgem(unsigned int param, SourceLocation source)
+{
+    if (m_token.isNot(GasToken::identifier) && m_token.isNot(GasToken::label))
+    {
+        Diag(m_token, diag::err_expected_ident);
+        return false;
+    }
+    llvm::StringRef name = m_token.getIdentifierInfo()->getName();
+    if (!m_gas_preproc.PurgeMacro(name))
+        Diag(m_token, diag::err_macro_undefined) << name;
+    ConsumeToken();
+    return true;
+}
+
+bool
+GasParser::CollectBlock(std::vector<Token>* tokens, bool macro)
+{
     int depth = 1;
     for (;;)
     {
-        if (m_token.isAtStartOfLine() && m_token.is(GasToken::label) &&
-            m_token.getIdentifierInfo()->isStr(".endr"))
+        if (m_token.is(GasToken::eof))
+            return false;
+        if (m_token.isAtStartOfLine() && m_token.is(GasToken::label))
         {
-            if (depth == 1)
+            IdentifierInfo* ii = m_token.getIdentifierInfo();
+            if (ii->isStr(macro ? ".endm" : ".endr"))
+            {
+                if (--depth == 0)
+                    return true;
+            }
+            // handle nesting
+            else if (macro ? ii->isStr(".macro") :
+                     (ii->isStr(".rept") || ii->isStr(".irp") ||
+                      ii->isStr(".irpc")))
+                ++depth;
+        }
+        tokens->push_back(m_token);
+        ConsumeAnyToken();
+    }
+}
+
+// Can whitespace around this token separate macro arguments?
+static bool
+isMacroArgOperator(const Token& tok)
+{
+    switch (tok.getKind())
+    {
+        case GasToken::plus:
+        case GasToken::minus:
+        case GasToken::star:
+        case GasToken::slash:
+        case GasToken::amp:
+        case GasToken::ampamp:
+        case GasToken::pipe:
+        case GasToken::pipepipe:
+        case GasToken::caret:
+        case GasToken::tilde:
+        case GasToken::exclaim:
+        case GasToken::less:
+        case GasToken::lessless:
+        case GasToken::lessequal:
+        case GasToken::lessgreater:
+        case GasToken::greater:
+        case GasToken::greatergreater:
+        case GasToken::greaterequal:
+        case GasToken::equal:
+        case GasToken::equalequal:
+        case GasToken::colon:
+        case GasToken::l_paren:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void
+GasParser::ParseMacroArg(std::vector<Token>* arg, bool rest)
+{
+    // Arguments end at a comma or at whitespace between two operands,
+    // except inside parentheses.
+    int depth = 0;
+    while (!m_token.isEndOfStatement() && m_token.isNot(GasToken::eof))
+    {
+        if (!rest && depth == 0)
+        {
+            if (m_token.is(GasToken::comma))
+                break;
+            if (!arg->empty() && m_token.hasLeadingSpace() &&
+                !isMacroArgOperator(arg->back()) &&
+                !isMacroArgOperator(m_token))
                 break;
-            --depth;
         }
-        // handle nesting
-        if (m_token.isAtStartOfLine() && m_token.is(GasToken::label) &&
-            m_token.getIdentifierInfo()->isStr(".rept"))
+        if (m_token.is(GasToken::l_paren))
             ++depth;
-        if (m_token.is(GasToken::eof))
+        else if (m_token.is(GasToken::r_paren) && depth > 0)
+            --depth;
+        arg->push_back(m_token);
+        ConsumeAnyToken();
+    }
+}
+
+bool
+GasParser::ParseMacroCall(const GasMacro& macro, SourceLocation source)
+{
+    unsigned int nparams = macro.params.size();
+    GasMacroArgs args(nparams);
+    unsigned int pos = 0;
+
+    while (!m_token.isEndOfStatement() && m_token.isNot(GasToken::eof))
+    {
+        unsigned int slot = pos;
+        if ((m_token.is(GasToken::identifier) || m_token.is(GasToken::label))
+            && NextToken().is(GasToken::equal))
         {
-            Diag(source, diag::err_rept_without_endr);
-            // TODO: Push remaining tokens back on so we can continue working
-#if 0
-            Token* alloc_tokens = new Token[tokens.size()];
-            std::copy(tokens.begin(), tokens.end(), alloc_tokens);
-            m_preproc.EnterTokenStream(alloc_tokens, tokens.size(), false,
-                                       true);
-            ConsumeToken(); // get the first token of stream
-#endif
+            // keyword argument
+            IdentifierInfo* ii = m_token.getIdentifierInfo();
+            for (slot=0; slot<nparams; ++slot)
+            {
+                if (macro.params[slot].name == ii)
+                    break;
+            }
+            if (slot == nparams)
+            {
+                Diag(m_token, diag::err_macro_unknown_param)
+                    << macro.name << ii->getName();
+                return false;
+            }
+            ConsumeToken();
+            ConsumeToken(); // also eat the =
+        }
+        else if (pos >= nparams)
+        {
+            Diag(m_token, diag::err_macro_too_many_args) << macro.name;
             return false;
         }
-        tokens.push_back(m_token);
-        ConsumeToken();
+        else
+            ++pos;
+
+        args[slot].clear();
+        ParseMacroArg(&args[slot], macro.params[slot].vararg);
+        if (m_token.is(GasToken::comma))
+            ConsumeToken();
     }
-    Token* alloc_tokens = new Token[count*tokens.size()];
-    for (unsigned long i=0; i<count; ++i)
-        std::copy(tokens.begin(), tokens.end(), &alloc_tokens[i*tokens.size()]);
-    m_preproc.EnterTokenStream(alloc_tokens, count*tokens.size(), false, true);
-    ConsumeToken(); // consume the .endr and get the first repeated token
-    return true;
+
+    // Fill in default values for omitted arguments.
+    for (unsigned int i=0; i<nparams; ++i)
+    {
+        if (!args[i].empty())
+            continue;
+        const GasMacro::Param& mparam = macro.params[i];
+        if (mparam.required)
+        {
+            Diag(source, diag::err_macro_missing_arg)
+                << mparam.name->getName() << macro.name;
+            return false;
+        }
+        args[i] = mparam.def;
+    }
+
+    std::vector<Token> tokens;
+    m_gas_preproc.ExpandMacro(macro, args, &tokens);
+    return m_gas_preproc.EnterMacroTokens(tokens, source);
 }
 
 bool
@@ -1291,7 +1590,7 @@ GasParser::SkipConditional(SourceLocation begin)
         if (!m_token.isAtStartOfLine() || m_token.isNot(GasToken::label))
         {
             prev_token = m_token;
-            ConsumeToken();
+            ConsumeAnyToken();
             continue;
         }
         IdentifierInfo* ii = m_token.getIdentifierInfo();
@@ -30,8 +30,15 @@
 //
 #include "GasPreproc.h"
 
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#include "llvm/ADT/SmallString.h"
 #include "yasmx/Basic/FileManager.h"
 #include "yasmx/Parse/HeaderSearch.h"
+#include "yasmx/Parse/IdentifierTable.h"
+#include "yasmx/IntNum.h"
 
 #include "GasLexer.h"
 
@@ -42,11 +49,15 @@ GasPreproc::GasPreproc(Diagnostic& diags,
                        SourceManager& sm,
                        HeaderSearch& headers)
     : Preprocessor(diags, sm, headers)
+    , m_macro_count(0)
 {
 }
 
 GasPreproc::~GasPreproc()
 {
+    for (MacroMap::iterator i=m_macros.begin(), end=m_macros.end(); i != end;
+         ++i)
+        delete i->getValue();
 }
 
 void
@@ -107,6 +118,352 @@ GasPreproc::HandleInclude(llvm::StringRef filename, SourceLocation source)
     return true;
 }
 
+// Macro names are case-insensitive.
+static llvm::StringRef
+getMacroKey(llvm::StringRef name, llvm::SmallVectorImpl<char>& buf)
+{
+    buf.clear();
+    for (llvm::StringRef::iterator i=name.begin(), end=name.end(); i != end;
+         ++i)
+        buf.push_back(std::tolower(static_cast<unsigned char>(*i)));
+    return llvm::StringRef(buf.data(), buf.size());
+}
+
+void
+GasPreproc::CompileMacro(GasMacro* macro)
+{
+    const std::vector<Token>& body = macro->body;
+    std::vector<GasMacro::Piece>& pieces = macro->pieces;
+    pieces.clear();
+
+    GasMacro::Piece run;
+    run.kind = GasMacro::Piece::TOKENS;
+    run.begin = 0;
+    run.param = 0;
+    run.start_of_line = false;
+    run.leading_space = false;
+    run.paste = false;
+
+    llvm::SmallString<4> buf;
+    unsigned int num = body.size();
+    for (unsigned int i=0; i+1<num; ++i)
+    {
+        // All references start with a backslash immediately followed by
+        // the rest of the reference.
+        const Token& tok = body[i];
+        const Token& next = body[i+1];
+        if (tok.isNot(GasToken::unknown) || tok.getLength() != 1 ||
+            next.hasLeadingSpace() || next.isEndOfStatement() ||
+            getSpelling(tok, buf) != "\\")
+            continue;
+
+        GasMacro::Piece piece;
+        piece.begin = i;
+        piece.end = i+2;
+        piece.param = 0;
+        piece.start_of_line = tok.isAtStartOfLine();
+        piece.leading_space = tok.hasLeadingSpace();
+        piece.paste = i != 0 && !tok.hasLeadingSpace() &&
+            !tok.isAtStartOfLine() && !body[i-1].isEndOfStatement();
+
+        if (next.is(GasToken::at))
+            piece.kind = GasMacro::Piece::COUNTER;
+        else if (next.is(GasToken::l_paren) && i+2 < num &&
+                 body[i+2].is(GasToken::r_paren) &&
+                 !body[i+2].hasLeadingSpace())
+        {
+            piece.kind = GasMacro::Piece::SEPARATOR;
+            piece.end = i+3;
+        }
+        else if (IdentifierInfo* ii = next.getIdentifierInfo())
+        {
+            unsigned int nparams = macro->params.size();
+            while (piece.param < nparams &&
+                   macro->params[piece.param].name != ii)
+                ++piece.param;
+            if (piece.param == nparams)
+                continue;       // not a parameter; leave it alone
+            piece.kind = GasMacro::Piece::PARAM;
+        }
+        else
+            continue;
+
+        if (run.begin < i)
+        {
+            run.end = i;
+            pieces.push_back(run);
+        }
+        pieces.push_back(piece);
+
+        // Tokens directly following the reference paste onto it.
+        run.begin = piece.end;
+        run.paste = run.begin < num && !body[run.begin].hasLeadingSpace() &&
+            !body[run.begin].isAtStartOfLine() &&
+            !body[run.begin].isEndOfStatement();
+        i = piece.end-1;
+    }
+    if (run.begin < num)
+    {
+        run.end = num;
+        pieces.push_back(run);
+    }
+}
+
+bool
+GasPreproc::DefineMacro(GasMacro* macro)
+{
+    llvm::SmallString<32> buf;
+    GasMacro*& entry = m_macros[getMacroKey(macro->name, buf)];
+    if (entry != 0)
+    {
+        Diag(macro->source, diag::err_macro_redefined) << macro->name;
+        Diag(entry->source, diag::note_previous_definition);
+        delete macro;
+        return false;
+    }
+    entry = macro;
+    return true;
+}
+
+bool
+GasPreproc::PurgeMacro(llvm::StringRef name)
+{
+    llvm::SmallString<32> buf;
+    MacroMap::iterator i = m_macros.find(getMacroKey(name, buf));
+    if (i == m_macros.end())
+        return false;
+    delete i->getValue();
+    m_macros.erase(i);
+    return true;
+}
+
+const GasMacro*
+GasPreproc::getMacro(llvm::StringRef name) const
+{
+    llvm::SmallString<32> buf;
+    MacroMap::const_iterator i = m_macros.find(getMacroKey(name, buf));
+    if (i == m_macros.end())
+        return 0;
+    return i->getValue();
+}
+
+llvm::StringRef
+GasPreproc::getTokenText(const Token& tok,
+                         llvm::SmallVectorImpl<char>& buf) const
+{
+    if (tok.isLiteral())
+        return tok.getLiteral();
+    if (IdentifierInfo* ii = tok.getIdentifierInfo())
+        return ii->getName();
+    return getSpelling(tok, buf);
+}
+
+bool
+GasPreproc::PasteTokens(Token* lhs, const Token& rhs)
+{
+    llvm::SmallString<64> text;
+    llvm::SmallString<32> buf;
+    text += getTokenText(*lhs, buf);
+    text += getTokenText(rhs, buf);
+
+    // The result must lex as a single identifier or number.
+    unsigned char first = text[0];
+    bool number = std::isdigit(first);
+    if (!number && !std::isalpha(first) && first != '_' && first != '.')
+        return false;
+    for (llvm::SmallString<64>::iterator i=text.begin(), end=text.end();
+         i != end; ++i)
+    {
+        unsigned char ch = *i;
+        if (!std::isalnum(ch) && ch != '_' && ch != '.' &&
+            (number || ch != '$'))
+            return false;
+    }
+
+    if (number)
+    {
+        // Numeric literals must be nul-terminated for GasNumericParser.
+        char* data = static_cast<char*>(
+            getPreprocessorAllocator().Allocate(text.size()+1, 1));
+        std::memcpy(data, text.data(), text.size());
+        data[text.size()] = '\0';
+        lhs->setKind(GasToken::numeric_constant);
+        lhs->setFlag(Token::Literal);
+        lhs->setLiteralData(data);
+    }
+    else
+    {
+        IdentifierInfo* ii = getIdentifierInfo(text.str());
+        unsigned int kind = ii->getTokenKind();
+        if (kind == Token::unknown)
+            kind = (first == '_' || first == '.') ?
+                GasToken::label : GasToken::identifier;
+        lhs->clearFlag(Token::Literal);
+        lhs->setKind(kind);
+        lhs->setIdentifierInfo(ii);
+    }
+    lhs->setLength(text.size());
+    return true;
+}
+
+void
+GasPreproc::ExpandMacro(const GasMacro& macro,
+                        const GasMacroArgs& args,
+                        std::vector<Token>* out)
+{
+    Token counter;
+    counter.StartToken();
+
+    // Can the next token paste onto the previous output token?
+    bool can_paste = false;
+    // Flags of an empty reference, passed on to the next token output.
+    bool pending = false, start_of_line = false, leading_space = false;
+
+    for (std::vector<GasMacro::Piece>::const_iterator
+         piece=macro.pieces.begin(), end=macro.pieces.end(); piece != end;
+         ++piece)
+    {
+        const Token* begin = 0;
+        const Token* last = 0;
+        switch (piece->kind)
+        {
+            case GasMacro::Piece::TOKENS:
+                begin = &macro.body[piece->begin];
+                last = begin + (piece->end - piece->begin);
+                break;
+            case GasMacro::Piece::PARAM:
+            {
+                const std::vector<Token>& val = args[piece->param];
+                if (!val.empty())
+                {
+                    begin = &val[0];
+                    last = begin + val.size();
+                }
+                break;
+            }
+            case GasMacro::Piece::COUNTER:
+                if (counter.is(GasToken::unknown))
+                {
+                    llvm::SmallString<16> num;
+                    IntNum(m_macro_count).getStr(num);
+                    char* data = static_cast<char*>(
+                        getPreprocessorAllocator().Allocate(num.size()+1, 1));
+                    std::memcpy(data, num.data(), num.size());
+                    data[num.size()] = '\0';
+                    counter.setKind(GasToken::numeric_constant);
+                    counter.setLocation(macro.body[piece->begin].getLocation());
+                    counter.setLength(num.size());
+                    counter.setFlag(Token::Literal);
+                    counter.setLiteralData(data);
+                }
+                begin = &counter;
+                last = begin + 1;
+                break;
+            case GasMacro::Piece::SEPARATOR:
+                break;
+        }
+
+        bool paste = piece->paste && can_paste;
+        if (begin == last)
+        {
+            if (!paste)
+            {
+                can_paste = false;
+                if (!pending)
+                {
+                    pending = true;
+                    start_of_line = piece->start_of_line;
+                    leading_space = piece->leading_space;
+                }
+            }
+            continue;
+        }
+
+        if (!paste || !PasteTokens(&out->back(), *begin))
+        {
+            out->push_back(*begin);
+            Token& first = out->back();
+            if (pending)
+            {
+                first.setFlagValue(Token::StartOfLine, start_of_line);
+                first.setFlagValue(Token::LeadingSpace, leading_space);
+            }
+            else if (piece->kind != GasMacro::Piece::TOKENS)
+            {
+                first.setFlagValue(Token::StartOfLine, piece->start_of_line);
+                first.setFlagValue(Token::LeadingSpace, piece->leading_space);
+            }
+        }
+        out->insert(out->end(), begin+1, last);
+        pending = false;
+        can_paste = true;
+    }
+
+    ++m_macro_count;
+}
+
+void
+GasPreproc::SplitChars(const std::vector<Token>& toks, GasMacroArgs* values)
+{
+    llvm::SmallString<32> buf;
+    for (std::vector<Token>::const_iterator tok=toks.begin(), end=toks.end();
+         tok != end; ++tok)
+    {
+        if (tok->isNot(GasToken::identifier) && tok->isNot(GasToken::label) &&
+            tok->isNot(GasToken::numeric_constant))
+        {
+            values->push_back(std::vector<Token>(1, *tok));
+            continue;
+        }
+
+        llvm::StringRef text = getTokenText(*tok, buf);
+        for (llvm::StringRef::iterator i=text.begin(), iend=text.end();
+             i != iend; ++i)
+        {
+            Token ch;
+            ch.StartToken();
+            ch.setLocation(tok->getLocation());
+            ch.setLength(1);
+            if (std::isdigit(static_cast<unsigned char>(*i)))
+            {
+                char* data = static_cast<char*>(
+                    getPreprocessorAllocator().Allocate(2, 1));
+                data[0] = *i;
+                data[1] = '\0';
+                ch.setKind(GasToken::numeric_constant);
+                ch.setFlag(Token::Literal);
+                ch.setLiteralData(data);
+            }
+            else
+            {
+                IdentifierInfo* ii = getIdentifierInfo(llvm::StringRef(i, 1));
+                ch.setKind((*i == '_' || *i == '.') ?
+                           GasToken::label : GasToken::identifier);
+                ch.setIdentifierInfo(ii);
+            }
+            values->push_back(std::vector<Token>(1, ch));
+        }
+    }
+}
+
+bool
+GasPreproc::EnterMacroTokens(const std::vector<Token>& toks,
+                             SourceLocation source)
+{
+    if (m_include_macro_stack.size() >= MaxAllowedIncludeStackDepth-1)
+    {
+        Diag(source, diag::err_macro_nested_too_deep);
+        return false;
+    }
+    if (toks.empty())
+        return true;
+
+    Token* alloc_tokens = new Token[toks.size()];
+    std::copy(toks.begin(), toks.end(), alloc_tokens);
+    EnterTokenStream(alloc_tokens, toks.size(), false, true);
+    return true;
+}
+
 void
 GasPreproc::RegisterBuiltinMacros()
 {
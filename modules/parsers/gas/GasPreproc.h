@@ -30,9 +30,15 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 //
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
 #include "yasmx/Basic/SourceLocation.h"
 #include "yasmx/Config/export.h"
 #include "yasmx/Parse/Preprocessor.h"
+#include "yasmx/Parse/Token.h"
 
 
 namespace yasm
@@ -43,6 +49,49 @@ class IdentifierInfo;
 namespace parser
 {
 
+/// A GAS macro (.macro), or the body of an .irp/.irpc block.
+/// The body is kept as the tokens lexed at definition time.  References
+/// to parameters (\name), \@ and \() are resolved once into a list of
+/// pieces, so an expansion only copies tokens and substitutes argument
+/// tokens into the parameter slots; the body is never re-lexed.
+struct YASM_STD_EXPORT GasMacro
+{
+    struct Param
+    {
+        IdentifierInfo* name;
+        std::vector<Token> def;     ///< default value
+        bool required;              ///< :req
+        bool vararg;                ///< :vararg
+    };
+
+    struct Piece
+    {
+        enum Kind
+        {
+            TOKENS,     ///< body tokens [begin, end)
+            PARAM,      ///< value of parameter param
+            COUNTER,    ///< \@ (number of macros expanded so far)
+            SEPARATOR   ///< \() (expands to nothing)
+        };
+        Kind kind;
+        unsigned int begin, end;
+        unsigned int param;
+        bool start_of_line;     ///< leading backslash starts a line
+        bool leading_space;     ///< leading backslash follows whitespace
+        /// First token pastes onto the preceding one (no whitespace).
+        bool paste;
+    };
+
+    std::string name;
+    SourceLocation source;
+    std::vector<Param> params;
+    std::vector<Token> body;
+    std::vector<Piece> pieces;
+};
+
+/// Argument values for a macro expansion, one token list per parameter.
+typedef std::vector<std::vector<Token> > GasMacroArgs;
+
 class YASM_STD_EXPORT GasPreproc : public Preprocessor
 {
 public:
@@ -55,12 +104,64 @@ public:
 
     bool HandleInclude(llvm::StringRef filename, SourceLocation source);
 
+    /// Resolve the parameter references in a macro body.  Must be called
+    /// after the params and body of macro are filled in, and before it is
+    /// expanded.
+    void CompileMacro(GasMacro* macro);
+
+    /// Define a macro.  Takes ownership of macro.
+    /// @return False (and deletes macro) if the macro is already defined.
+    bool DefineMacro(GasMacro* macro);
+
+    /// Delete a macro definition (.purgem).
+    /// @return False if no macro by that name is defined.
+    bool PurgeMacro(llvm::StringRef name);
+
+    /// Are any macros defined?
+    bool hasMacros() const { return !m_macros.empty(); }
+
+    /// Look up a macro by name (case-insensitive).
+    /// @return NULL if not defined.
+    const GasMacro* getMacro(llvm::StringRef name) const;
+
+    /// Append the expansion of a macro to a token list.
+    /// @param macro    macro
+    /// @param args     argument values, one per parameter
+    /// @param out      output tokens
+    void ExpandMacro(const GasMacro& macro,
+                     const GasMacroArgs& args,
+                     std::vector<Token>* out);
+
+    /// Split tokens into single characters (for .irpc).  Each character of
+    /// an identifier or number becomes a separate value; other tokens are
+    /// kept whole.
+    void SplitChars(const std::vector<Token>& toks, GasMacroArgs* values);
+
+    /// Enter expanded macro tokens so they are lexed next.
+    /// @return False if macros are nested too deeply.
+    bool EnterMacroTokens(const std::vector<Token>& toks,
+                          SourceLocation source);
+
 protected:
     virtual void RegisterBuiltinMacros();
     virtual Lexer* CreateLexer(FileID fid,
                                const llvm::MemoryBuffer* input_buffer);
 
 private:
+    /// Get the text of a token (even one created by pasting).
+    llvm::StringRef getTokenText(const Token& tok,
+                                 llvm::SmallVectorImpl<char>& buf) const;
+
+    /// Paste rhs onto the end of lhs, if the result is a single identifier
+    /// or number.
+    /// @return False if the tokens cannot be pasted.
+    bool PasteTokens(Token* lhs, const Token& rhs);
+
+    typedef llvm::StringMap<GasMacro*> MacroMap;
+    MacroMap m_macros;
+
+    /// Number of macros expanded so far (for \@).
+    unsigned long m_macro_count;
 };
 
 }} // namespace yasm::parser
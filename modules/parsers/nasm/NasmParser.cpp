@@ -31,6 +31,7 @@
 #include <cstdarg>
 #include <cstdio>
 #include <cstdlib>
+#include <string>
 
 #include "llvm/ADT/SmallString.h"
 #include "llvm/Support/MemoryBuffer.h"
@@ -55,6 +56,28 @@ using namespace yasm::parser;
 
 static unsigned int nasm_errors;
 
+namespace {
+/// Memory buffer that takes over the contents of a string, so the
+/// preprocessed source is not copied again when handed to the lexer.
+class StringMemoryBuffer : public llvm::MemoryBuffer
+{
+public:
+    StringMemoryBuffer(std::string& str, llvm::StringRef name)
+        : m_name(name)
+    {
+        m_str.swap(str);
+        init(m_str.c_str(), m_str.c_str() + m_str.size());
+    }
+
+    virtual const char* getBufferIdentifier() const
+    { return m_name.c_str(); }
+
+private:
+    std::string m_str;
+    std::string m_name;
+};
+} // anonymous namespace
+
 static void
 nasm_efunc(int severity, const char *fmt, ...)
 {
@@ -196,7 +219,10 @@ NasmParser::Parse(Object& object, Directives& dirs, Diagnostic& diags)
     nasm::pp_extra_stdmac(nasm_standard_mac);
 
     // preprocess input
+    // The expanded source is usually at least as large as the main file;
+    // start there to avoid most regrowth copies of a large result.
     std::string result;
+    result.reserve(sm.getBuffer(sm.getMainFileID())->getBufferSize());
     long prior_linnum = 0;
     char *file_name = 0;
     int lineinc = 0;
@@ -216,6 +242,7 @@ NasmParser::Parse(Object& object, Directives& dirs, Diagnostic& diags)
         // NOTE: useful
         result += line;
         result += '\n';
+        nasm_free(line);
     }
     nasm::nasmpp.cleanup(1);
     for (int i=0; i<7; ++i)
@@ -235,11 +262,10 @@ NasmParser::Parse(Object& object, Directives& dirs, Diagnostic& diags)
 #endif
 
     // override main file with preprocessed source
-    const char* filename =
+    std::string filename =
         sm.getBuffer(sm.getMainFileID())->getBufferIdentifier();
     sm.clearIDTables();
-    sm.createMainFileIDForMemBuffer(
-        llvm::MemoryBuffer::getMemBufferCopy(result, filename));
+    sm.createMainFileIDForMemBuffer(new StringMemoryBuffer(result, filename));
 
 #endif
     // Get first token
@@ -33,6 +33,8 @@
  *
  * detoken is used to convert the line back to text
  */
+#define DEBUG_TYPE "nasm-pp"
+
 #include <cctype>
 #include <climits>
 #include <cstdarg>
@@ -40,6 +42,7 @@
 #include <cstring>
 
 #include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "yasmx/IntNum.h"
 #include "yasmx/Expr.h"
@@ -56,6 +59,10 @@ using yasm::FileID;
 using yasm::IntNum;
 using yasm::SourceLocation;
 
+STATISTIC(num_macro_lookups, "Number of macro table lookups");
+STATISTIC(num_macro_hits, "Number of macro table lookups finding the name");
+STATISTIC(num_macro_probes, "Number of macro table entries compared");
+STATISTIC(num_macro_grows, "Number of macro table resizes");
 
 namespace nasm {
 
@@ -131,6 +138,7 @@ yasm_fgets(char *buf, int n, const llvm::MemoryBuffer *in, size_t *pos)
 
 typedef struct SMacro SMacro;
 typedef struct MMacro MMacro;
+typedef struct MacroBucket MacroBucket;
 typedef struct Context Context;
 typedef struct Token Token;
 typedef struct Blocks Blocks;
@@ -192,6 +200,18 @@ struct MMacro
     int lineno;                 /* Current line number on expansion */
 };
 
+/*
+ * An entry in the macro table: all the single-line and multi-line
+ * macros whose names are equal ignoring case.
+ */
+struct MacroBucket
+{
+    char *name;                 /* name the entry was created with */
+    unsigned int hash;          /* hash of the upper-cased name */
+    SMacro *smacros;
+    MMacro *mmacros;
+};
+
 /*
  * The context stack is composed of a linked list of these.
  */
@@ -444,21 +464,16 @@ static int first_line = 1;
 static int curly_opened = 0;
 
 /*
- * The number of hash values we use for the macro lookup tables.
- * FIXME: We should *really* be able to configure this at run time,
- * or even have the hash table automatically expanding when necessary.
- */
-#define NHASH 31
-
-/*
- * The current set of multi-line macros we have defined.
- */
-static MMacro *mmacros[NHASH];
-
-/*
- * The current set of single-line macros we have defined.
+ * The current set of single-line and multi-line macros we have
+ * defined, hashed by case-folded name.  The table is open-addressed
+ * (linear probing), always a power of two in size, and doubles when
+ * it becomes three quarters full.  Entries are never removed until
+ * all macros are cleared, so a lookup stops at the first empty slot.
  */
-static SMacro *smacros[NHASH];
+#define MACRO_TABLE_INIT 256
+static MacroBucket **macro_table;
+static unsigned int macro_table_size;
+static unsigned int macro_table_count;
 
 /*
  * The multi-line macro we are currently defining, or the %rep
@@ -1179,33 +1194,117 @@ prepreproc(char *line)
  * The hash function for macro lookups. Note that due to some
  * macros having case-insensitive names, the hash function must be
  * invariant under case changes. We implement this by applying a
- * perfectly normal hash function to the uppercase of the string.
+ * perfectly normal hash function (32-bit FNV-1a) to the uppercase
+ * of the string.
  */
-static int
-hash(char *s)
+static unsigned int
+hash(const char *s)
 {
-    unsigned int h = 0;
-    unsigned int i = 0;
-    /*
-     * Powers of three, mod 31.
-     */
-    static const int multipliers[] = {
-        1, 3, 9, 27, 19, 26, 16, 17, 20, 29, 25, 13, 8, 24, 10,
-        30, 28, 22, 4, 12, 5, 15, 14, 11, 2, 6, 18, 23, 7, 21
-    };
-
+    unsigned int h = 2166136261U;
 
     while (*s)
     {
-        h += multipliers[i] * (unsigned char) (toupper(*s));
+        h ^= (unsigned char) toupper((unsigned char) *s);
+        h *= 16777619U;
         s++;
-        if (++i >= elements(multipliers))
-            i = 0;
     }
-    h %= NHASH;
     return h;
 }
 
+/*
+ * Double the size of the macro table (or create it).
+ */
+static void
+grow_macro_table(void)
+{
+    MacroBucket **old_table = macro_table;
+    unsigned int old_size = macro_table_size;
+    unsigned int i, j, mask;
+
+    macro_table_size = old_size ? old_size * 2 : MACRO_TABLE_INIT;
+    macro_table = (MacroBucket **)
+        nasm_malloc(macro_table_size * sizeof(MacroBucket *));
+    for (i = 0; i < macro_table_size; i++)
+        macro_table[i] = NULL;
+
+    mask = macro_table_size - 1;
+    for (i = 0; i < old_size; i++)
+    {
+        if (!old_table[i])
+            continue;
+        for (j = old_table[i]->hash & mask; macro_table[j];
+             j = (j + 1) & mask)
+            ;
+        macro_table[j] = old_table[i];
+    }
+    nasm_free(old_table);
+    ++num_macro_grows;
+}
+
+/*
+ * Find the macro table entry for name, ignoring case.  If there is
+ * none, return NULL, or if create is set, add an empty entry.
+ */
+static MacroBucket *
+find_macros(const char *name, int create)
+{
+    unsigned int h = hash(name);
+    unsigned int i, mask;
+    MacroBucket *b;
+
+    ++num_macro_lookups;
+    if (macro_table)
+    {
+        mask = macro_table_size - 1;
+        for (i = h & mask; (b = macro_table[i]) != NULL; i = (i + 1) & mask)
+        {
+            ++num_macro_probes;
+            if (b->hash == h && !nasm_stricmp(b->name, name))
+            {
+                ++num_macro_hits;
+                return b;
+            }
+        }
+    }
+    if (!create)
+        return NULL;
+
+    if ((macro_table_count + 1) * 4 > macro_table_size * 3)
+        grow_macro_table();
+    mask = macro_table_size - 1;
+    for (i = h & mask; macro_table[i]; i = (i + 1) & mask)
+        ;
+
+    b = (MacroBucket *) nasm_malloc(sizeof(MacroBucket));
+    b->name = nasm_strdup(name);
+    b->hash = h;
+    b->smacros = NULL;
+    b->mmacros = NULL;
+    macro_table[i] = b;
+    macro_table_count++;
+    return b;
+}
+
+/*
+ * The single-line macros named name (ignoring case), or NULL.
+ */
+static SMacro *
+find_smacros(const char *name)
+{
+    MacroBucket *b = find_macros(name, FALSE);
+    return b ? b->smacros : NULL;
+}
+
+/*
+ * The multi-line macros named name (ignoring case), or NULL.
+ */
+static MMacro *
+find_mmacros(const char *name)
+{
+    MacroBucket *b = find_macros(name, FALSE);
+    return b ? b->mmacros : NULL;
+}
+
 /*
  * Free a linked list of tokens.
  */
@@ -1247,6 +1346,42 @@ free_mmacro(MMacro * m)
     nasm_free(m);
 }
 
+/*
+ * Free all single-line and multi-line macros and the macro table.
+ */
+static void
+free_macros(void)
+{
+    unsigned int h;
+
+    for (h = 0; h < macro_table_size; h++)
+    {
+        MacroBucket *b = macro_table[h];
+        if (!b)
+            continue;
+        while (b->mmacros)
+        {
+            MMacro *m = b->mmacros;
+            b->mmacros = m->next;
+            free_mmacro(m);
+        }
+        while (b->smacros)
+        {
+            SMacro *s = b->smacros;
+            b->smacros = s->next;
+            nasm_free(s->name);
+            free_tlist(s->expansion);
+            nasm_free(s);
+        }
+        nasm_free(b->name);
+        nasm_free(b);
+    }
+    nasm_free(macro_table);
+    macro_table = NULL;
+    macro_table_size = 0;
+    macro_table_count = 0;
+}
+
 /*
  * Pop the context stack.
  */
@@ -2004,7 +2139,7 @@ smacro_defined(Context * ctx, char *name, int nparam, SMacro ** defn,
         m = ctx->localmac;
     }
     else
-        m = smacros[hash(name)];
+        m = find_smacros(name);
 
     while (m)
     {
@@ -2300,7 +2435,7 @@ if_condition(Token * tline, int i)
                 tline = tline->next;
                 searching.plus = TRUE;
             }
-            mmac = mmacros[hash(searching.name)];
+            mmac = find_mmacros(searching.name);
             while (mmac)
             {
                 if (!strcmp(mmac->name, searching.name) &&
@@ -2805,23 +2940,7 @@ do_directive(Token * tline)
             if (tline->next)
                 error(ERR_WARNING,
                         "trailing garbage after `%%clear' ignored");
-            for (j = 0; j < NHASH; j++)
-            {
-                while (mmacros[j])
-                {
-                    MMacro *m2 = mmacros[j];
-                    mmacros[j] = m2->next;
-                    free_mmacro(m2);
-                }
-                while (smacros[j])
-                {
-                    SMacro *s = smacros[j];
-                    smacros[j] = smacros[j]->next;
-                    nasm_free(s->name);
-                    free_tlist(s->expansion);
-                    nasm_free(s);
-                }
-            }
+            free_macros();
             free_tlist(origline);
             return DIRECTIVE_FOUND;
 
@@ -2936,10 +3055,13 @@ do_directive(Token * tline)
                         "`%%endscope': already popped all levels");
             else
             {
-                for (k = 0; k < NHASH; k++)
+                for (k = 0; k < (int)macro_table_size; k++)
                 {
-                    SMacro **smlast = &smacros[k];
-                    smac = smacros[k];
+                    SMacro **smlast;
+                    if (!macro_table[k])
+                        continue;
+                    smlast = &macro_table[k]->smacros;
+                    smac = *smlast;
                     while (smac)
                     {
                         if (smac->level < Level)
@@ -3175,7 +3297,7 @@ do_directive(Token * tline)
                 tline = tline->next;
                 defining->nolist = TRUE;
             }
-            mmac = mmacros[hash(defining->name)];
+            mmac = find_mmacros(defining->name);
             while (mmac)
             {
                 if (!strcmp(mmac->name, defining->name) &&
@@ -3218,9 +3340,11 @@ do_directive(Token * tline)
                         tline->text);
                 return DIRECTIVE_FOUND;
             }
-            k = hash(defining->name);
-            defining->next = mmacros[k];
-            mmacros[k] = defining;
+            {
+                MacroBucket *b = find_macros(defining->name, TRUE);
+                defining->next = b->mmacros;
+                b->mmacros = defining;
+            }
             defining = NULL;
             free_tlist(origline);
             return DIRECTIVE_FOUND;
@@ -3416,7 +3540,7 @@ do_directive(Token * tline)
 
             ctx = get_ctx(tline->text, FALSE);
             if (!ctx)
-                smhead = &smacros[hash(tline->text)];
+                smhead = &find_macros(tline->text, TRUE)->smacros;
             else
                 smhead = &ctx->localmac;
             mname = tline->text;
@@ -3563,7 +3687,7 @@ do_directive(Token * tline)
             /* Find the context that symbol belongs to */
             ctx = get_ctx(tline->text, FALSE);
             if (!ctx)
-                smhead = &smacros[hash(tline->text)];
+                smhead = &find_macros(tline->text, TRUE)->smacros;
             else
                 smhead = &ctx->localmac;
 
@@ -3603,7 +3727,7 @@ do_directive(Token * tline)
             }
             ctx = get_ctx(tline->text, FALSE);
             if (!ctx)
-                smhead = &smacros[hash(tline->text)];
+                smhead = &find_macros(tline->text, TRUE)->smacros;
             else
                 smhead = &ctx->localmac;
             mname = tline->text;
@@ -3683,7 +3807,7 @@ do_directive(Token * tline)
             }
             ctx = get_ctx(tline->text, FALSE);
             if (!ctx)
-                smhead = &smacros[hash(tline->text)];
+                smhead = &find_macros(tline->text, TRUE)->smacros;
             else
                 smhead = &ctx->localmac;
             mname = tline->text;
@@ -3797,7 +3921,7 @@ do_directive(Token * tline)
             }
             ctx = get_ctx(tline->text, FALSE);
             if (!ctx)
-                smhead = &smacros[hash(tline->text)];
+                smhead = &find_macros(tline->text, TRUE)->smacros;
             else
                 smhead = &ctx->localmac;
             mname = tline->text;
@@ -4315,7 +4439,7 @@ expand_smacro(Token * tline)
             else
                 ctx = NULL;
             if (!ctx)
-                head = smacros[hash(mname)];
+                head = find_smacros(mname);
             else
                 head = ctx->localmac;
             /*
@@ -4725,7 +4849,7 @@ is_mmacro(Token * tline, Token *** params_array)
     Token **params;
     int nparam;
 
-    head = mmacros[hash(tline->text)];
+    head = find_mmacros(tline->text);
 
     /*
      * Efficiency: first we see if any macro exists with the given
@@ -5023,8 +5147,6 @@ error(int severity, const char *fmt, ...)
 static void
 pp_reset(FileID fid, int apass, efunc errfunc, evalfunc eval, nasm_eval_setfuncs setfunc)
 {
-    int h;
-
     //Sets utility functions for stuffs in nasm-eval.cpp
     setfunc(ppscan, errfunc, evaluate_curly_brackets, ppdir_processor);
 
@@ -5048,11 +5170,7 @@ pp_reset(FileID fid, int apass, efunc errfunc, evalfunc eval, nasm_eval_setfuncs
     defining = NULL;
     nested_mac_count = 0;
     nested_rep_count = 0;
-    for (h = 0; h < NHASH; h++)
-    {
-        mmacros[h] = NULL;
-        smacros[h] = NULL;
-    }
+    free_macros();
     unique = 0;
     if (tasm_compatible_mode) {
         pp_extra_stdmac(tasm_compat_macros);
@@ -5338,8 +5456,6 @@ pp_getline(void)
 static void
 pp_cleanup(int pass_)
 {
-    int h;
-
     if (pass_ == 1)
     {
         if (defining)
@@ -5352,23 +5468,7 @@ pp_cleanup(int pass_)
     }
     while (cstk)
         ctx_pop();
-    for (h = 0; h < NHASH; h++)
-    {
-        while (mmacros[h])
-        {
-            MMacro *m = mmacros[h];
-            mmacros[h] = mmacros[h]->next;
-            free_mmacro(m);
-        }
-        while (smacros[h])
-        {
-            SMacro *s = smacros[h];
-            smacros[h] = smacros[h]->next;
-            nasm_free(s->name);
-            free_tlist(s->expansion);
-            nasm_free(s);
-        }
-    }
+    free_macros();
     while (istk)
     {
         Include *i = istk;
@@ -0,0 +1,17 @@
+[bits 32]
+nop				; out: 90
+align 16			; out: eb 0d 90 90 90 90 90 90 90 90 90 90 90 90 90
+[cpu 686]
+nop				; out: 90
+align 16			; out: 66 66 66 66 66 66 2e 0f 1f 84 00 00 00 00 00
+db 1,2,3,4,5,6,7,8,9,10,11,12,13,14	; out: 01 02 03 04 05 06 07 08 09 0a 0b 0c 0d 0e
+align 16			; out: 66 90
+[cpu k8]
+nop				; out: 90
+align 16			; out: 0f 1f 80 00 00 00 00 0f 1f 84 00 00 00 00 00
+[cpu 686 basicnop]
+nop				; out: 90
+align 16			; out: eb 0d 90 90 90 90 90 90 90 90 90 90 90 90 90
+[cpu 386]
+nop				; out: 90
+align 16			; out: eb 0d 90 90 90 90 90 90 90 90 90 90 90 90 90
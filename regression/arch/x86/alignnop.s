@@ -0,0 +1,11 @@
+.code32
+.arch i686
+nop			# out: 90
+.p2align 5		# out: 66 66 66 66 66 66 2e 0f 1f 84 00 00 00 00 00
+			# out: 66 66 66 66 66 66 2e 0f 1f 84 00 00 00 00 00 90
+.arch .sse4, nojumps
+nop			# out: 90
+.p2align 4		# out: 66 66 66 66 66 66 2e 0f 1f 84 00 00 00 00 00
+.arch i386
+nop			# out: 90
+.p2align 4		# out: eb 0d 90 90 90 90 90 90 90 90 90 90 90 90 90
@@ -0,0 +1,54 @@
+; [yasm -f bin -p nasm --align-branch-boundary=32]
+[bits 32]
+top:
+times 28 nop
+				; out: 90 90 90 90 90 90 90 90 90 90 90 90 90 90 90 90
+				; out: 90 90 90 90 90 90 90 90 90 90 90 90
+; fused cmp/jcc pair is padded as a unit
+cmp eax, 1				; out: 8d 74 26 00 83 f8 01
+jne top				; out: 75 db
+times 23 nop
+				; out: 90 90 90 90 90 90 90 90 90 90 90 90 90 90 90 90
+				; out: 90 90 90 90 90 90 90
+; jo does not fuse with cmp
+cmp ecx, 2				; out: 83 f9 02
+jo top				; out: 90 70 be
+times 26 nop
+				; out: 90 90 90 90 90 90 90 90 90 90 90 90 90 90 90 90
+				; out: 90 90 90 90 90 90 90 90 90 90
+; memory and immediate operands do not fuse
+cmp dword [ebx], 1			; out: 83 3b 01
+je top				; out: 90 74 9e
+times 27 nop
+				; out: 90 90 90 90 90 90 90 90 90 90 90 90 90 90 90 90
+				; out: 90 90 90 90 90 90 90 90 90 90 90
+; direct jump
+jmp near top				; out: 8d 76 00 e9 7b ff ff ff
+times 19 nop
+				; out: 90 90 90 90 90 90 90 90 90 90 90 90 90 90 90 90
+				; out: 90 90 90
+; padding grows when the jcc becomes near
+cmp eax, 1				; out: 90 8d b4 26 00 00 00 00 83 f8 01
+jne dest				; out: 0f 85 80 00 00 00
+times 128 nop
+				; out: 90 90 90 90 90 90 90 90 90 90 90 90 90 90 90 90
+				; out: 90 90 90 90 90 90 90 90 90 90 90 90 90 90 90 90
+				; out: 90 90 90 90 90 90 90 90 90 90 90 90 90 90 90 90
+				; out: 90 90 90 90 90 90 90 90 90 90 90 90 90 90 90 90
+				; out: 90 90 90 90 90 90 90 90 90 90 90 90 90 90 90 90
+				; out: 90 90 90 90 90 90 90 90 90 90 90 90 90 90 90 90
+				; out: 90 90 90 90 90 90 90 90 90 90 90 90 90 90 90 90
+				; out: 90 90 90 90 90 90 90 90 90 90 90 90 90 90 90 90
+dest:
+times 54 nop
+				; out: 90 90 90 90 90 90 90 90 90 90 90 90 90 90 90 90
+				; out: 90 90 90 90 90 90 90 90 90 90 90 90 90 90 90 90
+				; out: 90 90 90 90 90 90 90 90 90 90 90 90 90 90 90 90
+				; out: 90 90 90 90 90 90
+; loop is not padded
+loop dest				; out: e2 c8
+times 30 nop
+				; out: 90 90 90 90 90 90 90 90 90 90 90 90 90 90 90 90
+				; out: 90 90 90 90 90 90 90 90 90 90 90 90 90 90
+jmp short dest				; out: 90 eb a7
+ret				; out: c3
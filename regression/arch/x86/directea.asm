@@ -0,0 +1,31 @@
+[bits 64]
+lbl:
+mov eax, ebx                    ; out: 89 d8
+mov eax, [rbx]                  ; out: 8b 03
+mov eax, [rbp]                  ; out: 8b 45 00
+mov eax, [r12]                  ; out: 41 8b 04 24
+mov eax, [r13+8]                ; out: 41 8b 45 08
+mov eax, [rsp+8]                ; out: 8b 44 24 08
+mov rax, [rbx+rcx*4+100]        ; out: 48 8b 44 8b 64
+mov eax, [rbx+r9*8-1000]        ; out: 42 8b 84 cb 18 fc ff ff
+mov eax, [rcx*2]                ; out: 8b 04 09
+mov eax, [rcx*3]                ; out: 8b 04 49
+mov eax, [nosplit rcx*2]        ; out: 8b 04 4d 00 00 00 00
+mov eax, [0x12345678]           ; out: 8b 04 25 78 56 34 12
+mov eax, [ecx+edx]              ; out: 67 8b 04 11
+mov eax, [lbl+rbx]              ; out: 8b 83 00 00 00 00
+mov eax, [rbx+lbl+16]           ; out: 8b 83 10 00 00 00
+mov eax, [rbx+fwd]              ; out: 8b 83 5d 00 00 00
+mov eax, [fs:rbx+8]             ; out: 64 8b 43 08
+vmovdqa ymm0, [rax+16]          ; out: c5 fd 6f 40 10
+vmovdqa ymm8, [r9+rax*2]        ; out: c4 41 7d 6f 04 41
+lea rcx, [rsi+rdi]              ; out: 48 8d 0c 3e
+fwd:
+[bits 32]
+mov eax, [ebx+ecx*4+8]          ; out: 8b 44 8b 08
+mov eax, [esp]                  ; out: 8b 04 24
+mov ax, [ebp-4]                 ; out: 66 8b 45 fc
+mov eax, [lbl+esi]              ; out: 8b 86 00 00 00 00
+[bits 16]
+mov ax, [ebx+4]                 ; out: 67 8b 43 04
+mov eax, [ecx*4+lbl]            ; out: 67 66 8b 04 8d 00 00 00 00
@@ -0,0 +1,20 @@
+; [yasm -f bin --batch-optimize]
+; Each expansion pushes the previous jump out of short range.
+bits 32
+jz l1
+jz l2
+jz l3
+jz l4
+times 116 nop
+l1:
+times 4 nop
+l2:
+times 4 nop
+l3:
+times 4 nop
+l4:
+jmp l0
+times 100 nop
+l0:
+jz $-120
+times 20h-(($-$$) & 1fh) nop
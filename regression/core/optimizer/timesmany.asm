@@ -0,0 +1,12 @@
+; [yasm -f bin]
+; Many independent span-dependent TIMES; each only sees its own jump.
+bits 32
+%macro padjmp 0
+times (%%end-%%jmp) & 1 nop
+%%jmp: jmp top
+%%end:
+%endmacro
+top:
+%rep 256
+padjmp
+%endrep
@@ -0,0 +1,27 @@
+; [yasm -f elf64 -g dwarf2]
+; Line information generated from the assembly source.
+; A .debug_info section is provided so the output doesn't depend on the
+; current directory.
+section .text
+func:
+    mov eax, 1
+    add eax, ebx
+
+    jmp func
+%macro twonops 0
+    nop
+    nop
+%endmacro
+    twonops
+    mov ecx, 2
+    ret
+
+section .text2 exec
+    nop
+    ret
+
+section .data
+    dd 1
+
+section .debug_info
+    db 0
@@ -0,0 +1,11 @@
+; [yasm -f elf64 -g dwarf2]
+; Data ahead of the first instruction: line rows must start after it.
+section .text
+    db 1, 2, 3
+    nop
+    nop
+    mov eax, 1
+    ret
+
+section .debug_info
+    db 0
@@ -0,0 +1,13 @@
+; [yasm -f elf64 --merge-strings]
+; Duplicate and tail strings share storage in .shstrtab and .strtab.
+extern foo
+extern my_foo
+global bar
+global foobar
+section .text
+bar: call foo
+foobar: call my_foo
+section .data
+dd foo, bar
+section .rodata.text
+dd my_foo
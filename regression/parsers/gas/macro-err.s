@@ -0,0 +1,15 @@
+# [fail]
+.macro a x:req
+.endm
+.macro a
+.endm
+.macro b x
+.endm
+ a
+ b y=1
+ b 1 2
+.macro c x:bad
+.endm
+.purgem zz
+.endm
+.irp x 1
@@ -0,0 +1,55 @@
+# [oformat elf64]
+.text
+# recursion, defaults, nested conditionals
+.macro sum from=0, to=5
+ .long \from
+ .if \to-\from
+ sum (\from+1),\to
+ .endif
+.endm
+# required parameter, pasting onto a mnemonic, keyword arguments
+.macro store reg, off:req, sfx=q
+ mov\sfx \reg, \off(%rbp)
+.endm
+# \() separator and \@ counter
+.macro lbl name
+\name\()_x: .byte 1
+cnt_\@: .byte \@
+.endm
+# vararg parameter takes the remaining arguments
+.macro va first, rest:vararg
+ .byte \first
+ .byte \rest
+.endm
+ sum 0, 3
+ sum
+ store %rax, 8
+ store %bx, 4, w
+ store off=12, reg=%ecx, sfx=l
+ lbl abc
+ lbl def
+ va 1, 2, 3, 4
+ .quad abc_x, def_x, cnt_13, cnt_14
+.irp r, %rax, %rbx, %rcx
+ push \r
+.endr
+.irp r
+ .byte 0x55\r
+.endr
+.irpc i, 0123
+ .byte \i
+ movdqa %xmm\i, %xmm0
+.endr
+.rept 2
+ .irp v, 7 8
+ .byte \v
+ .endr
+.endr
+.macro m2
+ nop
+.endm
+.purgem m2
+.macro M2
+ ret
+.endm
+ m2; m2
@@ -0,0 +1,18 @@
+# [oformat elf64]
+.text
+.rept 3
+.rept 2
+nop
+.endr
+ret
+.endr
+.rept 0
+int3
+.endr
+.rept 1
+.endr
+.data
+.rept 4
+.long 1, 2
+.byte 7
+.endr
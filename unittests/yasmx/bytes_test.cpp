@@ -0,0 +1,76 @@
+// Bytes unit tests
+//
+//  Copyright (C) 2011  PathScale Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND OTHER CONTRIBUTORS ``AS IS''
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR OTHER CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#include <gtest/gtest.h>
+
+#include "yasmx/BytecodeContainer.h"
+#include "yasmx/Bytecode.h"
+#include "yasmx/Bytes.h"
+
+TEST(BytesTest, WriteInlineAndHeap)
+{
+    yasm::Bytes bytes;
+    bytes.Write(3, 0xaa);
+    EXPECT_EQ(3U, bytes.size());
+
+    // grow well past the inline buffer
+    for (unsigned int i=0; i<100; ++i)
+        bytes.push_back(static_cast<unsigned char>(i));
+    ASSERT_EQ(103U, bytes.size());
+    EXPECT_EQ(0xaa, bytes[2]);
+    EXPECT_EQ(0, bytes[3]);
+    EXPECT_EQ(99, bytes[102]);
+}
+
+TEST(BytesTest, Swap)
+{
+    yasm::Bytes small, large;
+    small.setBigEndian();
+    small.Write(2, 0x11);
+    large.setLittleEndian();
+    large.Write(40, 0x22);
+
+    small.swap(large);
+    ASSERT_EQ(40U, small.size());
+    EXPECT_EQ(0x22, small[39]);
+    EXPECT_TRUE(small.isLittleEndian());
+    ASSERT_EQ(2U, large.size());
+    EXPECT_EQ(0x11, large[1]);
+    EXPECT_TRUE(large.isBigEndian());
+}
+
+TEST(BytecodeContainerTest, AppendBytecode)
+{
+    yasm::BytecodeContainer container(0);
+    std::auto_ptr<yasm::Bytecode> bc(new yasm::Bytecode);
+    bc->getFixed().Write(5, 0x90);
+    container.AppendBytecode(bc);
+
+    yasm::Bytecode& back = container.bytecodes_back();
+    EXPECT_EQ(&container, back.getContainer());
+    ASSERT_EQ(5U, back.getFixedLen());
+    EXPECT_EQ(0x90, back.getFixed()[4]);
+    EXPECT_EQ(2U, container.size());
+}
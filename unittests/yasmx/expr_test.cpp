@@ -96,6 +96,22 @@ TEST_F(ExprTest, Construct)
     EXPECT_EQ("5+((-5)*6)", String::Format(e5));
 }
 
+// Expr::swap() and assignment tests
+TEST_F(ExprTest, Swap)
+{
+    Expr small(5);
+    Expr big = ADD(a, MUL(b, 4), SUB(c, 6), 7);
+    small.swap(big);
+    EXPECT_EQ("a+(b*4)+(c-6)+7", String::Format(small));
+    EXPECT_EQ("5", String::Format(big));
+
+    x = small;
+    EXPECT_EQ("a+(b*4)+(c-6)+7", String::Format(x));
+    x = big;
+    EXPECT_EQ("5", String::Format(x));
+    EXPECT_EQ("a+(b*4)+(c-6)+7", String::Format(small));
+}
+
 // Expr::Contains() tests
 TEST_F(ExprTest, Contains)
 {
@@ -156,6 +172,12 @@ TEST_F(ExprTest, TransformNeg)
     ExprTest::TransformNeg(x);
     EXPECT_EQ("a+(b*-1)", String::Format(x));
 
+    // Operands of other operators keep their own sign.
+    x = SUB(a, SUB(b, XOR(c, SUB(d, e))));
+    EXPECT_EQ("a-(b-(c^(d-e)))", String::Format(x));
+    ExprTest::TransformNeg(x);
+    EXPECT_EQ("a+((b*-1)+(c^(d+(e*-1))))", String::Format(x));
+
     // And should gracefully handle IDENTs.
     x = Expr(a);
     EXPECT_EQ("a", String::Format(x));
@@ -206,6 +228,64 @@ TEST_F(ExprTest, Simplify)
     EXPECT_EQ("5", String::Format(x));
 }
 
+TEST_F(ExprTest, SimplifyConstFold)
+{
+    yasmunit::MockDiagnosticClient mock_client;
+    Diagnostic diags(&mock_client);
+    SourceManager smgr(diags);
+    diags.setSourceManager(&smgr);
+
+    // Integer-only expressions are folded directly.
+    x = SUB(1, SUB(2, XOR(3, 4)));
+    EXPECT_EQ("1-(2-(3^4))", String::Format(x));
+    x.Simplify(diags);
+    EXPECT_EQ("6", String::Format(x));
+
+    x = OR(AND(NEG(141), 0xff), MUL(-3, 5));
+    x.Simplify(diags);
+    EXPECT_EQ("-13", String::Format(x));
+
+    // Results that don't fit in a long still fold correctly.
+    x = ADD(IntNum(0x7fffffffL), MUL(IntNum(0x7fffffffL), 0x7fffffffL,
+                                      0x7fffffffL));
+    x.Simplify(diags);
+    EXPECT_EQ("9903520300447984152500764670", String::Format(x));
+
+    x = MUL(IntNum(0x100000000L), 0x100000000L);
+    x.Simplify(diags);
+    EXPECT_EQ("18446744073709551616", String::Format(x));
+}
+
+// Adding a register forces the full leveling path; it must agree with the
+// integer-only fast path.
+TEST_F(ExprTest, SimplifyConstFoldLevelMatch)
+{
+    yasmunit::MockDiagnosticClient mock_client;
+    Diagnostic diags(&mock_client);
+    SourceManager smgr(diags);
+    diags.setSourceManager(&smgr);
+
+    Expr exprs[] =
+    {
+        SUB(1, SUB(2, XOR(3, 4))),
+        SUB(10, AND(SUB(7, 2), 6)),
+        SUB(SUB(8, OR(1, 2)), NEG(XOR(5, SUB(3, 1)))),
+        MUL(SUB(4, XOR(1, 3)), SUB(0, 5)),
+        SUB(100, MUL(3, SUB(9, AND(14, 7)))),
+    };
+    for (unsigned int i=0; i<sizeof(exprs)/sizeof(exprs[0]); ++i)
+    {
+        Expr folded = exprs[i];
+        folded.Simplify(diags);
+        ASSERT_TRUE(folded.isIntNum());
+
+        x = ADD(a, exprs[i]);
+        x.Simplify(diags);
+        EXPECT_EQ("a+" + String::Format(folded), String::Format(x))
+            << "expression " << i;
+    }
+}
+
 //
 // Expr::LevelOp() tests
 //
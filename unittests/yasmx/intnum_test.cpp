@@ -159,6 +159,37 @@ TEST(IntNumOperatorOverloadTest, IncDec)
     ASSERT_EQ(5, x.getInt());
 }
 
+TEST(IntNumBigTest, Arithmetic)
+{
+    // Values wider than a long exercise the bitvector calculation path.
+    IntNum big, x;
+    big.setStr("100000000000000000000000000000000", 16);   // 2^128
+    x = big;
+    x /= IntNum(0x10000);
+    EXPECT_EQ("10000000000000000000000000000", x.getStr(16));
+    x = big;
+    x -= 1;
+    x %= IntNum(0x10000);
+    EXPECT_EQ(0xFFFF, x.getInt());
+    x = big;
+    x >>= 120;
+    EXPECT_EQ(256, x.getInt());
+    x = -big;
+    x >>= 127;
+    EXPECT_EQ(-2, x.getInt());
+    x = -big;
+    x.CalcAssert(Op::SIGNDIV, big);
+    EXPECT_EQ(-1, x.getInt());
+    x = -big;
+    x -= 5;
+    x.CalcAssert(Op::SIGNMOD, big);
+    EXPECT_EQ(-5, x.getInt());
+    x = big * big;
+    EXPECT_EQ(0, (x >> 256).getInt());
+    EXPECT_TRUE(-big < big);
+    EXPECT_TRUE(big > IntNum(-1));
+}
+
 class IntNumStreamOutputTest : public ::testing::TestWithParam<long> {};
 
 
@@ -0,0 +1,84 @@
+// Object symbol table unit tests
+//
+//  Copyright (C) 2011  PathScale Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND OTHER CONTRIBUTORS ``AS IS''
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR OTHER CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include "yasmx/Object.h"
+#include "yasmx/Symbol.h"
+
+using namespace yasm;
+
+TEST(ObjectTest, GetSymbol)
+{
+    Object object("x", "y", 0);
+    SymbolRef a, b;
+    {
+        // names are copied; the caller's storage can go away
+        std::string name("foo");
+        a = object.getSymbol(name);
+        name = "bar";
+        b = object.getSymbol(name);
+    }
+    EXPECT_EQ("foo", a->getName());
+    EXPECT_EQ("bar", b->getName());
+    EXPECT_EQ(a, object.getSymbol("foo"));
+    EXPECT_EQ(b, object.FindSymbol("bar"));
+    EXPECT_FALSE(object.FindSymbol("baz"));
+
+    // symbols are listed in creation order
+    Object::symbol_iterator i = object.symbols_begin();
+    ASSERT_NE(object.symbols_end(), i);
+    EXPECT_EQ("foo", i->getName());
+    ++i;
+    ASSERT_NE(object.symbols_end(), i);
+    EXPECT_EQ("bar", i->getName());
+    ++i;
+    EXPECT_EQ(object.symbols_end(), i);
+}
+
+TEST(ObjectTest, RenameSymbol)
+{
+    Object object("x", "y", 0);
+    SymbolRef a = object.getSymbol("foo");
+    object.RenameSymbol(a, std::string("renamed"));
+    EXPECT_EQ("renamed", a->getName());
+    EXPECT_FALSE(object.FindSymbol("foo"));
+    EXPECT_EQ(a, object.FindSymbol("renamed"));
+    EXPECT_NE(a, object.getSymbol("foo"));
+}
+
+TEST(ObjectTest, NonTableSymbol)
+{
+    Object object("x", "y", 0);
+    SymbolRef a = object.AddNonTableSymbol("$");
+    SymbolRef b = object.AddNonTableSymbol("$");
+    EXPECT_NE(a, b);
+    EXPECT_EQ("$", a->getName());
+    EXPECT_EQ("$", b->getName());
+    EXPECT_FALSE(object.FindSymbol("$"));
+    EXPECT_EQ(object.symbols_end(), object.symbols_begin());
+}
@@ -0,0 +1,428 @@
+//
+// Optimizer cache unit tests
+//
+//  Copyright (C) 2011  PathScale Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND OTHER CONTRIBUTORS ``AS IS''
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR OTHER CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+#include <gtest/gtest.h>
+
+#include <climits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include "yasmx/Basic/Diagnostic.h"
+#include "yasmx/Basic/SourceManager.h"
+#include "yasmx/Bytecode.h"
+#include "yasmx/BytecodeContainer.h"
+#include "yasmx/BytecodeOutput.h"
+#include "yasmx/Expr.h"
+#include "yasmx/Object.h"
+#include "yasmx/OptimizerCache.h"
+#include "yasmx/Section.h"
+#include "yasmx/Symbol.h"
+
+#include "unittests/diag_mock.h"
+
+
+using namespace yasm;
+
+static OptimizerCache::Expansion
+MakeExpansion(unsigned long bc, int id, long old_val, long new_val)
+{
+    OptimizerCache::Expansion exp;
+    exp.bc = bc;
+    exp.id = id;
+    exp.old_val = old_val;
+    exp.new_val = new_val;
+    exp.len = 5;
+    exp.neg_thres = -32768;
+    exp.pos_thres = 32767;
+    exp.keep = true;
+    return exp;
+}
+
+TEST(OptimizerCacheTest, RecordLookup)
+{
+    OptimizerCache cache;
+    std::string key1(OptimizerCache::KEY_SIZE, 'a');
+    std::string key2(OptimizerCache::KEY_SIZE, 'b');
+
+    EXPECT_EQ(0, cache.Lookup(key1));
+
+    cache.Record(key1).push_back(MakeExpansion(3, 1, 0, 200));
+    const OptimizerCache::Expansions* exps = cache.Lookup(key1);
+    ASSERT_TRUE(exps != 0);
+    ASSERT_EQ(1U, exps->size());
+    EXPECT_EQ(3U, (*exps)[0].bc);
+    EXPECT_EQ(200, (*exps)[0].new_val);
+    EXPECT_EQ(0, cache.Lookup(key2));
+
+    // Recording again replaces the entry.
+    cache.Record(key1);
+    exps = cache.Lookup(key1);
+    ASSERT_TRUE(exps != 0);
+    EXPECT_TRUE(exps->empty());
+}
+
+TEST(OptimizerCacheTest, RoundTrip)
+{
+    std::string key1(OptimizerCache::KEY_SIZE, '\0');
+    std::string key2(OptimizerCache::KEY_SIZE, '\xff');
+
+    std::string data;
+    {
+        OptimizerCache cache;
+        OptimizerCache::Expansions& exps = cache.Record(key1);
+        exps.push_back(MakeExpansion(1, 1, 0, 300));
+        exps.push_back(MakeExpansion(7, -1, -5, LONG_MAX));
+        exps.back().keep = false;
+        cache.Record(key2).push_back(MakeExpansion(2, 0, 4, 8));
+
+        llvm::raw_string_ostream os(data);
+        cache.Write(os);
+    }
+
+    std::auto_ptr<llvm::MemoryBuffer>
+        buf(llvm::MemoryBuffer::getMemBuffer(data, "<cache>"));
+    OptimizerCache cache;
+    ASSERT_TRUE(cache.Read(*buf));
+    EXPECT_EQ(2U, cache.size());
+
+    const OptimizerCache::Expansions* exps = cache.Lookup(key1);
+    ASSERT_TRUE(exps != 0);
+    ASSERT_EQ(2U, exps->size());
+    EXPECT_EQ(1U, (*exps)[0].bc);
+    EXPECT_EQ(1, (*exps)[0].id);
+    EXPECT_EQ(0, (*exps)[0].old_val);
+    EXPECT_EQ(300, (*exps)[0].new_val);
+    EXPECT_EQ(5U, (*exps)[0].len);
+    EXPECT_EQ(-32768, (*exps)[0].neg_thres);
+    EXPECT_EQ(32767, (*exps)[0].pos_thres);
+    EXPECT_TRUE((*exps)[0].keep);
+    EXPECT_EQ(-1, (*exps)[1].id);
+    EXPECT_EQ(-5, (*exps)[1].old_val);
+    EXPECT_EQ(LONG_MAX, (*exps)[1].new_val);
+    EXPECT_FALSE((*exps)[1].keep);
+
+    exps = cache.Lookup(key2);
+    ASSERT_TRUE(exps != 0);
+    ASSERT_EQ(1U, exps->size());
+    EXPECT_EQ(0, (*exps)[0].id);
+}
+
+TEST(OptimizerCacheTest, WriteOnlyUsed)
+{
+    std::string key1(OptimizerCache::KEY_SIZE, '1');
+    std::string key2(OptimizerCache::KEY_SIZE, '2');
+
+    std::string data;
+    {
+        OptimizerCache cache;
+        cache.Record(key1);
+        cache.Record(key2);
+        llvm::raw_string_ostream os(data);
+        cache.Write(os);
+    }
+
+    // Reload and only touch key1; key2 should not be written out again.
+    std::string data2;
+    {
+        std::auto_ptr<llvm::MemoryBuffer>
+            buf(llvm::MemoryBuffer::getMemBuffer(data, "<cache>"));
+        OptimizerCache cache;
+        ASSERT_TRUE(cache.Read(*buf));
+        EXPECT_TRUE(cache.Lookup(key1) != 0);
+        llvm::raw_string_ostream os(data2);
+        cache.Write(os);
+    }
+
+    std::auto_ptr<llvm::MemoryBuffer>
+        buf(llvm::MemoryBuffer::getMemBuffer(data2, "<cache>"));
+    OptimizerCache cache;
+    ASSERT_TRUE(cache.Read(*buf));
+    EXPECT_EQ(1U, cache.size());
+    EXPECT_TRUE(cache.Lookup(key1) != 0);
+    EXPECT_EQ(0, cache.Lookup(key2));
+}
+
+TEST(OptimizerCacheTest, ReadInvalid)
+{
+    OptimizerCache cache;
+
+    std::auto_ptr<llvm::MemoryBuffer>
+        badmagic(llvm::MemoryBuffer::getMemBuffer("XXXX\1\0\0\0", "<cache>"));
+    EXPECT_FALSE(cache.Read(*badmagic));
+
+    // Valid header, truncated entry.
+    std::auto_ptr<llvm::MemoryBuffer> truncated(
+        llvm::MemoryBuffer::getMemBuffer(
+            llvm::StringRef("YOPT\1\0\0\0\1\0\0\0abc", 15), "<cache>"));
+    EXPECT_FALSE(cache.Read(*truncated));
+    EXPECT_EQ(0U, cache.size());
+
+    // Expansion count larger than the remaining data.
+    std::string huge("YOPT\1\0\0\0\1\0\0\0", 12);
+    huge.append(OptimizerCache::KEY_SIZE, 'a');
+    huge.append("\xff\xff\xff\xff", 4);
+    huge.append(49, '\0');
+    std::auto_ptr<llvm::MemoryBuffer>
+        badcount(llvm::MemoryBuffer::getMemBuffer(huge, "<cache>"));
+    EXPECT_FALSE(cache.Read(*badcount));
+    EXPECT_EQ(0U, cache.size());
+}
+
+namespace {
+// Collects section contents; the test sections hold no values that need
+// relocation.
+class StringOutput : public BytecodeStreamOutput
+{
+public:
+    StringOutput(llvm::raw_ostream& os, Diagnostic& diags)
+        : BytecodeStreamOutput(os, diags)
+    {}
+
+    bool ConvertValueToBytes(Value& value,
+                             Location loc,
+                             NumericOutput& num_out)
+    {
+        return false;
+    }
+};
+} // anonymous namespace
+
+// Assemble a section of LEB128 label distances, alignments and a TIMES
+// block, optimized with the given cache, and return its contents.
+static std::string
+AssembleSection(OptimizerCache* cache)
+{
+    yasmunit::MockDiagnosticId mock_client;
+    Diagnostic diags(&mock_client);
+    SourceManager smgr(diags);
+    diags.setSourceManager(&smgr);
+
+    Object object("x", "y", 0);
+    Section* sect = new Section(".text", true, false, SourceLocation());
+    object.AppendSection(std::auto_ptr<Section>(sect));
+
+    const int nlabels = 400;
+    std::vector<SymbolRef> labels;
+    for (int i=0; i<nlabels; ++i)
+        labels.push_back(object.getSymbol("L" + llvm::Twine(i).str()));
+
+    for (int i=0; i<nlabels; ++i)
+    {
+        labels[i]->DefineLabel(sect->getEndLoc());
+        int target = (i*37 + 11) % nlabels;
+        std::auto_ptr<Expr> dist(new Expr(SUB(labels[target], labels[i])));
+        AppendLEB128(*sect, dist, true, SourceLocation(), diags);
+        for (int j=0; j<i%5; ++j)
+            AppendByte(*sect, static_cast<unsigned char>(i));
+        if (i % 9 == 0)
+            AppendAlign(*sect, Expr(8), Expr(), Expr(), 0, SourceLocation());
+        if (i % 50 == 3)
+        {
+            std::auto_ptr<BytecodeContainer> contents(
+                new BytecodeContainer(0));
+            AppendByte(*contents, 0x90);
+            std::auto_ptr<Expr> count(new Expr(SUB(labels[i-1],
+                                                   labels[i-3])));
+            AppendMultiple(*sect, contents, count, SourceLocation());
+        }
+    }
+
+    object.Finalize(diags);
+    object.Optimize(diags, cache);
+    EXPECT_FALSE(diags.hasErrorOccurred());
+
+    std::string data;
+    llvm::raw_string_ostream os(data);
+    StringOutput out(os, diags);
+    for (Section::bc_iterator bc=sect->bytecodes_begin(),
+         end=sect->bytecodes_end(); bc != end; ++bc)
+        EXPECT_TRUE(bc->Output(out));
+    os.flush();
+    return data;
+}
+
+TEST(OptimizerCacheTest, ReplayMatchesUncached)
+{
+    std::string uncached = AssembleSection(0);
+    ASSERT_FALSE(uncached.empty());
+
+    // First run records the section, second replays it.
+    std::string data;
+    {
+        OptimizerCache cache;
+        EXPECT_EQ(uncached, AssembleSection(&cache));
+        EXPECT_EQ(1U, cache.size());
+        llvm::raw_string_ostream os(data);
+        cache.Write(os);
+    }
+
+    std::auto_ptr<llvm::MemoryBuffer>
+        buf(llvm::MemoryBuffer::getMemBuffer(data, "<cache>"));
+    OptimizerCache cache;
+    ASSERT_TRUE(cache.Read(*buf));
+    EXPECT_EQ(uncached, AssembleSection(&cache));
+
+    // Make sure the entry is really used: a cached outcome that is
+    // consistent but differs from what the optimizer picks (a wider
+    // LEB128) must show up in the output.  Widen the last two-byte LEB128
+    // so no TIMES count depends on it.
+    std::string key = data.substr(12, OptimizerCache::KEY_SIZE);
+    const OptimizerCache::Expansions* exps = cache.Lookup(key);
+    ASSERT_TRUE(exps != 0);
+    OptimizerCache::Expansions widened = *exps;
+    OptimizerCache::Expansions::iterator exp = widened.end();
+    for (OptimizerCache::Expansions::iterator i=widened.begin(),
+         end=widened.end(); i != end; ++i)
+    {
+        if (i->id == 2 && i->len == 2 &&
+            (exp == widened.end() || i->bc > exp->bc))
+            exp = i;
+    }
+    ASSERT_TRUE(exp != widened.end());
+    exp->new_val = 100000;
+    exp->len = 3;
+    exp->neg_thres = -(1L<<20);
+    exp->pos_thres = (1L<<20)-1;
+    cache.Record(key) = widened;
+
+    std::string replayed = AssembleSection(&cache);
+    EXPECT_NE(uncached, replayed);
+    EXPECT_LT(uncached.size(), replayed.size());
+}
+
+// Assemble a section of eight functions, each a run of LEB128 branch
+// distances to labels of the same function, ending in a two-byte LEB128.
+// Functions f and f+4 are identical.  If edit_func is non-negative, that
+// function gets one more byte in its body.
+static std::string
+AssembleFunctions(OptimizerCache* cache, int edit_func)
+{
+    yasmunit::MockDiagnosticId mock_client;
+    Diagnostic diags(&mock_client);
+    SourceManager smgr(diags);
+    diags.setSourceManager(&smgr);
+
+    Object object("x", "y", 0);
+    Section* sect = new Section(".text", true, false, SourceLocation());
+    object.AppendSection(std::auto_ptr<Section>(sect));
+
+    const int nfuncs = 8, ninsns = 30;
+    for (int f=0; f<nfuncs; ++f)
+    {
+        std::vector<SymbolRef> labels;
+        for (int i=0; i<ninsns; ++i)
+            labels.push_back(object.getSymbol("f" + llvm::Twine(f).str()
+                                              + "_" + llvm::Twine(i).str()));
+        for (int i=0; i<ninsns; ++i)
+        {
+            labels[i]->DefineLabel(sect->getEndLoc());
+            for (int j=0; j<1+(i*7+f%4)%6; ++j)
+                AppendByte(*sect, static_cast<unsigned char>(i));
+            if (f == edit_func && i == ninsns/2)
+                AppendByte(*sect, 0x90);
+            int target = (i*13 + 5) % ninsns;
+            std::auto_ptr<Expr> dist(new Expr(SUB(labels[target],
+                                                  labels[i])));
+            AppendLEB128(*sect, dist, true, SourceLocation(), diags);
+        }
+
+        // Distance back to the entry; no other span crosses it.
+        std::auto_ptr<Expr> dist(new Expr(SUB(labels[0],
+                                              labels[ninsns-1])));
+        AppendLEB128(*sect, dist, true, SourceLocation(), diags);
+    }
+
+    object.Finalize(diags);
+    object.Optimize(diags, cache);
+    EXPECT_FALSE(diags.hasErrorOccurred());
+
+    std::string data;
+    llvm::raw_string_ostream os(data);
+    StringOutput out(os, diags);
+    for (Section::bc_iterator bc=sect->bytecodes_begin(),
+         end=sect->bytecodes_end(); bc != end; ++bc)
+        EXPECT_TRUE(bc->Output(out));
+    os.flush();
+    return data;
+}
+
+TEST(OptimizerCacheTest, EditReplaysOtherRuns)
+{
+    std::string uncached = AssembleFunctions(0, -1);
+    std::string edited = AssembleFunctions(0, 3);
+
+    // One entry per distinct function.
+    std::string data;
+    {
+        OptimizerCache cache;
+        EXPECT_EQ(uncached, AssembleFunctions(&cache, -1));
+        EXPECT_EQ(4U, cache.size());
+        llvm::raw_string_ostream os(data);
+        cache.Write(os);
+    }
+
+    // Widen the last LEB128 of every entry (the one at the end of the
+    // function, so no other span changes).  Only replayed runs pick that
+    // up, so the edited section must grow by one byte for each function
+    // but the edited one, which must be optimized again.
+    std::auto_ptr<llvm::MemoryBuffer>
+        buf(llvm::MemoryBuffer::getMemBuffer(data, "<cache>"));
+    OptimizerCache cache;
+    ASSERT_TRUE(cache.Read(*buf));
+    const std::size_t expansion_size = 49;
+    std::size_t pos = 12;
+    for (int entry=0; entry<4; ++entry)
+    {
+        ASSERT_LE(pos + OptimizerCache::KEY_SIZE + 4, data.size());
+        std::string key = data.substr(pos, OptimizerCache::KEY_SIZE);
+        const OptimizerCache::Expansions* exps = cache.Lookup(key);
+        ASSERT_TRUE(exps != 0);
+        pos += OptimizerCache::KEY_SIZE + 4 + exps->size()*expansion_size;
+
+        OptimizerCache::Expansions widened = *exps;
+        OptimizerCache::Expansions::iterator exp = widened.end();
+        for (OptimizerCache::Expansions::iterator i=widened.begin(),
+             end=widened.end(); i != end; ++i)
+        {
+            if (i->id == 2 && i->len == 2 &&
+                (exp == widened.end() || i->bc > exp->bc))
+                exp = i;
+        }
+        ASSERT_TRUE(exp != widened.end());
+        exp->new_val = 100000;
+        exp->len = 3;
+        exp->neg_thres = -(1L<<20);
+        exp->pos_thres = (1L<<20)-1;
+        cache.Record(key) = widened;
+    }
+
+    std::string replayed = AssembleFunctions(&cache, 3);
+    EXPECT_EQ(edited.size() + 7, replayed.size());
+    EXPECT_EQ(5U, cache.size());
+}
@@ -0,0 +1,187 @@
+//
+// Optimizer unit tests
+//
+//  Copyright (C) 2011  PathScale Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND OTHER CONTRIBUTORS ``AS IS''
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR OTHER CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/raw_ostream.h"
+#include "yasmx/Basic/Diagnostic.h"
+#include "yasmx/Basic/SourceManager.h"
+#include "yasmx/Config/functional.h"
+#include "yasmx/Bytecode.h"
+#include "yasmx/BytecodeContainer.h"
+#include "yasmx/BytecodeOutput.h"
+#include "yasmx/Expr.h"
+#include "yasmx/Object.h"
+#include "yasmx/Optimizer.h"
+#include "yasmx/Section.h"
+#include "yasmx/Symbol.h"
+
+#include "unittests/diag_mock.h"
+
+
+using namespace yasm;
+
+namespace {
+// Collects section contents; the test sections hold no values that need
+// relocation.
+class StringOutput : public BytecodeStreamOutput
+{
+public:
+    StringOutput(llvm::raw_ostream& os, Diagnostic& diags)
+        : BytecodeStreamOutput(os, diags)
+    {}
+
+    bool ConvertValueToBytes(Value& value,
+                             Location loc,
+                             NumericOutput& num_out)
+    {
+        return false;
+    }
+};
+} // anonymous namespace
+
+// Append a "function": an aligned entry followed by instructions of
+// varying length, each with a signed LEB128 branch distance to another
+// label of the same function.  If loop_align is set, the middle of the
+// function is aligned too, so some branches cross an alignment.
+static void
+AppendFunction(Object& object,
+               BytecodeContainer& sect,
+               const std::string& name,
+               bool loop_align,
+               Diagnostic& diags)
+{
+    const int ninsns = 40;
+
+    AppendAlign(sect, Expr(16), Expr(), Expr(), 0, SourceLocation());
+    AppendByte(sect, 0x55);
+
+    std::vector<SymbolRef> labels;
+    for (int i=0; i<ninsns; ++i)
+        labels.push_back(object.getSymbol(name + llvm::Twine(i).str()));
+
+    for (int i=0; i<ninsns; ++i)
+    {
+        if (loop_align && i == ninsns/2)
+            AppendAlign(sect, Expr(16), Expr(), Expr(), 0, SourceLocation());
+        labels[i]->DefineLabel(sect.getEndLoc());
+        for (int j=0; j<1+(i*7)%6; ++j)
+            AppendByte(sect, static_cast<unsigned char>(i));
+        int target = (i*13 + 5) % ninsns;
+        std::auto_ptr<Expr> dist(new Expr(SUB(labels[target], labels[i])));
+        AppendLEB128(sect, dist, true, SourceLocation(), diags);
+    }
+    AppendByte(sect, 0xc3);
+}
+
+// Assemble a section of aligned functions and a section with an aligned
+// loop, run the optimizer steps as Object::Optimize() does, and return
+// the contents of both sections.  If batched is non-NULL, step 2 is done
+// by Step2Batched() and the number of batched expansions is stored there.
+static std::string
+AssembleFunctions(unsigned long* batched)
+{
+    yasmunit::MockDiagnosticId mock_client;
+    Diagnostic diags(&mock_client);
+    SourceManager smgr(diags);
+    diags.setSourceManager(&smgr);
+
+    Object object("x", "y", 0);
+    Section* text = new Section(".text", true, false, SourceLocation());
+    object.AppendSection(std::auto_ptr<Section>(text));
+    Section* loops = new Section(".loops", true, false, SourceLocation());
+    object.AppendSection(std::auto_ptr<Section>(loops));
+
+    for (int i=0; i<50; ++i)
+        AppendFunction(object, *text, "f" + llvm::Twine(i).str() + "_",
+                       false, diags);
+    AppendFunction(object, *loops, "loop_", true, diags);
+
+    object.Finalize(diags);
+    EXPECT_FALSE(diags.hasErrorOccurred());
+
+    Optimizer opt(diags);
+    unsigned long bc_index = 0;
+    for (Object::section_iterator sect=object.sections_begin(),
+         sectend=object.sections_end(); sect != sectend; ++sect)
+    {
+        unsigned long offset = 0;
+        sect->bytecodes_front().setIndex(bc_index++);
+        sect->bytecodes_front().setOffset(0);
+        for (Section::bc_iterator bc=sect->bytecodes_begin(),
+             bcend=sect->bytecodes_end(); bc != bcend; ++bc)
+        {
+            bc->setIndex(bc_index++);
+            bc->setOffset(offset);
+            EXPECT_TRUE(bc->CalcLen(TR1::bind(&Optimizer::AddSpan, &opt,
+                                              _1, _2, _3, _4, _5),
+                                    diags));
+            if (bc->getSpecial() == Bytecode::Contents::SPECIAL_OFFSET)
+                opt.AddOffsetSetter(*bc);
+            offset = bc->getNextOffset();
+        }
+    }
+    opt.Step1b();
+    object.UpdateBytecodeOffsets(diags);
+    EXPECT_FALSE(opt.Step1d());
+    opt.Step1e();
+    if (batched)
+        *batched = opt.Step2Batched();
+    else
+        opt.Step2();
+    object.UpdateBytecodeOffsets(diags);
+    EXPECT_FALSE(diags.hasErrorOccurred());
+
+    std::string data;
+    llvm::raw_string_ostream os(data);
+    StringOutput out(os, diags);
+    for (Object::section_iterator sect=object.sections_begin(),
+         sectend=object.sections_end(); sect != sectend; ++sect)
+    {
+        for (Section::bc_iterator bc=sect->bytecodes_begin(),
+             end=sect->bytecodes_end(); bc != end; ++bc)
+            EXPECT_TRUE(bc->Output(out));
+    }
+    os.flush();
+    return data;
+}
+
+TEST(OptimizerTest, BatchedMatchesStep2)
+{
+    std::string sequential = AssembleFunctions(0);
+    ASSERT_FALSE(sequential.empty());
+
+    // The aligns between functions are crossed by no branch, so the
+    // functions section is expanded in batches; the loop section is left
+    // to step 2.  Either way the result must not change.
+    unsigned long batched = 0;
+    EXPECT_EQ(sequential, AssembleFunctions(&batched));
+    EXPECT_GT(batched, 0UL);
+}
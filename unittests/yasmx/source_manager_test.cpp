@@ -0,0 +1,140 @@
+// SourceManager unit tests
+//
+//  Copyright (C) 2011  PathScale Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND OTHER CONTRIBUTORS ``AS IS''
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR OTHER CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "llvm/Support/MemoryBuffer.h"
+#include "yasmx/Basic/Diagnostic.h"
+#include "yasmx/Basic/SourceManager.h"
+
+#include "unittests/diag_mock.h"
+
+using namespace yasm;
+
+class SourceManagerTest : public testing::Test
+{
+protected:
+    yasmunit::MockDiagnosticClient mock_client;
+    Diagnostic diags;
+    SourceManager smgr;
+
+    SourceManagerTest() : diags(&mock_client), smgr(diags)
+    {
+        diags.setSourceManager(&smgr);
+    }
+
+    FileID AddBuffer(const std::string& str)
+    {
+        return smgr.createMainFileIDForMemBuffer(
+            llvm::MemoryBuffer::getMemBufferCopy(str, "<test>"));
+    }
+
+    // Byte-at-a-time line numbering: \r\n and \n\r count as one line
+    // break, nulls are ignored.
+    static std::vector<unsigned int> ReferenceLines(const std::string& str)
+    {
+        std::vector<unsigned int> lines;
+        unsigned int line = 1;
+        for (std::string::size_type i=0; i<str.size(); ++i)
+        {
+            lines.push_back(line);
+            char c = str[i];
+            if (c != '\n' && c != '\r')
+                continue;
+            if (i+1 < str.size() && (str[i+1] == '\n' || str[i+1] == '\r')
+                && str[i+1] != c)
+                lines.push_back(line), ++i;
+            ++line;
+        }
+        lines.push_back(line);  // end of buffer
+        return lines;
+    }
+
+    void CheckLines(const std::string& str)
+    {
+        smgr.clearIDTables();
+        FileID fid = AddBuffer(str);
+        std::vector<unsigned int> expect = ReferenceLines(str);
+        for (unsigned int i=0; i<expect.size(); ++i)
+            ASSERT_EQ(expect[i], smgr.getLineNumber(fid, i))
+                << "offset " << i;
+    }
+};
+
+TEST_F(SourceManagerTest, LineEndings)
+{
+    std::string str("a\nb\r\nc\rd\n\re\r\rf\n");
+    FileID fid = AddBuffer(str);
+    EXPECT_EQ(1U, smgr.getLineNumber(fid, 0));  // a
+    EXPECT_EQ(2U, smgr.getLineNumber(fid, 2));  // b
+    EXPECT_EQ(3U, smgr.getLineNumber(fid, 5));  // c
+    EXPECT_EQ(4U, smgr.getLineNumber(fid, 7));  // d
+    EXPECT_EQ(5U, smgr.getLineNumber(fid, 10)); // e
+    EXPECT_EQ(6U, smgr.getLineNumber(fid, 12)); // empty line
+    EXPECT_EQ(7U, smgr.getLineNumber(fid, 13)); // f
+    EXPECT_EQ(8U, smgr.getLineNumber(fid, 15)); // end of buffer
+}
+
+TEST_F(SourceManagerTest, EmbeddedNull)
+{
+    std::string str("ab", 2);
+    str.append(1, '\0');
+    str.append("cd\nef");
+    FileID fid = AddBuffer(str);
+    EXPECT_EQ(1U, smgr.getLineNumber(fid, 4));
+    EXPECT_EQ(2U, smgr.getLineNumber(fid, 6));
+}
+
+TEST_F(SourceManagerTest, LongBuffers)
+{
+    // Lines of every length around the scanning block size, with each kind
+    // of line break, so breaks and \r\n pairs land on every position within
+    // and across blocks.
+    static const char* breaks[] = {"\n", "\r\n", "\r", "\n\r", "\r\r"};
+    for (unsigned int b=0; b<sizeof(breaks)/sizeof(breaks[0]); ++b)
+    {
+        std::string str;
+        for (unsigned int len=0; len<70; ++len)
+        {
+            str.append(len, 'x');
+            str.append(breaks[b]);
+        }
+        CheckLines(str);
+    }
+
+    // Nulls and line breaks mixed densely.
+    std::string str;
+    unsigned long seed = 1;
+    static const char chars[] = {'\n', '\r', '\0', 'x'};
+    for (unsigned int i=0; i<1000; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        str.append(1, chars[(seed >> 16) & 3]);
+    }
+    CheckLines(str);
+}
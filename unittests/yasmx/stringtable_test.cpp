@@ -0,0 +1,73 @@
+//
+// String table unit tests
+//
+//  Copyright (C) 2011  PathScale Inc.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions
+// are met:
+// 1. Redistributions of source code must retain the above copyright
+//    notice, this list of conditions and the following disclaimer.
+// 2. Redistributions in binary form must reproduce the above copyright
+//    notice, this list of conditions and the following disclaimer in the
+//    documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND OTHER CONTRIBUTORS ``AS IS''
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR OTHER CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+//
+#include <gtest/gtest.h>
+
+#include "yasmx/StringTable.h"
+
+using namespace yasm;
+
+TEST(StringTableTest, Append)
+{
+    StringTable strtab;
+    EXPECT_EQ(1UL, strtab.getIndex("foo"));
+    EXPECT_EQ(5UL, strtab.getIndex("foo"));
+    EXPECT_EQ(9UL, strtab.getSize());
+    EXPECT_EQ("foo", strtab.getString(5));
+}
+
+TEST(StringTableTest, Interning)
+{
+    StringTable strtab(4);
+    strtab.setInterning();
+    EXPECT_EQ(5UL, strtab.getIndex("foo"));
+    EXPECT_EQ(9UL, strtab.getIndex("bar"));
+    EXPECT_EQ(5UL, strtab.getIndex("foo"));
+    EXPECT_EQ(9UL, strtab.getSize());
+}
+
+TEST(StringTableTest, MergeTails)
+{
+    StringTable strtab;
+    unsigned long text = strtab.getIndex(".text");
+    unsigned long rela_text = strtab.getIndex(".rela.text");
+    unsigned long data = strtab.getIndex(".data");
+    unsigned long text2 = strtab.getIndex(".text");
+    unsigned long empty = strtab.getIndex("");
+    strtab.MergeTails();
+
+    // ".rela.text", ".data", and the initial 0 byte.
+    EXPECT_EQ(18UL, strtab.getSize());
+    EXPECT_EQ(".text", strtab.getString(strtab.getMergedIndex(text)));
+    EXPECT_EQ(".rela.text",
+              strtab.getString(strtab.getMergedIndex(rela_text)));
+    EXPECT_EQ(".data", strtab.getString(strtab.getMergedIndex(data)));
+    EXPECT_EQ(strtab.getMergedIndex(text), strtab.getMergedIndex(text2));
+    EXPECT_EQ(strtab.getMergedIndex(rela_text) + 5,
+              strtab.getMergedIndex(text));
+    EXPECT_EQ(0UL, strtab.getMergedIndex(0));
+    EXPECT_EQ("", strtab.getString(strtab.getMergedIndex(empty)));
+}